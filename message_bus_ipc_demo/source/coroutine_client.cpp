@@ -0,0 +1,104 @@
+/**
+ *   @file: coroutine_client.cpp
+ *
+ *   @date: Oct 18, 2026
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <string>
+#include "MessageClientCoroutines.h"
+
+using namespace std;
+using namespace messagebusipc;
+
+
+const char* ECHO_SERVICE_NAME = "EchoService";
+const char* ECHO_USER_NAME = "EchoUser";
+const uint32_t ID_ECHO_REQUEST = 60;
+const uint32_t ID_ECHO_REPLY = 61;
+const uint32_t ID_ECHO_STOP = 62;
+
+//====================================================================================================
+// Echo service: one coroutine answers every request
+//====================================================================================================
+Task<> serveEchoes(CoroutineExecutor &executor) {
+    while (true) {
+        ReceivedMessage request = co_await executor.receive();
+        if (request.id == ID_ECHO_STOP)
+            break;
+        if (request.id != ID_ECHO_REQUEST)
+            continue;
+
+        const char *data = request.data.empty() ? NULL : &request.data[0];
+        co_await executor.send(ID_ECHO_REPLY, data, request.data.size(), request.sender.c_str());
+    }
+    executor.stop();
+}
+
+//====================================================================================================
+// Echo user: many conversations at once, each a request/reply loop of its own
+//====================================================================================================
+struct Conversations {
+    int num_conversations;
+    int num_left;
+    int num_failed;
+    chrono::steady_clock::time_point start;
+};
+
+Task<> converse(CoroutineExecutor &executor, int conversation, int num_rounds, Conversations &all) {
+    co_await executor.waitForClient(ECHO_SERVICE_NAME);
+
+    for (int round = 0; round < num_rounds; round++) {
+        char text[32];
+        int length = snprintf(text, sizeof(text), "%d/%d", conversation, round) + 1;
+        optional<ReceivedMessage> reply = co_await executor.request(ID_ECHO_REQUEST, text, length, ECHO_SERVICE_NAME, ID_ECHO_REPLY);
+        if (!reply || (reply->data.size() != (size_t)length) || memcmp(&reply->data[0], text, length))
+            all.num_failed++;
+    }
+
+    // the last one to finish reports and lets the service go
+    if (--all.num_left > 0)
+        co_return;
+
+    auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - all.start).count();
+    printf("%d conversations x %d rounds: %d failed, %lld ms\n", all.num_conversations, num_rounds, all.num_failed, (long long)elapsed);
+    co_await executor.send(ID_ECHO_STOP, NULL, 0, ECHO_SERVICE_NAME);
+}
+
+//====================================================================================================
+// Program entry point
+//====================================================================================================
+int main(int argc, char* argv[]) {
+    // optional arguments: number of conversations and rounds per conversation; needs the hub running
+    int num_conversations = (argc > 1) ? atoi(argv[1]) : 1000;
+    int num_rounds = (argc > 2) ? atoi(argv[2]) : 10;
+
+    thread service([] {
+        MessageClient client;
+        CoroutineExecutor executor(client);
+        if (!executor.connect(ECHO_SERVICE_NAME)) {
+            printf("Can't connect to the hub\n");
+            return;
+        }
+        executor.spawn(serveEchoes(executor));
+        executor.run();
+    });
+
+    MessageClient client;
+    CoroutineExecutor executor(client);
+    if (executor.connect(ECHO_USER_NAME)) {
+        Conversations all = { num_conversations, num_conversations, 0, chrono::steady_clock::now() };
+        for (int i = 0; i < num_conversations; i++)
+            executor.spawn(converse(executor, i, num_rounds, all));
+        executor.run();
+    }
+    else
+        printf("Can't connect to the hub\n");
+
+    service.join();
+    return 0;
+}
@@ -15,8 +15,16 @@ using namespace messagebusipc;
 //====================================================================================================
 // Program entry point
 //====================================================================================================
-int main() {
+int main(int argc, char* argv[]) {
+    // optional arguments: directory to journal routed messages in ("" for none) and hot restart address;
+    // hub started with the same hot restart address takes the clients over from this one
+    MessageHubConfig config;
+    if (argc > 1)
+        config.journal_directory = argv[1];
+    if (argc > 2)
+        config.hot_restart_address = argv[2];
+
     // run MessageHub in current thread (blocking run)
-    MessageHub::runAndForget(false);
+    MessageHub::runAndForget(false, config);
     return 0;
 }
@@ -0,0 +1,370 @@
+/**
+ *   @file: AsyncLog.cpp
+ *
+ *   @date: Oct 18, 2026
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <string>
+#include <vector>
+#include "PThreadLockGuard.h"
+#include "AsyncLog.h"
+
+using namespace messagebusipc;
+
+namespace {
+
+/**
+ * Single producer single consumer ring of records; the producer is the thread that owns it, the consumer is the log thread
+ */
+struct Ring {
+    static const unsigned NUM_RECORDS = 256; // power of 2
+
+    AsyncLog::Record records[NUM_RECORDS];
+    uint32_t head;       // next record to write; written by the owner only
+    uint32_t tail;       // next record to print; written by the log thread only
+    uint32_t dropped;    // records that didn't fit; atomic
+    bool abandoned;      // owner thread exited, the log thread frees the ring once it's printed; atomic
+
+    Ring() : head(0), tail(0), dropped(0), abandoned(false) {}
+};
+
+// after printing something the log thread waits this long for more, so busy producers are printed in batches
+const unsigned FLUSH_INTERVAL_USECONDS = 1000;
+
+// 1 while the log thread sleeps on it with nothing to print; a producer whose ring was empty wakes it up. Futex word
+uint32_t log_thread_parked = 0;
+
+pthread_mutex_t rings_mutex = PTHREAD_MUTEX_INITIALIZER; // guards rings and log_thread_started, serializes printing
+std::vector<Ring*> &rings = *new std::vector<Ring*>; // never destroyed; the log thread may still run at exit
+bool log_thread_started = false;
+pthread_key_t ring_key;
+pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+__thread Ring *own_ring = NULL;
+
+LogLevel initialLevel() {
+    const char *env = getenv(LOG_LEVEL_ENV);
+    if (env) {
+        std::string value(env);
+        if (value == "off")
+            return LOG_LEVEL_OFF;
+        if (value == "error")
+            return LOG_LEVEL_ERROR;
+        if (value == "debug")
+            return LOG_LEVEL_DEBUG;
+    }
+
+#ifdef NDEBUG
+    return LOG_LEVEL_ERROR;
+#else
+    return LOG_LEVEL_DEBUG;
+#endif
+}
+
+/**
+ * @name    formatRecord
+ * @brief   printf the record into out; every conversion of the format takes the next stored argument
+ */
+void formatRecord(const AsyncLog::Record &record, std::string &out) {
+    const char *args = record.args;
+    const char *args_end = record.args + record.size;
+    char spec[32];
+    char formatted[512];
+
+    for (const char *c = record.format; *c; c++) {
+        if (*c != '%') {
+            out.push_back(*c);
+            continue;
+        }
+        if (c[1] == '%') {
+            out.push_back('%');
+            c++;
+            continue;
+        }
+
+        // conversion spec: flags, width, precision, length, conversion
+        unsigned spec_length = 0;
+        const char *conversion = c;
+        do {
+            spec[spec_length++] = *conversion++;
+        } while (*conversion && !strchr("diouxXcsfFeEgGaAp", *conversion) && (spec_length < sizeof(spec) - 2));
+        if (!*conversion)
+            break;
+        spec[spec_length++] = *conversion;
+        spec[spec_length] = '\0';
+        c = conversion;
+
+        if (args >= args_end) {
+            out.append("<?>");
+            continue;
+        }
+
+        uint8_t type = *args++;
+        if (type == AsyncLog::ARG_STRING) {
+            uint8_t length = *args++;
+            std::string s(args, length);
+            args += length;
+            snprintf(formatted, sizeof(formatted), spec, s.c_str());
+        }
+        else {
+            char value[8];
+            memcpy(value, args, sizeof(value));
+            args += sizeof(value);
+
+            int64_t integer;
+            double floating;
+            const void *pointer;
+            memcpy(&integer, value, sizeof(integer));
+            memcpy(&floating, value, sizeof(floating));
+            memcpy(&pointer, value, sizeof(pointer));
+
+            bool is_long = strchr(spec, 'l') || strchr(spec, 'z') || strchr(spec, 'j') || strchr(spec, 't');
+            if (strchr("fFeEgGaA", *conversion))
+                snprintf(formatted, sizeof(formatted), spec, (type == AsyncLog::ARG_DOUBLE) ? floating : (double)integer);
+            else if (*conversion == 'p')
+                snprintf(formatted, sizeof(formatted), spec, pointer);
+            else if (*conversion == 's')
+                snprintf(formatted, sizeof(formatted), "%p", pointer); // not a string after all
+            else if (is_long)
+                snprintf(formatted, sizeof(formatted), spec, (long long)integer);
+            else
+                snprintf(formatted, sizeof(formatted), spec, (int)integer);
+        }
+        out.append(formatted);
+    }
+}
+
+/**
+ * @name    printRings
+ * @brief   Print what's in the rings; free the rings of exited threads
+ * @return  Number of records printed
+ * @note    rings_mutex must be held
+ */
+unsigned printRings() {
+    unsigned num_printed = 0;
+    std::string out;
+
+    for (size_t i = 0; i < rings.size(); ) {
+        Ring *ring = rings[i];
+        bool abandoned = __atomic_load_n(&ring->abandoned, __ATOMIC_ACQUIRE);
+        uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        uint32_t tail = ring->tail;
+
+        for (; tail != head; tail++) {
+            formatRecord(ring->records[tail % Ring::NUM_RECORDS], out);
+            out.push_back('\n');
+            num_printed++;
+        }
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+        uint32_t dropped = __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED);
+        if (dropped) {
+            char note[64];
+            snprintf(note, sizeof(note), "[IPC] log: %u records dropped\n", dropped);
+            out.append(note);
+        }
+
+        if (abandoned) {
+            delete ring;
+            rings[i] = rings.back();
+            rings.pop_back();
+        }
+        else
+            i++;
+    }
+
+    if (!out.empty()) {
+        fwrite(out.data(), 1, out.size(), stdout);
+        fflush(stdout);
+    }
+    return num_printed;
+}
+
+unsigned printRingsLocked() {
+    PThreadLockGuard lock(rings_mutex);
+    return printRings();
+}
+
+/**
+ * @name    logThreadFunc
+ * @brief   Print records in batches while they come, sleep without waking up while there are none
+ */
+void* logThreadFunc(void*) {
+    while (true) {
+        if (printRingsLocked() > 0) {
+            usleep(FLUSH_INTERVAL_USECONDS);
+            continue;
+        }
+
+        // park; look once more after saying so, a record committed meanwhile saw log_thread_parked 0 and didn't wake us
+        __atomic_store_n(&log_thread_parked, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (printRingsLocked() == 0)
+            syscall(SYS_futex, &log_thread_parked, FUTEX_WAIT_PRIVATE, 1, NULL, NULL, 0);
+        __atomic_store_n(&log_thread_parked, 0, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+/**
+ * @name    wakeLogThread
+ * @brief   Wake the log thread if it is parked
+ */
+void wakeLogThread() {
+    if (__atomic_load_n(&log_thread_parked, __ATOMIC_RELAXED) && __atomic_exchange_n(&log_thread_parked, 0, __ATOMIC_RELAXED))
+        syscall(SYS_futex, &log_thread_parked, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+/**
+ * @name    startLogThread
+ * @note    rings_mutex must be held
+ */
+void startLogThread() {
+    if (log_thread_started)
+        return;
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, logThreadFunc, NULL) != 0)
+        return;
+    pthread_detach(thread);
+    log_thread_started = true;
+}
+
+void atExit() {
+    AsyncLog::flush();
+}
+
+// forked child has no log thread, the next record starts a new one. Other threads are gone too,
+// and what's in the rings is printed by the parent
+void afterForkInChild() {
+    pthread_mutex_init(&rings_mutex, NULL);
+    log_thread_started = false;
+    log_thread_parked = 0;
+
+    for (size_t i = 0; i < rings.size(); i++)
+        if (rings[i] != own_ring)
+            delete rings[i];
+    rings.clear();
+
+    if (own_ring) {
+        own_ring->tail = own_ring->head;
+        rings.push_back(own_ring);
+    }
+}
+
+void abandonRing(void *ring) {
+    own_ring = NULL;
+    __atomic_store_n(&static_cast<Ring*>(ring)->abandoned, true, __ATOMIC_RELEASE);
+}
+
+void createRingKey() {
+    pthread_key_create(&ring_key, abandonRing);
+    pthread_atfork(NULL, NULL, afterForkInChild);
+    atexit(atExit);
+}
+
+}
+
+int AsyncLog::current_level = initialLevel();
+
+/**
+ * @name    setLevel
+ * @brief   Log records of given level and more severe from now on
+ */
+void AsyncLog::setLevel(LogLevel new_level) {
+    __atomic_store_n(&current_level, new_level, __ATOMIC_RELAXED);
+}
+
+/**
+ * @name    flush
+ * @brief   Print all records stored so far, without waiting for the log thread; called at exit
+ */
+void AsyncLog::flush() {
+    PThreadLockGuard lock(rings_mutex);
+    printRings();
+}
+
+/**
+ * @name    beginRecord
+ * @return  Free record in calling thread's ring, NULL if the ring is full
+ */
+AsyncLog::Record *AsyncLog::beginRecord() {
+    // first record of this thread; register its ring
+    if (!own_ring) {
+        pthread_once(&ring_key_once, createRingKey);
+        own_ring = new Ring;
+        pthread_setspecific(ring_key, own_ring);
+        PThreadLockGuard lock(rings_mutex);
+        rings.push_back(own_ring);
+    }
+
+    // forked child; the ring is still there, the thread isn't
+    if (!__atomic_load_n(&log_thread_started, __ATOMIC_RELAXED)) {
+        PThreadLockGuard lock(rings_mutex);
+        startLogThread();
+    }
+
+    uint32_t tail = __atomic_load_n(&own_ring->tail, __ATOMIC_ACQUIRE);
+    if (own_ring->head - tail >= Ring::NUM_RECORDS) {
+        __atomic_add_fetch(&own_ring->dropped, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    return &own_ring->records[own_ring->head % Ring::NUM_RECORDS];
+}
+
+/**
+ * @name    commitRecord
+ * @brief   Make the record started with beginRecord visible to the log thread; wake it if the ring was empty
+ * @note    The fence pairs with the one in logThreadFunc: either the log thread sees the record, or this sees it parked
+ */
+void AsyncLog::commitRecord() {
+    uint32_t head = own_ring->head;
+    __atomic_store_n(&own_ring->head, head + 1, __ATOMIC_RELEASE);
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&own_ring->tail, __ATOMIC_RELAXED) == head)
+        wakeLogThread();
+}
+
+/**
+ * @name    putBytes
+ * @brief   Append type tag and value to the record's arguments; arguments that don't fit are left out
+ */
+void AsyncLog::putBytes(Record &record, ArgType type, const void *bytes, unsigned size) {
+    if (record.size + 1 + size > sizeof(record.args))
+        return;
+
+    record.args[record.size] = (char)type;
+    memcpy(record.args + record.size + 1, bytes, size);
+    record.size += 1 + size;
+}
+
+/**
+ * @name    put
+ * @brief   Strings are copied, as much as fits into the record
+ */
+void AsyncLog::put(Record &record, const char *s) {
+    if (!s)
+        s = "(null)";
+
+    int room = (int)sizeof(record.args) - record.size - 2;
+    if (room < 0)
+        return;
+
+    size_t length = strlen(s);
+    if (length > (size_t)room)
+        length = room;
+    if (length > 255)
+        length = 255;
+
+    record.args[record.size] = (char)ARG_STRING;
+    record.args[record.size + 1] = (char)length;
+    memcpy(record.args + record.size + 2, s, length);
+    record.size += 2 + length;
+}
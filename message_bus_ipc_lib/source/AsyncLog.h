@@ -0,0 +1,107 @@
+/**
+ *   @file: AsyncLog.h
+ *
+ *   @date: Oct 18, 2026
+ */
+
+#ifndef MESSAGE_BUS_IPC_LIB_SOURCE_ASYNCLOG_H_
+#define MESSAGE_BUS_IPC_LIB_SOURCE_ASYNCLOG_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+namespace messagebusipc {
+
+enum LogLevel {
+    LOG_LEVEL_OFF,
+    LOG_LEVEL_ERROR,  // something failed
+    LOG_LEVEL_DEBUG   // everything, including every routed message
+};
+
+// Environment variable setting the initial log level: off, error or debug
+const char LOG_LEVEL_ENV[] = "MBIPC_LOG_LEVEL";
+
+/**
+ * @class   AsyncLog
+ * @brief   Logger that keeps formatting off the calling thread. The caller stores a binary record: format string pointer
+ *          and raw argument values, strings copied, into its own lock free ring; a background thread formats the records
+ *          printf style and prints them. Records that don't fit into a full ring are dropped and counted
+ * @note    Level can be changed any time; disabled level costs a single load and the arguments are not evaluated
+ *          (see DEBUG_MSG). Only printf conversions without '*' width/precision are supported
+ */
+class AsyncLog {
+public:
+    static LogLevel level() { return (LogLevel)__atomic_load_n(&current_level, __ATOMIC_RELAXED); }
+    static bool enabled(LogLevel at_level) { return at_level <= level(); }
+    static void setLevel(LogLevel new_level);
+    static void flush();
+
+    /**
+     * @name    write
+     * @brief   Store the record for the background thread
+     * @param   format String literal; it must live as long as the program, only its address is stored
+     */
+    template<class... Args>
+    static void write(LogLevel at_level, const char *format, const Args&... args) {
+        Record *record = beginRecord();
+        if (!record)
+            return;
+
+        record->format = format;
+        record->level = at_level;
+        record->size = 0;
+        putAll(*record, args...);
+        commitRecord();
+    }
+
+    // argument types in the record
+    enum ArgType { ARG_INTEGER, ARG_DOUBLE, ARG_STRING, ARG_POINTER };
+
+    static const unsigned RECORD_SIZE = 256;
+    struct Record {
+        const char *format;
+        uint8_t level;
+        uint16_t size;   // bytes used in args
+        char args[RECORD_SIZE - sizeof(const char*) - sizeof(uint32_t)];
+    };
+
+private:
+    static int current_level;
+
+    static Record *beginRecord();
+    static void commitRecord();
+
+    static void putAll(Record &record) { (void)record; }
+
+    template<class T, class... Rest>
+    static void putAll(Record &record, const T &arg, const Rest&... rest) {
+        put(record, arg);
+        putAll(record, rest...);
+    }
+
+    static void putBytes(Record &record, ArgType type, const void *bytes, unsigned size);
+    static void put(Record &record, const char *s);
+    static void put(Record &record, char *s) { put(record, (const char*)s); }
+
+    template<class T>
+    static typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type put(Record &record, T value) {
+        int64_t integer = (int64_t)value;
+        putBytes(record, ARG_INTEGER, &integer, sizeof(integer));
+    }
+
+    template<class T>
+    static typename std::enable_if<std::is_floating_point<T>::value>::type put(Record &record, T value) {
+        double floating = value;
+        putBytes(record, ARG_DOUBLE, &floating, sizeof(floating));
+    }
+
+    template<class T>
+    static void put(Record &record, const T *pointer) {
+        putBytes(record, ARG_POINTER, &pointer, sizeof(pointer));
+    }
+};
+
+}
+
+#endif /* MESSAGE_BUS_IPC_LIB_SOURCE_ASYNCLOG_H_ */
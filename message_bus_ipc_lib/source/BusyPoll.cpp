@@ -0,0 +1,72 @@
+/**
+ *   @file: BusyPoll.cpp
+ *
+ *   @date: Oct 18, 2026
+ */
+
+#include <time.h>
+#include <unistd.h>
+#include "MessageBusIpcCommon.h"
+#include "BusyPoll.h"
+
+using namespace messagebusipc;
+
+/**
+ * @name    nowNs
+ * @return  Monotonic time in nanoseconds
+ */
+uint64_t AdaptiveSpinner::nowNs() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * @name    multipleCpus
+ * @return  True if there is more than one CPU online, so a spinning thread doesn't take the CPU from the one it waits for
+ */
+bool AdaptiveSpinner::multipleCpus() {
+    static const bool multiple_cpus = (sysconf(_SC_NPROCESSORS_ONLN) > 1);
+    return multiple_cpus;
+}
+
+CpuPinning::CpuPinning() :
+        pinned_cpu(BusyPollConfig::NO_CPU_PINNING), has_original_affinity(false) {
+    CPU_ZERO(&original_affinity);
+}
+
+/**
+ * @name    apply
+ * @brief   Pin calling thread to given core, or restore the original affinity for NO_CPU_PINNING; no-op if nothing changed
+ * @return  True on success, False otherwise
+ */
+bool CpuPinning::apply(int cpu) {
+    if (cpu == pinned_cpu)
+        return true;
+
+    pthread_t self = pthread_self();
+    if (!has_original_affinity) {
+        if (pthread_getaffinity_np(self, sizeof(original_affinity), &original_affinity))
+            return false;
+        has_original_affinity = true;
+    }
+
+    int return_code;
+    if (cpu == BusyPollConfig::NO_CPU_PINNING)
+        return_code = pthread_setaffinity_np(self, sizeof(original_affinity), &original_affinity);
+    else {
+        cpu_set_t affinity;
+        CPU_ZERO(&affinity);
+        CPU_SET(cpu, &affinity);
+        return_code = pthread_setaffinity_np(self, sizeof(affinity), &affinity);
+    }
+
+    if (return_code) {
+        ERROR_MSG("%s: pthread_setaffinity_np(%d) failed with error code: %d", __FUNCTION__, cpu, return_code);
+        pinned_cpu = cpu; // don't retry on every message
+        return false;
+    }
+
+    pinned_cpu = cpu;
+    return true;
+}
@@ -0,0 +1,127 @@
+/**
+ *   @file: BusyPoll.h
+ *
+ *   @date: Oct 18, 2026
+ */
+
+#ifndef MESSAGE_BUS_IPC_LIB_SOURCE_BUSYPOLL_H_
+#define MESSAGE_BUS_IPC_LIB_SOURCE_BUSYPOLL_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+
+namespace messagebusipc {
+
+/**
+ * @struct  BusyPollConfig
+ * @brief   Low latency mode: spin waiting for the next message before going to sleep, and optionally stay on one CPU core.
+ *          Longer spin means lower wakeup latency under sparse traffic and more CPU burnt while idle
+ */
+struct BusyPollConfig {
+    BusyPollConfig() :
+            spin_useconds(0), cpu(NO_CPU_PINNING) {
+    }
+
+    static const int NO_CPU_PINNING = -1;
+
+    unsigned spin_useconds; // how long to spin before parking; 0 turns busy polling off
+    int cpu;                // core to pin the thread to, NO_CPU_PINNING to let the scheduler decide
+};
+
+/**
+ * @class   AdaptiveSpinner
+ * @brief   Spin-then-park helper. Spinning stops after the configured time; every spin that ends without work
+ *          halves the next spin time (down to 1/16 of the configured one), and one that finds work restores it,
+ *          so an idle thread gradually stops burning CPU while a busy one keeps spinning
+ * @note    Not thread safe; one per waiting thread
+ */
+class AdaptiveSpinner {
+public:
+    AdaptiveSpinner() :
+            max_spin_ns(0), spin_ns(0) {
+    }
+
+    void configure(unsigned spin_useconds) {
+        uint64_t new_max = multipleCpus() ? (uint64_t)spin_useconds * 1000 : 0; // spinning on the only core just delays the sender
+        if (new_max != max_spin_ns)
+            max_spin_ns = spin_ns = new_max;
+    }
+
+    bool enabled() const { return max_spin_ns != 0; }
+
+    // ready() that makes a syscall is called at most every this many pauses, see spin
+    static const unsigned SYSCALL_MAX_PAUSES = 64;
+
+    /**
+     * @name    spin
+     * @brief   Spin until ready() returns true or the spin time is up
+     * @param   max_pauses Pauses between ready() calls double up to this; more than 1 for ready() that is not a cheap load
+     * @return  True if ready, False if it is time to park
+     */
+    template<class Ready>
+    bool spin(Ready ready, unsigned max_pauses = 1) {
+        if (spin_ns == 0)
+            return false;
+
+        uint64_t deadline = nowNs() + spin_ns;
+        unsigned pauses = 1;
+        for (unsigned i = 1; ; i++) {
+            if (ready()) {
+                spin_ns = max_spin_ns;
+                return true;
+            }
+
+            for (unsigned p = 0; p < pauses; p++)
+                cpuRelax();
+            if (pauses < max_pauses)
+                pauses *= 2;
+
+            if ((i % CLOCK_CHECK_INTERVAL == 0) && (nowNs() >= deadline))
+                break;
+        }
+
+        if (spin_ns > (max_spin_ns >> MAX_BACKOFF_SHIFT))
+            spin_ns /= 2;
+        return false;
+    }
+
+    static uint64_t nowNs();
+    static bool multipleCpus();
+
+private:
+    static const unsigned CLOCK_CHECK_INTERVAL = 16;
+    static const unsigned MAX_BACKOFF_SHIFT = 4;
+
+    uint64_t max_spin_ns;
+    uint64_t spin_ns;
+
+    static void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+};
+
+/**
+ * @class   CpuPinning
+ * @brief   Pins the calling thread to a core and remembers the original affinity, so the pinning can be undone
+ * @note    Not thread safe; one per pinned thread
+ */
+class CpuPinning {
+public:
+    CpuPinning();
+
+    bool apply(int cpu);
+
+private:
+    int pinned_cpu;
+    bool has_original_affinity;
+    cpu_set_t original_affinity;
+};
+
+}
+
+#endif /* MESSAGE_BUS_IPC_LIB_SOURCE_BUSYPOLL_H_ */
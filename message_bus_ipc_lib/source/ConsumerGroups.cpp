@@ -0,0 +1,130 @@
+/**
+ *   @file: ConsumerGroups.cpp
+ *
+ *   @date: Oct 18, 2026
+ */
+
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
+#include <limits.h>
+#include <algorithm>
+#include <set>
+#include "MessageBusIpcCommon.h"
+#include "Hash.h"
+#include "ConsumerGroups.h"
+
+using namespace messagebusipc;
+
+ConsumerGroups::ConsumerGroups(ConsumerGroupPolicy policy, uint32_t key_size) :
+        policy(policy), key_size(key_size) {
+}
+
+/**
+ * @name    pick
+ * @brief   Choose the member of the group to get the message; the sender itself is never chosen
+ * @param   it Iterator over connected clients; left at the end
+ * @return  Chosen member, NULL if group has no members besides the sender
+ */
+const MessageChannel *ConsumerGroups::pick(ThreadsafeChannelList::Iterator &it, const std::string &group, const MessageChannel &sender,
+                                           const char *data, uint32_t size, const std::string &origin_name) {
+    members.clear();
+    it.reset();
+    MessageChannel const *channel;
+    while ((channel = it.getNext()))
+        if ((channel->helloFlags() & HELLO_FLAG_CONSUMER_GROUP) && (*channel != sender) && (channel->name() == group))
+            members.push_back(channel);
+
+    if (members.empty()) {
+        turns.erase(group);
+        return NULL;
+    }
+
+    if (policy == CONSUMER_GROUP_KEY_AFFINITY)
+        return pickByKey(data, size, origin_name);
+
+    unsigned turn = turns[group]++;
+    if (policy == CONSUMER_GROUP_LEAST_BACKLOG)
+        return pickLeastBacklog(turn);
+
+    return members[turn % members.size()];
+}
+
+/**
+ * @name    dropEmptyGroups
+ * @brief   Forget round robin positions of the groups whose last member is gone; call when clients leave
+ * @param   it Iterator over connected clients; left at the end
+ */
+void ConsumerGroups::dropEmptyGroups(ThreadsafeChannelList::Iterator &it) {
+    if (turns.empty())
+        return;
+
+    std::set<std::string> groups;
+    it.reset();
+    MessageChannel const *channel;
+    while ((channel = it.getNext()))
+        if (channel->helloFlags() & HELLO_FLAG_CONSUMER_GROUP)
+            groups.insert(channel->name());
+
+    for (std::map<std::string, unsigned>::iterator turn = turns.begin(); turn != turns.end();)
+        if (groups.count(turn->first))
+            ++turn;
+        else
+            turns.erase(turn++);
+}
+
+/**
+ * @name    pickLeastBacklog
+ * @param   turn Round robin position; among members of equal backlog the one closest to it wins
+ */
+const MessageChannel *ConsumerGroups::pickLeastBacklog(unsigned turn) const {
+    const MessageChannel *best = NULL;
+    int best_backlog = INT_MAX;
+    for (size_t i = 0; i < members.size(); i++) {
+        const MessageChannel *member = members[(turn + i) % members.size()];
+        int bytes = backlog(*member);
+        if (bytes < best_backlog) {
+            best = member;
+            best_backlog = bytes;
+        }
+        if (bytes == 0)
+            break;
+    }
+
+    return best;
+}
+
+/**
+ * @name    pickByKey
+ * @brief   Rendezvous hashing of the key and every member, highest score wins;
+ *          when a member leaves, only its keys move, when one joins, it takes a fair share from everybody
+ * @note    Member is told by its name and descriptor together; logical clients of one connection share the descriptor
+ */
+const MessageChannel *ConsumerGroups::pickByKey(const char *data, uint32_t size, const std::string &origin_name) const {
+    uint64_t key = fnv1a64(origin_name.data(), origin_name.size());
+    key = fnv1a64(data, std::min(size, key_size), key);
+
+    const MessageChannel *best = NULL;
+    uint64_t best_score = 0;
+    for (std::vector<const MessageChannel*>::const_iterator it = members.begin(); it != members.end(); ++it) {
+        const std::string &name = (*it)->name();
+        int fd = (*it)->fileDescriptor();
+        uint64_t score = hashMix64(fnv1a64(&fd, sizeof(fd), fnv1a64(name.data(), name.size(), key)));
+        if (!best || (score > best_score)) {
+            best = *it;
+            best_score = score;
+        }
+    }
+
+    return best;
+}
+
+/**
+ * @name    backlog
+ * @return  Bytes sent to the member and not read by it yet
+ */
+int ConsumerGroups::backlog(const MessageChannel &member) {
+    int bytes = 0;
+    if (ioctl(member.fileDescriptor(), SIOCOUTQ, &bytes) == -1)
+        return INT_MAX - 1;
+    return bytes;
+}
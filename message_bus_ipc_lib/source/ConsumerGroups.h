@@ -0,0 +1,53 @@
+/**
+ *   @file: ConsumerGroups.h
+ *
+ *   @date: Oct 18, 2026
+ */
+
+#ifndef MESSAGE_BUS_IPC_LIB_SOURCE_CONSUMERGROUPS_H_
+#define MESSAGE_BUS_IPC_LIB_SOURCE_CONSUMERGROUPS_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdint.h>
+#include "MessageChannel.h"
+#include "ThreadsafeChannelList.h"
+
+namespace messagebusipc {
+
+enum ConsumerGroupPolicy {
+    CONSUMER_GROUP_ROUND_ROBIN,     // members take turns
+    CONSUMER_GROUP_LEAST_BACKLOG,   // member with the fewest bytes waiting in its socket, round robin among equal ones
+    CONSUMER_GROUP_KEY_AFFINITY     // same key goes to the same member as long as it stays; see MessageHubConfig::consumer_group_key_size
+};
+
+/**
+ * @class   ConsumerGroups
+ * @brief   Clients that connect under the same name with HELLO_FLAG_CONSUMER_GROUP form a group sharing the work:
+ *          message addressed to that name goes to exactly one of them. Plain clients of the same name still get every message,
+ *          broadcast still goes to everybody
+ * @note    Not thread safe; owned by the MessageHub router thread
+ */
+class ConsumerGroups {
+public:
+    ConsumerGroups(ConsumerGroupPolicy policy, uint32_t key_size);
+
+    const MessageChannel *pick(ThreadsafeChannelList::Iterator &it, const std::string &group, const MessageChannel &sender,
+                               const char *data, uint32_t size, const std::string &origin_name);
+    void dropEmptyGroups(ThreadsafeChannelList::Iterator &it);
+
+private:
+    ConsumerGroupPolicy policy;
+    uint32_t key_size;                          // leading payload bytes hashed along with the sender name for key affinity
+    std::map<std::string, unsigned> turns;      // round robin position of every group that has members
+    std::vector<const MessageChannel*> members; // reused by pick
+
+    const MessageChannel *pickLeastBacklog(unsigned turn) const;
+    const MessageChannel *pickByKey(const char *data, uint32_t size, const std::string &origin_name) const;
+    static int backlog(const MessageChannel &member);
+};
+
+}
+
+#endif /* MESSAGE_BUS_IPC_LIB_SOURCE_CONSUMERGROUPS_H_ */
@@ -0,0 +1,49 @@
+/**
+ *   @file: Hash.h
+ *
+ *   @date: Oct 19, 2026
+ */
+
+#ifndef MESSAGE_BUS_IPC_LIB_SOURCE_HASH_H_
+#define MESSAGE_BUS_IPC_LIB_SOURCE_HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace messagebusipc {
+
+/**
+ * @brief   FNV-1a; to hash several pieces, pass the result of one as the seed of the next
+ * @note    Cheap and good enough for hash tables, but the last bytes are poorly mixed;
+ *          finish with hashMix64 when the hash is compared, eg. in rendezvous hashing
+ */
+const uint32_t FNV1A_32_SEED = 2166136261u;
+const uint64_t FNV1A_64_SEED = 14695981039346656037ULL;
+
+inline uint32_t fnv1a32(const void *bytes, size_t size, uint32_t hash = FNV1A_32_SEED) {
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ static_cast<const uint8_t*>(bytes)[i]) * 16777619u;
+    return hash;
+}
+
+inline uint64_t fnv1a64(const void *bytes, size_t size, uint64_t hash = FNV1A_64_SEED) {
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ static_cast<const uint8_t*>(bytes)[i]) * 1099511628211ULL;
+    return hash;
+}
+
+/**
+ * @brief   MurmurHash3 finalizer; every input bit affects every output bit
+ */
+inline uint64_t hashMix64(uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+}
+
+#endif /* MESSAGE_BUS_IPC_LIB_SOURCE_HASH_H_ */
@@ -0,0 +1,446 @@
+/**
+ *   @file: HotRestart.cpp
+ *
+ *   @date: Oct 18, 2026
+ */
+
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <cstring>
+#include "MessageBusIpcCommon.h"
+#include "PThreadLockGuard.h"
+#include "HotRestart.h"
+
+using namespace messagebusipc;
+
+const unsigned HotRestart::DRAIN_TIMEOUT_MS;
+
+HotRestart::HotRestart() :
+        control_fd(UNINITIALIZED_SOCKET_FD), stop_fd(UNINITIALIZED_SOCKET_FD), in_progress(false), round(0), drained(false), handed_over(false),
+        accepting_stopped(false) {
+    pthread_mutex_init(&state_mutex, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&drained_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_cond_init(&outcome_cond, NULL);
+}
+
+HotRestart::~HotRestart() {
+    if (control_fd != UNINITIALIZED_SOCKET_FD) {
+        close(control_fd);
+        address.cleanup();
+    }
+    if (stop_fd != UNINITIALIZED_SOCKET_FD)
+        close(stop_fd);
+    pthread_cond_destroy(&drained_cond);
+    pthread_cond_destroy(&outcome_cond);
+    pthread_mutex_destroy(&state_mutex);
+}
+
+/**
+ * @name    listen
+ * @brief   Wait for the new hub at given address; its connection makes the control descriptor readable
+ * @param   address Unix socket address, see HubAddress; descriptors can't travel over tcp
+ * @return  True on success, False otherwise
+ */
+bool HotRestart::listen(const std::string &address) {
+    if (!this->address.parse(address))
+        return false;
+
+    if (this->address.transport() != HubAddress::TRANSPORT_UNIX) {
+        ERROR_MSG("%s: hot restart needs unix stream socket, got %s", __FUNCTION__, address.c_str());
+        return false;
+    }
+
+    stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (stop_fd == UNINITIALIZED_SOCKET_FD) {
+        ERROR_MSG("%s: eventfd failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+        return false;
+    }
+
+    control_fd = this->address.listenSocket(1);
+    return control_fd != UNINITIALIZED_SOCKET_FD;
+}
+
+/**
+ * @name    handlerStopped
+ * @brief   Note that client handler stopped, or accepting stopped if the channel has no socket
+ * @param   data Handover round the stop mark belongs to
+ * @return  True if all client connections on the list are stopped now and the handover can go on, False otherwise
+ * @note    Called by the router thread for ID_HOT_RESTART_HANDOVER; what the handlers received before is routed by then
+ */
+bool HotRestart::handlerStopped(const MessageChannel &channel, const char *data, uint32_t size, ThreadsafeChannelList &channel_list) {
+    PThreadLockGuard lock(state_mutex);
+
+    // mark left over from the handover called off
+    uint32_t stopped_round;
+    if (size != sizeof(stopped_round))
+        return false;
+    memcpy(&stopped_round, data, sizeof(stopped_round));
+    if (!in_progress || (stopped_round != round))
+        return false;
+
+    if (channel.fileDescriptor() == UNINITIALIZED_SOCKET_FD)
+        accepting_stopped = true;
+    else
+        receive_versions[channel.fileDescriptor()] = channel.receiveVersion();
+
+    // no new clients come after accepting stopped; those on the list either stop or say goodbye
+    if (!accepting_stopped)
+        return false;
+
+    ThreadsafeChannelList::Iterator it = channel_list.getIterator();
+    MessageChannel const *listed;
+    while ((listed = it.getNext()))
+        if (!listed->isMultiplexed() && !(listed->helloFlags() & HELLO_FLAG_HUB_LINK) && !receive_versions.count(listed->fileDescriptor()))
+            return false;
+
+    drained = true;
+    pthread_cond_signal(&drained_cond);
+    return true;
+}
+
+/**
+ * @name    handOver
+ * @brief   Take the new hub's connection, stop the client handlers, wait for the router to drain and send the sockets over
+ * @return  HANDOVER_CALLED_OFF if the handlers and the router didn't drain in time; the control descriptor listens again then.
+ *          Otherwise this hub is done and its clients belong to the new one
+ * @note    Called once the control descriptor became readable, on the thread that accepted clients
+ */
+HotRestart::HandOverStatus HotRestart::handOver(MessageServer &server, ThreadsafeChannelList &channel_list, ThreadsafeMessageQueue &message_queue) {
+    // hot restart off, or couldn't listen again after calling the last one off
+    if (control_fd == UNINITIALIZED_SOCKET_FD)
+        return HANDOVER_FAILED;
+
+    // 1. new hub connected; the address is its to listen on now, so the socket file stays
+    int successor_fd = accept(control_fd, NULL, NULL);
+    close(control_fd);
+    control_fd = UNINITIALIZED_SOCKET_FD;
+    if (successor_fd == UNINITIALIZED_SOCKET_FD) {
+        ERROR_MSG("%s: accept failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+        callOff();
+        return HANDOVER_CALLED_OFF;
+    }
+
+    // 2. client handlers stop between messages; then the router routes what is left in the queue
+    uint32_t stop_round;
+    {
+        PThreadLockGuard lock(state_mutex);
+        in_progress = true;
+        stop_round = round;
+    }
+    uint64_t signal = 1;
+    if (write(stop_fd, &signal, sizeof(signal)) != sizeof(signal))
+        ERROR_MSG("%s: eventfd write failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+
+    // the router may be stuck sending to a client that doesn't read, and the queue full; don't wait for it forever
+    bool stop_queued = message_queue.tryPush(MessageChannel(), ID_HOT_RESTART_HANDOVER, (const char*)&stop_round, sizeof(stop_round), "", DRAIN_TIMEOUT_MS);
+    if (!stop_queued || !waitDrained(DRAIN_TIMEOUT_MS)) {
+        ERROR_MSG("%s: clients not drained in %u ms, handover called off", __FUNCTION__, DRAIN_TIMEOUT_MS);
+        close(successor_fd); // before any record, so the new hub knows
+        callOff();
+        return HANDOVER_CALLED_OFF;
+    }
+    DEBUG_MSG("%s: drained, handing over", __FUNCTION__);
+
+    // 3. listening sockets first, so the new hub has them even if a client fails to go over
+    MessageChannel successor(successor_fd);
+    std::vector<std::string> addresses;
+    std::vector<int> socket_fds;
+    server.listeners(addresses, socket_fds);
+
+    bool success = true;
+    for (size_t i = 0; success && (i < addresses.size()); i++)
+        success = successor.sendDescriptor(ID_HOT_RESTART_LISTENER, addresses[i].c_str(), addresses[i].length() + 1, "", socket_fds[i]);
+
+    // 4. clients, then the end mark
+    success = success && sendClients(successor, channel_list) && successor.send(ID_HOT_RESTART_DONE, NULL, 0, "");
+    if (!success)
+        ERROR_MSG("%s: handover failed", __FUNCTION__);
+
+    // 5. sockets live on in the new hub; closing ours doesn't disturb them. The stopped handlers can go
+    server.release();
+    close(successor_fd);
+
+    PThreadLockGuard lock(state_mutex);
+    handed_over = true;
+    pthread_cond_broadcast(&outcome_cond);
+    return success ? HANDOVER_DONE : HANDOVER_FAILED;
+}
+
+/**
+ * @name    waitDrained
+ * @return  True if drained, False if not within timeout_ms; the handover is called off then, so the router can't drain meanwhile
+ */
+bool HotRestart::waitDrained(unsigned timeout_ms) {
+    timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    PThreadLockGuard lock(state_mutex);
+    while (!drained)
+        if (pthread_cond_timedwait(&drained_cond, &state_mutex, &deadline) == ETIMEDOUT)
+            break;
+
+    if (!drained)
+        in_progress = false; // no more stop marks count; callOff does the rest
+    return drained;
+}
+
+/**
+ * @name    callOff
+ * @brief   Let the stopped handlers carry on, forget the stop marks and listen for the next attempt
+ */
+void HotRestart::callOff() {
+    {
+        PThreadLockGuard lock(state_mutex);
+        in_progress = false;
+        round++;
+        drained = false;
+        accepting_stopped = false;
+        receive_versions.clear();
+
+        // handlers that haven't seen the stop descriptor yet won't see it at all
+        uint64_t signaled;
+        if ((read(stop_fd, &signaled, sizeof(signaled)) != sizeof(signaled)) && (errno != EAGAIN))
+            ERROR_MSG("%s: eventfd read failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+        pthread_cond_broadcast(&outcome_cond);
+    }
+
+    control_fd = address.listenSocket(1);
+    if (control_fd == UNINITIALIZED_SOCKET_FD)
+        ERROR_MSG("%s: can't listen for the next hub at %s; hot restart is off", __FUNCTION__, address.toString().c_str());
+}
+
+/**
+ * @name    sendClients
+ * @brief   Send every client connection followed by the logical clients attached to it; hub links are left out
+ * @return  True on success, False otherwise
+ */
+bool HotRestart::sendClients(const MessageChannel &successor, ThreadsafeChannelList &channel_list) {
+    ThreadsafeChannelList::Iterator it = channel_list.getIterator();
+    MessageChannel const *channel;
+
+    std::multimap<int, const MessageChannel*> attached;
+    while ((channel = it.getNext()))
+        if (channel->isMultiplexed())
+            attached.insert(std::make_pair(channel->fileDescriptor(), channel));
+
+    ClientRecord record;
+    it.reset();
+    while ((channel = it.getNext())) {
+        if (channel->isMultiplexed() || (channel->helloFlags() & HELLO_FLAG_HUB_LINK))
+            continue;
+
+        // the peer IDs the client sends by go along; the handler is stopped, so nobody receives meanwhile
+        int fd = channel->fileDescriptor();
+        encodeClient(*channel, receive_versions[fd], record);
+        std::string connection((const char*)&record, sizeof(record));
+        connection.append(channel->peerIds());
+        if (!successor.sendDescriptor(ID_HOT_RESTART_CLIENT, connection.data(), connection.size(), "", fd))
+            return false;
+
+        typedef std::multimap<int, const MessageChannel*>::const_iterator AttachedIterator;
+        std::pair<AttachedIterator, AttachedIterator> range = attached.equal_range(fd);
+        for (AttachedIterator logical = range.first; logical != range.second; ++logical) {
+            encodeClient(*logical->second, WIRE_VERSION_1, record);
+            if (!successor.send(ID_HOT_RESTART_CLIENT, (const char*)&record, sizeof(record), ""))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @name    takeOver
+ * @brief   Get the listening sockets and clients of the hub running at given address
+ * @param   server Gets the listening sockets
+ * @param   channels Filled with client connections, each followed by the logical clients attached to it
+ * @return  TAKEOVER_DONE if taken over; TAKEOVER_NO_HUB if no hub runs there or the handover broke halfway, then there is
+ *          nothing to take over; TAKEOVER_CALLED_OFF if the running hub closed the connection before sending anything
+ */
+HotRestart::TakeOverStatus HotRestart::takeOver(const std::string &address, MessageServer &server, std::vector<MessageChannel> &channels) {
+    HubAddress running;
+    channels.clear();
+    if (!running.parse(address))
+        return TAKEOVER_NO_HUB;
+
+    int control_fd = running.connectSocket();
+    if (control_fd == UNINITIALIZED_SOCKET_FD) {
+        DEBUG_MSG("%s: no hub to take over at %s", __FUNCTION__, address.c_str());
+        return TAKEOVER_NO_HUB;
+    }
+
+    MessageChannel control(control_fd);
+    char data[MAX_RECORD_SIZE];
+    uint32_t id;
+    uint32_t size;
+    std::string recipient;
+    int passed_fd;
+    bool done = false;
+    bool received = false;
+    size_t connection_index = 0;
+
+    while (!done && control.receive(id, data, size, recipient, passed_fd, sizeof(data) - 1)) {
+        received = true;
+        if ((id == ID_HOT_RESTART_LISTENER) && (passed_fd != UNINITIALIZED_SOCKET_FD)) {
+            data[size] = '\0';
+            if (!server.adopt(data, passed_fd))
+                break;
+            continue;
+        }
+
+        // connection comes with its socket, logical client uses the socket of the connection before
+        if (id == ID_HOT_RESTART_CLIENT) {
+            const MessageChannel *connection = (passed_fd == UNINITIALIZED_SOCKET_FD) && !channels.empty() ? &channels[connection_index] : NULL;
+            MessageChannel channel;
+            if (!decodeClient(data, size, passed_fd, connection, channel)) {
+                if (passed_fd != UNINITIALIZED_SOCKET_FD)
+                    close(passed_fd);
+                break;
+            }
+
+            if (passed_fd != UNINITIALIZED_SOCKET_FD)
+                connection_index = channels.size();
+            channels.push_back(channel);
+            continue;
+        }
+
+        if (passed_fd != UNINITIALIZED_SOCKET_FD)
+            close(passed_fd);
+        done = (id == ID_HOT_RESTART_DONE);
+    }
+    close(control_fd);
+
+    if (!received) {
+        ERROR_MSG("%s: hub at %s called the handover off", __FUNCTION__, address.c_str());
+        return TAKEOVER_CALLED_OFF;
+    }
+
+    if (!done) {
+        ERROR_MSG("%s: handover from %s broke off", __FUNCTION__, address.c_str());
+        closeAll(channels);
+        server.release();
+        return TAKEOVER_NO_HUB;
+    }
+
+    DEBUG_MSG("%s: took over %d channels from %s", __FUNCTION__, (int)channels.size(), address.c_str());
+    return TAKEOVER_DONE;
+}
+
+/**
+ * @name    awaitMessage
+ * @brief   Wait until the client sends something or the handover starts
+ * @return  True if receive can go on, False if the handler should stop, see stopHandler; without hot restart returns immediately
+ */
+bool HotRestart::awaitMessage(const MessageChannel &channel) const {
+    if (stop_fd == UNINITIALIZED_SOCKET_FD)
+        return true;
+
+    pollfd fds[2] = { { channel.fileDescriptor(), POLLIN, 0 }, { stop_fd, POLLIN, 0 } };
+    while (poll(fds, 2, -1) == -1)
+        if (errno != EINTR) {
+            ERROR_MSG("%s: poll failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+            return true; // receive reports the trouble
+        }
+
+    // handover goes first; what the client sent waits in the socket for the new hub
+    return !fds[1].revents;
+}
+
+/**
+ * @name    stopHandler
+ * @brief   Tell the router this handler stopped and wait for the handover to finish or be called off
+ * @return  True if handed over and the handler is done, False if it should carry on receiving
+ */
+bool HotRestart::stopHandler(const MessageChannel &channel, ThreadsafeMessageQueue &message_queue) {
+    uint32_t stop_round;
+    {
+        PThreadLockGuard lock(state_mutex);
+        if (!in_progress)
+            return false; // called off meanwhile
+        stop_round = round;
+    }
+
+    message_queue.push(channel, ID_HOT_RESTART_HANDOVER, (const char*)&stop_round, sizeof(stop_round), "");
+
+    PThreadLockGuard lock(state_mutex);
+    while (!handed_over && (round == stop_round))
+        pthread_cond_wait(&outcome_cond, &state_mutex);
+    return handed_over;
+}
+
+/**
+ * @name    stopRequested
+ * @return  True if the handover started, False otherwise
+ */
+bool HotRestart::stopRequested() const {
+    if (stop_fd == UNINITIALIZED_SOCKET_FD)
+        return false;
+
+    pollfd pfd = { stop_fd, POLLIN, 0 };
+    return poll(&pfd, 1, 0) > 0;
+}
+
+void HotRestart::encodeClient(const MessageChannel &channel, uint8_t receive_version, ClientRecord &record) {
+    memset(&record, 0, sizeof(record));
+    record.hello_flags = channel.helloFlags();
+    record.seqpacket = channel.isSeqpacket();
+    record.send_version = channel.sendVersion();
+    record.receive_version = receive_version;
+    strncpy(record.name, channel.name().c_str(), MAX_CLIENT_NAME_LENGTH);
+}
+
+/**
+ * @name    decodeClient
+ * @param   socket_fd Socket of client connection, UNINITIALIZED_SOCKET_FD for logical client
+ * @param   connection Connection the logical client is attached to, NULL for client connection
+ * @return  True on success, False if the record is broken
+ */
+bool HotRestart::decodeClient(const char *data, uint32_t size, int socket_fd, const MessageChannel *connection, MessageChannel &channel) {
+    ClientRecord record;
+    if ((size < sizeof(record)) || ((socket_fd == UNINITIALIZED_SOCKET_FD) && !connection))
+        return false;
+
+    memcpy(&record, data, sizeof(record));
+    record.name[MAX_CLIENT_NAME_LENGTH] = '\0';
+
+    if (connection) {
+        channel = *connection;
+        channel.setMultiplexed(true);
+    }
+    else {
+        channel = MessageChannel(socket_fd);
+        channel.setSeqpacket(record.seqpacket);
+        channel.setSendVersion(record.send_version);
+        channel.setReceiveVersion(record.receive_version);
+        if ((size > sizeof(record)) && !channel.setPeerIds(data + sizeof(record), size - sizeof(record)))
+            return false;
+    }
+    channel.setName(record.name);
+    channel.setHelloFlags(record.hello_flags);
+    return true;
+}
+
+/**
+ * @name    closeAll
+ * @brief   Close the connections taken over so far; their clients reconnect
+ */
+void HotRestart::closeAll(std::vector<MessageChannel> &channels) {
+    for (std::vector<MessageChannel>::iterator it = channels.begin(); it != channels.end(); ++it)
+        if (!it->isMultiplexed())
+            close(it->fileDescriptor());
+    channels.clear();
+}
@@ -0,0 +1,109 @@
+/**
+ *   @file: HotRestart.h
+ *
+ *   @date: Oct 18, 2026
+ */
+
+#ifndef MESSAGE_BUS_IPC_LIB_SOURCE_HOTRESTART_H_
+#define MESSAGE_BUS_IPC_LIB_SOURCE_HOTRESTART_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdint.h>
+#include <pthread.h>
+#include "MessageChannel.h"
+#include "MessageServer.h"
+#include "ThreadsafeChannelList.h"
+#include "ThreadsafeMessageQueue.h"
+#include "HubAddress.h"
+
+namespace messagebusipc {
+
+/**
+ * @class   HotRestart
+ * @brief   Replace the running hub with a new hub process without the clients noticing, see MessageHubConfig::hot_restart_address.
+ *          The running hub listens on the hot restart address; the new hub connects there on start. Then the running hub
+ *          stops accepting, its client handlers stop between messages, the router drains the message queue, and the listening
+ *          sockets and client sockets go over to the new hub (SCM_RIGHTS) along with client names, flags and wire versions.
+ *          Whatever clients sent meanwhile waits in their sockets for the new hub to read.
+ *          If the handlers and the router don't drain within DRAIN_TIMEOUT_MS, eg. a client stalled halfway through a message
+ *          or stopped reading, the handover is called off: the handlers carry on, the running hub accepts clients again
+ *          and waits for the next attempt, and the new hub exits
+ * @note    Links to other hubs are not handed over, they reconnect; messages buffered for disconnected clients
+ *          and the last value cache stay with the old hub
+ */
+class HotRestart {
+public:
+    enum HandOverStatus {
+        HANDOVER_DONE,          // the new hub has the listening sockets and clients
+        HANDOVER_FAILED,        // sending to the new hub broke; this hub is done anyway, clients not sent over reconnect
+        HANDOVER_CALLED_OFF     // not drained in time; this hub carries on
+    };
+
+    enum TakeOverStatus {
+        TAKEOVER_DONE,          // listening sockets and clients taken over
+        TAKEOVER_NO_HUB,        // nothing to take over, start afresh
+        TAKEOVER_CALLED_OFF     // the running hub carries on; don't start
+    };
+
+    HotRestart();
+    ~HotRestart();
+
+    // running hub
+    bool listen(const std::string &address);
+    int controlDescriptor() const { return control_fd; }
+    bool handlerStopped(const MessageChannel &channel, const char *data, uint32_t size, ThreadsafeChannelList &channel_list);
+    HandOverStatus handOver(MessageServer &server, ThreadsafeChannelList &channel_list, ThreadsafeMessageQueue &message_queue);
+
+    // new hub
+    static TakeOverStatus takeOver(const std::string &address, MessageServer &server, std::vector<MessageChannel> &channels);
+
+    // client handlers and hub links
+    bool awaitMessage(const MessageChannel &channel) const;
+    bool stopHandler(const MessageChannel &channel, ThreadsafeMessageQueue &message_queue);
+    bool stopRequested() const;
+
+    // client handlers and the router get this long to drain once the new hub connected
+    static const unsigned DRAIN_TIMEOUT_MS = 5000;
+
+private:
+    // client state as sent to the new hub
+    struct ClientRecord {
+        uint32_t hello_flags;
+        uint8_t seqpacket;
+        uint8_t send_version;
+        uint8_t receive_version;
+        uint8_t reserved;
+        char name[MAX_CLIENT_NAME_LENGTH + 1];
+    };
+
+    // listening address or client record followed by v2 peer IDs of the connection, see MessageChannel::peerIds
+    static const uint32_t MAX_RECORD_SIZE = 32 * 1024;
+
+    HubAddress address;
+    int control_fd;     // listening for the new hub
+    int stop_fd;        // nonblocking eventfd, signaled once the new hub connected; stays readable unless the handover is called off
+
+    // handover state, guarded by state_mutex
+    pthread_mutex_t state_mutex;
+    pthread_cond_t drained_cond;    // monotonic clock
+    pthread_cond_t outcome_cond;    // stopped handlers wait here to exit or carry on
+    bool in_progress;   // the new hub connected and the handlers are stopping
+    uint32_t round;     // handover attempt; stop marks of attempts called off are ignored
+    bool drained;       // every client handler stopped and the router routed all they had received
+    bool handed_over;   // the handlers stopped are done
+    bool accepting_stopped;
+    std::map<int, uint8_t> receive_versions; // stopped handlers: socket -> wire version the client sends in
+
+    bool waitDrained(unsigned timeout_ms);
+    void callOff();
+    bool sendClients(const MessageChannel &successor, ThreadsafeChannelList &channel_list);
+    static void encodeClient(const MessageChannel &channel, uint8_t receive_version, ClientRecord &record);
+    static bool decodeClient(const char *data, uint32_t size, int socket_fd, const MessageChannel *connection, MessageChannel &channel);
+    static void closeAll(std::vector<MessageChannel> &channels);
+};
+
+}
+
+#endif /* MESSAGE_BUS_IPC_LIB_SOURCE_HOTRESTART_H_ */
@@ -0,0 +1,315 @@
+/**
+ *   @file: HubAddress.cpp
+ *
+ *   @date: Oct 18, 2026
+ */
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <cstdlib>
+#include <cstddef>
+#include "MessageBusIpcCommon.h"
+#include "Hash.h"
+#include "HubAddress.h"
+
+using namespace messagebusipc;
+
+static const char UNIX_PREFIX[] = "unix:";
+static const char TCP_PREFIX[] = "tcp:";
+static const char SEQPACKET_PREFIX[] = "seqpacket:";
+
+const char HubAddress::SEQPACKET_SUFFIX[] = ".seq";
+
+HubAddress::HubAddress() :
+        address_transport(TRANSPORT_UNIX), address_string(std::string(UNIX_PREFIX) + MESSAGE_HUB_SOCKET_FILENAME), path(MESSAGE_HUB_SOCKET_FILENAME) {
+
+    // whole host can be switched to other hub without touching the code
+    const char *address = getenv(MESSAGE_HUB_ADDRESS_ENV);
+    if (address && *address)
+        parse(address);
+}
+
+/**
+ * @name    parse
+ * @brief   Set the address from its string form, see class description
+ * @return  True on success, False if the address is malformed; then the address is left unchanged
+ */
+bool HubAddress::parse(const std::string &address) {
+    // unix:/path, /path, unix:@name or @name
+    if ((address.compare(0, strlen(UNIX_PREFIX), UNIX_PREFIX) == 0) || (address.compare(0, 1, "/") == 0) || (address.compare(0, 1, "@") == 0)) {
+        std::string new_path = ((address[0] == '/') || (address[0] == '@')) ? address : address.substr(strlen(UNIX_PREFIX));
+        if ((new_path.length() < 2) || (new_path.length() >= sizeof(sockaddr_un::sun_path))) {
+            ERROR_MSG("%s: bad unix socket path in %s", __FUNCTION__, address.c_str());
+            return false;
+        }
+
+        address_transport = TRANSPORT_UNIX;
+        path = new_path;
+        address_string = UNIX_PREFIX + path;
+        return true;
+    }
+
+    // seqpacket:/path or seqpacket:@name
+    if (address.compare(0, strlen(SEQPACKET_PREFIX), SEQPACKET_PREFIX) == 0) {
+        HubAddress unix_address;
+        if (!unix_address.parse(address.substr(strlen(SEQPACKET_PREFIX))) || (unix_address.address_transport != TRANSPORT_UNIX))
+            return false;
+
+        address_transport = TRANSPORT_UNIX_SEQPACKET;
+        path = unix_address.path;
+        address_string = SEQPACKET_PREFIX + path;
+        return true;
+    }
+
+    // tcp:host:port or tcp:[host]:port
+    if (address.compare(0, strlen(TCP_PREFIX), TCP_PREFIX) == 0) {
+        std::string host_port = address.substr(strlen(TCP_PREFIX));
+        std::string::size_type colon = host_port.rfind(':');
+        if ((colon == std::string::npos) || (colon == 0) || (colon + 1 == host_port.length())) {
+            ERROR_MSG("%s: expected tcp:host:port, got %s", __FUNCTION__, address.c_str());
+            return false;
+        }
+
+        std::string new_host = host_port.substr(0, colon);
+        if ((new_host.length() > 2) && (new_host[0] == '[') && (new_host[new_host.length() - 1] == ']'))
+            new_host = new_host.substr(1, new_host.length() - 2);
+
+        address_transport = TRANSPORT_TCP;
+        host = new_host;
+        port = host_port.substr(colon + 1);
+        address_string = address;
+        return true;
+    }
+
+    ERROR_MSG("%s: unknown transport in %s", __FUNCTION__, address.c_str());
+    return false;
+}
+
+/**
+ * @name    connectSocket
+ * @return  Socket connected to the address, UNINITIALIZED_SOCKET_FD on failure
+ */
+int HubAddress::connectSocket() const {
+    DEBUG_MSG("%s: connecting to MessageHub socket: %s...", __FUNCTION__, address_string.c_str());
+    int socket_fd = (address_transport == TRANSPORT_TCP) ? connectTcp() : connectUnix();
+    if (socket_fd != UNINITIALIZED_SOCKET_FD)
+        DEBUG_MSG("%s: done.", __FUNCTION__);
+    return socket_fd;
+}
+
+/**
+ * @name    listenSocket
+ * @return  Listening socket bound to the address, UNINITIALIZED_SOCKET_FD on failure
+ */
+int HubAddress::listenSocket(int backlog) const {
+    DEBUG_MSG("%s: binding listening socket to %s...", __FUNCTION__, address_string.c_str());
+    int socket_fd = (address_transport == TRANSPORT_TCP) ? listenTcp(backlog) : listenUnix(backlog);
+    if (socket_fd != UNINITIALIZED_SOCKET_FD)
+        DEBUG_MSG("%s: done.", __FUNCTION__);
+    return socket_fd;
+}
+
+/**
+ * @name    cleanup
+ * @brief   Remove what listening left behind, ie. the unix socket file
+ */
+void HubAddress::cleanup() const {
+    if ((address_transport != TRANSPORT_TCP) && !abstract())
+        unlink(path.c_str());
+}
+
+/**
+ * @name    seqpacketCounterpart
+ * @brief   Get the SOCK_SEQPACKET address the hub listens on next to this unix address, see MessageHubConfig::seqpacket
+ * @return  True on success, False if this is not unix stream address or the name gets too long
+ */
+bool HubAddress::seqpacketCounterpart(HubAddress &counterpart) const {
+    if (address_transport != TRANSPORT_UNIX)
+        return false;
+
+    return counterpart.parse(SEQPACKET_PREFIX + path + SEQPACKET_SUFFIX);
+}
+
+/**
+ * @name    tuneTcpSocket
+ * @brief   Send small messages rightaway instead of coalescing them, and make the socket buffers big enough for bursts
+ */
+void HubAddress::tuneTcpSocket(int socket_fd) {
+    int enable = 1;
+    if (setsockopt(socket_fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable)) == -1)
+        ERROR_MSG("%s: setsockopt(TCP_NODELAY) failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+
+    int buffer_size = TCP_SOCKET_BUFFER_SIZE;
+    setsockopt(socket_fd, SOL_SOCKET, SO_SNDBUF, &buffer_size, sizeof(buffer_size));
+    setsockopt(socket_fd, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+}
+
+/**
+ * @name    forNamespace
+ * @brief   Pick the hub for logical bus namespace, so unrelated workloads spread over several hubs instead of sharing one;
+ *          all clients of the namespace must use the same hub_addresses list. Rendezvous hashing: every address gets
+ *          a score from hash of namespace and address and the highest wins, so adding or removing a hub moves only
+ *          the namespaces of that hub
+ * @return  Chosen address, empty string if hub_addresses is empty
+ */
+const std::string &HubAddress::forNamespace(const std::string &bus_namespace, const std::vector<std::string> &hub_addresses) {
+    static const std::string no_address;
+    const std::string *best = &no_address;
+    uint64_t best_score = 0;
+
+    for (std::vector<std::string>::const_iterator it = hub_addresses.begin(); it != hub_addresses.end(); ++it) {
+        // hash of namespace, separator and address; the addresses often differ in the last byte only, so mix it well
+        const uint8_t separator = 0xFF;
+        uint64_t score = fnv1a64(bus_namespace.data(), bus_namespace.size());
+        score = fnv1a64(&separator, sizeof(separator), score);
+        score = hashMix64(fnv1a64(it->data(), it->size(), score));
+
+        if ((best == &no_address) || (score > best_score)) {
+            best = &*it;
+            best_score = score;
+        }
+    }
+
+    return *best;
+}
+
+/**
+ * @name    unixSocketAddress
+ * @brief   Fill in sockaddr_un; abstract namespace name gets leading '\0' instead of '@' and no terminating '\0'
+ * @return  Length of the address to pass to bind/connect
+ */
+socklen_t HubAddress::unixSocketAddress(sockaddr_un &address) const {
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path.c_str(), path.length()); // parse made sure it fits
+    if (abstract())
+        address.sun_path[0] = '\0';
+
+    return offsetof(sockaddr_un, sun_path) + path.length();
+}
+
+int HubAddress::connectUnix() const {
+    int socket_fd = socket(AF_UNIX, unixSocketType(), 0);
+    if (socket_fd == UNINITIALIZED_SOCKET_FD) {
+        ERROR_MSG("%s: socket(AF_UNIX, %d, 0) failed, errno %d - %s", __FUNCTION__, unixSocketType(), errno, strerror(errno));
+        return UNINITIALIZED_SOCKET_FD;
+    }
+
+    sockaddr_un remote;
+    socklen_t length = unixSocketAddress(remote);
+
+    if (connect(socket_fd, (sockaddr*) &remote, length) == -1) {
+        ERROR_MSG("%s: connect failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+        close(socket_fd);
+        return UNINITIALIZED_SOCKET_FD;
+    }
+
+    return socket_fd;
+}
+
+int HubAddress::listenUnix(int backlog) const {
+    // delete socket file if such already exists
+    cleanup();
+
+    int socket_fd = socket(AF_UNIX, unixSocketType(), 0);
+    if (socket_fd == UNINITIALIZED_SOCKET_FD) {
+        ERROR_MSG("%s: socket(AF_UNIX, %d, 0) failed, errno %d - %s", __FUNCTION__, unixSocketType(), errno, strerror(errno));
+        return UNINITIALIZED_SOCKET_FD;
+    }
+
+    sockaddr_un local;
+    socklen_t local_length = unixSocketAddress(local);
+
+    if (bind(socket_fd, (sockaddr*) &local, local_length) == -1) {
+        ERROR_MSG("%s: bind failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+        close(socket_fd);
+        return UNINITIALIZED_SOCKET_FD;
+    }
+
+    if (listen(socket_fd, backlog) == -1) {
+        ERROR_MSG("%s: listen failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+        close(socket_fd);
+        return UNINITIALIZED_SOCKET_FD;
+    }
+
+    return socket_fd;
+}
+
+int HubAddress::connectTcp() const {
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo *addresses;
+    int error = getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses);
+    if (error) {
+        ERROR_MSG("%s: getaddrinfo(%s) failed - %s", __FUNCTION__, address_string.c_str(), gai_strerror(error));
+        return UNINITIALIZED_SOCKET_FD;
+    }
+
+    // first address that accepts the connection wins
+    int socket_fd = UNINITIALIZED_SOCKET_FD;
+    for (addrinfo *address = addresses; address; address = address->ai_next) {
+        socket_fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (socket_fd == UNINITIALIZED_SOCKET_FD)
+            continue;
+
+        tuneTcpSocket(socket_fd); // buffer sizes must be set before connect to affect the window
+        if (connect(socket_fd, address->ai_addr, address->ai_addrlen) == 0)
+            break;
+
+        ERROR_MSG("%s: connect failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+        close(socket_fd);
+        socket_fd = UNINITIALIZED_SOCKET_FD;
+    }
+
+    freeaddrinfo(addresses);
+    return socket_fd;
+}
+
+int HubAddress::listenTcp(int backlog) const {
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    addrinfo *addresses;
+    const char *node = ((host == "*") || host.empty()) ? NULL : host.c_str();
+    int error = getaddrinfo(node, port.c_str(), &hints, &addresses);
+    if (error) {
+        ERROR_MSG("%s: getaddrinfo(%s) failed - %s", __FUNCTION__, address_string.c_str(), gai_strerror(error));
+        return UNINITIALIZED_SOCKET_FD;
+    }
+
+    int socket_fd = UNINITIALIZED_SOCKET_FD;
+    for (addrinfo *address = addresses; address; address = address->ai_next) {
+        socket_fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (socket_fd == UNINITIALIZED_SOCKET_FD)
+            continue;
+
+        // restarted hub shouldn't wait for the old connections in TIME_WAIT
+        int enable = 1;
+        setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+        // accepted sockets inherit the buffer sizes from the listening one
+        tuneTcpSocket(socket_fd);
+
+        if ((bind(socket_fd, address->ai_addr, address->ai_addrlen) == 0) && (listen(socket_fd, backlog) == 0))
+            break;
+
+        ERROR_MSG("%s: bind/listen failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+        close(socket_fd);
+        socket_fd = UNINITIALIZED_SOCKET_FD;
+    }
+
+    freeaddrinfo(addresses);
+    return socket_fd;
+}
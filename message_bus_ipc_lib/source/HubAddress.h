@@ -0,0 +1,73 @@
+/**
+ *   @file: HubAddress.h
+ *
+ *   @date: Oct 18, 2026
+ */
+
+#ifndef MESSAGE_BUS_IPC_LIB_SOURCE_HUBADDRESS_H_
+#define MESSAGE_BUS_IPC_LIB_SOURCE_HUBADDRESS_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+namespace messagebusipc {
+
+/**
+ * @class   HubAddress
+ * @brief   Where the MessageHub listens and MessageClients connect to, given as a string:
+ *          "unix:/path/to/socket" (or just "/path/to/socket") - Unix domain socket
+ *          "unix:@name" (or just "@name")                     - Unix domain socket in the abstract namespace; no file, gone with the hub
+ *          "seqpacket:/path/to/socket", "seqpacket:@name"     - Unix domain SOCK_SEQPACKET socket, see MessageChannel
+ *          "tcp:host:port", "tcp:[ipv6]:port"                 - TCP; for listening host can be "*" to accept on all interfaces
+ *          Default constructed address comes from MESSAGE_HUB_ADDRESS_ENV environment variable if set, MESSAGE_HUB_SOCKET_FILENAME otherwise
+ */
+class HubAddress {
+public:
+    enum Transport {
+        TRANSPORT_UNIX,
+        TRANSPORT_UNIX_SEQPACKET,
+        TRANSPORT_TCP
+    };
+
+    HubAddress();
+
+    bool parse(const std::string &address);
+    Transport transport() const { return address_transport; }
+    const std::string &toString() const { return address_string; }
+
+    int connectSocket() const;
+    int listenSocket(int backlog) const;
+    void cleanup() const;
+    bool seqpacketCounterpart(HubAddress &counterpart) const;
+
+    static void tuneTcpSocket(int socket_fd);
+    static const std::string &forNamespace(const std::string &bus_namespace, const std::vector<std::string> &hub_addresses);
+
+private:
+    // seqpacket counterpart of unix address "/path" is "/path.seq"
+    static const char SEQPACKET_SUFFIX[];
+
+    // TCP sockets get big buffers, so a burst of large messages doesn't stall on the window
+    static const int TCP_SOCKET_BUFFER_SIZE = 1024 * 1024;
+
+    Transport address_transport;
+    std::string address_string;
+    std::string path;   // unix; abstract namespace name starts with '@'
+    std::string host;   // tcp
+    std::string port;   // tcp
+
+    bool abstract() const { return !path.empty() && (path[0] == '@'); }
+    socklen_t unixSocketAddress(sockaddr_un &address) const;
+    int unixSocketType() const { return (address_transport == TRANSPORT_UNIX_SEQPACKET) ? SOCK_SEQPACKET : SOCK_STREAM; }
+    int connectUnix() const;
+    int listenUnix(int backlog) const;
+    int connectTcp() const;
+    int listenTcp(int backlog) const;
+};
+
+}
+
+#endif /* MESSAGE_BUS_IPC_LIB_SOURCE_HUBADDRESS_H_ */
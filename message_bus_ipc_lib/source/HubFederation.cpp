@@ -0,0 +1,275 @@
+/**
+ *   @file: HubFederation.cpp
+ *
+ *   @date: Oct 18, 2026
+ */
+
+#include <sys/socket.h>
+#include <cstring>
+#include "PThreadLockGuard.h"
+#include "HubFederation.h"
+
+using namespace messagebusipc;
+
+HubFederation::Outbox::Outbox(const MessageChannel &channel) :
+        channel(channel), thread(), num_bytes(0), stopping(false), broken(false) {
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&not_empty, NULL);
+}
+
+HubFederation::Outbox::~Outbox() {
+    pthread_mutex_destroy(&mutex);
+    pthread_cond_destroy(&not_empty);
+}
+
+HubFederation::~HubFederation() {
+    for (std::vector<Link>::iterator it = links.begin(); it != links.end(); ++it)
+        stopOutbox(it->outbox);
+}
+
+/**
+ * @name    addLink
+ * @brief   Start using new link to other hub and tell the other hub about our clients
+ */
+void HubFederation::addLink(MessageChannel &link, ThreadsafeChannelList &channel_list) {
+    DEBUG_MSG("%s: hub linked: %s", __FUNCTION__, link.name().c_str());
+
+    Link new_link;
+    new_link.channel = link;
+    new_link.outbox = new Outbox(link);
+    int return_code = pthread_create(&new_link.outbox->thread, NULL, HubFederation::sendFunc, (void*) new_link.outbox);
+    if (return_code) {
+        ERROR_MSG("%s: pthread_create failed with error code: %d", __FUNCTION__, return_code);
+        delete new_link.outbox;
+        new_link.outbox = NULL;
+        shutdown(link.fileDescriptor(), SHUT_RDWR); // the link handler notices, the link is made again
+    }
+    links.push_back(new_link);
+
+    ThreadsafeChannelList::Iterator it = channel_list.getIterator();
+    MessageChannel const *channel;
+    while ((channel = it.getNext()))
+        post(links.back(), ID_HUB_CLIENT_JOINED, channel->name().c_str(), channel->name().length() + 1, "");
+}
+
+/**
+ * @name    removeLink
+ * @brief   Stop using broken link; clients of the other hub say goodbye to our clients
+ */
+void HubFederation::removeLink(MessageChannel &link, ThreadsafeChannelList &channel_list) {
+    DEBUG_MSG("%s: hub unlinked: %s", __FUNCTION__, link.name().c_str());
+
+    for (std::vector<Link>::iterator it = links.begin(); it != links.end(); ++it)
+        if (it->channel == link) {
+            for (std::multiset<std::string>::iterator client = it->clients.begin(); client != it->clients.end(); ++client)
+                sayToLocalClients(channel_list, ID_CLIENT_SAYS_GOODBYE, *client);
+            stopOutbox(it->outbox);
+            links.erase(it);
+            break;
+        }
+
+    link.shutDown();
+}
+
+/**
+ * @name    updateMembership
+ * @brief   Other hub says its client joined or left; pass it on to our clients as HELLO or GOODBYE
+ */
+void HubFederation::updateMembership(const MessageChannel &link, uint32_t id, const char *client_name, ThreadsafeChannelList &channel_list) {
+    Link *found = findLink(link);
+    if (!found)
+        return;
+
+    if (id == ID_HUB_CLIENT_JOINED) {
+        found->clients.insert(client_name);
+        sayToLocalClients(channel_list, ID_CLIENT_SAYS_HELLO, client_name);
+    }
+    else {
+        std::multiset<std::string>::iterator client = found->clients.find(client_name);
+        if (client == found->clients.end())
+            return;
+        found->clients.erase(client);
+        sayToLocalClients(channel_list, ID_CLIENT_SAYS_GOODBYE, client_name);
+    }
+}
+
+/**
+ * @name    announce
+ * @brief   Tell all linked hubs that our client joined (ID_HUB_CLIENT_JOINED) or left (ID_HUB_CLIENT_LEFT)
+ */
+void HubFederation::announce(uint32_t id, const std::string &client_name) {
+    for (std::vector<Link>::iterator it = links.begin(); it != links.end(); ++it)
+        post(*it, id, client_name.c_str(), client_name.length() + 1, "");
+}
+
+/**
+ * @name    listRemoteClients
+ * @brief   Name every client of the linked hubs, for the ID_CLIENT_SAYS_HELLO to newly connected client
+ */
+void HubFederation::listRemoteClients(std::vector<std::string> &clients) const {
+    for (std::vector<Link>::const_iterator it = links.begin(); it != links.end(); ++it)
+        clients.insert(clients.end(), it->clients.begin(), it->clients.end());
+}
+
+/**
+ * @name    forward
+ * @brief   Pass message from our client to the linked hubs: broadcast to every hub, otherwise to the hubs that have the recipient
+ */
+void HubFederation::forward(uint32_t id, const char *data, uint32_t size, const std::string &sender, const std::string &recipient) {
+    if (size > MESSAGE_BUFF_SIZE - ENVELOPE_SIZE) {
+        ERROR_MSG("%s: message %u of size %u too big to fit the envelope, not forwarded", __FUNCTION__, id, size);
+        return;
+    }
+
+    bool broadcast = (recipient == MBUS_ALL_CONNECTED_CLIENTS);
+    for (std::vector<Link>::iterator it = links.begin(); it != links.end(); ++it)
+        if (broadcast || it->clients.count(recipient))
+            forwardOverLink(*it, id, data, size, sender, recipient);
+}
+
+/**
+ * @name    unpack
+ * @brief   Take ID_HUB_FORWARD envelope off; data and size are adjusted to point at the original message
+ * @return  True on success, False if the envelope is malformed
+ */
+bool HubFederation::unpack(char *&data, uint32_t &size, uint32_t &id, std::string &sender) {
+    return MessageChannel::openEnvelope(data, size, id, sender);
+}
+
+HubFederation::Link *HubFederation::findLink(const MessageChannel &channel) {
+    for (std::vector<Link>::iterator it = links.begin(); it != links.end(); ++it)
+        if (it->channel == channel)
+            return &*it;
+
+    return NULL;
+}
+
+/**
+ * @name    forwardOverLink
+ * @brief   Post the message to the link in ID_HUB_FORWARD envelope naming the original sender
+ */
+bool HubFederation::forwardOverLink(const Link &link, uint32_t id, const char *data, uint32_t size, const std::string &sender, const std::string &recipient) {
+    return post(link, ID_HUB_FORWARD, data, size, recipient.c_str(), id, sender.c_str());
+}
+
+/**
+ * @name    post
+ * @brief   Encode the message, optionally in an envelope, and queue it for the sender thread of the link;
+ *          the router never waits for the other hub. Link too far behind is shut down, the link handler notices
+ * @return  True if queued, False if the link is broken
+ */
+bool HubFederation::post(const Link &link, uint32_t id, const char *data, uint32_t size, const char *recipient, uint32_t enclosed_id, const char *enclosed_name) {
+    Outbox *outbox = link.outbox;
+    if (!outbox)
+        return false;
+
+    uint32_t payload_size = enclosed_name ? ENVELOPE_SIZE + size : size;
+    char header[MessageChannel::MAX_HEADER_SIZE];
+    uint32_t header_size = link.channel.encodeHeader(header, id, payload_size, recipient);
+
+    std::string message;
+    message.reserve(header_size + payload_size);
+    message.append(header, header_size);
+    if (enclosed_name) {
+        char envelope[ENVELOPE_SIZE];
+        MessageChannel::packEnvelope(envelope, enclosed_id, enclosed_name);
+        message.append(envelope, ENVELOPE_SIZE);
+    }
+    if (size > 0)
+        message.append(data, size);
+
+    PThreadLockGuard lock(outbox->mutex);
+    if (outbox->broken)
+        return false;
+
+    if (outbox->num_bytes + message.size() > MAX_QUEUED_BYTES_PER_LINK) {
+        ERROR_MSG("%s: hub %s is %u bytes behind, unlinking", __FUNCTION__, link.channel.name().c_str(), outbox->num_bytes);
+        outbox->broken = true;
+        outbox->messages.clear();
+        outbox->num_bytes = 0;
+        shutdown(link.channel.fileDescriptor(), SHUT_RDWR);
+        return false;
+    }
+
+    outbox->num_bytes += message.size();
+    outbox->messages.push_back(std::string());
+    outbox->messages.back().swap(message);
+    pthread_cond_signal(&outbox->not_empty);
+    return true;
+}
+
+/**
+ * @name    stopOutbox
+ * @brief   Finish the sender thread of removed link; what it didn't send is thrown away
+ */
+void HubFederation::stopOutbox(Outbox *outbox) {
+    if (!outbox)
+        return;
+
+    {
+        PThreadLockGuard lock(outbox->mutex);
+        outbox->stopping = true;
+        pthread_cond_signal(&outbox->not_empty);
+    }
+
+    shutdown(outbox->channel.fileDescriptor(), SHUT_RDWR); // breaks a send blocked on the other hub
+    pthread_join(outbox->thread, NULL);
+    delete outbox;
+}
+
+/**
+ * @name    sendFunc
+ * @param   varg Holds Outbox*
+ * @brief   Send what the router posted to the link, up to MAX_MESSAGES_PER_SEND messages with one syscall
+ * @note    This is run in a dedicated thread per link
+ */
+void* HubFederation::sendFunc(void* varg) {
+    Outbox *outbox = (Outbox*) varg;
+    std::vector<std::string> batch;
+    std::vector<iovec> iovecs;
+
+    while (true) {
+        {
+            PThreadLockGuard lock(outbox->mutex);
+            while (outbox->messages.empty() && !outbox->stopping)
+                pthread_cond_wait(&outbox->not_empty, &outbox->mutex);
+            if (outbox->stopping)
+                break;
+
+            batch.clear();
+            while (!outbox->messages.empty() && (batch.size() < MAX_MESSAGES_PER_SEND)) {
+                batch.push_back(std::string());
+                batch.back().swap(outbox->messages.front());
+                outbox->messages.pop_front();
+                outbox->num_bytes -= batch.back().size();
+            }
+        }
+
+        iovecs.resize(batch.size());
+        for (size_t i = 0; i < batch.size(); i++) {
+            iovecs[i].iov_base = &batch[i][0];
+            iovecs[i].iov_len = batch[i].size();
+        }
+
+        // link is broken; its handler notices and the router removes it
+        if (!outbox->channel.sendVectored(&iovecs[0], iovecs.size())) {
+            PThreadLockGuard lock(outbox->mutex);
+            outbox->broken = true;
+            outbox->messages.clear();
+            outbox->num_bytes = 0;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @name    sayToLocalClients
+ * @brief   Send ID_CLIENT_SAYS_HELLO or ID_CLIENT_SAYS_GOODBYE on behalf of remote client to all our clients
+ */
+void HubFederation::sayToLocalClients(ThreadsafeChannelList &channel_list, uint32_t id, const std::string &client_name) {
+    ThreadsafeChannelList::Iterator it = channel_list.getIterator();
+    MessageChannel const *channel;
+    while ((channel = it.getNext()))
+        channel->send(id, client_name.c_str(), client_name.length() + 1, "");
+}
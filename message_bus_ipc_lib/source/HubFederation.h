@@ -0,0 +1,92 @@
+/**
+ *   @file: HubFederation.h
+ *
+ *   @date: Oct 18, 2026
+ */
+
+#ifndef MESSAGE_BUS_IPC_LIB_SOURCE_HUBFEDERATION_H_
+#define MESSAGE_BUS_IPC_LIB_SOURCE_HUBFEDERATION_H_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <set>
+#include <stdint.h>
+#include <pthread.h>
+#include "MessageBusIpcCommon.h"
+#include "MessageChannel.h"
+#include "ThreadsafeChannelList.h"
+
+namespace messagebusipc {
+
+/**
+ * @class   HubFederation
+ * @brief   Links of this MessageHub to other hubs and the clients connected to them. Over a link hubs tell each other
+ *          which clients joined and left (ID_HUB_CLIENT_JOINED/LEFT) and pass messages for remote clients wrapped
+ *          in ID_HUB_FORWARD envelope, so the original sender name travels along. Forwarded messages are delivered
+ *          locally only and never forwarded again, so a broadcast crosses each link once; hubs are expected to form
+ *          a full mesh, each pair linked once.
+ *          The router never writes to a link itself: messages for the other hub are encoded into the link's outbox
+ *          and a sender thread of the link sends them, many at a time. Hub that falls MAX_QUEUED_BYTES_PER_LINK behind
+ *          is unlinked rather than stalling the router or losing messages; it links again and learns our clients anew
+ * @note    Not thread safe; owned by the MessageHub router thread
+ */
+class HubFederation {
+public:
+    static const uint32_t ENVELOPE_SIZE = MessageChannel::ENVELOPE_SIZE;
+
+    // encoded messages waiting for a slow hub, above that the link is broken
+    static const uint32_t MAX_QUEUED_BYTES_PER_LINK = 64 * 1024 * 1024;
+
+    // messages the sender thread sends in one go
+    static const unsigned MAX_MESSAGES_PER_SEND = 64;
+
+    HubFederation() {}
+    ~HubFederation();
+
+    void addLink(MessageChannel &link, ThreadsafeChannelList &channel_list);
+    void removeLink(MessageChannel &link, ThreadsafeChannelList &channel_list);
+    void updateMembership(const MessageChannel &link, uint32_t id, const char *client_name, ThreadsafeChannelList &channel_list);
+    void announce(uint32_t id, const std::string &client_name);
+    void listRemoteClients(std::vector<std::string> &clients) const;
+    void forward(uint32_t id, const char *data, uint32_t size, const std::string &sender, const std::string &recipient);
+    bool empty() const { return links.empty(); }
+
+    static bool unpack(char *&data, uint32_t &size, uint32_t &id, std::string &sender);
+
+private:
+    struct Outbox {
+        Outbox(const MessageChannel &channel);
+        ~Outbox();
+        MessageChannel channel;
+        pthread_t thread;
+        pthread_mutex_t mutex;
+        pthread_cond_t not_empty;
+        std::deque<std::string> messages;   // encoded, ready to send
+        uint32_t num_bytes;
+        bool stopping;
+        bool broken;                        // overflowed or failed to send; the rest is thrown away
+    };
+
+    struct Link {
+        MessageChannel channel;
+        std::multiset<std::string> clients; // clients of the same name may connect to the remote hub more than once
+        Outbox *outbox;
+    };
+
+    std::vector<Link> links;
+
+    Link *findLink(const MessageChannel &channel);
+    bool forwardOverLink(const Link &link, uint32_t id, const char *data, uint32_t size, const std::string &sender, const std::string &recipient);
+    static bool post(const Link &link, uint32_t id, const char *data, uint32_t size, const char *recipient, uint32_t enclosed_id = 0, const char *enclosed_name = NULL);
+    static void stopOutbox(Outbox *outbox);
+    static void* sendFunc(void* varg);
+    static void sayToLocalClients(ThreadsafeChannelList &channel_list, uint32_t id, const std::string &client_name);
+
+    HubFederation(const HubFederation&);
+    HubFederation& operator=(const HubFederation&);
+};
+
+}
+
+#endif /* MESSAGE_BUS_IPC_LIB_SOURCE_HUBFEDERATION_H_ */
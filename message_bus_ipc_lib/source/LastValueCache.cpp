@@ -0,0 +1,94 @@
+/**
+ *   @file: LastValueCache.cpp
+ *
+ *   @date: Oct 18, 2026
+ */
+
+#include "Hash.h"
+#include "LastValueCache.h"
+
+using namespace messagebusipc;
+
+LastValueCache::LastValueCache(LastValueCacheMode mode, uint32_t max_keys, uint32_t max_bytes) :
+        mode(mode), max_keys(max_keys), max_bytes(max_bytes), num_bytes(0) {
+}
+
+/**
+ * @name    update
+ * @brief   Remember the message as the latest value of its key; forget the least recently updated values above the limits
+ */
+void LastValueCache::update(uint32_t id, const char *data, uint32_t size, const std::string &sender) {
+    if (mode == LAST_VALUE_CACHE_OFF)
+        return;
+
+    // too big to cache; the value it replaces is stale, so it goes too
+    Key key = keyOf(id, sender);
+    if (max_bytes && (size > max_bytes)) {
+        forget(key);
+        return;
+    }
+
+    std::unordered_map<Key, ValueList::iterator, KeyHash>::iterator found = values.find(key);
+    if (found == values.end()) {
+        order.push_back(Value());
+        found = values.insert(std::make_pair(key, --order.end())).first;
+    }
+    else
+        order.splice(order.end(), order, found->second);
+
+    Value &value = *found->second;
+    num_bytes -= value.data.size();
+    value.id = id;
+    value.sender = sender;
+    value.data.assign(data, data + size); // keeps the capacity; same ID usually comes with the same size
+    num_bytes += size;
+
+    // the value just updated is the last in order, it stays
+    while ((max_keys && (values.size() > max_keys)) || (max_bytes && (num_bytes > max_bytes))) {
+        const Value &oldest = order.front();
+        forget(keyOf(oldest.id, oldest.sender));
+    }
+}
+
+/**
+ * @name    snapshot
+ * @brief   Get all the cached values, least recently updated first
+ * @note    Pointers are valid until the next update
+ */
+void LastValueCache::snapshot(std::vector<const Value*> &values) const {
+    values.clear();
+    values.reserve(this->values.size());
+    for (ValueList::const_iterator it = order.begin(); it != order.end(); ++it)
+        values.push_back(&*it);
+}
+
+/**
+ * @name    keyOf
+ * @return  What the value of the message is cached under in this mode
+ */
+LastValueCache::Key LastValueCache::keyOf(uint32_t id, const std::string &sender) const {
+    Key key;
+    key.id = id;
+    if (mode == LAST_VALUE_CACHE_BY_ID_AND_SENDER)
+        key.sender = sender;
+    return key;
+}
+
+/**
+ * @name    forget
+ * @brief   Drop the value of the key, if cached
+ */
+void LastValueCache::forget(const Key &key) {
+    std::unordered_map<Key, ValueList::iterator, KeyHash>::iterator found = values.find(key);
+    if (found == values.end())
+        return;
+
+    num_bytes -= found->second->data.size();
+    order.erase(found->second);
+    values.erase(found);
+}
+
+size_t LastValueCache::KeyHash::operator()(const Key &key) const {
+    uint32_t hash = fnv1a32(&key.id, sizeof(key.id));
+    return fnv1a32(key.sender.data(), key.sender.size(), hash);
+}
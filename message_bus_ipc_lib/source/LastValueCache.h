@@ -0,0 +1,74 @@
+/**
+ *   @file: LastValueCache.h
+ *
+ *   @date: Oct 18, 2026
+ */
+
+#ifndef MESSAGE_BUS_IPC_LIB_SOURCE_LASTVALUECACHE_H_
+#define MESSAGE_BUS_IPC_LIB_SOURCE_LASTVALUECACHE_H_
+
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <stdint.h>
+
+namespace messagebusipc {
+
+// what the hub remembers of broadcast messages for clients that connect later
+enum LastValueCacheMode {
+    LAST_VALUE_CACHE_OFF,
+    LAST_VALUE_CACHE_BY_ID,             // latest payload of every message ID, whoever sent it
+    LAST_VALUE_CACHE_BY_ID_AND_SENDER   // latest payload of every message ID from every sender
+};
+
+/**
+ * @class   LastValueCache
+ * @brief   Latest broadcast payloads, handed to new clients as the snapshot of current state of the bus.
+ *          Up to max_keys values and max_bytes of payload are kept; above that the least recently updated are forgotten,
+ *          and a payload bigger than max_bytes is not cached at all
+ * @note    Not thread safe; owned by the MessageHub router thread
+ */
+class LastValueCache {
+public:
+    struct Value {
+        uint32_t id;
+        std::string sender;
+        std::vector<char> data;
+    };
+
+    LastValueCache(LastValueCacheMode mode, uint32_t max_keys = 0, uint32_t max_bytes = 0);
+
+    void update(uint32_t id, const char *data, uint32_t size, const std::string &sender);
+    void snapshot(std::vector<const Value*> &values) const;
+    bool enabled() const { return mode != LAST_VALUE_CACHE_OFF; }
+    size_t size() const { return values.size(); }
+    uint64_t bytes() const { return num_bytes; }
+
+private:
+    struct Key {
+        uint32_t id;
+        std::string sender;
+        bool operator==(const Key &other) const { return (id == other.id) && (sender == other.sender); }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key &key) const;
+    };
+
+    typedef std::list<Value> ValueList;
+
+    LastValueCacheMode mode;
+    uint32_t max_keys;      // 0 means no limit
+    uint32_t max_bytes;     // payload bytes; 0 means no limit
+    uint64_t num_bytes;
+    ValueList order;        // least recently updated first
+    std::unordered_map<Key, ValueList::iterator, KeyHash> values;
+
+    Key keyOf(uint32_t id, const std::string &sender) const;
+    void forget(const Key &key);
+};
+
+}
+
+#endif /* MESSAGE_BUS_IPC_LIB_SOURCE_LASTVALUECACHE_H_ */
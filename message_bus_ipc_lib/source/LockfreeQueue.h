@@ -0,0 +1,119 @@
+/**
+ *   @file: LockfreeQueue.h
+ *
+ *   @date: Oct 18, 2026
+ */
+
+#ifndef MESSAGE_BUS_IPC_LIB_SOURCE_LOCKFREEQUEUE_H_
+#define MESSAGE_BUS_IPC_LIB_SOURCE_LOCKFREEQUEUE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace messagebusipc {
+
+/**
+ * @class   LockfreeQueue
+ * @brief   Bounded multi-producer multi-consumer queue; push and pop never take a lock.
+ *          Every cell carries a sequence number telling whether it is ready for the producer or the consumer
+ *          (D. Vyukov's bounded MPMC queue). Capacity is rounded up to the power of 2.
+ */
+template<class T>
+class LockfreeQueue {
+public:
+    LockfreeQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity)
+            size *= 2;
+
+        mask = size - 1;
+        cells = new Cell[size];
+        for (size_t i = 0; i < size; i++)
+            __atomic_store_n(&cells[i].sequence, i, __ATOMIC_RELAXED);
+        __atomic_store_n(&enqueue_pos, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&dequeue_pos, 0, __ATOMIC_RELAXED);
+    }
+
+    ~LockfreeQueue() {
+        delete[] cells;
+    }
+
+    size_t capacity() const {
+        return mask + 1;
+    }
+
+    /**
+     * @name    push
+     * @return  True on success, False if the queue is full
+     */
+    bool push(const T &item) {
+        Cell *cell;
+        size_t pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+        while (true) {
+            cell = &cells[pos & mask];
+            size_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+            if (diff == 0) {
+                if (__atomic_compare_exchange_n(&enqueue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                    break;
+            }
+            else if (diff < 0)
+                return false; // full
+            else
+                pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+        }
+
+        cell->item = item;
+        __atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    /**
+     * @name    pop
+     * @return  True on success, False if the queue is empty
+     */
+    bool pop(T &item) {
+        Cell *cell;
+        size_t pos = __atomic_load_n(&dequeue_pos, __ATOMIC_RELAXED);
+        while (true) {
+            cell = &cells[pos & mask];
+            size_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (__atomic_compare_exchange_n(&dequeue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                    break;
+            }
+            else if (diff < 0)
+                return false; // empty
+            else
+                pos = __atomic_load_n(&dequeue_pos, __ATOMIC_RELAXED);
+        }
+
+        item = cell->item;
+        __atomic_store_n(&cell->sequence, pos + mask + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+private:
+    struct Cell {
+        size_t sequence;
+        T item;
+    };
+
+    static const size_t CACHELINE_SIZE = 64;
+
+    Cell *cells;
+    size_t mask;
+    char pad0[CACHELINE_SIZE];
+    size_t enqueue_pos;
+    char pad1[CACHELINE_SIZE];
+    size_t dequeue_pos;
+    char pad2[CACHELINE_SIZE];
+
+    LockfreeQueue(const LockfreeQueue&);
+    LockfreeQueue& operator=(const LockfreeQueue&);
+};
+
+}
+
+#endif /* MESSAGE_BUS_IPC_LIB_SOURCE_LOCKFREEQUEUE_H_ */
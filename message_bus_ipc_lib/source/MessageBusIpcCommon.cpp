@@ -15,20 +15,24 @@ namespace messagebusipc {
 static const char * MessageBusMessages_Names[] = { MBIPC_MESSAGES(ENUM_NAME1_OPERATOR, ENUM_NAME2_OPERATOR, ENUM_COMMENT_OPERATOR) NULL };
 
 /**
- * message values in the same order as names
+ * number of names; internal messages come right after ID_USER_MESSAGE_BASE and have consecutive values
  */
-static const MessageBusMessage MessageBusMessages_Values[] = { MBIPC_MESSAGES(ENUM_ENUMVAL1_OPERATOR, ENUM_ENUMVAL2_OPERATOR, ENUM_COMMENT_OPERATOR) (MessageBusMessage)(uint32_t)-1 };
+static const uint32_t MessageBusMessages_Count = sizeof(MessageBusMessages_Names) / sizeof(MessageBusMessages_Names[0]) - 1;
+static_assert(ID_INTERNAL_MESSAGE_END - ID_CLIENT_SAYS_HELLO + 1 == MessageBusMessages_Count, "GetMessageName indexes names by internal message value");
 
 /**
- * @brief find message string representation using MessageBusMessages_Values::MessageBusMessages_Names like map
+ * @brief find message string representation by indexing MessageBusMessages_Names directly
  * @param Msg
  * @return message name od "ID_?" if id not found
  */
 const char * GetMessageName(MessageBusMessage Msg)
 {
-   for (uint32_t i = 0; MessageBusMessages_Values[i] != (uint32_t)-1; ++i)
-      if (MessageBusMessages_Values[i] == Msg)
-         return MessageBusMessages_Names[i];
+   if (Msg == ID_USER_MESSAGE_BASE)
+      return MessageBusMessages_Names[0];
+
+   uint32_t index = (uint32_t)Msg - (uint32_t)ID_CLIENT_SAYS_HELLO + 1;
+   if ((uint32_t)Msg >= (uint32_t)ID_CLIENT_SAYS_HELLO && index < MessageBusMessages_Count)
+      return MessageBusMessages_Names[index];
    return "ID_?";
 }
 
@@ -10,6 +10,7 @@
 
 #include <cstdio>
 #include <stdint.h>
+#include "AsyncLog.h"
 
 namespace messagebusipc {
 
@@ -27,9 +28,22 @@ namespace messagebusipc {
    COM("IPC internal messages") \
    OP2(ID_CLIENT_SAYS_HELLO, 1000000) COM("sent to the hub and all clients when new client connects, conveys client name") \
    OP1(ID_CLIENT_SAYS_GOODBYE) COM("sent to all clients when client disconnects, conveys client name") \
+   OP1(ID_CLIENT_REQUESTS_PEER_CHANNEL) COM("sent to the hub when client wants a direct channel to other client, conveys peer name") \
+   OP1(ID_PEER_CHANNEL_ESTABLISHED) COM("sent to both peers along with direct channel socket descriptor, conveys peer name") \
+   OP1(ID_HUB_CLIENT_JOINED) COM("sent between federated hubs when client connects to one of them, conveys client name") \
+   OP1(ID_HUB_CLIENT_LEFT) COM("sent between federated hubs when client disconnects from one of them, conveys client name") \
+   OP1(ID_HUB_FORWARD) COM("sent between federated hubs, conveys message for remote client along with its original ID and sender name") \
+   OP1(ID_WIRE_VERSION_SWITCH) COM("sent by the hub and by the client, conveys wire protocol version the sender uses from the next message on; to v2 from the hub also the number of peer IDs it keeps") \
+   OP1(ID_CLIENT_ATTACHES) COM("sent to the hub to add logical client to the connection, conveys hello flags and client name") \
+   OP1(ID_CLIENT_DETACHES) COM("sent to the hub to remove logical client from the connection, conveys client name") \
+   OP1(ID_MUX_FORWARD) COM("sent between the hub and client, conveys message of logical client along with its original ID and the logical client name") \
+   OP1(ID_HOT_RESTART_LISTENER) COM("sent by the running hub to its successor along with listening socket descriptor, conveys the address, see HotRestart") \
+   OP1(ID_HOT_RESTART_CLIENT) COM("sent by the running hub to its successor, conveys client state; along with socket descriptor for a connection, without for logical client on it") \
+   OP1(ID_HOT_RESTART_DONE) COM("sent by the running hub to its successor after everything was handed over") \
+   OP1(ID_HOT_RESTART_HANDOVER) COM("hub internal; client handler stopped so the successor can take the connection over") \
 
 // here enum definition becomes real
-enum MessageBusMessage { MBIPC_MESSAGES(ENUM_DEFINE1_OPERATOR, ENUM_DEFINE2_OPERATOR, ENUM_COMMENT_OPERATOR) };
+enum MessageBusMessage { MBIPC_MESSAGES(ENUM_DEFINE1_OPERATOR, ENUM_DEFINE2_OPERATOR, ENUM_COMMENT_OPERATOR) ID_INTERNAL_MESSAGE_END };
 
 // use this function to get enum string representation
 const char * GetMessageName(MessageBusMessage Msg);
@@ -39,21 +53,41 @@ const char * GetMessageName(MessageBusMessage Msg);
 // MessageHub listening socket
 const char MESSAGE_HUB_SOCKET_FILENAME[] = "/tmp/ipc_hub";
 
+// Environment variable overriding the default hub address, eg. MBIPC_HUB_ADDRESS=unix:@my_bus; see HubAddress
+const char MESSAGE_HUB_ADDRESS_ENV[] = "MBIPC_HUB_ADDRESS";
+
 // Maximum size of single message in bytes
 const unsigned MESSAGE_BUFF_SIZE = 1024 * 1024 * 10; // 10MB
 
+// Maximum length of client name that fits into message header
+const unsigned MAX_CLIENT_NAME_LENGTH = 19;
+
+// ID_CLIENT_SAYS_HELLO payload sent by the client is optional uint32_t with these flags;
+// with HELLO_FLAG_WIRE_V2 followed by uint32_t number of v2 peer IDs the client keeps, see MessageChannel
+const uint32_t HELLO_FLAG_RESUME_SESSION = 1 << 0; // hub should keep messages for a while after disconnect and replay them on reconnect
+const uint32_t HELLO_FLAG_HUB_LINK       = 1 << 1; // this is not a client but other hub linking with us, see HubFederation
+const uint32_t HELLO_FLAG_WIRE_V2        = 1 << 2; // client understands wire protocol v2, see MessageChannel
+const uint32_t HELLO_FLAG_CONSUMER_GROUP = 1 << 3; // client shares messages addressed to its name with others of the same name, see ConsumerGroups
+
+// Wire protocol versions; every connection starts with v1 and switches with ID_WIRE_VERSION_SWITCH
+const uint8_t WIRE_VERSION_1 = 1;
+const uint8_t WIRE_VERSION_2 = 2;
+
 // socket file descriptor that is not initialized
 const int UNINITIALIZED_SOCKET_FD = -1;
 
 // Message addressed to all connected recipients
 const char MBUS_ALL_CONNECTED_CLIENTS[] = "*";
 
-// Debugging messages routine
-#ifndef NDEBUG
-#define DEBUG_MSG(fmt, ...) printf("[IPC] " fmt "\n", __VA_ARGS__)
+// Diagnostic messages; stored by AsyncLog and printed by its thread. Arguments are evaluated only if the level is on.
+// MBIPC_NO_LOG compiles them out
+#ifndef MBIPC_NO_LOG
+#define LOG_MSG(level, fmt, ...) do { if (AsyncLog::enabled(level)) AsyncLog::write(level, "[IPC] " fmt, ##__VA_ARGS__); } while (0)
 #else
-#define DEBUG_MSG(...)
+#define LOG_MSG(...) do {} while (0)
 #endif
+#define DEBUG_MSG(fmt, ...) LOG_MSG(LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+#define ERROR_MSG(fmt, ...) LOG_MSG(LOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
 
 }
 
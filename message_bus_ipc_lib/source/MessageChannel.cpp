@@ -7,18 +7,147 @@
 
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
 #include <cstdio>
 #include <cassert>
+#include <cstring>
+#include <algorithm>
+#include <deque>
 #include "MessageBusIpcCommon.h"
 #include "MessageChannel.h"
+#include "HubAddress.h"
+#include "Hash.h"
+#include "PThreadLockGuard.h"
 
 using namespace messagebusipc;
 
+const uint32_t MessageChannel::SEQPACKET_MAX_PACKET_SIZE;
+const uint32_t MessageChannel::ENVELOPE_SIZE;
+const uint32_t MessageChannel::PEER_IDS;
+const uint32_t MessageChannel::MAX_PEER_IDS;
+
+/**
+ * @struct  MessageChannel::Writer
+ * @brief   The thread holding the writer sends over the socket; other threads don't wait for it, they leave a copy
+ *          of their message in the backlog and the holder sends it before letting go, in the order the messages came
+ */
+struct MessageChannel::Writer {
+    enum Kind { SEND_MESSAGE, SEND_ENVELOPED, SEND_VECTORED };
+
+    struct Deferred {
+        Deferred() : kind(SEND_MESSAGE), envelope_id(0), id(0), passed_fd(UNINITIALIZED_SOCKET_FD) {}
+        ~Deferred() {
+            if (passed_fd != UNINITIALIZED_SOCKET_FD)
+                close(passed_fd);
+        }
+        MessageChannel channel;     // the copy asked to send; multiplexed one still puts the message in its envelope
+        uint8_t kind;
+        uint32_t envelope_id;
+        uint32_t id;
+        std::string data;           // SEND_VECTORED: the encoded messages back to back
+        std::string recipient;
+        std::string enclosed_name;
+        int passed_fd;              // duplicate of the descriptor to send, closed when done
+    };
+
+    Writer() : refs(1), busy(false), owner(), depth(0) {
+        pthread_mutex_init(&mutex, NULL);
+        pthread_cond_init(&idle, NULL);
+    }
+
+    ~Writer() {
+        for (std::deque<Deferred*>::iterator it = backlog.begin(); it != backlog.end(); ++it)
+            delete *it;
+        pthread_cond_destroy(&idle);
+        pthread_mutex_destroy(&mutex);
+    }
+
+    static bool send(const Deferred &deferred) {
+        const MessageChannel &channel = deferred.channel;
+        const char *data = deferred.data.data();
+        uint32_t size = deferred.data.size();
+        bool sent;
+        if (deferred.kind == SEND_ENVELOPED)
+            sent = channel.send_enveloped(deferred.envelope_id, deferred.id, data, size, deferred.recipient.c_str(), deferred.enclosed_name.c_str());
+        else if (deferred.kind == SEND_VECTORED) {
+            iovec iov;
+            iov.iov_base = const_cast<char*>(data);
+            iov.iov_len = size;
+            sent = channel.sendVectored(&iov, 1);
+        }
+        else
+            sent = channel.send_message(deferred.id, data, size, deferred.recipient.c_str(), deferred.passed_fd);
+
+        if (!sent)
+            ERROR_MSG("%s: deferred message %u to %s failed, errno %d - %s", __FUNCTION__, deferred.id, channel.name().c_str(), errno, strerror(errno));
+        return sent;
+    }
+
+    int refs;                   // atomic; copies of the channel sharing the writer
+    pthread_mutex_t mutex;
+    pthread_cond_t idle;        // signalled when the writer is let go
+    bool busy;
+    pthread_t owner;
+    unsigned int depth;         // nested sends and holds of the owner
+    std::deque<Deferred*> backlog;
+};
+
+/**
+ * @struct  MessageChannel::PeerIds
+ * @brief   Wire protocol v2 peer IDs of a connection; the name each table ID stands for, one table each way
+ */
+struct MessageChannel::PeerIds {
+    PeerIds() : refs(1), num_sent(PEER_IDS), num_received(PEER_IDS) {}
+
+    int refs;                           // atomic; copies of the channel sharing the tables
+    uint32_t num_sent;                  // IDs the other side keeps, as it told at HELLO
+    uint32_t num_received;              // IDs we keep, as we told at HELLO
+    std::vector<std::string> sent;      // names the other side knows by ID; changed by the thread holding the sends
+    std::vector<std::string> received;  // names the other side spelled out; changed by the receiving thread only
+};
+
+template <class T>
+MessageChannel::SharedRef<T>::SharedRef(const SharedRef &other) :
+        object(other.object) {
+    if (object)
+        __atomic_add_fetch(&object->refs, 1, __ATOMIC_RELAXED);
+}
+
+template <class T>
+MessageChannel::SharedRef<T> &MessageChannel::SharedRef<T>::operator=(const SharedRef &other) {
+    if (other.object)
+        __atomic_add_fetch(&other.object->refs, 1, __ATOMIC_RELAXED);
+    reset(other.object);
+    return *this;
+}
+
+template <class T>
+MessageChannel::SharedRef<T>::~SharedRef() {
+    reset(NULL);
+}
+
+/**
+ * @name    reset
+ * @param   next Already referenced on behalf of this SharedRef, or NULL
+ */
+template <class T>
+void MessageChannel::SharedRef<T>::reset(T *next) {
+    if (object && (__atomic_sub_fetch(&object->refs, 1, __ATOMIC_ACQ_REL) == 0))
+        delete object;
+    object = next;
+}
+
+template class MessageChannel::SharedRef<MessageChannel::Writer>;
+template class MessageChannel::SharedRef<MessageChannel::PeerIds>;
+
 MessageChannel::MessageChannel(int socket_fd) :
-        socket_fd(socket_fd) {
+        socket_fd(socket_fd), hello_flags(0), seqpacket(false), send_version(WIRE_VERSION_1), receive_version(WIRE_VERSION_1),
+        multiplexed(false) {
 }
 
 MessageChannel::~MessageChannel() {
@@ -30,40 +159,33 @@ MessageChannel::~MessageChannel() {
 /**
  * @name    connectToMessageHub
  * @brief   Connect to the central message hub; the hub must be already running before you call this function
+ * @param   address Where the hub listens, see HubAddress; NULL or empty means the default address
  * @return  True on successful connection, False otherwise
  */
-bool MessageChannel::connectToMessageHub() {
+bool MessageChannel::connectToMessageHub(const char *address) {
 
     // in case this is a re-connection attempt - close old connection
     if (socket_fd != UNINITIALIZED_SOCKET_FD)
         close(socket_fd);
+    socket_fd = UNINITIALIZED_SOCKET_FD;
 
-    // get a socket filedescriptor
-    socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
-
-    // check socket for failure
-    if (socket_fd == UNINITIALIZED_SOCKET_FD) {
-        DEBUG_MSG("%s: socket(AF_UNIX, SOCK_STREAM, 0) failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+    HubAddress hub_address;
+    if (address && *address && !hub_address.parse(address))
         return false;
-    }
 
-    DEBUG_MSG("%s: connecting to MessageHub socket: %s...", __FUNCTION__, MESSAGE_HUB_SOCKET_FILENAME);
-    sockaddr_un remote;
-    remote.sun_family = AF_UNIX;
-    strncpy(remote.sun_path, MESSAGE_HUB_SOCKET_FILENAME, sizeof(remote.sun_path));
-    remote.sun_path[sizeof(remote.sun_path)-1] = '\0';
-    size_t length = strlen(remote.sun_path) + sizeof(remote.sun_family);
-    
-    if (connect(socket_fd, (sockaddr*) &remote, length) == -1) {
-        close(socket_fd);  // cleanup filedescriptor
-        socket_fd = UNINITIALIZED_SOCKET_FD; // status: uninitialized
-        DEBUG_MSG("%s: connect failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
-        return false;
-    }
-    DEBUG_MSG("%s: done.", __FUNCTION__);
+    socket_fd = hub_address.connectSocket();
+    setSeqpacket(hub_address.transport() == HubAddress::TRANSPORT_UNIX_SEQPACKET);
+    return (socket_fd != UNINITIALIZED_SOCKET_FD);
+}
 
-    // success
-    return true;
+/**
+ * @name    supportsDescriptorPassing
+ * @return  True if file descriptors can be sent over this channel (unix socket), False otherwise (tcp)
+ */
+bool MessageChannel::supportsDescriptorPassing() const {
+    int domain = 0;
+    socklen_t length = sizeof(domain);
+    return (getsockopt(socket_fd, SOL_SOCKET, SO_DOMAIN, &domain, &length) == 0) && (domain == AF_UNIX);
 }
 
 /**
@@ -76,6 +198,167 @@ void MessageChannel::shutDown() {
    socket_fd = UNINITIALIZED_SOCKET_FD;
 }
 
+/**
+ * @name    setSeqpacket
+ * @brief   Socket is SOCK_SEQPACKET; message fragments carry no header, so the channel serializes its sends to keep them together
+ */
+void MessageChannel::setSeqpacket(bool enable) {
+    seqpacket = enable;
+    if (seqpacket)
+        serializeSends();
+}
+
+/**
+ * @name    serializeSends
+ * @brief   Make this channel and its copies from now on take turns at the socket, so any thread may send over it:
+ *          a thread that finds the socket taken leaves a copy of its message for the thread sending, which sends it
+ *          before letting go. Nobody waits for the socket, except holdSends
+ * @note    Hub side and seqpacket; other channel that only one thread writes to needs none of it. No-op if serialized already
+ */
+void MessageChannel::serializeSends() {
+    if (!writer.get())
+        writer.reset(new Writer);
+}
+
+/**
+ * @name    shareSends
+ * @brief   Take turns with other channel over the same socket, eg. multiplexed channel with its connection; see serializeSends
+ */
+void MessageChannel::shareSends(const MessageChannel &other) {
+    writer = other.writer;
+    peer_ids = other.peer_ids;
+}
+
+/**
+ * @name    holdSends
+ * @brief   Take the socket for a series of messages; meanwhile messages sent by other threads wait in the backlog
+ *          and go out after the series, see releaseSends. Waits if other thread holds the socket
+ * @note    No-op without serializeSends; may be nested
+ */
+void MessageChannel::holdSends() const {
+    Writer *w = writer.get();
+    if (!w)
+        return;
+
+    PThreadLockGuard lock(w->mutex);
+    while (w->busy && !pthread_equal(w->owner, pthread_self()))
+        pthread_cond_wait(&w->idle, &w->mutex);
+    w->busy = true;
+    w->owner = pthread_self();
+    w->depth++;
+}
+
+/**
+ * @name    releaseSends
+ * @brief   Let go of the socket taken with holdSends, sending out the backlog first
+ */
+void MessageChannel::releaseSends() const {
+    leaveSend();
+}
+
+/**
+ * @name    holdsSends
+ * @return  True if the calling thread holds the socket, False otherwise or if sends are not serialized
+ * @note    Implementation detail
+ */
+bool MessageChannel::holdsSends() const {
+    Writer *w = writer.get();
+    if (!w)
+        return false;
+
+    PThreadLockGuard lock(w->mutex);
+    return w->busy && pthread_equal(w->owner, pthread_self());
+}
+
+/**
+ * @name    enterSend
+ * @return  True if the calling thread holds the socket now, False if other thread does
+ * @note    Implementation detail
+ */
+bool MessageChannel::enterSend() const {
+    Writer *w = writer.get();
+    if (!w)
+        return true;
+
+    PThreadLockGuard lock(w->mutex);
+    if (w->busy && !pthread_equal(w->owner, pthread_self()))
+        return false;
+    w->busy = true;
+    w->owner = pthread_self();
+    w->depth++;
+    return true;
+}
+
+/**
+ * @name    leaveSend
+ * @brief   Let go of the socket; the last one out sends the backlog first
+ * @note    Implementation detail
+ */
+void MessageChannel::leaveSend() const {
+    Writer *w = writer.get();
+    if (!w)
+        return;
+
+    PThreadLockGuard lock(w->mutex);
+    if (--w->depth > 0)
+        return;
+
+    while (!w->backlog.empty()) {
+        Writer::Deferred *deferred = w->backlog.front();
+        w->backlog.pop_front();
+        w->depth = 1;
+        pthread_mutex_unlock(&w->mutex);
+        Writer::send(*deferred);
+        delete deferred;
+        pthread_mutex_lock(&w->mutex);
+        w->depth = 0;
+    }
+    w->busy = false;
+    pthread_cond_broadcast(&w->idle);
+}
+
+/**
+ * @name    deferSend
+ * @brief   Other thread holds the socket; leave it a copy of the message, or send it now if it has let go meanwhile
+ * @return  True if the message was sent or left in the backlog, False otherwise
+ * @note    Implementation detail
+ */
+bool MessageChannel::deferSend(uint8_t kind, uint32_t envelope_id, uint32_t id, const char *buf, uint32_t size, const char *recipient,
+                               const char *enclosed_name, int passed_fd) const {
+    Writer::Deferred *deferred = new Writer::Deferred;
+    deferred->channel = *this;
+    deferred->kind = kind;
+    deferred->envelope_id = envelope_id;
+    deferred->id = id;
+    if (size > 0)
+        deferred->data.assign(buf, size);
+    deferred->recipient = recipient ? recipient : "";
+    deferred->enclosed_name = enclosed_name ? enclosed_name : "";
+    if ((passed_fd != UNINITIALIZED_SOCKET_FD) && ((deferred->passed_fd = fcntl(passed_fd, F_DUPFD_CLOEXEC, 0)) == -1)) {
+        ERROR_MSG("%s: fcntl failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+        deferred->passed_fd = UNINITIALIZED_SOCKET_FD;
+        delete deferred;
+        return false;
+    }
+
+    Writer *w = writer.get();
+    {
+        PThreadLockGuard lock(w->mutex);
+        if (w->busy) {
+            w->backlog.push_back(deferred);
+            return true;
+        }
+        w->busy = true;
+        w->owner = pthread_self();
+        w->depth = 1;
+    }
+
+    bool sent = Writer::send(*deferred);
+    delete deferred;
+    leaveSend();
+    return sent;
+}
+
 /**
  * @name    isConnected
  * @return  True if connected to the other communication endpoint
@@ -100,36 +383,602 @@ bool MessageChannel::send(uint32_t message_id, const char *data, uint32_t size,
         return false;
     }
 
+    // other thread is sending; it sends this one too
+    if (!enterSend())
+        return deferSend(Writer::SEND_MESSAGE, 0, message_id, data, size, recipient, NULL, UNINITIALIZED_SOCKET_FD);
+
     // send the message
-    if (!send_message(message_id, data, size, recipient)) {
-        DEBUG_MSG("%s: send_message failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+    bool sent = send_message(message_id, data, size, recipient, UNINITIALIZED_SOCKET_FD);
+    if (!sent)
+        ERROR_MSG("%s: send_message failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+
+    leaveSend();
+    return sent;
+}
+
+/**
+ * @name    setName
+ * @brief   Name the channel after the client on the other end
+ */
+void MessageChannel::setName(const std::string &name) {
+    channel_name = name;
+}
+
+/**
+ * @name    sendDescriptor
+ * @brief   Send a message over a socket along with a file descriptor (SCM_RIGHTS)
+ * @param   passed_fd File descriptor to be duplicated into the receiving process
+ * @return  True if send was successful, False otherwise
+ * @note    Only works over AF_UNIX sockets
+ */
+bool MessageChannel::sendDescriptor(uint32_t message_id, const char *data, uint32_t size, const char *recipient, int passed_fd) const {
+
+    // check connection
+    if (!isConnected()) {
+        DEBUG_MSG("%s: not connected to MessageHub", __FUNCTION__);
         return false;
     }
 
-    return true;
+    if (!enterSend())
+        return deferSend(Writer::SEND_MESSAGE, 0, message_id, data, size, recipient, NULL, passed_fd);
+
+    // send the message, the descriptor travels along with the header
+    bool sent = send_message(message_id, data, size, recipient, passed_fd);
+    if (!sent)
+        ERROR_MSG("%s: send_message failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+
+    leaveSend();
+    return sent;
 }
 
 /**
  * @name    send_message
  * @note    Implementation detail
  */
-bool MessageChannel::send_message(uint32_t id, const char *buf, uint32_t size, const char *recipient) const {
+bool MessageChannel::send_message(uint32_t id, const char *buf, uint32_t size, const char *recipient, int passed_fd) const {
+
+    // logical client gets its messages over the shared connection, in an envelope saying who they are for;
+    // descriptors go to real connections only
+    if (multiplexed) {
+        if (passed_fd != UNINITIALIZED_SOCKET_FD) {
+            errno = EINVAL;
+            return false;
+        }
+        return send_enveloped(ID_MUX_FORWARD, id, buf, size, recipient, channel_name.c_str());
+    }
+
+    Header header;
+    uint32_t header_size = encodeHeader(header.bytes, id, size, recipient);
+
+    // seqpacket: header and as much payload as fits go in the first packet, the rest of payload in following packets;
+    // packets are delivered in order and no other message comes in between while this thread holds the socket,
+    // so the fragments need no header of their own
+    if (seqpacket) {
+        assert(holdsSends());
+        uint32_t first_size = std::min(size, SEQPACKET_MAX_PACKET_SIZE - header_size);
+        iovec iov[2];
+        iov[0].iov_base = header.bytes;
+        iov[0].iov_len = header_size;
+        iov[1].iov_base = const_cast<char*>(buf);
+        iov[1].iov_len = first_size;
+        if (!send_packet(iov, 2, passed_fd))
+            return false;
+
+        for (uint32_t num_bytes_sent = first_size; num_bytes_sent < size; num_bytes_sent += iov[0].iov_len) {
+            iov[0].iov_base = const_cast<char*>(buf) + num_bytes_sent;
+            iov[0].iov_len = std::min(size - num_bytes_sent, SEQPACKET_MAX_PACKET_SIZE);
+            if (!send_packet(iov, 1, UNINITIALIZED_SOCKET_FD))
+                return false;
+        }
+        return true;
+    }
+
+    if (passed_fd != UNINITIALIZED_SOCKET_FD) {
+        if (!send_buffer_with_descriptor(header.bytes, header_size, passed_fd))
+            return false;
+    }
+    else if (!send_buffer(header.bytes, header_size))
+        return false;
+
+    if (!send_buffer(buf, size))
+        return false;
+
+    return true;
+}
+
+/**
+ * @name    sendInEnvelope
+ * @brief   Send envelope_id message with ENVELOPE_SIZE bytes of envelope, carrying the original message ID and enclosed_name,
+ *          in front of the payload; the payload is not copied
+ * @return  True if send was successful, False otherwise
+ */
+bool MessageChannel::sendInEnvelope(uint32_t envelope_id, uint32_t id, const char *data, uint32_t size, const char *recipient, const char *enclosed_name) const {
+
+    // check connection
+    if (!isConnected()) {
+        DEBUG_MSG("%s: not connected to MessageHub", __FUNCTION__);
+        return false;
+    }
+
+    if (!enterSend())
+        return deferSend(Writer::SEND_ENVELOPED, envelope_id, id, data, size, recipient, enclosed_name, UNINITIALIZED_SOCKET_FD);
+
+    // send the message
+    bool sent = send_enveloped(envelope_id, id, data, size, recipient, enclosed_name);
+    if (!sent)
+        ERROR_MSG("%s: send_enveloped failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+
+    leaveSend();
+    return sent;
+}
+
+/**
+ * @name    packEnvelope
+ * @param   envelope ENVELOPE_SIZE bytes
+ */
+void MessageChannel::packEnvelope(char *envelope, uint32_t id, const char *enclosed_name) {
+    memset(envelope, 0, ENVELOPE_SIZE);
+    memcpy(envelope, &id, sizeof(id));
+    strncpy(envelope + sizeof(id), enclosed_name, MAX_CLIENT_NAME_LENGTH);
+}
+
+/**
+ * @name    openEnvelope
+ * @brief   Take the envelope off; data and size are adjusted to point at the original message
+ * @return  True on success, False if the envelope is malformed
+ */
+bool MessageChannel::openEnvelope(char *&data, uint32_t &size, uint32_t &id, std::string &enclosed_name) {
+    if (size < ENVELOPE_SIZE)
+        return false;
+
+    memcpy(&id, data, sizeof(id));
+    const char *name = data + sizeof(id);
+    enclosed_name.assign(name, strnlen(name, MAX_CLIENT_NAME_LENGTH));
+    data += ENVELOPE_SIZE;
+    size -= ENVELOPE_SIZE;
+    return true;
+}
+
+/**
+ * @name    send_enveloped
+ * @note    Implementation detail
+ */
+bool MessageChannel::send_enveloped(uint32_t envelope_id, uint32_t id, const char *buf, uint32_t size, const char *recipient, const char *enclosed_name) const {
+    if (size > MESSAGE_BUFF_SIZE - ENVELOPE_SIZE) {
+        errno = EMSGSIZE;
+        return false;
+    }
+
+    Header header;
+    uint32_t header_size = encodeHeader(header.bytes, envelope_id, ENVELOPE_SIZE + size, recipient);
+
+    char envelope[ENVELOPE_SIZE];
+    packEnvelope(envelope, id, enclosed_name);
+
+    iovec iov[3];
+    iov[0].iov_base = header.bytes;
+    iov[0].iov_len = header_size;
+    iov[1].iov_base = envelope;
+    iov[1].iov_len = sizeof(envelope);
+    iov[2].iov_base = const_cast<char*>(buf);
+    iov[2].iov_len = size;
+    return sendVectored(iov, 3);
+}
+
+/**
+ * @name    encodeHeader
+ * @brief   Put message header in the channel's outgoing wire protocol version into header_buffer.
+ *          v2: the recipient goes by its ID in the table of the connection; the name is spelled out along
+ *          the first time, and again whenever the ID passes to other name. The table is direct mapped by name hash,
+ *          so it never holds more than the other side keeps
+ * @param   header_buffer At least MAX_HEADER_SIZE bytes
+ * @return  Header size in bytes
+ * @note    v2: headers must go out in the order encoded, so encode only as the single sender or holding the sends
+ */
+uint32_t MessageChannel::encodeHeader(char *header_buffer, uint32_t id, uint32_t size, const char *recipient) const {
+    if (send_version == WIRE_VERSION_1) {
+        MessageHeader header;
+        header.id = id;
+        header.size = size;
+        strncpy(header.recipient_name, recipient, sizeof(header.recipient_name));
+        header.recipient_name[sizeof(header.recipient_name)-1] = '\0';
+        memcpy(header_buffer, &header, sizeof(header));
+        return sizeof(header);
+    }
 
-    MessageHeader header;
+    MessageHeaderV2 header;
+    header.version = WIRE_VERSION_2;
+    header.flags = 0;
+    header.extension_size = 0;
     header.id = id;
     header.size = size;
-    strncpy(header.recipient_name, recipient, sizeof(header.recipient_name));
-    header.recipient_name[sizeof(header.recipient_name)-1] = '\0';
 
-    if (!send_buffer(reinterpret_cast<char*>(&header), sizeof(header)))
+    if (!*recipient)
+        header.peer_id = PEER_ID_NOBODY;
+    else if (strcmp(recipient, MBUS_ALL_CONNECTED_CLIENTS) == 0)
+        header.peer_id = PEER_ID_EVERYBODY;
+    else {
+        PeerIds *ids = peer_ids.get();
+        uint8_t length = strnlen(recipient, MAX_CLIENT_NAME_LENGTH);
+        uint32_t slot = fnv1a32(recipient, length) % ids->num_sent;
+        if (ids->sent.empty())
+            ids->sent.resize(ids->num_sent);
+        header.peer_id = PEER_ID_FIRST + slot;
+
+        // the other side doesn't know the name by this ID yet
+        std::string &known = ids->sent[slot];
+        if ((known.length() != length) || (memcmp(known.data(), recipient, length) != 0)) {
+            known.assign(recipient, length);
+            char *extension = header_buffer + sizeof(header);
+            extension[0] = EXTENSION_PEER_NAME;
+            extension[1] = length;
+            memcpy(extension + 2, recipient, length);
+            header.extension_size = 2 + length;
+        }
+    }
+
+    memcpy(header_buffer, &header, sizeof(header));
+    return sizeof(header) + header.extension_size;
+}
+
+/**
+ * @name    fixedHeaderSize
+ * @return  Header size without v2 extension fields
+ */
+uint32_t MessageChannel::fixedHeaderSize(uint8_t version) const {
+    return (version == WIRE_VERSION_2) ? sizeof(MessageHeaderV2) : sizeof(MessageHeader);
+}
+
+/**
+ * @name    headerSize
+ * @return  Size of encoded header including v2 extension fields
+ */
+uint32_t MessageChannel::headerSize(const Header &header) const {
+    return (send_version == WIRE_VERSION_2) ? sizeof(MessageHeaderV2) + header.v2.extension_size : sizeof(MessageHeader);
+}
+
+/**
+ * @name    decodeHeader
+ * @brief   Get message ID, payload size and peer name out of header received in the channel's incoming wire protocol version
+ * @param   extensions v2 extension fields, header.v2.extension_size bytes
+ * @return  True on success, False if v2 peer ID is out of the table or was never spelled out; the connection is broken then
+ */
+bool MessageChannel::decodeHeader(const Header &header, const char *extensions, uint32_t &id, uint32_t &size, std::string &recipient) const {
+    if (receive_version == WIRE_VERSION_1) {
+        id = header.v1.id;
+        size = header.v1.size;
+        recipient = header.v1.recipient_name;
+        return true;
+    }
+
+    id = header.v2.id;
+    size = header.v2.size;
+
+    uint32_t peer_id = header.v2.peer_id;
+    if (peer_id == PEER_ID_NOBODY) {
+        recipient.clear();
+        return true;
+    }
+    if (peer_id == PEER_ID_EVERYBODY) {
+        recipient = MBUS_ALL_CONNECTED_CLIENTS;
+        return true;
+    }
+
+    PeerIds *ids = peer_ids.get();
+    uint32_t slot = peer_id - PEER_ID_FIRST;
+    if ((peer_id < PEER_ID_FIRST) || (slot >= ids->num_received)) {
+        ERROR_MSG("%s: peer ID %u of message %u out of %u, %s", __FUNCTION__, peer_id, id, ids->num_received, channel_name.c_str());
         return false;
+    }
+    if (ids->received.empty())
+        ids->received.resize(ids->num_received);
 
-    if (!send_buffer(buf, size))
+    // name spelled out; the ID stands for it from now on
+    uint32_t extension_size = header.v2.extension_size;
+    for (uint32_t i = 0; i + 2 <= extension_size; i += 2 + (uint8_t)extensions[i + 1]) {
+        uint8_t type = extensions[i];
+        uint8_t length = extensions[i + 1];
+        if (i + 2 + length > extension_size)
+            break;
+
+        if ((type == EXTENSION_PEER_NAME) && (length > 0)) {
+            ids->received[slot].assign(extensions + i + 2, length);
+            break;
+        }
+    }
+
+    recipient = ids->received[slot];
+    if (recipient.empty()) {
+        ERROR_MSG("%s: peer ID %u of message %u was never named, %s", __FUNCTION__, peer_id, id, channel_name.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @name    setSendVersion
+ * @param   num_peer_ids v2: IDs the other side keeps, up to MAX_PEER_IDS
+ * @note    Before copies of the channel are made, so that they share the ID tables
+ */
+void MessageChannel::setSendVersion(uint8_t version, uint32_t num_peer_ids) {
+    send_version = version;
+    if (version == WIRE_VERSION_2) {
+        PeerIds &ids = peerIdTables();
+        ids.num_sent = std::max(1u, std::min(num_peer_ids, MAX_PEER_IDS));
+        ids.sent.clear();
+    }
+}
+
+/**
+ * @name    setReceiveVersion
+ * @param   num_peer_ids v2: IDs we keep, as told the other side; up to MAX_PEER_IDS
+ * @note    By the receiving thread
+ */
+void MessageChannel::setReceiveVersion(uint8_t version, uint32_t num_peer_ids) {
+    receive_version = version;
+    if (version == WIRE_VERSION_2) {
+        PeerIds &ids = peerIdTables();
+        ids.num_received = std::max(1u, std::min(num_peer_ids, MAX_PEER_IDS));
+        ids.received.clear();
+    }
+}
+
+/**
+ * @name    peerIdTables
+ * @note    Implementation detail
+ */
+MessageChannel::PeerIds &MessageChannel::peerIdTables() {
+    if (!peer_ids.get())
+        peer_ids.reset(new PeerIds);
+    return *peer_ids.get();
+}
+
+/**
+ * @name    peerIds
+ * @brief   v2 ID tables as the other side knows them, for other process to take the connection over; see setPeerIds
+ * @return  Table sizes, then ID, name length and name of every name received; empty without v2
+ * @note    Not while receiving
+ */
+std::string MessageChannel::peerIds() const {
+    std::string encoded;
+    PeerIds *ids = peer_ids.get();
+    if (!ids)
+        return encoded;
+
+    encoded.append((const char*)&ids->num_sent, sizeof(ids->num_sent));
+    encoded.append((const char*)&ids->num_received, sizeof(ids->num_received));
+    for (uint32_t slot = 0; slot < ids->received.size(); slot++) {
+        const std::string &name = ids->received[slot];
+        if (name.empty())
+            continue;
+
+        uint32_t peer_id = PEER_ID_FIRST + slot;
+        uint8_t length = name.length();
+        encoded.append((const char*)&peer_id, sizeof(peer_id));
+        encoded.append((const char*)&length, sizeof(length));
+        encoded.append(name);
+    }
+    return encoded;
+}
+
+/**
+ * @name    setPeerIds
+ * @brief   Take over v2 ID tables encoded by peerIds; names we sent are spelled out again
+ * @return  True on success, False if the encoding is broken
+ */
+bool MessageChannel::setPeerIds(const char *data, uint32_t size) {
+    uint32_t num_sent;
+    uint32_t num_received;
+    if (size < sizeof(num_sent) + sizeof(num_received))
+        return false;
+
+    memcpy(&num_sent, data, sizeof(num_sent));
+    memcpy(&num_received, data + sizeof(num_sent), sizeof(num_received));
+    if ((num_sent == 0) || (num_sent > MAX_PEER_IDS) || (num_received == 0) || (num_received > MAX_PEER_IDS))
+        return false;
+
+    PeerIds &ids = peerIdTables();
+    ids.num_sent = num_sent;
+    ids.num_received = num_received;
+    ids.sent.clear();
+    ids.received.assign(num_received, std::string());
+
+    uint32_t pos = sizeof(num_sent) + sizeof(num_received);
+    while (pos < size) {
+        uint32_t peer_id;
+        uint8_t length;
+        if (pos + sizeof(peer_id) + sizeof(length) > size)
+            return false;
+        memcpy(&peer_id, data + pos, sizeof(peer_id));
+        memcpy(&length, data + pos + sizeof(peer_id), sizeof(length));
+        pos += sizeof(peer_id) + sizeof(length);
+        if ((peer_id < PEER_ID_FIRST) || (peer_id - PEER_ID_FIRST >= num_received) || (pos + length > size))
+            return false;
+
+        ids.received[peer_id - PEER_ID_FIRST].assign(data + pos, length);
+        pos += length;
+    }
+    return true;
+}
+
+/**
+ * @name    sendVectored
+ * @brief   Send all the buffers in one go, usually many encoded messages at once
+ * @param   iov Buffers to send; modified in place as bytes go out
+ * @param   num_buffers_sent Optional; number of leading buffers that went out whole, also on failure.
+ *          Over SOCK_SEQPACKET counted at message boundaries
+ * @return  True if all bytes sent, False otherwise
+ */
+bool MessageChannel::sendVectored(iovec *iov, int iovcnt, int *num_buffers_sent) const {
+    int num_done = 0;
+    if (!num_buffers_sent)
+        num_buffers_sent = &num_done;
+    *num_buffers_sent = 0;
+
+    // check connection
+    if (!isConnected()) {
+        DEBUG_MSG("%s: not connected to MessageHub", __FUNCTION__);
         return false;
+    }
+
+    // other thread is sending; it sends these too, all or none
+    if (!enterSend()) {
+        std::string buffers;
+        for (int i = 0; i < iovcnt; i++)
+            buffers.append((const char*)iov[i].iov_base, iov[i].iov_len);
+        if (!deferSend(Writer::SEND_VECTORED, 0, 0, buffers.data(), buffers.size(), NULL, NULL, UNINITIALIZED_SOCKET_FD))
+            return false;
+        *num_buffers_sent = iovcnt;
+        return true;
+    }
+
+    bool sent = seqpacket ? send_vectored_packets(iov, iovcnt, num_buffers_sent) : send_vectored(iov, iovcnt, num_buffers_sent);
+    leaveSend();
+    return sent;
+}
+
+/**
+ * @name    send_vectored
+ * @note    Implementation detail
+ */
+bool MessageChannel::send_vectored(iovec *iov, int iovcnt, int *num_buffers_sent) const {
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+
+    while (iovcnt > 0) {
+        msg.msg_iov = iov;
+        msg.msg_iovlen = std::min(iovcnt, (int)IOV_MAX); // the rest goes in the next round
+        int num_bytes_sent = sendmsg(socket_fd, &msg, MSG_NOSIGNAL);
+        if (num_bytes_sent <= 0) {
+            ERROR_MSG("%s: sendmsg failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+            return false;
+        }
+
+        // skip what went out
+        while ((iovcnt > 0) && ((size_t)num_bytes_sent >= iov->iov_len)) {
+            num_bytes_sent -= iov->iov_len;
+            iov++;
+            iovcnt--;
+            (*num_buffers_sent)++;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char*)iov->iov_base + num_bytes_sent;
+            iov->iov_len -= num_bytes_sent;
+        }
+    }
 
     return true;
 }
 
+/**
+ * @name    send_vectored_packets
+ * @brief   Split the encoded messages back to back in iov into packets along message boundaries, see send_message
+ * @note    Implementation detail
+ */
+bool MessageChannel::send_vectored_packets(iovec *iov, int iovcnt, int *num_buffers_sent) const {
+    assert(holdsSends()); // fragments of one message must not interleave with another's, see send_message
+    std::vector<iovec> packet;
+    int index = 0;
+    size_t offset = 0;
+
+    // append next num_bytes of iov to the packet
+    auto take = [&](uint32_t num_bytes) -> bool {
+        while (num_bytes > 0) {
+            if (index == iovcnt)
+                return false;
+
+            size_t available = iov[index].iov_len - offset;
+            if (available == 0) {
+                index++;
+                offset = 0;
+                continue;
+            }
+
+            iovec part;
+            part.iov_base = (char*)iov[index].iov_base + offset;
+            part.iov_len = std::min(available, (size_t)num_bytes);
+            packet.push_back(part);
+            offset += part.iov_len;
+            num_bytes -= part.iov_len;
+        }
+        return true;
+    };
+
+    while (true) {
+        while ((index < iovcnt) && (offset == iov[index].iov_len)) {
+            index++;
+            offset = 0;
+        }
+        *num_buffers_sent = index;
+        if (index == iovcnt)
+            return true;
+
+        // header may be split between buffers; gather it to learn the payload size
+        packet.clear();
+        if (!take(fixedHeaderSize(send_version))) {
+            ERROR_MSG("%s: truncated message header", __FUNCTION__);
+            return false;
+        }
+
+        Header header;
+        char *header_bytes = header.bytes;
+        for (std::vector<iovec>::iterator it = packet.begin(); it != packet.end(); ++it) {
+            memcpy(header_bytes, it->iov_base, it->iov_len);
+            header_bytes += it->iov_len;
+        }
+
+        // v2 extension fields go in the first packet along with the header
+        if ((send_version == WIRE_VERSION_2) && !take(header.v2.extension_size))
+            return false;
+
+        uint32_t payload_size = (send_version == WIRE_VERSION_2) ? header.v2.size : header.v1.size;
+        uint32_t first_size = std::min(payload_size, SEQPACKET_MAX_PACKET_SIZE - headerSize(header));
+        if (!take(first_size) || !send_packet(&packet[0], packet.size(), UNINITIALIZED_SOCKET_FD))
+            return false;
+
+        for (uint32_t num_bytes_left = payload_size - first_size; num_bytes_left > 0; ) {
+            uint32_t fragment_size = std::min(num_bytes_left, SEQPACKET_MAX_PACKET_SIZE);
+            packet.clear();
+            if (!take(fragment_size) || !send_packet(&packet[0], packet.size(), UNINITIALIZED_SOCKET_FD))
+                return false;
+            num_bytes_left -= fragment_size;
+        }
+    }
+}
+
+/**
+ * @name    send_packet
+ * @brief   Send single SOCK_SEQPACKET packet, optionally with a file descriptor attached
+ * @note    Implementation detail
+ */
+bool MessageChannel::send_packet(iovec *iov, int iovcnt, int passed_fd) const {
+    char control[CMSG_SPACE(sizeof(int))];
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovcnt;
+
+    if (passed_fd != UNINITIALIZED_SOCKET_FD) {
+        memset(control, 0, sizeof(control));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &passed_fd, sizeof(int));
+    }
+
+    // packet goes out whole or not at all
+    int num_bytes_sent;
+    do {
+        num_bytes_sent = sendmsg(socket_fd, &msg, MSG_NOSIGNAL);
+    } while ((num_bytes_sent == -1) && (errno == EINTR));
+
+    return num_bytes_sent >= 0;
+}
+
 /**
  * @name    send_buffer
  * @note    Implementation detail
@@ -146,6 +995,40 @@ bool MessageChannel::send_buffer(const char *buf, uint32_t size) const {
     return (bytes_left == 0); // success if all bytes sent
 }
 
+/**
+ * @name    send_buffer_with_descriptor
+ * @brief   Send the buffer, attaching passed_fd to its first byte
+ * @note    Implementation detail
+ */
+bool MessageChannel::send_buffer_with_descriptor(const char *buf, uint32_t size, int passed_fd) const {
+    iovec iov;
+    iov.iov_base = const_cast<char*>(buf);
+    iov.iov_len = size;
+
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &passed_fd, sizeof(int));
+
+    int num_bytes_sent = sendmsg(socket_fd, &msg, MSG_NOSIGNAL);
+    if (num_bytes_sent <= 0)
+        return false;
+
+    // the descriptor went out with the first chunk; send the rest the usual way
+    return send_buffer(buf + num_bytes_sent, size - num_bytes_sent);
+}
+
 /**
  * @name    receive
  * @param   message_id ID of received message
@@ -163,8 +1046,36 @@ bool MessageChannel::receive(uint32_t &message_id, char* buf, uint32_t &size, st
     }
 
     // send the message
-    if (!receive_message(message_id, buf, size, recipient, max_size)) {
-        DEBUG_MSG("%s: receive_message terminated, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+    if (!receive_message(message_id, buf, size, recipient, NULL, max_size)) {
+        ERROR_MSG("%s: receive_message terminated, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @name    receive
+ * @param   passed_fd File descriptor sent along with the message or UNINITIALIZED_SOCKET_FD if there was none
+ * @return  True on success, False on error
+ * @note    The caller takes ownership of passed_fd
+ */
+bool MessageChannel::receive(uint32_t &message_id, char* buf, uint32_t &size, std::string &recipient, int &passed_fd, uint32_t max_size) const {
+
+    passed_fd = UNINITIALIZED_SOCKET_FD;
+
+    // check connection
+    if (!isConnected()) {
+        DEBUG_MSG("%s: Not connected to MessageHub", __FUNCTION__);
+        return false;
+    }
+
+    // receive the message
+    if (!receive_message(message_id, buf, size, recipient, &passed_fd, max_size)) {
+        ERROR_MSG("%s: receive_message terminated, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+        if (passed_fd != UNINITIALIZED_SOCKET_FD)
+            close(passed_fd);
+        passed_fd = UNINITIALIZED_SOCKET_FD;
         return false;
     }
 
@@ -176,18 +1087,35 @@ bool MessageChannel::receive(uint32_t &message_id, char* buf, uint32_t &size, st
  * @param   max_size    Maximum number of bytes that can fit into the buffer
  * @note    Implementation detail
  */
-bool MessageChannel::receive_message(uint32_t &id, char* buf, uint32_t &size, std::string &recipient, uint32_t max_size) const {
-    MessageHeader header;
+bool MessageChannel::receive_message(uint32_t &id, char* buf, uint32_t &size, std::string &recipient, int *passed_fd, uint32_t max_size) const {
+    if (seqpacket)
+        return receive_packets(id, buf, size, recipient, passed_fd, max_size);
 
-    if (!receive_buffer(reinterpret_cast<char*>(&header), sizeof(header)))
+    Header header;
+    uint32_t header_size = fixedHeaderSize(receive_version);
+
+    if (passed_fd) {
+        if (!receive_buffer_with_descriptor(header.bytes, header_size, *passed_fd))
+            return false;
+    }
+    else if (!receive_buffer(header.bytes, header_size))
         return false;
 
-    id = header.id;
-    size = header.size;
-    recipient = header.recipient_name;
+    char extensions[MAX_EXTENSIONS_SIZE];
+    if (receive_version == WIRE_VERSION_2) {
+        if ((header.v2.version != WIRE_VERSION_2) || (header.v2.extension_size > MAX_EXTENSIONS_SIZE)) {
+            ERROR_MSG("%s: malformed v2 header, version %u, extensions %u", __FUNCTION__, header.v2.version, header.v2.extension_size);
+            return false;
+        }
+        if (!receive_buffer(extensions, header.v2.extension_size))
+            return false;
+    }
+
+    if (!decodeHeader(header, extensions, id, size, recipient))
+        return false;
 
     if (size > max_size) {
-        DEBUG_MSG("Too big message received, id: %d, size: %d (max %d), %s -> %s", id, size, max_size, channel_name.c_str(), recipient.c_str());
+        ERROR_MSG("Too big message received, id: %d, size: %d (max %d), %s -> %s", id, size, max_size, channel_name.c_str(), recipient.c_str());
         return false;
     }
 
@@ -197,6 +1125,79 @@ bool MessageChannel::receive_message(uint32_t &id, char* buf, uint32_t &size, st
     return true;
 }
 
+/**
+ * @name    receive_packets
+ * @brief   Receive header and first part of the payload with single call, then the fragments if any; see send_message
+ * @note    Implementation detail
+ */
+bool MessageChannel::receive_packets(uint32_t &id, char* buf, uint32_t &size, std::string &recipient, int *passed_fd, uint32_t max_size) const {
+    Header header;
+    uint32_t header_size = fixedHeaderSize(receive_version);
+    iovec iov[2];
+    iov[0].iov_base = header.bytes;
+    iov[0].iov_len = header_size;
+    iov[1].iov_base = buf;
+    iov[1].iov_len = max_size;
+
+    char control[CMSG_SPACE(sizeof(int))];
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    if (passed_fd) {
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+    }
+
+    int num_bytes_received;
+    do {
+        num_bytes_received = recvmsg(socket_fd, &msg, MSG_CMSG_CLOEXEC);
+    } while ((num_bytes_received == -1) && (errno == EINTR));
+
+    if (passed_fd)
+        for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+            if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS))
+                memcpy(passed_fd, CMSG_DATA(cmsg), sizeof(int));
+
+    if (num_bytes_received < (int)header_size)
+        return false;
+    uint32_t num_payload_bytes = num_bytes_received - header_size;
+
+    // v2 extension fields landed in front of the payload; take them out of the way
+    char extensions[MAX_EXTENSIONS_SIZE];
+    if (receive_version == WIRE_VERSION_2) {
+        uint32_t extension_size = header.v2.extension_size;
+        if ((header.v2.version != WIRE_VERSION_2) || (extension_size > MAX_EXTENSIONS_SIZE) || (extension_size > num_payload_bytes)) {
+            ERROR_MSG("%s: malformed v2 header, version %u, extensions %u", __FUNCTION__, header.v2.version, extension_size);
+            return false;
+        }
+        if (extension_size) {
+            memcpy(extensions, buf, extension_size);
+            num_payload_bytes -= extension_size;
+            memmove(buf, buf + extension_size, num_payload_bytes);
+        }
+    }
+
+    if (!decodeHeader(header, extensions, id, size, recipient))
+        return false;
+
+    if ((size > max_size) || (msg.msg_flags & MSG_TRUNC)) {
+        ERROR_MSG("Too big message received, id: %d, size: %d (max %d), %s -> %s", id, size, max_size, channel_name.c_str(), recipient.c_str());
+        return false;
+    }
+
+    // fragments
+    uint32_t num_bytes_left = size - std::min(size, num_payload_bytes);
+    while (num_bytes_left > 0) {
+        num_bytes_received = recv(socket_fd, buf + size - num_bytes_left, num_bytes_left, 0);
+        if (num_bytes_received <= 0)
+            return false;
+        num_bytes_left -= num_bytes_received;
+    }
+
+    return true;
+}
+
 /**
  * @name    receive_buffer
  * @note    Implementation detail
@@ -211,3 +1212,251 @@ bool MessageChannel::receive_buffer(char* buf, uint32_t size) const {
 
     return (num_bytes_left == 0);
 }
+
+/**
+ * @name    receive_buffer_with_descriptor
+ * @brief   Receive the buffer, picking up a file descriptor that might be attached to it
+ * @note    Implementation detail
+ */
+bool MessageChannel::receive_buffer_with_descriptor(char* buf, uint32_t size, int &passed_fd) const {
+    uint32_t num_bytes_left = size;
+    int num_bytes_received;
+
+    do {
+        iovec iov;
+        iov.iov_base = buf;
+        iov.iov_len = num_bytes_left;
+
+        char control[CMSG_SPACE(sizeof(int))];
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        num_bytes_received = recvmsg(socket_fd, &msg, MSG_CMSG_CLOEXEC);
+        if (num_bytes_received <= 0)
+            break;
+
+        for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+            if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS))
+                memcpy(&passed_fd, CMSG_DATA(cmsg), sizeof(int));
+
+        num_bytes_left -= num_bytes_received;
+        buf += num_bytes_received;
+    } while (num_bytes_left > 0);
+
+    return (num_bytes_left == 0);
+}
+
+/**
+ * @name    setNonblocking
+ * @brief   Switch the socket into O_NONBLOCK mode; use with receiveNonblocking/sendNonblocking
+ * @return  True on success, False otherwise
+ */
+bool MessageChannel::setNonblocking() const {
+    int flags = fcntl(socket_fd, F_GETFL, 0);
+    if ((flags == -1) || (fcntl(socket_fd, F_SETFL, flags | O_NONBLOCK) == -1)) {
+        ERROR_MSG("%s: fcntl failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @name    readable
+ * @return  True if receive wouldn't block right now (data arrived or the connection is closed), False otherwise
+ */
+bool MessageChannel::readable() const {
+    pollfd pfd;
+    pfd.fd = socket_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    return poll(&pfd, 1, 0) > 0;
+}
+
+/**
+ * @name    hasInput
+ * @return  Same as readable, with a peek at the socket instead of poll; cheaper to call over and over while busy polling
+ */
+bool MessageChannel::hasInput() const {
+    char byte;
+    if (recv(socket_fd, &byte, sizeof(byte), MSG_PEEK | MSG_DONTWAIT) >= 0)
+        return true; // data, or 0 for closed connection
+
+    return (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR); // error; receive reports it
+}
+
+/**
+ * @name    receiveNonblocking
+ * @brief   Continue receiving the message described by progress with as many bytes as the socket has right now
+ * @param   progress Partially received message; reset automatically when the next message starts
+ * @return  RECEIVE_COMPLETE if the whole message is in progress, RECEIVE_INCOMPLETE if the socket ran dry,
+ *          RECEIVE_FAILED on error or when the other side closed the connection
+ * @note    Payload gets an extra '\0' byte past its end
+ */
+MessageChannel::ReceiveStatus MessageChannel::receiveNonblocking(ReceiveProgress &progress, uint32_t max_size) const {
+
+    // previous message already handed out; start a new one
+    if ((progress.header_bytes == sizeof(MessageHeader)) && (progress.payload_bytes == progress.header.size)) {
+        progress.header_bytes = 0;
+        progress.payload_bytes = 0;
+    }
+
+    // 1. header; a descriptor may come along with it
+    while (progress.header_bytes < sizeof(MessageHeader)) {
+        iovec iov;
+        iov.iov_base = reinterpret_cast<char*>(&progress.header) + progress.header_bytes;
+        iov.iov_len = sizeof(MessageHeader) - progress.header_bytes;
+
+        char control[CMSG_SPACE(sizeof(int))];
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        int num_bytes_received = recvmsg(socket_fd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+        if (num_bytes_received == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+            return RECEIVE_INCOMPLETE;
+        if (num_bytes_received <= 0)
+            return RECEIVE_FAILED;
+
+        for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+            if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS)) {
+                if (progress.passed_fd != UNINITIALIZED_SOCKET_FD)
+                    close(progress.passed_fd); // nobody took the previous one
+                memcpy(&progress.passed_fd, CMSG_DATA(cmsg), sizeof(int));
+            }
+
+        progress.header_bytes += num_bytes_received;
+        if (progress.header_bytes == sizeof(MessageHeader)) {
+            if (progress.header.size > max_size) {
+                ERROR_MSG("Too big message received, id: %d, size: %d (max %d), %s", progress.header.id, progress.header.size, max_size, channel_name.c_str());
+                return RECEIVE_FAILED;
+            }
+            if (progress.payload.size() < progress.header.size + 1)
+                progress.payload.resize(progress.header.size + 1);
+        }
+    }
+
+    // 2. payload
+    while (progress.payload_bytes < progress.header.size) {
+        int num_bytes_received = recv(socket_fd, &progress.payload[progress.payload_bytes], progress.header.size - progress.payload_bytes, MSG_DONTWAIT);
+        if (num_bytes_received == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+            return RECEIVE_INCOMPLETE;
+        if (num_bytes_received <= 0)
+            return RECEIVE_FAILED;
+
+        progress.payload_bytes += num_bytes_received;
+    }
+
+    progress.payload[progress.header.size] = '\0';
+    return RECEIVE_COMPLETE;
+}
+
+/**
+ * @name    sendNonblocking
+ * @brief   Send as much of the message as the socket takes right now and keep the rest in pending
+ * @param   pending Bytes not yet sent on this channel; must be flushed with flushNonblocking when socket becomes writable
+ * @return  True if the message was sent or queued, False on error
+ */
+bool MessageChannel::sendNonblocking(uint32_t id, const char *data, uint32_t size, const char *recipient, std::string &pending) const {
+
+    // check connection
+    if (!isConnected()) {
+        DEBUG_MSG("%s: not connected to MessageHub", __FUNCTION__);
+        return false;
+    }
+
+    Header header;
+    uint32_t header_size = encodeHeader(header.bytes, id, size, recipient);
+
+    // 1. something is already waiting; keep the order
+    if (!pending.empty()) {
+        pending.append(header.bytes, header_size);
+        pending.append(data, size);
+        return flushNonblocking(pending);
+    }
+
+    // 2. try to send header and payload in one go
+    iovec iov[2];
+    iov[0].iov_base = header.bytes;
+    iov[0].iov_len = header_size;
+    iov[1].iov_base = const_cast<char*>(data);
+    iov[1].iov_len = size;
+
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+
+    int num_bytes_sent = sendmsg(socket_fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (num_bytes_sent == -1) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            ERROR_MSG("%s: sendmsg failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+            return false;
+        }
+        num_bytes_sent = 0;
+    }
+
+    // 3. keep what didn't fit
+    uint32_t header_bytes_sent = std::min((uint32_t)num_bytes_sent, header_size);
+    uint32_t payload_bytes_sent = num_bytes_sent - header_bytes_sent;
+    pending.append(header.bytes + header_bytes_sent, header_size - header_bytes_sent);
+    pending.append(data + payload_bytes_sent, size - payload_bytes_sent);
+    return true;
+}
+
+/**
+ * @name    flushNonblocking
+ * @brief   Send as much of pending bytes as the socket takes right now
+ * @return  True if no error occurred (some bytes may still be pending), False on error
+ */
+bool MessageChannel::flushNonblocking(std::string &pending) const {
+    size_t num_bytes_flushed = 0;
+    while (num_bytes_flushed < pending.size()) {
+        int num_bytes_sent = ::send(socket_fd, pending.data() + num_bytes_flushed, pending.size() - num_bytes_flushed, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (num_bytes_sent == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                break;
+            ERROR_MSG("%s: send failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+            return false;
+        }
+        num_bytes_flushed += num_bytes_sent;
+    }
+
+    pending.erase(0, num_bytes_flushed);
+    return true;
+}
+
+MessageChannel::ReceiveProgress::ReceiveProgress() :
+        header_bytes(0), payload_bytes(0), payload(1), passed_fd(UNINITIALIZED_SOCKET_FD) {
+    header.id = 0;
+    header.size = 0;
+}
+
+MessageChannel::ReceiveProgress::~ReceiveProgress() {
+    if (passed_fd != UNINITIALIZED_SOCKET_FD)
+        close(passed_fd);
+}
+
+/**
+ * @name    recipient
+ * @return  Recipient name from the received header
+ */
+std::string MessageChannel::ReceiveProgress::recipient() const {
+    return std::string(header.recipient_name, strnlen(header.recipient_name, sizeof(header.recipient_name)));
+}
+
+/**
+ * @name    takeDescriptor
+ * @return  File descriptor that came along with the message or UNINITIALIZED_SOCKET_FD; the caller takes ownership
+ */
+int MessageChannel::ReceiveProgress::takeDescriptor() {
+    int fd = passed_fd;
+    passed_fd = UNINITIALIZED_SOCKET_FD;
+    return fd;
+}
@@ -9,7 +9,9 @@
 #define MESSAGE_BUS_IPC_LIB_SOURCE_MESSAGECHANNEL_H_
 
 #include <string>
+#include <vector>
 #include <stdint.h>
+#include <sys/uio.h>
 #include "MessageBusIpcCommon.h"
 
 namespace messagebusipc {
@@ -17,42 +19,199 @@ namespace messagebusipc {
 /**
  * @class   MessageChannel
  * @brief   A channel of communication; allows sending and receiving messages over provided socked file descriptor.
+ *          Over SOCK_SEQPACKET socket (setSeqpacket) a message up to SEQPACKET_MAX_PACKET_SIZE is sent as one packet
+ *          and received with one call; bigger payload continues in following packets, which carry no header of their own,
+ *          so one message must go out whole before the next starts: seqpacket channel always serializes its sends
+ *          Wire protocol v1 header carries the peer name, v2 header is shorter and carries 32 bit peer ID instead.
+ *          Peer IDs belong to the connection, one table each way: the sender spells the name out in extension field
+ *          the first time and whenever it gives the ID to other name, the receiver remembers it; an ID nobody spelled
+ *          out is an error. The receiver tells the sender at HELLO how many IDs it keeps, see setSendVersion.
+ *          Each direction switches to v2 separately, with ID_WIRE_VERSION_SWITCH as the last v1 message.
+ *          Multiplexed channel is a logical client sharing the connection of another; on the hub side messages sent to it
+ *          go in ID_MUX_FORWARD envelope naming it, see MessageClient::attachClient
+ *          Copies of a channel with serializeSends take turns at the socket; see holdSends
+ * @note    Nonblocking send/receive work over SOCK_STREAM and wire protocol v1 only
  */
 class MessageChannel {
 public:
+    class ReceiveProgress;
+    enum ReceiveStatus { RECEIVE_COMPLETE, RECEIVE_INCOMPLETE, RECEIVE_FAILED };
+
     MessageChannel(int socket_fd = UNINITIALIZED_SOCKET_FD);
     ~MessageChannel();
     bool operator==(const MessageChannel& second) const {
-        return socket_fd == second.socket_fd;
+        return (socket_fd == second.socket_fd) && (multiplexed == second.multiplexed) && (!multiplexed || (channel_name == second.channel_name));
     }
     bool operator!=(const MessageChannel& second) const {
-        return socket_fd != second.socket_fd;
+        return !(*this == second);
     }
 
-    bool connectToMessageHub();
+    bool connectToMessageHub(const char *address = NULL);
+    bool supportsDescriptorPassing() const;
     void shutDown();
     bool send(uint32_t id, const char *data, uint32_t size, const char *recipient) const;
+    bool sendDescriptor(uint32_t id, const char *data, uint32_t size, const char *recipient, int passed_fd) const;
     bool receive(uint32_t &id, char *data, uint32_t &size, std::string &recipient, uint32_t max_size = MESSAGE_BUFF_SIZE) const;
-    void setName(const std::string &name) { channel_name = name; }
+    bool receive(uint32_t &id, char *data, uint32_t &size, std::string &recipient, int &passed_fd, uint32_t max_size = MESSAGE_BUFF_SIZE) const;
+    ReceiveStatus receiveNonblocking(ReceiveProgress &progress, uint32_t max_size = MESSAGE_BUFF_SIZE) const;
+    bool sendNonblocking(uint32_t id, const char *data, uint32_t size, const char *recipient, std::string &pending) const;
+    bool flushNonblocking(std::string &pending) const;
+    bool setNonblocking() const;
+    bool sendVectored(iovec *iov, int iovcnt, int *num_buffers_sent = NULL) const;
+    uint32_t encodeHeader(char *header_buffer, uint32_t id, uint32_t size, const char *recipient) const;
+    bool sendInEnvelope(uint32_t envelope_id, uint32_t id, const char *data, uint32_t size, const char *recipient, const char *enclosed_name) const;
+    static void packEnvelope(char *envelope, uint32_t id, const char *enclosed_name);
+    static bool openEnvelope(char *&data, uint32_t &size, uint32_t &id, std::string &enclosed_name);
+    bool readable() const;
+    bool hasInput() const;
+    int fileDescriptor() const { return socket_fd; }
+    void setName(const std::string &name);
     const std::string &name() const { return channel_name; }
+    void setHelloFlags(uint32_t flags) { hello_flags = flags; }
+    uint32_t helloFlags() const { return hello_flags; }
+    void setSeqpacket(bool enable);
+    bool isSeqpacket() const { return seqpacket; }
+    void setSendVersion(uint8_t version, uint32_t num_peer_ids = PEER_IDS);
+    void setReceiveVersion(uint8_t version, uint32_t num_peer_ids = PEER_IDS);
+    std::string peerIds() const;
+    bool setPeerIds(const char *data, uint32_t size);
+    uint8_t sendVersion() const { return send_version; }
+    uint8_t receiveVersion() const { return receive_version; }
+    void setMultiplexed(bool enable) { multiplexed = enable; }
+    bool isMultiplexed() const { return multiplexed; }
+    void serializeSends();
+    void shareSends(const MessageChannel &other);
+    void holdSends() const;
+    void releaseSends() const;
+
+    // encodeHeader needs this much room
+    static const uint32_t MAX_HEADER_SIZE = 40;
+
+    // envelope put in front of the payload by sendInEnvelope: original message ID and a client name
+    static const uint32_t ENVELOPE_SIZE = sizeof(uint32_t) + MAX_CLIENT_NAME_LENGTH + 1;
+
+    // biggest packet sent over SOCK_SEQPACKET socket; must stay below the socket send buffer size
+    static const uint32_t SEQPACKET_MAX_PACKET_SIZE = 64 * 1024;
+
+    // v2 peer IDs the channel keeps for the other side by default and at most; "" and "*" have IDs of their own
+    static const uint32_t PEER_IDS = 256;
+    static const uint32_t MAX_PEER_IDS = 1024;
 
 private:
     int socket_fd;
     std::string channel_name;
+    uint32_t hello_flags; // what the client asked for when connecting, HELLO_FLAG_*
+    bool seqpacket;       // socket is SOCK_SEQPACKET, message boundaries are kept by the kernel
+    uint8_t send_version;     // WIRE_VERSION_* of outgoing messages
+    uint8_t receive_version;  // WIRE_VERSION_* of incoming messages
+    bool multiplexed;     // logical client on the connection of another, named by channel_name; hub side only
+
+    // state of the connection shared by copies of the channel; T has atomic refs, starting at 1
+    template <class T>
+    class SharedRef {
+    public:
+        SharedRef() : object(NULL) {}
+        SharedRef(const SharedRef &other);
+        SharedRef &operator=(const SharedRef &other);
+        ~SharedRef();
+        void reset(T *next);
+        T *get() const { return object; }
+
+    private:
+        T *object;
+    };
 
-    bool send_message(uint32_t id, const char *buf, uint32_t size, const char *recipient) const;
+    // writing thread of the socket and the messages other threads left for it, see serializeSends
+    struct Writer;
+    SharedRef<Writer> writer;
+
+    // v2 peer ID tables, see encodeHeader
+    struct PeerIds;
+    SharedRef<PeerIds> peer_ids;
+
+    bool holdsSends() const;
+    bool enterSend() const;
+    void leaveSend() const;
+    bool deferSend(uint8_t kind, uint32_t envelope_id, uint32_t id, const char *buf, uint32_t size, const char *recipient, const char *enclosed_name,
+                   int passed_fd) const;
+    PeerIds &peerIdTables();
+
+    // v2 extension fields follow the header as type, length, value; unknown types are skipped
+    static const uint8_t EXTENSION_PEER_NAME = 1; // name the peer ID of the header stands for from now on
+    static const uint32_t MAX_EXTENSIONS_SIZE = 1024;
+
+    // v2 peer IDs with fixed meaning; table IDs follow
+    static const uint32_t PEER_ID_NOBODY = 0;     // "", the hub itself and presence notifications
+    static const uint32_t PEER_ID_EVERYBODY = 1;  // MBUS_ALL_CONNECTED_CLIENTS
+    static const uint32_t PEER_ID_FIRST = 2;
+
+    union Header;
+    uint32_t headerSize(const Header &header) const;
+    uint32_t fixedHeaderSize(uint8_t version) const;
+    bool decodeHeader(const Header &header, const char *extensions, uint32_t &id, uint32_t &size, std::string &recipient) const;
+
+    bool send_message(uint32_t id, const char *buf, uint32_t size, const char *recipient, int passed_fd) const;
+    bool send_enveloped(uint32_t envelope_id, uint32_t id, const char *buf, uint32_t size, const char *recipient, const char *enclosed_name) const;
     bool send_buffer(const char *buf, uint32_t size) const;
+    bool send_buffer_with_descriptor(const char *buf, uint32_t size, int passed_fd) const;
 
-    bool receive_message(uint32_t &id, char* buf, uint32_t &size, std::string &recipient, uint32_t max_size) const;
+    bool receive_message(uint32_t &id, char* buf, uint32_t &size, std::string &recipient, int *passed_fd, uint32_t max_size) const;
     bool receive_buffer(char* buf, uint32_t size) const;
+    bool receive_buffer_with_descriptor(char* buf, uint32_t size, int &passed_fd) const;
+
+    bool send_packet(iovec *iov, int iovcnt, int passed_fd) const;
+    bool send_vectored(iovec *iov, int iovcnt, int *num_buffers_sent) const;
+    bool send_vectored_packets(iovec *iov, int iovcnt, int *num_buffers_sent) const;
+    bool receive_packets(uint32_t &id, char* buf, uint32_t &size, std::string &recipient, int *passed_fd, uint32_t max_size) const;
 
     bool isConnected() const;
 
     struct MessageHeader {
         uint32_t id;
         uint32_t size;
-        char     recipient_name[20]; // the name could be hashed into a number to improve performance later
+        char     recipient_name[MAX_CLIENT_NAME_LENGTH + 1]; // hub puts sender name here when delivering
     };
+
+    struct MessageHeaderV2 {
+        uint8_t  version;         // WIRE_VERSION_2
+        uint8_t  flags;           // none defined yet; ignored by receiver
+        uint16_t extension_size;  // bytes of extension fields between the header and the payload
+        uint32_t id;
+        uint32_t size;
+        uint32_t peer_id;         // PEER_ID_* or table ID of recipient name; hub puts sender ID here when delivering
+    };
+
+    union Header {
+        MessageHeader v1;
+        MessageHeaderV2 v2;
+        char bytes[MAX_HEADER_SIZE];
+    };
+};
+
+/**
+ * @class   ReceiveProgress
+ * @brief   Message being received piece by piece from a nonblocking socket; see MessageChannel::receiveNonblocking
+ */
+class MessageChannel::ReceiveProgress {
+public:
+    ReceiveProgress();
+    ~ReceiveProgress();
+    uint32_t id() const { return header.id; }
+    uint32_t size() const { return header.size; }
+    char *data() { return &payload[0]; }
+    std::string recipient() const;
+    int takeDescriptor();
+
+private:
+    friend class MessageChannel;
+    MessageHeader header;
+    uint32_t header_bytes;
+    uint32_t payload_bytes;
+    std::vector<char> payload; // keeps its capacity between messages
+    int passed_fd;
+
+    ReceiveProgress(const ReceiveProgress&);
+    ReceiveProgress& operator=(const ReceiveProgress&);
 };
 
 }
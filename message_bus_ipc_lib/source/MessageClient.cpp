@@ -11,9 +11,15 @@
 #include <unistd.h>
 #include <errno.h>
 #include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <algorithm>
 #include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
 #include "MessageBusIpcCommon.h"
 #include "MessageChannel.h"
+#include "HubAddress.h"
 #include "MessageClient.h"
 
 
@@ -22,23 +28,72 @@ using namespace messagebusipc;
 
 MessageClient::MessageClient() {
     pthread_mutex_init(&send_mutex, NULL);
+    pthread_mutex_init(&drain_mutex, NULL);
+    pthread_mutex_init(&send_room_mutex, NULL);
+    pthread_cond_init(&send_room_cond, NULL);
+    send_room_waiters = 0;
+    pthread_mutex_init(&peer_changes_mutex, NULL);
+    num_peer_changes = 0;
     message_buffer = new char[MESSAGE_BUFF_SIZE];
     shutting_down = false;
+    epoll_fd = UNINITIALIZED_SOCKET_FD;
+    num_paused_channels = 0;
+    send_queue = NULL;
+    send_queue_open = false;
+    send_queue_users = 0;
+    send_queue_policy = SEND_QUEUE_BLOCK;
+    send_queue_length = 0;
+    send_queue_event_fd = UNINITIALIZED_SOCKET_FD;
+    has_sender_thread = false;
+    sender_thread_stopping = false;
+    hello_flags = 0;
+    prefer_seqpacket = false;
+    wire_version = WIRE_VERSION_2;
+    reconnect_seed = (unsigned)time(NULL) ^ (unsigned)getpid() ^ (unsigned)(uintptr_t)this;
 }
 
 MessageClient::~MessageClient() {
+    disableAsyncSend();
+    if (epoll_fd != UNINITIALIZED_SOCKET_FD)
+        close(epoll_fd);
+    for (std::map<std::string, AttachedClient*>::iterator it = attached_clients.begin(); it != attached_clients.end(); ++it)
+        delete it->second;
+    for (std::vector<AttachedClient*>::iterator it = detached_clients.begin(); it != detached_clients.end(); ++it)
+        delete *it;
     pthread_mutex_destroy(&send_mutex);
+    pthread_mutex_destroy(&drain_mutex);
+    pthread_cond_destroy(&send_room_cond);
+    pthread_mutex_destroy(&send_room_mutex);
+    pthread_mutex_destroy(&peer_changes_mutex);
     delete[] message_buffer;
 }
 
 /**
  * @name    waitForClient
  * @brief   Block current thread until given client becomes available
+ * @param   timeout_ms How long to wait at most; 0 just checks, WAIT_FOREVER waits without limit
+ * @return  True if the client is available, False on timeout
  */
-void MessageClient::waitForClient(const char *client_name) {
-    // could be based on synchronization primitives but lets keep things simple :)
-    while (!connected_clients.exists(client_name))
-        usleep (WAIT_CLIENT_DELAY_USECONDS);
+bool MessageClient::waitForClient(const char *client_name, int timeout_ms) {
+    return connected_clients.waitFor(client_name, timeout_ms);
+}
+
+/**
+ * @name    subscribePresence
+ * @brief   Get notified when clients join and leave the bus
+ * @note    Observer is called from the listener thread, or from dispatch() in nonblocking mode
+ */
+void MessageClient::subscribePresence(ClientPresenceObserver *observer) {
+    connected_clients.subscribe(observer);
+}
+
+/**
+ * @name    unsubscribePresence
+ * @brief   Stop the notifications; once this returns the observer is not called anymore and may be deleted
+ * @note    Waits for the observer calls in progress, so don't call it holding a lock the observer takes
+ */
+void MessageClient::unsubscribePresence(ClientPresenceObserver *observer) {
+    connected_clients.unsubscribe(observer);
 }
 
 /**
@@ -49,9 +104,537 @@ void MessageClient::waitForClient(const char *client_name) {
  * @note	Thread safe
  */
 bool MessageClient::send(uint32_t message_id, const void *data, uint32_t size, const char *client_name) {
+    if (enterSendQueue()) {
+        bool queued = enqueueSend(message_id, (const char*)data, size, client_name);
+        leaveSendQueue();
+        return queued;
+    }
+
     PThreadLockGuard lock(send_mutex); // only one thread can send at a time
 
-    return server_channel.send(message_id, (const char*)data, size, client_name);
+    return sendLocked(message_id, (const char*)data, size, client_name);
+}
+
+/**
+ * @name    sendLocked
+ * @brief   Send the message over direct peer channel if there is one, otherwise to the hub
+ * @note    send_mutex must be held
+ */
+bool MessageClient::sendLocked(uint32_t message_id, const char *data, uint32_t size, const char *client_name) {
+    applyPeerChangesLocked();
+
+    // direct channel to the recipient bypasses the hub
+    for (std::vector<MessageChannel>::iterator it = peer_channels.begin(); it != peer_channels.end(); ++it)
+        if (it->name() == client_name) {
+            if (sendOnChannel(*it, message_id, data, size, own_name.c_str())) // peer wants to know who's talking
+                return true;
+
+            // peer is gone; fall back to the hub. The listener or dispatch polls the socket, so it is the one to notice and clean up
+            DEBUG_MSG("%s: peer channel to %s broken", __FUNCTION__, client_name);
+            shutdown(it->fileDescriptor(), SHUT_RDWR);
+            break;
+        }
+
+    return sendOnChannel(server_channel, message_id, data, size, client_name);
+}
+
+/**
+ * @name    findPeerChannel
+ * @return  Direct channel to given client or NULL if there is none
+ * @note    send_mutex must be held
+ */
+MessageChannel *MessageClient::findPeerChannel(const char *client_name) {
+    for (std::vector<MessageChannel>::iterator it = peer_channels.begin(); it != peer_channels.end(); ++it)
+        if (it->name() == client_name)
+            return &(*it);
+
+    return NULL;
+}
+
+/**
+ * @name    enableAsyncSend
+ * @brief   From now on send() only puts the message into a lock-free queue and returns;
+ *          the queue is sent out in batches by a dedicated thread, by dispatch() in nonblocking mode,
+ *          or by whoever calls drainSendQueue()
+ * @param   capacity Maximum number of queued messages
+ * @param   policy What send() does when the queue is full
+ * @param   own_thread Start a dedicated sender thread; not needed in nonblocking mode
+ * @return  True on success, False otherwise
+ * @note    Safe while other threads send; sends already in progress finish the old way.
+ *          Enable/disable themselves from one thread at a time
+ */
+bool MessageClient::enableAsyncSend(unsigned capacity, SendQueueFullPolicy policy, bool own_thread) {
+    disableAsyncSend();
+
+    send_queue_event_fd = eventfd(0, EFD_CLOEXEC);
+    if (send_queue_event_fd == -1) {
+        ERROR_MSG("%s: eventfd failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+        send_queue_event_fd = UNINITIALIZED_SOCKET_FD;
+        return false;
+    }
+
+    send_queue_policy = policy;
+    send_queue_length = 0;
+    {
+        PThreadLockGuard drain_lock(drain_mutex);
+        send_queue = new LockfreeQueue<QueuedSend*>(capacity);
+    }
+
+    // event loop drains the queue when the eventfd fires
+    if (epoll_fd != UNINITIALIZED_SOCKET_FD) {
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = send_queue_event_fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, send_queue_event_fd, &event);
+    }
+
+    if (own_thread) {
+        sender_thread_stopping = false;
+        int return_code = pthread_create(&sender_thread, NULL, MessageClient::senderThreadFunc, (void*) this);
+        if (return_code) {
+            ERROR_MSG("%s: pthread_create failed with error code: %d", __FUNCTION__, return_code);
+            disableAsyncSend();
+            return false;
+        }
+        has_sender_thread = true;
+    }
+
+    __atomic_store_n(&send_queue_open, true, __ATOMIC_SEQ_CST); // producers go through the queue from now on
+    return true;
+}
+
+/**
+ * @name    disableAsyncSend
+ * @brief   Send out whatever is queued and go back to sending synchronously
+ * @note    Safe while other threads send: waits for the ones pushing to the queue right now to leave it;
+ *          messages sent synchronously meanwhile may overtake queued ones. Enable/disable from one thread at a time
+ */
+void MessageClient::disableAsyncSend() {
+    if (!send_queue)
+        return;
+
+    // 1. no new producers; the ones inside may wait for room, so keep draining until they leave
+    __atomic_store_n(&send_queue_open, false, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&send_queue_users, __ATOMIC_SEQ_CST) > 0)
+        if (drainSendQueue() == 0)
+            sched_yield();
+
+    // 2. nobody pushes anymore; stop the sender thread and send out the rest
+    if (has_sender_thread) {
+        sender_thread_stopping = true;
+        uint64_t wakeup = 1;
+        if (write(send_queue_event_fd, &wakeup, sizeof(wakeup)) != sizeof(wakeup))
+            ERROR_MSG("%s: eventfd write failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+        pthread_join(sender_thread, NULL);
+        has_sender_thread = false;
+    }
+
+    drainSendQueue();
+
+    // 3. drainers in other threads may still be at it
+    LockfreeQueue<QueuedSend*> *queue;
+    {
+        PThreadLockGuard drain_lock(drain_mutex);
+        queue = send_queue;
+        send_queue = NULL;
+    }
+    delete queue;
+    close(send_queue_event_fd); // also removes it from epoll_fd
+    send_queue_event_fd = UNINITIALIZED_SOCKET_FD;
+}
+
+/**
+ * @name    enterSendQueue
+ * @return  True if asynchronous send is on; the queue stays until leaveSendQueue then. False if it is off
+ */
+bool MessageClient::enterSendQueue() {
+    if (!__atomic_load_n(&send_queue_open, __ATOMIC_RELAXED))
+        return false;
+
+    // announce first, then look again; disableAsyncSend closes first, then looks for users
+    __atomic_add_fetch(&send_queue_users, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&send_queue_open, __ATOMIC_SEQ_CST))
+        return true;
+
+    leaveSendQueue();
+    return false;
+}
+
+/**
+ * @name    leaveSendQueue
+ * @brief   Done with the queue, see enterSendQueue
+ */
+void MessageClient::leaveSendQueue() {
+    __atomic_sub_fetch(&send_queue_users, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @name    enqueueSend
+ * @brief   Copy the message into the send queue
+ * @return  True if queued, False if the queue is full and the policy says so
+ */
+bool MessageClient::enqueueSend(uint32_t message_id, const char *data, uint32_t size, const char *client_name) {
+    QueuedSend *message = reinterpret_cast<QueuedSend*>(new char[sizeof(QueuedSend) + size]);
+    message->id = message_id;
+    message->size = size;
+    strncpy(message->recipient, client_name, sizeof(message->recipient));
+    message->recipient[sizeof(message->recipient)-1] = '\0';
+    memcpy(message->data(), data, size);
+
+    while (!send_queue->push(message)) {
+        switch (send_queue_policy) {
+        case SEND_QUEUE_FAIL:
+            delete[] reinterpret_cast<char*>(message);
+            return false;
+
+        case SEND_QUEUE_DROP_OLDEST: {
+            QueuedSend *oldest;
+            if (send_queue->pop(oldest)) {
+                __atomic_sub_fetch(&send_queue_length, 1, __ATOMIC_ACQ_REL);
+                delete[] reinterpret_cast<char*>(oldest);
+            }
+            break;
+        }
+
+        case SEND_QUEUE_BLOCK:
+        default:
+            waitForSendRoom();
+            break;
+        }
+    }
+
+    // wake the drainer only when the queue just became non empty
+    if (__atomic_fetch_add(&send_queue_length, 1, __ATOMIC_ACQ_REL) == 0) {
+        uint64_t wakeup = 1;
+        if (write(send_queue_event_fd, &wakeup, sizeof(wakeup)) != sizeof(wakeup))
+            ERROR_MSG("%s: eventfd write failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+    }
+
+    return true;
+}
+
+/**
+ * @name    waitForSendRoom
+ * @brief   Sleep until the drainer takes messages out of the full send queue
+ * @note    Returns right away if it already did. The caller retries the push; other producers may be faster
+ */
+void MessageClient::waitForSendRoom() {
+    PThreadLockGuard lock(send_room_mutex);
+
+    // announce first, then look; drainSendQueue takes first, then looks for waiters
+    __atomic_add_fetch(&send_room_waiters, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&send_queue_length, __ATOMIC_SEQ_CST) >= (int32_t)send_queue->capacity())
+        pthread_cond_wait(&send_room_cond, &send_room_mutex);
+    __atomic_sub_fetch(&send_room_waiters, 1, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * @name    drainSendQueue
+ * @brief   Send queued messages from the calling thread, in batches
+ * @param   max_messages Upper bound of messages sent in single call
+ * @return  Number of messages taken from the queue
+ * @note    Use it on shutdown to make sure nothing is left behind
+ */
+unsigned MessageClient::drainSendQueue(unsigned max_messages) {
+    PThreadLockGuard drain_lock(drain_mutex);
+    if (!send_queue)
+        return 0;
+
+    QueuedSend *batch[SEND_BATCH_SIZE];
+    unsigned num_drained = 0;
+    int32_t num_left;
+    do {
+        // 1. take a batch
+        unsigned count = 0;
+        while ((count < SEND_BATCH_SIZE) && (num_drained + count < max_messages) && send_queue->pop(batch[count]))
+            count++;
+
+        // 2. send it under single lock acquisition
+        if (count > 0) {
+            OutgoingMessage messages[SEND_BATCH_SIZE];
+            for (unsigned i = 0; i < count; i++) {
+                OutgoingMessage message = { batch[i]->id, batch[i]->data(), batch[i]->size, batch[i]->recipient };
+                messages[i] = message;
+            }
+
+            PThreadLockGuard lock(send_mutex);
+            sendBatchLocked(messages, count, NULL);
+        }
+
+        for (unsigned i = 0; i < count; i++)
+            delete[] reinterpret_cast<char*>(batch[i]);
+
+        num_drained += count;
+        num_left = __atomic_sub_fetch(&send_queue_length, count, __ATOMIC_SEQ_CST);
+        if ((count > 0) && (__atomic_load_n(&send_room_waiters, __ATOMIC_SEQ_CST) > 0)) {
+            PThreadLockGuard lock(send_room_mutex);
+            pthread_cond_broadcast(&send_room_cond);
+        }
+    } while ((num_left > 0) && (num_drained < max_messages));
+
+    return num_drained;
+}
+
+/**
+ * @name    sendBatch
+ * @brief   Send many messages at once: under single lock acquisition, and in blocking mode framed into a single vectored write
+ *          to the hub. Each message is delivered as if it was given to send(): over a peer channel if there is one
+ *          and through the send queue if enableAsyncSend is on
+ * @param   results Optional, count entries; set to what send() would return for each message
+ * @return  Number of messages sent
+ * @note    Thread safe
+ */
+unsigned MessageClient::sendBatch(const OutgoingMessage *messages, unsigned count, bool *results) {
+    if (enterSendQueue()) {
+        unsigned num_sent = 0;
+        for (unsigned i = 0; i < count; i++) {
+            bool sent = enqueueSend(messages[i].id, (const char*)messages[i].data, messages[i].size, messages[i].client_name);
+            if (results)
+                results[i] = sent;
+            num_sent += sent;
+        }
+        leaveSendQueue();
+        return num_sent;
+    }
+
+    PThreadLockGuard lock(send_mutex);
+
+    applyPeerChangesLocked();
+    return sendBatchLocked(messages, count, results);
+}
+
+/**
+ * @name    sendBatchLocked
+ * @brief   Send the messages; runs of messages for the hub go out in a single vectored write when in blocking mode
+ * @param   results Optional, count entries
+ * @return  Number of messages sent
+ * @note    send_mutex must be held
+ */
+unsigned MessageClient::sendBatchLocked(const OutgoingMessage *messages, unsigned count, bool *results) {
+    const uint32_t header_stride = MessageChannel::MAX_HEADER_SIZE;
+    batch_headers.resize(count * header_stride);
+    batch_iovecs.clear();
+    batch_run.clear();
+    unsigned num_sent = 0;
+
+    for (unsigned i = 0; i < count; i++) {
+        const OutgoingMessage &message = messages[i];
+
+        // peer channels and nonblocking mode take the regular path
+        if ((epoll_fd != UNINITIALIZED_SOCKET_FD) || findPeerChannel(message.client_name)) {
+            num_sent += flushBatchRunLocked(results);
+
+            bool sent = sendLocked(message.id, (const char*)message.data, message.size, message.client_name);
+            if (!sent)
+                ERROR_MSG("%s: send of %u to %s failed", __FUNCTION__, message.id, message.client_name);
+            if (results)
+                results[i] = sent;
+            num_sent += sent;
+            continue;
+        }
+
+        char *header = &batch_headers[i * header_stride];
+        iovec iov;
+        iov.iov_base = header;
+        iov.iov_len = server_channel.encodeHeader(header, message.id, message.size, message.client_name);
+        batch_iovecs.push_back(iov);
+        iov.iov_base = const_cast<void*>(message.data);
+        iov.iov_len = message.size;
+        batch_iovecs.push_back(iov);
+        batch_run.push_back(i);
+    }
+
+    return num_sent + flushBatchRunLocked(results);
+}
+
+/**
+ * @name    flushBatchRunLocked
+ * @brief   Write out the messages gathered in batch_iovecs; if the write breaks off, the messages that made it whole count as sent
+ * @return  Number of messages sent
+ * @note    send_mutex must be held
+ */
+unsigned MessageClient::flushBatchRunLocked(bool *results) {
+    if (batch_run.empty())
+        return 0;
+
+    int num_buffers_sent = 0;
+    bool all_sent = server_channel.sendVectored(&batch_iovecs[0], batch_iovecs.size(), &num_buffers_sent);
+    if (!all_sent)
+        ERROR_MSG("%s: sendVectored failed after %d of %d buffers", __FUNCTION__, num_buffers_sent, (int)batch_iovecs.size());
+
+    // every message is two buffers: header and payload
+    unsigned num_sent = all_sent ? batch_run.size() : num_buffers_sent / 2;
+    if (results)
+        for (size_t i = 0; i < batch_run.size(); i++)
+            results[batch_run[i]] = (i < num_sent);
+
+    batch_iovecs.clear();
+    batch_run.clear();
+    return num_sent;
+}
+
+/**
+ * @name    drainSendQueueEvent
+ * @brief   dispatch() part; drain the queue within the budget and come back later if there is more
+ */
+void MessageClient::drainSendQueueEvent(unsigned max_messages) {
+    uint64_t signaled;
+    if (read(send_queue_event_fd, &signaled, sizeof(signaled)) != sizeof(signaled))
+        return;
+
+    drainSendQueue(max_messages);
+
+    // budget exhausted; make sure the event loop comes back for the rest
+    if (__atomic_load_n(&send_queue_length, __ATOMIC_ACQUIRE) > 0) {
+        uint64_t wakeup = 1;
+        if (write(send_queue_event_fd, &wakeup, sizeof(wakeup)) != sizeof(wakeup))
+            ERROR_MSG("%s: eventfd write failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+    }
+}
+
+/**
+ * @name    senderThreadFunc
+ * @param   varg Holds MessageClient*
+ * @brief   Sleep until the send queue gets some messages, then send them
+ * @note    This is run in a dedicated thread
+ */
+void* MessageClient::senderThreadFunc(void* varg) {
+    MessageClient *client = (MessageClient*) varg;
+    uint64_t signaled;
+
+    while (!client->sender_thread_stopping) {
+        if (read(client->send_queue_event_fd, &signaled, sizeof(signaled)) != sizeof(signaled))
+            continue;
+
+        client->drainSendQueue();
+    }
+
+    return NULL;
+}
+
+/**
+ * @name    sendOnChannel
+ * @brief   Send the message either blocking or, in nonblocking mode, keeping what didn't fit for later flush
+ * @note    send_mutex must be held
+ */
+bool MessageClient::sendOnChannel(MessageChannel &channel, uint32_t message_id, const char *data, uint32_t size, const char *client_name) {
+    if (epoll_fd == UNINITIALIZED_SOCKET_FD)
+        return channel.send(message_id, data, size, client_name);
+
+    std::string &outgoing = channel_buffers[channel.fileDescriptor()].outgoing;
+    bool was_flushed = outgoing.empty();
+    if (!channel.sendNonblocking(message_id, data, size, client_name, outgoing))
+        return false;
+
+    // ask for EPOLLOUT so dispatch flushes the rest
+    if (was_flushed && !outgoing.empty())
+        watchWritable(channel.fileDescriptor(), true);
+    return true;
+}
+
+/**
+ * @name    requestPeerChannel
+ * @brief   Ask the hub to broker a direct channel to given client; once established, messages to that client bypass the hub
+ * @return  True if the request was sent, False otherwise
+ * @note    The channel is established asynchronously; ID_PEER_CHANNEL_ESTABLISHED is delivered to the callback when ready.
+ *          Broadcasts and client presence notifications always go through the hub.
+ *          If there are many clients of given name, only one of them is connected directly
+ */
+bool MessageClient::requestPeerChannel(const char *peer_name) {
+    PThreadLockGuard lock(send_mutex);
+
+    return sendOnChannel(server_channel, ID_CLIENT_REQUESTS_PEER_CHANNEL, peer_name, strlen(peer_name) + 1, "");
+}
+
+/**
+ * @name    hasPeerChannel
+ * @return  True if there is a direct channel to given client
+ * @note    Thread safe
+ */
+bool MessageClient::hasPeerChannel(const char *peer_name) {
+    PThreadLockGuard lock(send_mutex);
+
+    applyPeerChangesLocked();
+    for (std::vector<MessageChannel>::iterator it = peer_channels.begin(); it != peer_channels.end(); ++it)
+        if (it->name() == peer_name)
+            return true;
+
+    return false;
+}
+
+/**
+ * @name    enableSessionResume
+ * @brief   Ask the hub to keep messages addressed to this client for a while after the connection breaks
+ *          and deliver them when the client reconnects under the same name
+ * @note    Takes effect on the next connect
+ */
+void MessageClient::enableSessionResume(bool enable) {
+    if (enable)
+        hello_flags |= HELLO_FLAG_RESUME_SESSION;
+    else
+        hello_flags &= ~HELLO_FLAG_RESUME_SESSION;
+}
+
+/**
+ * @name    enableConsumerGroup
+ * @brief   Join the consumer group of this client's name: every message addressed to the name goes to one member of the group only,
+ *          picked by the hub according to MessageHubConfig::consumer_group_policy
+ * @note    Takes effect on the next connect
+ */
+void MessageClient::enableConsumerGroup(bool enable) {
+    if (enable)
+        hello_flags |= HELLO_FLAG_CONSUMER_GROUP;
+    else
+        hello_flags &= ~HELLO_FLAG_CONSUMER_GROUP;
+}
+
+/**
+ * @name    setBusyPoll
+ * @brief   Switch the listener thread to busy polling: spin for the next message before going to sleep,
+ *          and optionally pin it to a core. Zero spin_useconds switches back to plain blocking
+ * @note    Can be called any time from any thread; takes effect when the listener waits for the next message
+ */
+void MessageClient::setBusyPoll(const BusyPollConfig &config) {
+    __atomic_store_n(&busy_poll.spin_useconds, config.spin_useconds, __ATOMIC_RELAXED);
+    __atomic_store_n(&busy_poll.cpu, config.cpu, __ATOMIC_RELAXED);
+}
+
+/**
+ * @name    setHubAddress
+ * @brief   Connect to the hub at given address instead of the default one, eg. "tcp:127.0.0.1:5555" or "unix:@my_bus"; see HubAddress
+ * @note    Takes effect on the next connect. Peer channels are not available over tcp, messages go through the hub then
+ */
+void MessageClient::setHubAddress(const char *address) {
+    hub_address = address ? address : "";
+}
+
+/**
+ * @name    setSeqpacket
+ * @brief   Prefer SOCK_SEQPACKET connection to the hub, so most messages arrive with a single receive call;
+ *          falls back to the regular stream connection if the hub doesn't offer it (MessageHubConfig::seqpacket)
+ * @note    Takes effect on the next connect; unix addresses and blocking mode (initializeAndListen) only
+ */
+void MessageClient::setSeqpacket(bool enable) {
+    prefer_seqpacket = enable;
+}
+
+/**
+ * @name    setWireVersion
+ * @brief   Limit wire protocol version offered to the hub; WIRE_VERSION_1 keeps the full peer name in every message header
+ * @note    Takes effect on the next connect; nonblocking mode (connectNonblocking) always uses WIRE_VERSION_1
+ */
+void MessageClient::setWireVersion(uint8_t version) {
+    wire_version = version;
+}
+
+/**
+ * @name    setBusNamespace
+ * @brief   Connect to the hub serving given logical bus namespace; the hub is picked from hub_addresses by HubAddress::forNamespace,
+ *          so all clients of the namespace end up on the same hub as long as they are given the same list
+ * @note    Takes effect on the next connect
+ */
+void MessageClient::setBusNamespace(const std::string &bus_namespace, const std::vector<std::string> &hub_addresses) {
+    hub_address = HubAddress::forNamespace(bus_namespace, hub_addresses);
 }
 
 /**
@@ -67,9 +650,591 @@ void MessageClient::shutDown() {
  * @name   tryConnectToMessageHub
  */
 bool MessageClient::tryConnectToMessageHub(const char *client_name) {
-    // connect to message hub and introduce yourself rightafter
-    if (server_channel.connectToMessageHub())
-        return server_channel.send(ID_CLIENT_SAYS_HELLO, NULL, 0, client_name);
-    else
+    // connect to message hub and introduce yourself rightafter; no flags means empty payload like before.
+    // Seqpacket goes first if asked for and the hub offers it; nonblocking mode needs stream.
+    // Connecting may take long over tcp, so senders are not held up meanwhile: the channel is private until published below
+    MessageChannel channel;
+    bool connected = false;
+    if (prefer_seqpacket && (epoll_fd == UNINITIALIZED_SOCKET_FD)) {
+        HubAddress address;
+        HubAddress counterpart;
+        if ((hub_address.empty() || address.parse(hub_address)) && address.seqpacketCounterpart(counterpart))
+            connected = channel.connectToMessageHub(counterpart.toString().c_str());
+    }
+
+    if (!connected && !channel.connectToMessageHub(hub_address.c_str()))
+        return false;
+
+    // v2 is offered in blocking mode only, along with the number of peer IDs we keep; receiveNonblocking speaks v1
+    uint32_t hello[2] = { hello_flags, MessageChannel::PEER_IDS };
+    uint32_t hello_size = hello_flags ? sizeof(hello[0]) : 0;
+    if ((wire_version >= WIRE_VERSION_2) && (epoll_fd == UNINITIALIZED_SOCKET_FD)) {
+        hello[0] |= HELLO_FLAG_WIRE_V2;
+        hello_size = sizeof(hello);
+    }
+
+    bool introduced = channel.send(ID_CLIENT_SAYS_HELLO, hello_size ? (const char*)hello : NULL, hello_size, client_name);
+    if (!introduced) {
+        channel.shutDown();
         return false;
+    }
+
+    // nothing else is sent before the hub knows who we are, so the channel is published only now; attached clients go first
+    PThreadLockGuard lock(send_mutex);
+    own_name = client_name;
+    if (server_channel.fileDescriptor() != UNINITIALIZED_SOCKET_FD)
+        close(server_channel.fileDescriptor()); // re-connection; connectToMessageHub used to close the old connection
+    server_channel = channel;
+
+    // logical clients attached before connecting or on the previous connection
+    for (std::map<std::string, AttachedClient*>::iterator it = attached_clients.begin(); introduced && (it != attached_clients.end()); ++it)
+        introduced = sendAttachLocked(it->first, it->second->flags);
+
+    return introduced;
+}
+
+/**
+ * @name    attach
+ * @brief   attachClient part; the hub is told now if connected, otherwise on connect
+ */
+bool MessageClient::attach(const char *client_name, AttachedClient *client, uint32_t flags) {
+    PThreadLockGuard lock(send_mutex);
+
+    if ((strlen(client_name) > MAX_CLIENT_NAME_LENGTH) || (own_name == client_name) || attached_clients.count(client_name)) {
+        DEBUG_MSG("%s: can't attach %s", __FUNCTION__, client_name);
+        delete client;
+        return false;
+    }
+
+    client->flags = flags;
+    attached_clients[client_name] = client;
+
+    // failure means the connection is broken; reconnect attaches it
+    if (server_channel.fileDescriptor() != UNINITIALIZED_SOCKET_FD)
+        sendAttachLocked(client_name, flags);
+    return true;
+}
+
+/**
+ * @name    detachClient
+ * @brief   Remove logical client added with attachClient; the hub says goodbye on its behalf
+ * @return  True on success, False if no such client is attached
+ */
+bool MessageClient::detachClient(const char *client_name) {
+    PThreadLockGuard lock(send_mutex);
+
+    std::map<std::string, AttachedClient*>::iterator it = attached_clients.find(client_name);
+    if (it == attached_clients.end())
+        return false;
+
+    detached_clients.push_back(it->second);
+    attached_clients.erase(it);
+
+    if (server_channel.fileDescriptor() != UNINITIALIZED_SOCKET_FD)
+        sendOnChannel(server_channel, ID_CLIENT_DETACHES, client_name, strlen(client_name) + 1, "");
+    return true;
+}
+
+/**
+ * @name    sendAs
+ * @brief   Send message on behalf of attached logical client
+ * @param   attached_name Logical client added with attachClient
+ * @param   client_name Recipient, same as for send()
+ * @note    Thread safe. Goes straight to the hub, even with enableAsyncSend
+ */
+bool MessageClient::sendAs(const char *attached_name, uint32_t message_id, const void *data, uint32_t size, const char *client_name) {
+    PThreadLockGuard lock(send_mutex);
+
+    if (!attached_clients.count(attached_name)) {
+        DEBUG_MSG("%s: %s not attached", __FUNCTION__, attached_name);
+        return false;
+    }
+
+    if (epoll_fd == UNINITIALIZED_SOCKET_FD)
+        return server_channel.sendInEnvelope(ID_MUX_FORWARD, message_id, (const char*)data, size, client_name, attached_name);
+
+    // nonblocking send keeps what the socket doesn't take in one piece; envelope and payload go together
+    mux_buffer.resize(MessageChannel::ENVELOPE_SIZE + size);
+    MessageChannel::packEnvelope(&mux_buffer[0], message_id, attached_name);
+    memcpy(&mux_buffer[MessageChannel::ENVELOPE_SIZE], data, size);
+    return sendOnChannel(server_channel, ID_MUX_FORWARD, &mux_buffer[0], mux_buffer.size(), client_name);
+}
+
+/**
+ * @name    sendAttachLocked
+ * @brief   Tell the hub about attached logical client: hello flags followed by the name
+ * @note    send_mutex must be held
+ */
+bool MessageClient::sendAttachLocked(const std::string &client_name, uint32_t flags) {
+    char payload[sizeof(flags) + MAX_CLIENT_NAME_LENGTH + 1];
+    memcpy(payload, &flags, sizeof(flags));
+    memcpy(payload + sizeof(flags), client_name.c_str(), client_name.length() + 1);
+    return sendOnChannel(server_channel, ID_CLIENT_ATTACHES, payload, sizeof(flags) + client_name.length() + 1, "");
+}
+
+/**
+ * @name    deliverToAttached
+ * @brief   Take ID_MUX_FORWARD envelope off and pass the message to the logical client it is for
+ * @note    Called from the listener thread or dispatch() only
+ */
+void MessageClient::deliverToAttached(char *data, uint32_t size, const std::string &sender) {
+    uint32_t message_id;
+    if (!MessageChannel::openEnvelope(data, size, message_id, mux_name))
+        return;
+
+    AttachedClient *client = NULL;
+    {
+        PThreadLockGuard lock(send_mutex);
+
+        // the listener is the only one calling attached clients, and it is not in any of them now
+        for (std::vector<AttachedClient*>::iterator it = detached_clients.begin(); it != detached_clients.end(); ++it)
+            delete *it;
+        detached_clients.clear();
+
+        std::map<std::string, AttachedClient*>::iterator it = attached_clients.find(mux_name);
+        if (it != attached_clients.end())
+            client = it->second;
+    }
+
+    if (!client) {
+        DEBUG_MSG("%s: message %u for %s that is not attached", __FUNCTION__, message_id, mux_name.c_str());
+        return;
+    }
+
+    if (!client->handle(message_id, data, size, sender)) {
+        DEBUG_MSG("%s: %s callback returns false. Detach it", __FUNCTION__, mux_name.c_str());
+        detachClient(mux_name.c_str());
+    }
+}
+
+/**
+ * @name    sleepBeforeReconnect
+ * @brief   Sleep random time from [delay/2, delay] so many clients don't hit restarted hub all at once
+ * @return  Delay to use for the next attempt
+ */
+unsigned MessageClient::sleepBeforeReconnect(unsigned delay_useconds) {
+    unsigned half = delay_useconds / 2;
+    usleep(half + rand_r(&reconnect_seed) % (half + 1));
+
+    if (delay_useconds >= RECONNECT_MAX_DELAY_USECONDS / 2)
+        return RECONNECT_MAX_DELAY_USECONDS;
+    return delay_useconds * 2;
+}
+
+/**
+ * @name    handleInternalMessage
+ * @brief   Update client bookkeeping on IPC internal messages
+ * @param   data Message payload, with room for terminating '\0'
+ * @param   passed_fd File descriptor that came along with the message, if any
+ */
+void MessageClient::handleInternalMessage(uint32_t message_id, char *data, uint32_t message_size, int passed_fd) {
+    switch (message_id) {
+    case ID_CLIENT_SAYS_HELLO: {
+        data[message_size] = '\0';
+        connected_clients.add(data);
+        DEBUG_MSG("%s: client connected: %s. Now [%s]", __FUNCTION__, data, connected_clients.toString().c_str());
+        break;
+    }
+
+    case ID_CLIENT_SAYS_GOODBYE: {
+        data[message_size] = '\0';
+        connected_clients.remove(data);
+        DEBUG_MSG("%s: client disconnected: %s. Now [%s]", __FUNCTION__, data, connected_clients.toString().c_str());
+        break;
+    }
+
+    case ID_WIRE_VERSION_SWITCH: {
+        // the hub talks the new version from the next message on, with as many peer IDs as we told it at HELLO;
+        // answer in the old one and switch the other direction too, with as many peer IDs as the hub keeps
+        uint32_t version_switch[2] = { 0, 0 };
+        memcpy(version_switch, data, std::min<uint32_t>(message_size, sizeof(version_switch)));
+        if (version_switch[0] != WIRE_VERSION_2) {
+            ERROR_MSG("%s: hub switches to unknown wire version %u", __FUNCTION__, version_switch[0]);
+            break;
+        }
+
+        PThreadLockGuard lock(send_mutex);
+        server_channel.setReceiveVersion(WIRE_VERSION_2);
+        if (version_switch[1] == 0) {
+            ERROR_MSG("%s: hub keeps no peer IDs, sending in wire version 1", __FUNCTION__);
+            break;
+        }
+        if (!server_channel.send(ID_WIRE_VERSION_SWITCH, (const char*)version_switch, sizeof(version_switch[0]), ""))
+            ERROR_MSG("%s: wire version switch send failed", __FUNCTION__);
+        server_channel.setSendVersion(WIRE_VERSION_2, version_switch[1]);
+        break;
+    }
+
+    case ID_PEER_CHANNEL_ESTABLISHED: {
+        data[message_size] = '\0';
+        if (passed_fd == UNINITIALIZED_SOCKET_FD) {
+            DEBUG_MSG("%s: peer channel to %s came without socket", __FUNCTION__, data);
+            break;
+        }
+
+        MessageChannel peer(passed_fd);
+        peer.setName(data);
+        DEBUG_MSG("%s: peer channel established: %s", __FUNCTION__, data);
+        if (epoll_fd == UNINITIALIZED_SOCKET_FD) {
+            addListenedPeer(peer);
+            return;
+        }
+
+        // nonblocking mode never blocks holding send_mutex
+        PThreadLockGuard lock(send_mutex);
+        if (!registerNonblockingChannel(peer)) {
+            peer.shutDown();
+            return;
+        }
+        peer_channels.push_back(peer);
+        return;
+    }
+
+    default:
+        break;
+    }
+
+    // descriptor not expected for this message
+    if (passed_fd != UNINITIALIZED_SOCKET_FD)
+        close(passed_fd);
+}
+
+/**
+ * @name    addListenedPeer
+ * @brief   Listener part of ID_PEER_CHANNEL_ESTABLISHED: poll the new channel, and hand it to the senders
+ * @note    Called from the listener thread only
+ */
+void MessageClient::addListenedPeer(const MessageChannel &peer) {
+    pollfd pfd = { peer.fileDescriptor(), POLLIN, 0 };
+    listen_fds.push_back(pfd);
+
+    {
+        PThreadLockGuard lock(peer_changes_mutex);
+        added_peer_channels.push_back(peer);
+        __atomic_add_fetch(&num_peer_changes, 1, __ATOMIC_RELEASE);
+    }
+    tryApplyPeerChanges();
+}
+
+/**
+ * @name    dropListenedPeer
+ * @brief   Stop polling broken peer channel and have the senders close it; the socket stays open until then,
+ *          so its descriptor number can't be reused under a sender
+ * @param   index Position in listen_fds, not the hub's
+ * @note    Called from the listener thread only
+ */
+void MessageClient::dropListenedPeer(size_t index) {
+    int peer_fd = listen_fds[index].fd;
+    listen_fds.erase(listen_fds.begin() + index);
+    shutdown(peer_fd, SHUT_RDWR);
+
+    {
+        PThreadLockGuard lock(peer_changes_mutex);
+        broken_peer_fds.push_back(peer_fd);
+        __atomic_add_fetch(&num_peer_changes, 1, __ATOMIC_RELEASE);
+    }
+    tryApplyPeerChanges();
+}
+
+/**
+ * @name    tryApplyPeerChanges
+ * @brief   Apply the listener's peer channel changes right away if no sender holds send_mutex; otherwise the sender does
+ */
+void MessageClient::tryApplyPeerChanges() {
+    if (pthread_mutex_trylock(&send_mutex) != 0)
+        return;
+
+    applyPeerChangesLocked();
+    pthread_mutex_unlock(&send_mutex);
+}
+
+/**
+ * @name    applyPeerChangesLocked
+ * @brief   Take over peer channels the listener opened and close those it found broken
+ * @note    send_mutex must be held
+ */
+void MessageClient::applyPeerChangesLocked() {
+    if (__atomic_load_n(&num_peer_changes, __ATOMIC_ACQUIRE) == 0)
+        return;
+
+    PThreadLockGuard lock(peer_changes_mutex);
+    peer_channels.insert(peer_channels.end(), added_peer_channels.begin(), added_peer_channels.end());
+    added_peer_channels.clear();
+
+    for (std::vector<int>::iterator fd = broken_peer_fds.begin(); fd != broken_peer_fds.end(); ++fd)
+        for (std::vector<MessageChannel>::iterator it = peer_channels.begin(); it != peer_channels.end(); ++it)
+            if (it->fileDescriptor() == *fd) {
+                DEBUG_MSG("%s: peer channel closed: %s", __FUNCTION__, it->name().c_str());
+                it->shutDown();
+                peer_channels.erase(it);
+                break;
+            }
+    broken_peer_fds.clear();
+    __atomic_store_n(&num_peer_changes, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * @name    spinUntilReadable
+ * @brief   In busy poll mode spin until the hub or any peer channel in listen_fds has something to read, or the spin time is up
+ */
+void MessageClient::spinUntilReadable() {
+    listen_pinning.apply(__atomic_load_n(&busy_poll.cpu, __ATOMIC_RELAXED));
+    listen_spinner.configure(__atomic_load_n(&busy_poll.spin_useconds, __ATOMIC_RELAXED));
+    if (!listen_spinner.enabled())
+        return;
+
+    // each check is a syscall; back off between them
+    if (listen_fds.size() == 1) {
+        listen_spinner.spin([this] { return server_channel.hasInput(); }, AdaptiveSpinner::SYSCALL_MAX_PAUSES);
+        return;
+    }
+
+    std::vector<pollfd> spin_fds(listen_fds);
+    listen_spinner.spin([&spin_fds] { return poll(&spin_fds[0], spin_fds.size(), 0) > 0; }, AdaptiveSpinner::SYSCALL_MAX_PAUSES);
+}
+
+/**
+ * @name    removePeerChannel
+ * @brief   Close and forget the peer channel of given socket
+ * @note    Nonblocking mode; the listener thread uses dropListenedPeer
+ */
+void MessageClient::removePeerChannel(int peer_fd) {
+    PThreadLockGuard lock(send_mutex);
+
+    for (std::vector<MessageChannel>::iterator it = peer_channels.begin(); it != peer_channels.end(); ++it)
+        if (it->fileDescriptor() == peer_fd) {
+            DEBUG_MSG("%s: peer channel closed: %s", __FUNCTION__, it->name().c_str());
+            channel_buffers.erase(peer_fd);
+            it->shutDown();
+            peer_channels.erase(it);
+            return;
+        }
+}
+
+/**
+ * @name    closePeerChannels
+ * @brief   Close all peer channels; they only live as long as the connection to the hub
+ */
+void MessageClient::closePeerChannels() {
+    PThreadLockGuard lock(send_mutex);
+
+    applyPeerChangesLocked();
+    for (std::vector<MessageChannel>::iterator it = peer_channels.begin(); it != peer_channels.end(); ++it) {
+        channel_buffers.erase(it->fileDescriptor());
+        it->shutDown();
+    }
+    peer_channels.clear();
+}
+
+/**
+ * @name    connectNonblocking
+ * @brief   Connect to the hub for use with an external event loop instead of initializeAndListen:
+ *          wait for fileDescriptor() to become readable, then call dispatch()
+ * @return  True on success, False otherwise; it is up to the caller when to retry
+ * @note    Sending never blocks in this mode; what the socket doesn't take is kept and flushed by dispatch() or flush()
+ */
+bool MessageClient::connectNonblocking(const char *client_name) {
+    // in case this is a re-connection attempt
+    disconnectNonblocking();
+
+    if (epoll_fd == UNINITIALIZED_SOCKET_FD) {
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd == -1) {
+            ERROR_MSG("%s: epoll_create1 failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+            epoll_fd = UNINITIALIZED_SOCKET_FD;
+            return false;
+        }
+    }
+
+    if (!tryConnectToMessageHub(client_name))
+        return false;
+
+    PThreadLockGuard lock(send_mutex);
+    if (!registerNonblockingChannel(server_channel)) {
+        server_channel.shutDown();
+        return false;
+    }
+
+    // asynchronous send may have been enabled before the event loop existed
+    if (send_queue_event_fd != UNINITIALIZED_SOCKET_FD) {
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = send_queue_event_fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, send_queue_event_fd, &event); // EEXIST on reconnect is fine
+    }
+
+    return true;
+}
+
+/**
+ * @name    flush
+ * @brief   Send as much of pending outgoing bytes as the sockets take right now
+ * @return  True if everything has been sent, False if something is still pending
+ */
+bool MessageClient::flush() {
+    drainSendQueue();
+
+    PThreadLockGuard lock(send_mutex);
+
+    bool flushed = true;
+    for (std::map<int, ChannelBuffers>::iterator it = channel_buffers.begin(); it != channel_buffers.end(); ++it) {
+        std::string &outgoing = it->second.outgoing;
+        if (outgoing.empty())
+            continue;
+
+        MessageChannel(it->first).flushNonblocking(outgoing);
+        if (outgoing.empty())
+            watchWritable(it->first, false);
+        else
+            flushed = false;
+    }
+
+    return flushed;
+}
+
+/**
+ * @name    registerNonblockingChannel
+ * @brief   Make the channel nonblocking and watch it with epoll_fd
+ * @note    send_mutex must be held
+ */
+bool MessageClient::registerNonblockingChannel(const MessageChannel &channel) {
+    if (!channel.setNonblocking())
+        return false;
+
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = channel.fileDescriptor();
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, channel.fileDescriptor(), &event) == -1) {
+        ERROR_MSG("%s: epoll_ctl failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+        return false;
+    }
+
+    channel_buffers[channel.fileDescriptor()];
+    return true;
+}
+
+/**
+ * @name    watchWritable
+ * @brief   Turn on/off waiting for the socket to become writable; readable is waited for unless reading is paused
+ * @note    send_mutex must be held
+ */
+void MessageClient::watchWritable(int fd, bool writable) {
+    std::map<int, ChannelBuffers>::const_iterator it = channel_buffers.find(fd);
+    bool paused = (it != channel_buffers.end()) && it->second.paused;
+
+    epoll_event event;
+    event.events = (paused ? 0 : EPOLLIN) | (writable ? EPOLLOUT : 0);
+    event.data.fd = fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event);
+}
+
+/**
+ * @name    flushChannel
+ * @brief   Send pending outgoing bytes of given socket
+ * @return  False on socket error, True otherwise
+ */
+bool MessageClient::flushChannel(int fd) {
+    PThreadLockGuard lock(send_mutex);
+
+    std::map<int, ChannelBuffers>::iterator it = channel_buffers.find(fd);
+    if (it == channel_buffers.end())
+        return true;
+
+    std::string &outgoing = it->second.outgoing;
+    if (!MessageChannel(fd).flushNonblocking(outgoing))
+        return false;
+
+    if (outgoing.empty())
+        watchWritable(fd, false);
+    return true;
+}
+
+/**
+ * @name    findChannelBuffers
+ * @return  Buffers of given socket or NULL if the socket is not known
+ * @note    The returned incoming state is only to be used by the dispatching thread
+ */
+MessageClient::ChannelBuffers *MessageClient::findChannelBuffers(int fd) {
+    PThreadLockGuard lock(send_mutex);
+
+    std::map<int, ChannelBuffers>::iterator it = channel_buffers.find(fd);
+    if (it == channel_buffers.end())
+        return NULL;
+
+    return &it->second;
+}
+
+/**
+ * @name    pauseReading
+ * @brief   Stop waiting for the socket to become readable; its received message waits for the callback to take it
+ * @param   ready_fd Readable when the callback takes messages again; watched from now on
+ */
+void MessageClient::pauseReading(int fd, int ready_fd) {
+    PThreadLockGuard lock(send_mutex);
+
+    std::map<int, ChannelBuffers>::iterator it = channel_buffers.find(fd);
+    if (it == channel_buffers.end())
+        return;
+
+    it->second.paused = true;
+    num_paused_channels++;
+    watchWritable(fd, !it->second.outgoing.empty());
+
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = ready_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ready_fd, &event); // EEXIST after first pause is fine
+}
+
+/**
+ * @name    resumeReading
+ * @brief   Wait for the socket to become readable again, see pauseReading
+ */
+void MessageClient::resumeReading(int fd) {
+    PThreadLockGuard lock(send_mutex);
+
+    std::map<int, ChannelBuffers>::iterator it = channel_buffers.find(fd);
+    if (it == channel_buffers.end())
+        return;
+
+    it->second.paused = false;
+    watchWritable(fd, !it->second.outgoing.empty());
+}
+
+/**
+ * @name    pausedChannels
+ * @brief   Get the paused sockets, see pauseReading
+ */
+void MessageClient::pausedChannels(std::vector<int> &fds) {
+    PThreadLockGuard lock(send_mutex);
+
+    for (std::map<int, ChannelBuffers>::iterator it = channel_buffers.begin(); it != channel_buffers.end(); ++it)
+        if (it->second.paused)
+            fds.push_back(it->first);
+    num_paused_channels = fds.size();
+}
+
+/**
+ * @name    clearReadyEvent
+ * @brief   Reset the eventfd signaling the callback takes messages again
+ */
+void MessageClient::clearReadyEvent(int ready_fd) {
+    uint64_t signaled;
+    if ((ready_fd != UNINITIALIZED_SOCKET_FD) && (read(ready_fd, &signaled, sizeof(signaled)) == -1) && (errno != EAGAIN))
+        ERROR_MSG("%s: eventfd read failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+}
+
+/**
+ * @name    disconnectNonblocking
+ * @brief   Close the hub connection and peer channels and forget everything that was pending
+ */
+void MessageClient::disconnectNonblocking() {
+    connected_clients.clear();
+    closePeerChannels();
+
+    PThreadLockGuard lock(send_mutex);
+    channel_buffers.clear();
+    num_paused_channels = 0;
+    if (server_channel.fileDescriptor() != UNINITIALIZED_SOCKET_FD)
+        server_channel.shutDown();
 }
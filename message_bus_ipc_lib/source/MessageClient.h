@@ -10,22 +10,101 @@
 
 #include <stdint.h>
 #include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <cstring>
+#include <vector>
+#include <map>
 #include "PThreadLockGuard.h"
 #include "ThreadsafeClientList.h"
 #include "MessageChannel.h"
+#include "MessageDispatcher.h"
+#include "LockfreeQueue.h"
+#include "TypedMessage.h"
+#include "BusyPoll.h"
 
 namespace messagebusipc {
 
+/**
+ * @class   MessageHandler
+ * @brief   Callback object that is told the sender too; pass MessageHandler* wherever MessageClient takes a callback
+ */
+class MessageHandler {
+public:
+    virtual ~MessageHandler() {}
+    virtual bool onMessage(uint32_t &id, char *data, uint32_t &size, const std::string &sender) = 0;
+};
+
 /**
  * @class   MessageClient
  * @brief   This is a message bus client; it connects to the MessageHub and sends and receives messages from it.
  */
 class MessageClient {
 public:
+    // what send() does when asynchronous send queue is full
+    enum SendQueueFullPolicy {
+        SEND_QUEUE_BLOCK,       // wait until there is room
+        SEND_QUEUE_FAIL,        // return false rightaway, message not sent
+        SEND_QUEUE_DROP_OLDEST  // make room by discarding the oldest queued message
+    };
+
+    // one message of sendBatch
+    struct OutgoingMessage {
+        uint32_t id;
+        const void *data;
+        uint32_t size;
+        const char *client_name; // recipient, MBUS_ALL_CONNECTED_CLIENTS for all
+    };
+
     MessageClient();
     virtual ~MessageClient();
-    void waitForClient(const char *client_name);
+    bool waitForClient(const char *client_name, int timeout_ms = ThreadsafeClientList::WAIT_FOREVER);
+    void subscribePresence(ClientPresenceObserver *observer);
+    void unsubscribePresence(ClientPresenceObserver *observer);
     bool send(uint32_t id, const void *data, uint32_t size, const char *client_name = MBUS_ALL_CONNECTED_CLIENTS);
+
+    /**
+     * @name    send
+     * @brief   Send typed message as it was built, no marshalling on the way
+     */
+    template<class Schema>
+    bool send(const TypedMessageBuilder<Schema> &message, const char *client_name = MBUS_ALL_CONNECTED_CLIENTS) {
+        return send(Schema::ID, message.data(), message.size(), client_name);
+    }
+
+    unsigned sendBatch(const OutgoingMessage *messages, unsigned count, bool *results = NULL);
+    bool enableAsyncSend(unsigned capacity, SendQueueFullPolicy policy = SEND_QUEUE_BLOCK, bool own_thread = true);
+    void disableAsyncSend();
+    unsigned drainSendQueue(unsigned max_messages = (unsigned)-1);
+    bool requestPeerChannel(const char *peer_name);
+    bool hasPeerChannel(const char *peer_name);
+    void enableSessionResume(bool enable);
+    void enableConsumerGroup(bool enable);
+
+    /**
+     * @name    attachClient
+     * @brief   Add logical client of given name to this client's hub connection. The hub routes to it like to a separately
+     *          connected client, with no thread or buffer of its own on either side; its messages arrive over this connection
+     *          and are handed to its own callback
+     * @param   callback Same as for initializeAndListen, called from the listener thread or dispatch();
+     *          when it returns false the logical client is detached
+     * @param   flags HELLO_FLAG_RESUME_SESSION and HELLO_FLAG_CONSUMER_GROUP apply to logical client too
+     * @return  True on success, False if the name is already used by this client or too long
+     * @note    Attached clients stay attached across reconnects. They send with sendAs and have no peer channels
+     */
+    template<class Callback>
+    bool attachClient(const char *client_name, Callback callback, uint32_t flags = 0) {
+        return attach(client_name, new AttachedCallback<Callback>(callback), flags);
+    }
+    bool detachClient(const char *client_name);
+    bool sendAs(const char *attached_name, uint32_t id, const void *data, uint32_t size, const char *client_name = MBUS_ALL_CONNECTED_CLIENTS);
+
+    void setBusyPoll(const BusyPollConfig &config);
+    void setHubAddress(const char *address);
+    void setSeqpacket(bool enable);
+    void setWireVersion(uint8_t version);
+    void setBusNamespace(const std::string &bus_namespace, const std::vector<std::string> &hub_addresses);
     void shutDown();
 
     /**
@@ -50,35 +129,233 @@ public:
      * @note    This is a blocking method. Best called from a separate thread
      * @note    callback: bool (*callback)(uint32_t &id, char *data, uint32_t &size);
      *          When callback returns false, this means termination of listening
+     * @note    callback can also be MessageDispatcher* to handle messages in a pool of worker threads,
+     *          or MessageHandler* to be told the sender
      */
     template<class Callback>
     void initializeAndListen(Callback callback, const char *client_name, bool auto_reconnect = true) {
+        unsigned reconnect_delay_useconds = RECONNECT_MIN_DELAY_USECONDS;
         do {
             // 1. if can successfully connect, then listen until connection is terminated
-            if (tryConnectToMessageHub(client_name))
+            if (tryConnectToMessageHub(client_name)) {
+                reconnect_delay_useconds = RECONNECT_MIN_DELAY_USECONDS;
                 auto_reconnect &= listenUntilConnectionTerminated(callback);
+            }
 
             // 2. we got here so connection is terminated; clear available client list and reinitialize the message channel
             connected_clients.clear();
+            closePeerChannels();
             server_channel = MessageChannel();
 
             // 3. sleep a while and maybe reconnect and listen again
-            sleep(RECONNECT_DELAY_SECONDS);
+            if (auto_reconnect && !shutting_down)
+                reconnect_delay_useconds = sleepBeforeReconnect(reconnect_delay_useconds);
         } while (auto_reconnect && !shutting_down);
 
         DEBUG_MSG("%s: finished listening to incoming messages.", __FUNCTION__);
     }
 
+    bool connectNonblocking(const char *client_name);
+    int fileDescriptor() const { return epoll_fd; }
+    bool flush();
+
+    /**
+     * @name    dispatch
+     * @brief   Handle messages that are already waiting on the client sockets and flush pending outgoing bytes; never blocks
+     * @param   callback Callback function that will handle incoming messages, same as for initializeAndListen
+     * @param   max_messages Upper bound of messages handled in single call
+     * @return  Number of messages handled, -1 if connection to the hub is terminated and connectNonblocking should be called again
+     * @note    Call when fileDescriptor() becomes readable. When callback returns false, dispatch returns rightaway.
+     *          With MessageDispatcher callback a full worker queue doesn't block: reading the socket pauses with the message
+     *          kept, so the socket pushes back on the sender, and goes on once the queue has room
+     */
+    template<class Callback>
+    int dispatch(Callback callback, unsigned max_messages = DISPATCH_MESSAGE_BUDGET) {
+        unsigned num_dispatched = 0;
+
+        // 1. messages held back by full MessageDispatcher go first; take the room signal before trying, so none is missed
+        if (num_paused_channels > 0) {
+            clearReadyEvent(readyDescriptor(callback));
+            std::vector<int> paused_fds;
+            pausedChannels(paused_fds);
+            for (size_t i = 0; i < paused_fds.size(); i++) {
+                int result = dispatchChannel(callback, paused_fds[i], num_dispatched, max_messages);
+                if (result != DISPATCH_CHANNEL_DONE)
+                    return (result == DISPATCH_HUB_LOST) ? -1 : num_dispatched;
+            }
+        }
+
+        epoll_event events[DISPATCH_MAX_EVENTS];
+        int num_events = epoll_wait(epoll_fd, events, DISPATCH_MAX_EVENTS, 0);
+
+        for (int i = 0; i < num_events; i++) {
+            int fd = events[i].data.fd;
+            bool is_hub = (fd == server_channel.fileDescriptor());
+
+            // 2. asynchronous send queue has messages
+            if (fd == send_queue_event_fd) {
+                drainSendQueueEvent(max_messages);
+                continue;
+            }
+
+            // 3. MessageDispatcher has room again; if something paused since step 1, the signal stays for the next call
+            if (fd == readyDescriptor(callback)) {
+                if (num_paused_channels == 0)
+                    clearReadyEvent(fd);
+                continue;
+            }
+
+            // 4. socket writable again; push out what send() could not
+            if ((events[i].events & EPOLLOUT) && !flushChannel(fd)) {
+                if (is_hub) {
+                    disconnectNonblocking();
+                    return -1;
+                }
+                removePeerChannel(fd);
+                continue;
+            }
+
+            if (!(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+                continue;
+
+            // 5. read messages while there are some and the budget allows
+            int result = dispatchChannel(callback, fd, num_dispatched, max_messages);
+            if (result != DISPATCH_CHANNEL_DONE)
+                return (result == DISPATCH_HUB_LOST) ? -1 : num_dispatched;
+        }
+
+        return num_dispatched;
+    }
+
 private:
     volatile bool shutting_down;
     char *message_buffer;
+    std::string own_name; // guarded by send_mutex
     MessageChannel server_channel;
     pthread_mutex_t send_mutex;
     ThreadsafeClientList connected_clients;
-    static const int RECONNECT_DELAY_SECONDS = 3;
-    static const int WAIT_CLIENT_DELAY_USECONDS = 100000;
+    std::vector<MessageChannel> peer_channels; // direct channels to other clients, guarded by send_mutex
+    uint32_t hello_flags;                      // HELLO_FLAG_* sent to the hub on connect
+    std::string hub_address;                   // see HubAddress; empty means the default address
+    bool prefer_seqpacket;                     // try SOCK_SEQPACKET counterpart of hub_address first
+    uint8_t wire_version;                      // highest WIRE_VERSION_* offered to the hub
+
+    // peer channels as the listener sees them. The listener never takes send_mutex: a sender may hold it while blocked
+    // on the full hub socket, and the hub may be blocked writing to the listener. Channels it opens or finds broken
+    // wait in peer_changes until somebody holding send_mutex applies them to peer_channels
+    std::vector<pollfd> listen_fds;                 // listener only; hub socket followed by peer channel sockets
+    pthread_mutex_t peer_changes_mutex;             // never held across socket I/O
+    std::vector<MessageChannel> added_peer_channels;   // guarded by peer_changes_mutex
+    std::vector<int> broken_peer_fds;                  // shut down, to be closed; guarded by peer_changes_mutex
+    int32_t num_peer_changes;                          // atomic; entries in the two above
+
+    // busy polling; config can be changed any time, spinner and pinning belong to the listener thread
+    BusyPollConfig busy_poll;
+    AdaptiveSpinner listen_spinner;
+    CpuPinning listen_pinning;
+    unsigned reconnect_seed;                   // rand_r state for reconnect jitter
+
+    // reconnect delay starts small so a restarted hub is picked up fast, then doubles up to the max
+    static const unsigned RECONNECT_MIN_DELAY_USECONDS = 5 * 1000;
+    static const unsigned RECONNECT_MAX_DELAY_USECONDS = 2 * 1000 * 1000;
+
+    // nonblocking mode; channel buffers are keyed by socket and guarded by send_mutex
+    struct ChannelBuffers {
+        ChannelBuffers() : paused(false) {}
+        MessageChannel::ReceiveProgress incoming;
+        std::string outgoing;
+        bool paused; // incoming holds a message the callback refused for now; socket not read until it takes it
+    };
+    int epoll_fd;
+    std::map<int, ChannelBuffers> channel_buffers;
+    unsigned num_paused_channels; // dispatching thread only; at least the number of paused channels
+    enum { DISPATCH_CHANNEL_DONE, DISPATCH_CALLBACK_STOPPED, DISPATCH_HUB_LOST };
+    static const unsigned DISPATCH_MESSAGE_BUDGET = 64;
+    static const int DISPATCH_MAX_EVENTS = 16;
+
+    // asynchronous send; producers push without taking any lock, the messages are sent in batches by drainSendQueue
+    struct QueuedSend {
+        uint32_t id;
+        uint32_t size;
+        char recipient[MAX_CLIENT_NAME_LENGTH + 1];
+        char *data() { return reinterpret_cast<char*>(this + 1); } // payload follows the struct
+    };
+    LockfreeQueue<QueuedSend*> *send_queue;  // drainers use it under drain_mutex; producers only between enterSendQueue and leaveSendQueue
+    bool send_queue_open;              // atomic; producers may push. disableAsyncSend closes it, then waits for send_queue_users to leave
+    int32_t send_queue_users;          // atomic; producers in enterSendQueue..leaveSendQueue
+    SendQueueFullPolicy send_queue_policy;
+    int32_t send_queue_length;         // atomic; messages pushed and not yet taken by the drainer
+    int send_queue_event_fd;           // eventfd, signaled when send queue becomes non empty
+    pthread_mutex_t drain_mutex;       // one drainer at a time keeps the message order
+    pthread_mutex_t send_room_mutex;   // SEND_QUEUE_BLOCK producers wait on send_room_cond under it
+    pthread_cond_t send_room_cond;     // broadcast by the drainer when it takes messages and somebody waits
+    int32_t send_room_waiters;         // atomic; producers in waitForSendRoom
+    pthread_t sender_thread;
+    bool has_sender_thread;
+    volatile bool sender_thread_stopping;
+    std::vector<char> batch_headers;   // guarded by send_mutex
+    std::vector<iovec> batch_iovecs;   // guarded by send_mutex
+    std::vector<unsigned> batch_run;   // messages whose header and payload are in batch_iovecs; guarded by send_mutex
+    static const unsigned SEND_BATCH_SIZE = 64;
+
+    // logical clients multiplexed over the hub connection, see attachClient
+    struct AttachedClient {
+        virtual ~AttachedClient() {}
+        virtual bool handle(uint32_t &id, char *data, uint32_t &size, const std::string &sender) = 0;
+        uint32_t flags;
+    };
+
+    template<class Callback>
+    struct AttachedCallback : public AttachedClient {
+        Callback callback;
+        AttachedCallback(Callback callback) :
+                callback(callback) {
+        }
+        bool handle(uint32_t &id, char *data, uint32_t &size, const std::string &sender) {
+            return invokeCallback(callback, id, data, size, sender);
+        }
+    };
+
+    std::map<std::string, AttachedClient*> attached_clients; // guarded by send_mutex
+    std::vector<AttachedClient*> detached_clients;           // the listener may still be in them and deletes them; guarded by send_mutex
+    std::vector<char> mux_buffer;                            // nonblocking sendAs; guarded by send_mutex
+    std::string mux_name;                                    // listener only
+
+    bool attach(const char *client_name, AttachedClient *client, uint32_t flags);
+    bool sendAttachLocked(const std::string &client_name, uint32_t flags);
+    void deliverToAttached(char *data, uint32_t size, const std::string &sender);
+
+    bool enterSendQueue();
+    void leaveSendQueue();
+    bool enqueueSend(uint32_t message_id, const char *data, uint32_t size, const char *client_name);
+    void waitForSendRoom();
+    unsigned sendBatchLocked(const OutgoingMessage *messages, unsigned count, bool *results);
+    unsigned flushBatchRunLocked(bool *results);
+    void drainSendQueueEvent(unsigned max_messages);
+    static void* senderThreadFunc(void* varg);
 
     bool tryConnectToMessageHub(const char *client_name);
+    unsigned sleepBeforeReconnect(unsigned delay_useconds);
+    bool sendLocked(uint32_t message_id, const char *data, uint32_t size, const char *client_name);
+    MessageChannel *findPeerChannel(const char *client_name);
+    void handleInternalMessage(uint32_t message_id, char *data, uint32_t message_size, int passed_fd);
+    bool sendOnChannel(MessageChannel &channel, uint32_t message_id, const char *data, uint32_t size, const char *client_name);
+    void addListenedPeer(const MessageChannel &peer);
+    void dropListenedPeer(size_t index);
+    void tryApplyPeerChanges();
+    void applyPeerChangesLocked();
+    void spinUntilReadable();
+    void removePeerChannel(int peer_fd);
+    void closePeerChannels();
+    bool registerNonblockingChannel(const MessageChannel &channel);
+    void watchWritable(int fd, bool writable);
+    bool flushChannel(int fd);
+    ChannelBuffers *findChannelBuffers(int fd);
+    void pauseReading(int fd, int ready_fd);
+    void resumeReading(int fd);
+    void pausedChannels(std::vector<int> &fds);
+    static void clearReadyEvent(int ready_fd);
+    void disconnectNonblocking();
 
     /**
      * @name    listenUntilConnectionTerminated
@@ -88,31 +365,61 @@ private:
     bool listenUntilConnectionTerminated(Callback callback) {
         uint32_t message_id = 0;
         uint32_t message_size = 0;
-        std::string recipient; // discard this as we know who we are
-
-        while (server_channel.receive(message_id, message_buffer, message_size, recipient)) {
-            switch (message_id) {
-            case ID_CLIENT_SAYS_HELLO: {
-                message_buffer[message_size] = '\0';
-                connected_clients.add(message_buffer);
-                DEBUG_MSG("%s: client connected: %s. Now [%s]", __FUNCTION__, message_buffer, connected_clients.toString().c_str());
-                break;
-            }
+        std::string sender; // hub puts the sender name where the recipient name was
+        int passed_fd;
+        pollfd hub = { server_channel.fileDescriptor(), POLLIN, 0 };
+        listen_fds.assign(1, hub);
 
-            case ID_CLIENT_SAYS_GOODBYE: {
-                message_buffer[message_size] = '\0';
-                connected_clients.remove(message_buffer);
-                DEBUG_MSG("%s: client disconnected: %s. Now [%s]", __FUNCTION__, message_buffer, connected_clients.toString().c_str());
-                break;
+        while (true) {
+            // 1. with direct peer channels open we need to wait on all of them; listen_fds[0] is always the hub
+            bool hub_readable = true;
+            bool has_peers = (listen_fds.size() > 1);
+            spinUntilReadable();
+            if (has_peers) {
+                if (poll(&listen_fds[0], listen_fds.size(), -1) == -1) {
+                    if (errno == EINTR)
+                        continue;
+                    ERROR_MSG("%s: poll failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+                    return true;
+                }
+                hub_readable = (listen_fds[0].revents != 0);
             }
 
-            default:
-                break;
+            // 2. message from the hub
+            if (hub_readable) {
+                if (!server_channel.receive(message_id, message_buffer, message_size, sender, passed_fd))
+                    break;
+
+                handleInternalMessage(message_id, message_buffer, message_size, passed_fd);
+                if (message_id == ID_MUX_FORWARD)
+                    deliverToAttached(message_buffer, message_size, sender);
+                else if (invokeCallback(callback, message_id, message_buffer, message_size, sender) == false) {
+                    DEBUG_MSG("%s: message callback returns false. Finish reception loop", __FUNCTION__);
+                    return false;
+                }
             }
 
-            if (callback(message_id, message_buffer, message_size) == false) {
-                DEBUG_MSG("%s: message callback returns false. Finish reception loop", __FUNCTION__);
-                return false;
+            // 3. messages that came directly from peers; channels established meanwhile have no revents yet
+            for (size_t i = 1; i < listen_fds.size(); i++) {
+                if (listen_fds[i].revents == 0)
+                    continue;
+
+                MessageChannel peer(listen_fds[i].fd);
+                if (!peer.receive(message_id, message_buffer, message_size, sender)) {
+                    dropListenedPeer(i--);
+                    continue;
+                }
+
+                // logical clients are reached through the hub only; a peer can't speak for them
+                if (message_id == ID_MUX_FORWARD) {
+                    DEBUG_MSG("%s: ID_MUX_FORWARD from peer %s dropped", __FUNCTION__, sender.c_str());
+                    continue;
+                }
+
+                if (invokeCallback(callback, message_id, message_buffer, message_size, sender) == false) {
+                    DEBUG_MSG("%s: message callback returns false. Finish reception loop", __FUNCTION__);
+                    return false;
+                }
             }
         } // while
 
@@ -120,6 +427,114 @@ private:
         return true;
     }
 
+    /**
+     * @name    invokeCallback
+     * @brief   Pass the message to user callback; sender is only of interest to MessageDispatcher
+     */
+    template<class Callback>
+    static bool invokeCallback(Callback &callback, uint32_t &id, char *data, uint32_t &size, const std::string &sender) {
+        return callback(id, data, size);
+    }
+
+    static bool invokeCallback(MessageDispatcher *dispatcher, uint32_t &id, char *data, uint32_t &size, const std::string &sender) {
+        return dispatcher->dispatch(id, data, size, sender);
+    }
+
+    static bool invokeCallback(MessageHandler *handler, uint32_t &id, char *data, uint32_t &size, const std::string &sender) {
+        return handler->onMessage(id, data, size, sender);
+    }
+
+    /**
+     * @name    tryInvokeCallback
+     * @brief   Like invokeCallback, but MessageDispatcher may refuse the message instead of blocking; see dispatch
+     */
+    template<class Callback>
+    static MessageDispatcher::DispatchStatus tryInvokeCallback(Callback &callback, uint32_t &id, char *data, uint32_t &size, const std::string &sender) {
+        return invokeCallback(callback, id, data, size, sender) ? MessageDispatcher::DISPATCHED : MessageDispatcher::DISPATCH_STOPPED;
+    }
+
+    static MessageDispatcher::DispatchStatus tryInvokeCallback(MessageDispatcher *dispatcher, uint32_t &id, char *data, uint32_t &size, const std::string &sender) {
+        return dispatcher->tryDispatch(id, data, size, sender);
+    }
+
+    /**
+     * @name    readyDescriptor
+     * @return  Descriptor readable when the callback takes messages again after refusing one, UNINITIALIZED_SOCKET_FD if it never refuses
+     */
+    template<class Callback>
+    static int readyDescriptor(Callback &callback) {
+        return UNINITIALIZED_SOCKET_FD;
+    }
+
+    static int readyDescriptor(MessageDispatcher *dispatcher) {
+        return dispatcher->readyDescriptor();
+    }
+
+    /**
+     * @name    dispatchChannel
+     * @brief   Receive and handle messages waiting on one socket of nonblocking mode, see dispatch
+     * @return  DISPATCH_CHANNEL_DONE to go on with other sockets, DISPATCH_CALLBACK_STOPPED or DISPATCH_HUB_LOST to return
+     */
+    template<class Callback>
+    int dispatchChannel(Callback &callback, int fd, unsigned &num_dispatched, unsigned max_messages) {
+        bool is_hub = (fd == server_channel.fileDescriptor());
+        ChannelBuffers *buffers = findChannelBuffers(fd);
+        if (!buffers)
+            return DISPATCH_CHANNEL_DONE;
+
+        MessageChannel::ReceiveProgress &incoming = buffers->incoming;
+        MessageChannel channel(fd);
+        while (num_dispatched < max_messages) {
+            // paused channel has its message received and seen by handleInternalMessage already
+            if (!buffers->paused) {
+                MessageChannel::ReceiveStatus status = channel.receiveNonblocking(incoming);
+                if (status == MessageChannel::RECEIVE_INCOMPLETE)
+                    break;
+
+                if (status == MessageChannel::RECEIVE_FAILED) {
+                    if (is_hub) {
+                        disconnectNonblocking();
+                        return DISPATCH_HUB_LOST;
+                    }
+                    removePeerChannel(fd);
+                    break;
+                }
+
+                if (is_hub)
+                    handleInternalMessage(incoming.id(), incoming.data(), incoming.size(), incoming.takeDescriptor());
+            }
+
+            uint32_t message_id = incoming.id();
+            uint32_t message_size = incoming.size();
+            if (message_id == ID_MUX_FORWARD) {
+                // logical clients are reached through the hub only; a peer can't speak for them
+                if (is_hub)
+                    deliverToAttached(incoming.data(), message_size, incoming.recipient());
+                else
+                    DEBUG_MSG("%s: ID_MUX_FORWARD from peer %s dropped", __FUNCTION__, incoming.recipient().c_str());
+                num_dispatched++;
+                continue;
+            }
+
+            MessageDispatcher::DispatchStatus status = tryInvokeCallback(callback, message_id, incoming.data(), message_size, incoming.recipient());
+            if (status == MessageDispatcher::DISPATCH_WOULD_BLOCK) {
+                if (!buffers->paused)
+                    pauseReading(fd, readyDescriptor(callback));
+                break;
+            }
+
+            if (buffers->paused)
+                resumeReading(fd);
+            num_dispatched++;
+            if (status == MessageDispatcher::DISPATCH_STOPPED) {
+                DEBUG_MSG("%s: message callback returns false. Finish dispatching", __FUNCTION__);
+                return DISPATCH_CALLBACK_STOPPED;
+            }
+        }
+
+        return DISPATCH_CHANNEL_DONE;
+    }
+
     // Functor for calling object member function
     template<class T, class F>
     struct MemberCallback {
@@ -0,0 +1,445 @@
+/**
+ *   @file: MessageClientCoroutines.h
+ *
+ *   @date: Oct 18, 2026
+ */
+
+#ifndef MESSAGE_BUS_IPC_LIB_SOURCE_MESSAGECLIENTCOROUTINES_H_
+#define MESSAGE_BUS_IPC_LIB_SOURCE_MESSAGECLIENTCOROUTINES_H_
+
+#if !defined(__cpp_impl_coroutine)
+#error "MessageClientCoroutines.h needs C++20 coroutines, eg. -std=c++20"
+#endif
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+#include <string>
+#include <vector>
+#include <deque>
+#include <list>
+#include <map>
+#include <poll.h>
+#include <errno.h>
+#include "MessageClient.h"
+
+namespace messagebusipc {
+
+/**
+ * @class   ReceivedMessage
+ * @brief   Message copied out of the client buffer for a coroutine
+ */
+struct ReceivedMessage {
+    uint32_t id = 0;
+    std::string sender;
+    std::vector<char> data;
+};
+
+template<class T>
+struct TaskResult {
+    std::optional<T> value;
+    template<class U> void return_value(U &&result) { value.emplace(std::forward<U>(result)); }
+    T take() { return std::move(*value); }
+};
+
+template<>
+struct TaskResult<void> {
+    void return_void() {}
+    void take() {}
+};
+
+/**
+ * @class   Task
+ * @brief   Coroutine that starts when co_awaited and gives T back to the awaiting coroutine; exceptions travel along
+ */
+template<class T = void>
+class Task {
+public:
+    struct promise_type;
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> finished) noexcept {
+            std::coroutine_handle<> continuation = finished.promise().continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+
+    struct promise_type : public TaskResult<T> {
+        std::coroutine_handle<> continuation;
+        std::exception_ptr error;
+
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void unhandled_exception() { error = std::current_exception(); }
+    };
+
+    Task(Task &&other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    ~Task() { if (handle) handle.destroy(); }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+    T await_resume() {
+        if (handle.promise().error)
+            std::rethrow_exception(handle.promise().error);
+        return handle.promise().take();
+    }
+
+private:
+    std::coroutine_handle<promise_type> handle;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+};
+
+/**
+ * @class   CoroutineExecutor
+ * @brief   Runs coroutines talking over single MessageClient in nonblocking mode, all on the thread that calls run().
+ *          Coroutines co_await receive(), send(), waitForClient() and request(); while they wait, the executor sleeps
+ *          on the client descriptor and resumes them as messages come and the socket drains:
+ *              MessageClient client;
+ *              CoroutineExecutor executor(client);
+ *              executor.connect("name");
+ *              executor.spawn(conversation(executor));
+ *              executor.run();
+ *          A conversation costs a coroutine frame, so thousands of them fit on one executor;
+ *          for more threads run more clients, each with its own executor
+ * @note    Not thread safe; use the executor from its coroutines and the run() thread only
+ */
+class CoroutineExecutor : private MessageHandler {
+public:
+    explicit CoroutineExecutor(MessageClient &client) : client(client), stopping(false) {}
+    ~CoroutineExecutor();
+
+    /**
+     * @name    connect
+     * @brief   Connect the client to the hub; also to reconnect after run() returned false. Waiting coroutines keep waiting
+     */
+    bool connect(const char *client_name) { return client.connectNonblocking(client_name); }
+
+    /**
+     * @name    spawn
+     * @brief   Run the task on this executor; it starts on the next run() turn and is owned by the executor
+     * @note    Exception escaping the task terminates the program, like one escaping a thread
+     */
+    void spawn(Task<void> task) { startDetached(this, std::move(task)); }
+
+    bool run();
+
+    /**
+     * @name    stop
+     * @brief   Make run() return after the current turn; called from a coroutine
+     */
+    void stop() { stopping = true; }
+
+    class ReceiveAwaiter;
+    class SendAwaiter;
+    class PresenceAwaiter;
+    class RequestAwaiter;
+
+    ReceiveAwaiter receive();
+    SendAwaiter send(uint32_t id, const void *data, uint32_t size, const char *client_name = MBUS_ALL_CONNECTED_CLIENTS);
+    PresenceAwaiter waitForClient(const char *client_name);
+    RequestAwaiter request(uint32_t id, const void *data, uint32_t size, const char *client_name, uint32_t reply_id);
+
+private:
+    typedef std::pair<std::string, uint32_t> ReplyKey; // who answers, with what message ID
+
+    struct Waiter {
+        std::coroutine_handle<> handle;
+        ReceivedMessage message;
+    };
+
+    // coroutine started by spawn; removes itself from roots when done
+    struct Detached {
+        struct promise_type {
+            CoroutineExecutor &executor;
+            std::list<std::coroutine_handle<> >::iterator position;
+
+            promise_type(CoroutineExecutor *executor, Task<void>&) : executor(*executor) {}
+            Detached get_return_object() {
+                std::coroutine_handle<promise_type> handle = std::coroutine_handle<promise_type>::from_promise(*this);
+                position = executor.roots.insert(executor.roots.end(), handle);
+                executor.ready.push_back(handle);
+                return Detached();
+            }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+
+            struct FinalAwaiter {
+                bool await_ready() noexcept { return false; }
+                void await_suspend(std::coroutine_handle<promise_type> finished) noexcept {
+                    promise_type &promise = finished.promise();
+                    promise.executor.roots.erase(promise.position);
+                    finished.destroy();
+                }
+                void await_resume() noexcept {}
+            };
+            FinalAwaiter final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+    };
+
+    MessageClient &client;
+    bool stopping;
+    std::list<std::coroutine_handle<> > roots;      // spawned coroutines not finished yet
+    std::deque<std::coroutine_handle<> > ready;     // to be resumed this turn
+    std::deque<ReceivedMessage> inbox;              // nobody was receiving when these came
+    std::deque<Waiter*> receivers;                  // in receive(), first come first served
+    std::multimap<ReplyKey, Waiter*> replies;       // in request(); same key is served in request order
+    std::vector<std::coroutine_handle<> > writers;  // in send(), waiting for the socket to drain
+    std::vector<std::pair<std::string, std::coroutine_handle<> > > presence_waiters; // in waitForClient()
+    ReplyKey reply_key;                             // onMessage lookup, kept for its string buffer
+
+    static Detached startDetached(CoroutineExecutor *executor, Task<void> task) { co_await task; }
+    bool onMessage(uint32_t &id, char *data, uint32_t &size, const std::string &sender) override;
+    void wakeWaiters();
+    void resumeReady();
+
+    CoroutineExecutor(const CoroutineExecutor&) = delete;
+    CoroutineExecutor& operator=(const CoroutineExecutor&) = delete;
+};
+
+/**
+ * @class   ReceiveAwaiter
+ * @brief   co_await gives the next message that is not a reply to request(); internal messages are left out
+ */
+class CoroutineExecutor::ReceiveAwaiter {
+public:
+    explicit ReceiveAwaiter(CoroutineExecutor &executor) : executor(executor) {}
+
+    bool await_ready() {
+        if (executor.inbox.empty())
+            return false;
+
+        waiter.message = std::move(executor.inbox.front());
+        executor.inbox.pop_front();
+        return true;
+    }
+    void await_suspend(std::coroutine_handle<> awaiting) {
+        waiter.handle = awaiting;
+        executor.receivers.push_back(&waiter);
+    }
+    ReceivedMessage await_resume() { return std::move(waiter.message); }
+
+private:
+    CoroutineExecutor &executor;
+    Waiter waiter;
+};
+
+/**
+ * @class   SendAwaiter
+ * @brief   co_await sends the message and, if the socket didn't take all that is pending, waits until it drains;
+ *          gives true on success, false if the connection is broken
+ * @note    Data needs to live only until the co_await starts
+ */
+class CoroutineExecutor::SendAwaiter {
+public:
+    SendAwaiter(CoroutineExecutor &executor, uint32_t id, const void *data, uint32_t size, const char *client_name) :
+            executor(executor), id(id), data(data), size(size), client_name(client_name), sent(false) {
+    }
+
+    bool await_ready() {
+        sent = executor.client.send(id, data, size, client_name);
+        return !sent || executor.client.flush();
+    }
+    void await_suspend(std::coroutine_handle<> awaiting) { executor.writers.push_back(awaiting); }
+    bool await_resume() { return sent; }
+
+private:
+    CoroutineExecutor &executor;
+    uint32_t id;
+    const void *data;
+    uint32_t size;
+    const char *client_name;
+    bool sent;
+};
+
+/**
+ * @class   PresenceAwaiter
+ * @brief   co_await returns when given client is connected to the bus
+ */
+class CoroutineExecutor::PresenceAwaiter {
+public:
+    PresenceAwaiter(CoroutineExecutor &executor, const char *client_name) : executor(executor), client_name(client_name) {}
+
+    bool await_ready() { return executor.client.waitForClient(client_name.c_str(), 0); }
+    void await_suspend(std::coroutine_handle<> awaiting) { executor.presence_waiters.push_back(std::make_pair(client_name, awaiting)); }
+    void await_resume() {}
+
+private:
+    CoroutineExecutor &executor;
+    std::string client_name;
+};
+
+/**
+ * @class   RequestAwaiter
+ * @brief   co_await sends the message and gives the first reply_id message that comes back from the recipient,
+ *          nullopt if the send failed
+ * @note    Data needs to live only until the co_await starts
+ */
+class CoroutineExecutor::RequestAwaiter {
+public:
+    RequestAwaiter(CoroutineExecutor &executor, uint32_t id, const void *data, uint32_t size, const char *client_name, uint32_t reply_id) :
+            executor(executor), id(id), data(data), size(size), key(client_name, reply_id), sent(false) {
+    }
+
+    // waiting for the reply starts before the request goes out, the reply can't slip by
+    bool await_ready() {
+        std::multimap<ReplyKey, Waiter*>::iterator position = executor.replies.insert(std::make_pair(key, &waiter));
+        sent = executor.client.send(id, data, size, key.first.c_str());
+        if (!sent)
+            executor.replies.erase(position);
+        return !sent;
+    }
+    void await_suspend(std::coroutine_handle<> awaiting) { waiter.handle = awaiting; }
+    std::optional<ReceivedMessage> await_resume() {
+        if (!sent)
+            return std::nullopt;
+        return std::move(waiter.message);
+    }
+
+private:
+    CoroutineExecutor &executor;
+    uint32_t id;
+    const void *data;
+    uint32_t size;
+    ReplyKey key;
+    Waiter waiter;
+    bool sent;
+};
+
+/**
+ * CoroutineExecutor Destructor.
+ * @brief   Destroy the coroutines that are still waiting
+ */
+inline CoroutineExecutor::~CoroutineExecutor() {
+    std::list<std::coroutine_handle<> > unfinished;
+    unfinished.swap(roots);
+    for (std::list<std::coroutine_handle<> >::iterator it = unfinished.begin(); it != unfinished.end(); ++it)
+        it->destroy();
+}
+
+inline CoroutineExecutor::ReceiveAwaiter CoroutineExecutor::receive() {
+    return ReceiveAwaiter(*this);
+}
+
+inline CoroutineExecutor::SendAwaiter CoroutineExecutor::send(uint32_t id, const void *data, uint32_t size, const char *client_name) {
+    return SendAwaiter(*this, id, data, size, client_name);
+}
+
+inline CoroutineExecutor::PresenceAwaiter CoroutineExecutor::waitForClient(const char *client_name) {
+    return PresenceAwaiter(*this, client_name);
+}
+
+inline CoroutineExecutor::RequestAwaiter CoroutineExecutor::request(uint32_t id, const void *data, uint32_t size, const char *client_name, uint32_t reply_id) {
+    return RequestAwaiter(*this, id, data, size, client_name, reply_id);
+}
+
+/**
+ * @name    run
+ * @brief   Resume coroutines until all spawned ones are done or stop() is called
+ * @return  True if done or stopped, False if the connection broke; connect() and run() again to carry on
+ */
+inline bool CoroutineExecutor::run() {
+    stopping = false;
+    resumeReady();
+
+    while (!stopping && !roots.empty()) {
+        pollfd pfd;
+        pfd.fd = client.fileDescriptor();
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if ((poll(&pfd, 1, -1) == -1) && (errno != EINTR)) {
+            ERROR_MSG("%s: poll failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+            return false;
+        }
+
+        if (client.dispatch(static_cast<MessageHandler*>(this)) < 0)
+            return false;
+
+        wakeWaiters();
+        resumeReady();
+    }
+
+    return true;
+}
+
+/**
+ * @name    onMessage
+ * @brief   Hand the message to the request waiting for it, else to the first receiver, else keep it in the inbox
+ */
+inline bool CoroutineExecutor::onMessage(uint32_t &id, char *data, uint32_t &size, const std::string &sender) {
+    // presence is followed by the client itself, see waitForClient
+    if (id >= ID_CLIENT_SAYS_HELLO)
+        return true;
+
+    Waiter *waiter = NULL;
+    if (!replies.empty()) {
+        reply_key.first = sender;
+        reply_key.second = id;
+        std::multimap<ReplyKey, Waiter*>::iterator reply = replies.find(reply_key);
+        if (reply != replies.end()) {
+            waiter = reply->second;
+            replies.erase(reply);
+        }
+    }
+    if (!waiter && !receivers.empty()) {
+        waiter = receivers.front();
+        receivers.pop_front();
+    }
+
+    if (!waiter)
+        inbox.push_back(ReceivedMessage());
+    ReceivedMessage &message = waiter ? waiter->message : inbox.back();
+    message.id = id;
+    message.sender = sender;
+    message.data.assign(data, data + size);
+
+    if (waiter)
+        ready.push_back(waiter->handle);
+    return true;
+}
+
+/**
+ * @name    wakeWaiters
+ * @brief   Make ready the senders whose data is out and the coroutines whose client showed up
+ */
+inline void CoroutineExecutor::wakeWaiters() {
+    if (!writers.empty() && client.flush()) {
+        ready.insert(ready.end(), writers.begin(), writers.end());
+        writers.clear();
+    }
+
+    for (size_t i = 0; i < presence_waiters.size(); )
+        if (client.waitForClient(presence_waiters[i].first.c_str(), 0)) {
+            ready.push_back(presence_waiters[i].second);
+            presence_waiters[i] = presence_waiters.back();
+            presence_waiters.pop_back();
+        }
+        else
+            i++;
+}
+
+/**
+ * @name    resumeReady
+ * @brief   Resume ready coroutines, including the ones they make ready in turn
+ */
+inline void CoroutineExecutor::resumeReady() {
+    while (!ready.empty()) {
+        std::coroutine_handle<> handle = ready.front();
+        ready.pop_front();
+        handle.resume();
+    }
+}
+
+}
+
+#endif /* MESSAGE_BUS_IPC_LIB_SOURCE_MESSAGECLIENTCOROUTINES_H_ */
@@ -0,0 +1,195 @@
+/**
+ *   @file: MessageDispatcher.cpp
+ *
+ *   @date: Oct 18, 2026
+ */
+
+#include <cstring>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "MessageBusIpcCommon.h"
+#include "Hash.h"
+#include "PThreadLockGuard.h"
+#include "MessageDispatcher.h"
+
+using namespace messagebusipc;
+
+MessageDispatcher::Worker::Worker() :
+        dispatcher(NULL), thread(), stopping(false) {
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&not_empty, NULL);
+    pthread_cond_init(&not_full, NULL);
+}
+
+MessageDispatcher::Worker::~Worker() {
+    pthread_mutex_destroy(&mutex);
+    pthread_cond_destroy(&not_empty);
+    pthread_cond_destroy(&not_full);
+}
+
+/**
+ * @name    startWorkers
+ * @brief   Create the worker threads
+ */
+void MessageDispatcher::startWorkers(unsigned num_workers, KeyFunc key_func) {
+    this->key_func = key_func;
+    callback_requested_stop = false;
+
+    ready_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (ready_fd == -1) {
+        ERROR_MSG("%s: eventfd failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+        ready_fd = UNINITIALIZED_SOCKET_FD;
+    }
+
+    if (num_workers == 0)
+        num_workers = 1;
+
+    for (unsigned i = 0; i < num_workers; i++) {
+        Worker *worker = new Worker;
+        worker->dispatcher = this;
+        int return_code = pthread_create(&worker->thread, NULL, MessageDispatcher::workerFunc, (void*) worker);
+        if (return_code) {
+            ERROR_MSG("%s: pthread_create failed with error code: %d", __FUNCTION__, return_code);
+            delete worker;
+            continue;
+        }
+        workers.push_back(worker);
+    }
+}
+
+MessageDispatcher::~MessageDispatcher() {
+    stop();
+    delete handler;
+    if (ready_fd != UNINITIALIZED_SOCKET_FD)
+        close(ready_fd);
+}
+
+/**
+ * @name    keyBySender
+ * @brief   Messages from the same sender keep their order
+ */
+uint32_t MessageDispatcher::keyBySender(uint32_t id, const char *data, uint32_t size, const std::string &sender) {
+    return fnv1a32(sender.data(), sender.size());
+}
+
+/**
+ * @name    keyByMessageId
+ * @brief   Messages of the same ID keep their order
+ */
+uint32_t MessageDispatcher::keyByMessageId(uint32_t id, const char *data, uint32_t size, const std::string &sender) {
+    return id;
+}
+
+/**
+ * @name    dispatch
+ * @brief   Copy the message and queue it for the worker responsible for its key
+ * @return  False if the callback asked to stop listening, True otherwise
+ * @note    Blocks when the worker queue is full, so a slow handler slows down the listener instead of eating memory
+ */
+bool MessageDispatcher::dispatch(uint32_t id, const char *data, uint32_t size, const std::string &sender) {
+    return enqueue(id, data, size, sender, true) == DISPATCHED;
+}
+
+/**
+ * @name    tryDispatch
+ * @brief   Like dispatch, but never waits for a full worker queue
+ * @return  DISPATCH_WOULD_BLOCK if the queue is full; the message is not taken then, try again once readyDescriptor()
+ *          becomes readable. DISPATCH_STOPPED if the callback asked to stop listening, DISPATCHED otherwise
+ * @note    For MessageClient::dispatch, which must not stall the caller's event loop
+ */
+MessageDispatcher::DispatchStatus MessageDispatcher::tryDispatch(uint32_t id, const char *data, uint32_t size, const std::string &sender) {
+    return enqueue(id, data, size, sender, false);
+}
+
+/**
+ * @name    enqueue
+ * @param   wait Wait for room in full worker queue, or give up with DISPATCH_WOULD_BLOCK
+ */
+MessageDispatcher::DispatchStatus MessageDispatcher::enqueue(uint32_t id, const char *data, uint32_t size, const std::string &sender, bool wait) {
+    if (callback_requested_stop || workers.empty())
+        return DISPATCH_STOPPED;
+
+    Worker *worker = workers[key_func(id, data, size, sender) % workers.size()];
+
+    PThreadLockGuard lock(worker->mutex);
+    while (worker->messages.size() >= MAX_QUEUED_MESSAGES_PER_WORKER) {
+        if (!wait)
+            return DISPATCH_WOULD_BLOCK;
+        pthread_cond_wait(&worker->not_full, &worker->mutex);
+    }
+
+    QueuedMessage message;
+    message.id = id;
+    message.size = size;
+    message.data = new char[size + 1]; // +1 for callbacks that null-terminate the payload
+    memcpy(message.data, data, size);
+    message.data[size] = '\0';
+
+    worker->messages.push_back(message);
+    pthread_cond_signal(&worker->not_empty);
+
+    return DISPATCHED;
+}
+
+/**
+ * @name    stop
+ * @brief   Let the workers handle what is already queued, then finish them
+ */
+void MessageDispatcher::stop() {
+    for (std::vector<Worker*>::iterator it = workers.begin(); it != workers.end(); ++it) {
+        Worker *worker = *it;
+        pthread_mutex_lock(&worker->mutex);
+        worker->stopping = true;
+        pthread_cond_signal(&worker->not_empty);
+        pthread_mutex_unlock(&worker->mutex);
+    }
+
+    for (std::vector<Worker*>::iterator it = workers.begin(); it != workers.end(); ++it) {
+        pthread_join((*it)->thread, NULL);
+        delete *it;
+    }
+    workers.clear();
+}
+
+/**
+ * @name    workerFunc
+ * @param   varg Holds Worker*
+ * @brief   Pop messages from the worker queue and pass them to the callback
+ * @note    This is run in a dedicated thread
+ */
+void* MessageDispatcher::workerFunc(void* varg) {
+    Worker *worker = (Worker*) varg;
+    MessageDispatcher *dispatcher = worker->dispatcher;
+
+    while (true) {
+        pthread_mutex_lock(&worker->mutex);
+        while (worker->messages.empty() && !worker->stopping)
+            pthread_cond_wait(&worker->not_empty, &worker->mutex);
+
+        if (worker->messages.empty()) { // stopping and nothing left
+            pthread_mutex_unlock(&worker->mutex);
+            break;
+        }
+
+        // tryDispatch may have given up on the full queue; tell it there is room
+        if ((worker->messages.size() == MAX_QUEUED_MESSAGES_PER_WORKER) && (dispatcher->ready_fd != UNINITIALIZED_SOCKET_FD)) {
+            uint64_t room = 1;
+            if (write(dispatcher->ready_fd, &room, sizeof(room)) != sizeof(room))
+                ERROR_MSG("%s: eventfd write failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+        }
+
+        QueuedMessage message = worker->messages.front();
+        worker->messages.pop_front();
+        pthread_cond_signal(&worker->not_full);
+        pthread_mutex_unlock(&worker->mutex);
+
+        if (!dispatcher->callback_requested_stop && !dispatcher->handler->handle(message.id, message.data, message.size)) {
+            DEBUG_MSG("%s: message callback returns false. Stop dispatching", __FUNCTION__);
+            dispatcher->callback_requested_stop = true;
+        }
+        delete[] message.data;
+    }
+
+    return NULL;
+}
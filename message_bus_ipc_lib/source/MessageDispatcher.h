@@ -0,0 +1,107 @@
+/**
+ *   @file: MessageDispatcher.h
+ *
+ *   @date: Oct 18, 2026
+ */
+
+#ifndef MESSAGE_BUS_IPC_LIB_SOURCE_MESSAGEDISPATCHER_H_
+#define MESSAGE_BUS_IPC_LIB_SOURCE_MESSAGEDISPATCHER_H_
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <pthread.h>
+#include <stdint.h>
+
+namespace messagebusipc {
+
+/**
+ * @class   MessageDispatcher
+ * @brief   Hands incoming messages over to a pool of worker threads.
+ *          Messages of the same key are handled one after another in arrival order, messages of different keys run in parallel.
+ *          Pass a pointer to the dispatcher as MessageClient callback:
+ *              MessageDispatcher dispatcher(callback, 4);
+ *              client.initializeAndListen(&dispatcher, "name");
+ */
+class MessageDispatcher {
+public:
+    enum DispatchStatus { DISPATCHED, DISPATCH_STOPPED, DISPATCH_WOULD_BLOCK };
+
+    // returns the key that decides which messages need to keep their order
+    typedef uint32_t (*KeyFunc)(uint32_t id, const char *data, uint32_t size, const std::string &sender);
+
+    static uint32_t keyBySender(uint32_t id, const char *data, uint32_t size, const std::string &sender);
+    static uint32_t keyByMessageId(uint32_t id, const char *data, uint32_t size, const std::string &sender);
+
+    /**
+     * @param   callback bool (*callback)(uint32_t &id, char *data, uint32_t &size), called from worker threads.
+     *          When callback returns false, MessageClient stops listening on the next message
+     * @param   num_workers Number of worker threads
+     * @param   key_func Message key for ordering
+     */
+    template<class Callback>
+    MessageDispatcher(Callback callback, unsigned num_workers, KeyFunc key_func = keyBySender) :
+            handler(new CallbackHandler<Callback>(callback)) {
+        startWorkers(num_workers, key_func);
+    }
+    ~MessageDispatcher();
+
+    bool dispatch(uint32_t id, const char *data, uint32_t size, const std::string &sender);
+    DispatchStatus tryDispatch(uint32_t id, const char *data, uint32_t size, const std::string &sender);
+    int readyDescriptor() const { return ready_fd; }
+    void stop();
+
+private:
+    static const unsigned MAX_QUEUED_MESSAGES_PER_WORKER = 1024;
+
+    struct Handler {
+        virtual ~Handler() {}
+        virtual bool handle(uint32_t &id, char *data, uint32_t &size) = 0;
+    };
+
+    template<class Callback>
+    struct CallbackHandler : public Handler {
+        Callback callback;
+        CallbackHandler(Callback callback) :
+                callback(callback) {
+        }
+        bool handle(uint32_t &id, char *data, uint32_t &size) {
+            return callback(id, data, size);
+        }
+    };
+
+    struct QueuedMessage {
+        uint32_t id;
+        uint32_t size;
+        char *data;
+    };
+
+    struct Worker {
+        Worker();
+        ~Worker();
+        MessageDispatcher *dispatcher;
+        pthread_t thread;
+        pthread_mutex_t mutex;
+        pthread_cond_t not_empty;
+        pthread_cond_t not_full;
+        std::deque<QueuedMessage> messages;
+        bool stopping;
+    };
+
+    Handler *handler;
+    KeyFunc key_func;
+    std::vector<Worker*> workers;
+    volatile bool callback_requested_stop;
+    int ready_fd; // eventfd, signaled when a full worker queue gets room again; see tryDispatch
+
+    void startWorkers(unsigned num_workers, KeyFunc key_func);
+    DispatchStatus enqueue(uint32_t id, const char *data, uint32_t size, const std::string &sender, bool wait);
+    static void* workerFunc(void* varg);
+
+    MessageDispatcher(const MessageDispatcher&);
+    MessageDispatcher& operator=(const MessageDispatcher&);
+};
+
+}
+
+#endif /* MESSAGE_BUS_IPC_LIB_SOURCE_MESSAGEDISPATCHER_H_ */
@@ -5,24 +5,84 @@
  * @author: Mateusz Midor
  */
 
+#include <sys/socket.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <cstring>
+#include <algorithm>
 #include <pthread.h>
 #include "MessageBusIpcCommon.h"
 #include "MessageChannel.h"
+#include "PThreadLockGuard.h"
 #include "MessageHub.h"
 
 using namespace messagebusipc;
 
+MessageHub::MessageHub(const MessageHubConfig &config) :
+        config(config), router_busy_poll(config.router_busy_poll), io_busy_poll(config.io_busy_poll) {
+}
+
+MessageHub::~MessageHub() {
+}
+
 /**
  * @name    runAndForget
  * @param   own_thread Should it be run in its own thread(non-blocking run)
+ * @param   config Optional features, see MessageHubConfig
  * @brief   Run the MessageHub and forget about it
  * @return  True on succcess, False otherwise
  */
-bool MessageHub::runAndForget(bool own_thread) {
+bool MessageHub::runAndForget(bool own_thread, const MessageHubConfig &config) {
     if (own_thread)
-        return runInSeparateThread(); // doesn't block
+        return runInSeparateThread(config); // doesn't block
     else
-        return (bool)runInCurrentThread(); // does block
+        return (bool)runInCurrentThread(new MessageHubConfig(config)); // does block
+}
+
+/**
+ * @name    start
+ * @brief   Run this hub in its own thread; for the callers that keep the hub, eg. to call setBusyPoll on it later
+ * @return  True if the thread started, False otherwise
+ * @note    The hub must outlive the thread; it runs until another hub takes over, see MessageHubConfig::hot_restart_address
+ */
+bool MessageHub::start() {
+    pthread_t thread;
+    int return_code = pthread_create(&thread, NULL, MessageHub::runFunc, (void*) this);
+    if (return_code) {
+        ERROR_MSG("%s: pthread_create failed with error code: %d", __FUNCTION__, return_code);
+        return false;
+    }
+
+    return_code = pthread_detach(thread);
+    if (return_code) {
+        ERROR_MSG("%s: pthread_detach failed with error code: %d", __FUNCTION__, return_code);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @name    runFunc
+ * @param   varg Holds MessageHub*, see start
+ */
+void* MessageHub::runFunc(void* varg) {
+    MessageHub *hub = (MessageHub*) varg;
+    return (void*)hub->run();
+}
+
+/**
+ * @name    setBusyPoll
+ * @brief   Switch busy polling of this hub, like MessageHubConfig::router_busy_poll and io_busy_poll
+ * @note    Can be called any time from any thread; the router and client handlers take it up when they wait for the next message.
+ *          Hubs started with runAndForget keep what their config says
+ */
+void MessageHub::setBusyPoll(const BusyPollConfig &router_busy_poll, const BusyPollConfig &io_busy_poll) {
+    __atomic_store_n(&this->router_busy_poll.spin_useconds, router_busy_poll.spin_useconds, __ATOMIC_RELAXED);
+    __atomic_store_n(&this->router_busy_poll.cpu, router_busy_poll.cpu, __ATOMIC_RELAXED);
+    __atomic_store_n(&this->io_busy_poll.spin_useconds, io_busy_poll.spin_useconds, __ATOMIC_RELAXED);
+    __atomic_store_n(&this->io_busy_poll.cpu, io_busy_poll.cpu, __ATOMIC_RELAXED);
+    message_queue.setBusyPoll(router_busy_poll.spin_useconds);
 }
 
 /**
@@ -30,19 +90,21 @@ bool MessageHub::runAndForget(bool own_thread) {
  * @brief   Create a thread and then run the MessageHub in that thread
  * @return  True on success, False otherwise
  */
-bool MessageHub::runInSeparateThread() {
+bool MessageHub::runInSeparateThread(const MessageHubConfig &config) {
     pthread_t thread;
     int return_code;
 
-    return_code = pthread_create(&thread, NULL, MessageHub::runInCurrentThread, NULL);
+    MessageHubConfig *arg = new MessageHubConfig(config);
+    return_code = pthread_create(&thread, NULL, MessageHub::runInCurrentThread, (void*) arg);
     if (return_code) {
-        DEBUG_MSG("%s: pthread_create failed with error code: %d", __FUNCTION__, return_code);
+        ERROR_MSG("%s: pthread_create failed with error code: %d", __FUNCTION__, return_code);
+        delete arg;
         return false;
     }
 
     return_code = pthread_detach(thread);
     if (return_code) {
-        DEBUG_MSG("%s: pthread_detach failed with error code: %d", __FUNCTION__, return_code);
+        ERROR_MSG("%s: pthread_detach failed with error code: %d", __FUNCTION__, return_code);
         return false;
     }
     return true;
@@ -50,10 +112,12 @@ bool MessageHub::runInSeparateThread() {
 
 /**
  * @name    runInCurrentThread
- * @param   varg Not used. Only there so this function can be used as pthread_create routine
+ * @param   varg Holds MessageHubConfig*, deleted here. void* so this function can be used as pthread_create routine
  */
 void* MessageHub::runInCurrentThread(void* varg) {
-    MessageHub hub;
+    MessageHubConfig *config = (MessageHubConfig*) varg;
+    MessageHub hub(*config);
+    delete config;
     return (void*)hub.run();
 }
 
@@ -63,18 +127,40 @@ void* MessageHub::runInCurrentThread(void* varg) {
  * @return  true if successfully initialized and run, false otherwise
  */
 bool MessageHub::run() {
-    // 1. prepare listening server
-    if (!server.init())
+    // 1. prepare listening server; with hot restart take the listening sockets and clients over from the running hub, if there is one
+    std::vector<MessageChannel> adopted;
+    bool hot_restart_on = !config.hot_restart_address.empty();
+    HotRestart::TakeOverStatus taken = hot_restart_on ? HotRestart::takeOver(config.hot_restart_address, server, adopted) : HotRestart::TAKEOVER_NO_HUB;
+    if (taken == HotRestart::TAKEOVER_CALLED_OFF)
+        return false; // running hub keeps its clients and addresses; try again later
+    if ((taken != HotRestart::TAKEOVER_DONE) && !server.init(config.listen_addresses, config.seqpacket))
         return false;
 
-    // 2. start thread that will route the incoming messages to clients
+    // 2. from now on the next hub can take over from us
+    if (hot_restart_on && !hot_restart.listen(config.hot_restart_address))
+        return false;
+
+    // 3. start thread that will route the incoming messages to clients
     if (!startMessageRouterThread())
         return false;
 
-    // 3. start accepting clients
-    startAcceptClients();
+    // 4. serve the clients taken over
+    adoptClients(adopted);
 
-    return true;
+    // 5. link with other hubs
+    if (!startFederationLinks())
+        return false;
+
+    // 6. accept clients until the next hub connects, then hand everything over to it and leave.
+    //    If the clients don't drain in time the handover is called off and accepting goes on
+    HotRestart::HandOverStatus status;
+    do {
+        server.setStopDescriptor(hot_restart.controlDescriptor());
+        startAcceptClients();
+        status = hot_restart.handOver(server, channel_list, message_queue);
+    } while (status == HotRestart::HANDOVER_CALLED_OFF);
+
+    return status == HotRestart::HANDOVER_DONE;
 }
 
 /**
@@ -86,25 +172,72 @@ bool MessageHub::startMessageRouterThread() {
     pthread_t thread;
     int return_code;
 
-    RouterFuncArg *arg = new RouterFuncArg(message_queue, channel_list);
+    RouterFuncArg *arg = new RouterFuncArg(message_queue, channel_list, config.last_value_cache, config, router_busy_poll,
+                                           config.hot_restart_address.empty() ? NULL : &hot_restart);
+    if (!config.journal_directory.empty() && !arg->journal.open(config.journal_directory, config.journal_segment_size, config.journal_max_segments)) {
+        ERROR_MSG("%s: could not open message journal in %s", __FUNCTION__, config.journal_directory.c_str());
+        delete arg;
+        return false;
+    }
+    if (!config.capture_file.empty() && !arg->capture.open(config.capture_file, config.capture_payloads)) {
+        ERROR_MSG("%s: could not open capture file %s", __FUNCTION__, config.capture_file.c_str());
+        delete arg;
+        return false;
+    }
+
+    message_queue.setBusyPoll(__atomic_load_n(&router_busy_poll.spin_useconds, __ATOMIC_RELAXED));
     return_code = pthread_create(&thread, NULL, MessageHub::routeMessagesFunc, (void*) arg);
     if (return_code) {
-        DEBUG_MSG("%s: pthread_create failed with error code: %d", __FUNCTION__, return_code);
+        ERROR_MSG("%s: pthread_create failed with error code: %d", __FUNCTION__, return_code);
         return false;
     }
 
     return_code = pthread_detach(thread);
     if (return_code) {
-        DEBUG_MSG("%s: pthread_detach failed with error code: %d", __FUNCTION__, return_code);
+        ERROR_MSG("%s: pthread_detach failed with error code: %d", __FUNCTION__, return_code);
         return false;
     }
 
     return true;
 }
 
+/**
+ * @name    startFederationLinks
+ * @brief   Create a thread for every configured federation peer that keeps the link to that hub up
+ * @return  True on successful thread creation, False otherwise
+ */
+bool MessageHub::startFederationLinks() {
+    if (!config.federation_peers.empty() && config.hub_name.empty()) {
+        ERROR_MSG("%s: federation peers given but hub_name is empty", __FUNCTION__);
+        return false;
+    }
+
+    for (std::vector<std::string>::const_iterator it = config.federation_peers.begin(); it != config.federation_peers.end(); ++it) {
+        pthread_t thread;
+        int return_code;
+
+        LinkFuncArg *arg = new LinkFuncArg(*it, config.hub_name, message_queue, channel_list, io_busy_poll, hot_restart);
+        return_code = pthread_create(&thread, NULL, MessageHub::linkWithHubFunc, (void*) arg);
+        if (return_code) {
+            ERROR_MSG("%s: pthread_create failed with error code: %d", __FUNCTION__, return_code);
+            delete arg;
+            return false;
+        }
+
+        return_code = pthread_detach(thread);
+        if (return_code) {
+            ERROR_MSG("%s: pthread_detach failed with error code: %d", __FUNCTION__, return_code);
+            return false;
+        }
+    }
+
+    return true;
+}
+
 /**
  * @name    startAcceptClients
  * @brief   Start listening to incoming client connections and handle them in dedicated threads
+ * @note    Returns only when the next hub takes over, see HotRestart
  */
 void MessageHub::startAcceptClients() {
 
@@ -113,26 +246,46 @@ void MessageHub::startAcceptClients() {
 
         // 1. accept new communication channel
         MessageChannel channel = server.acceptOne();
+        if (channel.fileDescriptor() == UNINITIALIZED_SOCKET_FD)
+            break;
 
-        // 2. put it on the list so the router function knows about it
-        channel_list.add(channel);
-
-        // 3. send ID_CLIENT_SAYS_HELLO from new to all connected clients and vice versa
-        broadcastClientConnected(channel_list, channel);
+        // 2. handle the client in separate thread; it waits for the client to say hello there, see greetClient
+        if (!handleClientInSeparateThread(channel, true)) {
+            ERROR_MSG("%s: handleClientInSeparateThread failed", __FUNCTION__);
+            channel.shutDown();
+        }
+    }
+}
 
-        // 4. handle the client in separate thread
-        if (!handleClientInSeparateThread(channel))
-            DEBUG_MSG("%s: handleClientInSeparateThread failed", __FUNCTION__);
+/**
+ * @name    adoptClients
+ * @brief   Serve the clients taken over from the previous hub; they are connected and know each other already, so no HELLO exchange
+ * @param   channels Client connections, each followed by the logical clients attached to it
+ */
+void MessageHub::adoptClients(const std::vector<MessageChannel> &channels) {
+    // logical clients take turns at the socket with their connection
+    std::vector<MessageChannel> adopted(channels);
+    for (std::vector<MessageChannel>::iterator it = adopted.begin(); it != adopted.end(); ++it) {
+        if (!it->isMultiplexed())
+            it->serializeSends();
+        else if (it != adopted.begin())
+            it->shareSends(*(it - 1));
+        channel_list.add(*it);
     }
+
+    for (std::vector<MessageChannel>::iterator it = adopted.begin(); it != adopted.end(); ++it)
+        if (!it->isMultiplexed() && !handleClientInSeparateThread(*it))
+            ERROR_MSG("%s: handleClientInSeparateThread failed", __FUNCTION__);
 }
 
 /**
  * @name    broadcastClientConnected
  * @brief   Send ID_CLIENT_SAYS_HELLO from new client to all connected clients
  *          and from every connected client to the new client
+ * @param   existing The clients listed before the new one; the ones listed after say hello themselves
  */
-void MessageHub::broadcastClientConnected(ThreadsafeChannelList &channel_list, MessageChannel &connected) {
-    ThreadsafeChannelList::Iterator it  = channel_list.getIterator(); // this is thread sync point
+void MessageHub::broadcastClientConnected(ThreadsafeChannelList::Iterator &existing, const MessageChannel &connected) {
+    ThreadsafeChannelList::Iterator &it = existing;
     MessageChannel const * channel;
     const std::string &connected_name = connected.name();
     while ((channel = it.getNext()))
@@ -159,26 +312,74 @@ void MessageHub::broadcastClientDisconnected(ThreadsafeChannelList &channel_list
             channel->send(ID_CLIENT_SAYS_GOODBYE, disconnected_name.c_str(), disconnected_name.length() + 1, "");
 }
 
+/**
+ * @name    brokerPeerChannel
+ * @brief   Create a socketpair and hand its ends to the requesting client and the named peer,
+ *          so they can exchange messages directly without the hub in between
+ * @return  True if the channel was handed over to both peers, False otherwise
+ */
+bool MessageHub::brokerPeerChannel(ThreadsafeChannelList &channel_list, MessageChannel &requester, const char *peer_name) {
+    ThreadsafeChannelList::Iterator it  = channel_list.getIterator(); // this is thread sync point
+    MessageChannel const * peer = NULL;
+    MessageChannel const * channel;
+    while ((channel = it.getNext()))
+        if ((*channel != requester) && !channel->isMultiplexed() && (channel->name() == peer_name)) {
+            peer = channel;
+            break;
+        }
+
+    if (!peer) {
+        DEBUG_MSG("%s: no such peer: %s", __FUNCTION__, peer_name);
+        return false;
+    }
+
+    // socket descriptors can't travel over tcp; such clients keep talking through the hub
+    if (!requester.supportsDescriptorPassing() || !peer->supportsDescriptorPassing()) {
+        DEBUG_MSG("%s: %s <-> %s not both on unix socket", __FUNCTION__, requester.name().c_str(), peer_name);
+        return false;
+    }
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1) {
+        ERROR_MSG("%s: socketpair failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+        return false;
+    }
+
+    // each peer gets one end of the socketpair and the name of the other peer
+    const std::string &requester_name = requester.name();
+    bool success = requester.sendDescriptor(ID_PEER_CHANNEL_ESTABLISHED, peer_name, strlen(peer_name) + 1, "", fds[0]) &&
+                   peer->sendDescriptor(ID_PEER_CHANNEL_ESTABLISHED, requester_name.c_str(), requester_name.length() + 1, "", fds[1]);
+    DEBUG_MSG("%s: %s <-> %s %s", __FUNCTION__, requester_name.c_str(), peer_name, success ? "established" : "failed");
+
+    // the peers own their duplicates now
+    close(fds[0]);
+    close(fds[1]);
+    return success;
+}
+
 /**
  * @name    handleClientInSeparateThread
  * @param   channel Communication channel of the connection that we want to handle
+ * @param   await_hello True for just accepted connection that didn't say hello yet
  * @brief   Create a thread and make it handle the new connection
  * @return  True on successful thread creation and run, False otherwise
  */
-bool MessageHub::handleClientInSeparateThread(MessageChannel &channel) {
+bool MessageHub::handleClientInSeparateThread(MessageChannel &channel, bool await_hello) {
     pthread_t thread;
     int return_code;
 
-    ClientFuncArg *arg = new ClientFuncArg(channel, message_queue, channel_list);
+    ClientFuncArg *arg = new ClientFuncArg(channel, message_queue, io_busy_poll, hot_restart);
+    arg->await_hello = await_hello;
+    arg->accept_hub_links = !config.hub_name.empty();
     return_code = pthread_create(&thread, NULL, MessageHub::handleClientFunc, (void*) arg);
     if (return_code) {
-        DEBUG_MSG("%s: pthread_create failed with error code: %d", __FUNCTION__, return_code);
+        ERROR_MSG("%s: pthread_create failed with error code: %d", __FUNCTION__, return_code);
         return false;
     }
 
     return_code = pthread_detach(thread);
     if (return_code) {
-        DEBUG_MSG("%s: pthread_detach failed with error code: %d", __FUNCTION__, return_code);
+        ERROR_MSG("%s: pthread_detach failed with error code: %d", __FUNCTION__, return_code);
         return false;
     }
 
@@ -193,6 +394,12 @@ bool MessageHub::handleClientInSeparateThread(MessageChannel &channel) {
  */
 void* MessageHub::handleClientFunc(void* varg) {
     ClientFuncArg *arg = (ClientFuncArg*) varg;
+    if (arg->await_hello && !greetClient(*arg)) {
+        arg->channel.shutDown();
+        delete arg;
+        return NULL;
+    }
+
     MessageChannel channel = arg->channel;
     const char *sender_name = channel.name().c_str();
 
@@ -201,24 +408,213 @@ void* MessageHub::handleClientFunc(void* varg) {
     std::string recipient;
     char *data = new char[MESSAGE_BUFF_SIZE];
 
-    while (channel.receive(message_id, data, size, recipient)) {
-        const char *message_name = GetMessageName((MessageBusMessage)message_id);
-        const char *recipient_name = recipient.c_str();
-        DEBUG_MSG("received message %s (%u), %s -> %s, size %d", message_name, message_id, sender_name, recipient_name, size);
-        (void)sender_name; (void)message_name; (void)recipient_name; // silent 'unused variable' warning
+    CpuPinning pinning;
+    AdaptiveSpinner spinner;
+
+    bool handed_over = false;
+
+    while (true) {
+        // busy polling: spin a while for the next message before falling asleep in receive; see MessageHub::setBusyPoll.
+        // Each check is a syscall, so the spinner backs off between them
+        pinning.apply(__atomic_load_n(&arg->busy_poll.cpu, __ATOMIC_RELAXED));
+        spinner.configure(__atomic_load_n(&arg->busy_poll.spin_useconds, __ATOMIC_RELAXED));
+        if (spinner.enabled())
+            spinner.spin([&channel] { return channel.hasInput(); }, AdaptiveSpinner::SYSCALL_MAX_PAUSES);
+
+        // hot restart: stop between messages, the next hub receives the rest
+        if (!arg->hot_restart.awaitMessage(channel)) {
+            if (arg->hot_restart.stopHandler(channel, arg->message_queue)) {
+                handed_over = true;
+                break;
+            }
+            continue; // handover called off
+        }
+
+        if (!channel.receive(message_id, data, size, recipient))
+            break;
+
+        DEBUG_MSG("received message %s (%u), %s -> %s, size %d", GetMessageName((MessageBusMessage)message_id), message_id, sender_name, recipient.c_str(), size);
+
+        // presence notifications and hot restart are the hub's business only
+        if ((message_id == ID_CLIENT_SAYS_HELLO) || (message_id == ID_CLIENT_SAYS_GOODBYE))
+            continue;
+
+        // logical client is introduced like a connected one; hubs don't attach
+        if (message_id == ID_CLIENT_ATTACHES) {
+            if (!(channel.helloFlags() & HELLO_FLAG_HUB_LINK))
+                awaitIntroduction(*arg, message_id, data, size);
+            continue;
+        }
+        if ((message_id >= ID_HOT_RESTART_LISTENER) && (message_id <= ID_HOT_RESTART_HANDOVER))
+            continue;
+
+        // client talks the new wire protocol version from the next message on; only this thread receives from it
+        if (message_id == ID_WIRE_VERSION_SWITCH) {
+            uint32_t version = 0;
+            if (size >= sizeof(version))
+                memcpy(&version, data, sizeof(version));
+            if ((version == WIRE_VERSION_1) || (version == WIRE_VERSION_2))
+                channel.setReceiveVersion(version);
+            else
+                ERROR_MSG("%s: %s switches to unknown wire version %u", __FUNCTION__, sender_name, version);
+            continue;
+        }
+
         arg->message_queue.push(channel, message_id, data, size, recipient);
     }
-    DEBUG_MSG("%s: client disconnected: %s", __FUNCTION__, channel.name().c_str());
+    DEBUG_MSG("%s: client %s: %s", __FUNCTION__, handed_over ? "handed over" : "disconnected", channel.name().c_str());
 
-    broadcastClientDisconnected(arg->channel_list, channel);
-    arg->channel_list.removeByValue(channel);
-    channel.shutDown(); // make sure the other side knows we are not listening anymore
+    // the router dismisses the clients it introduced, so the two can't happen out of order
+    // and resumable session doesn't lose a message in between. Client handed over stays connected, it is the next hub's now
+    if (!handed_over)
+        arg->message_queue.push(channel, ID_CLIENT_SAYS_GOODBYE, NULL, 0, "");
     delete[] data;
     delete arg;
 
     return NULL;
 }
 
+/**
+ * @name    greetClient
+ * @brief   Wait for just accepted client to say hello, then have the router introduce it
+ * @return  True if the client is on its way to the list, False if the connection is to be dropped
+ * @note    Run by the client handler thread, so a client slow to say hello holds up nobody else
+ */
+bool MessageHub::greetClient(ClientFuncArg &arg) {
+    MessageChannel &channel = arg.channel;
+    if (!MessageServer::awaitHello(channel)) {
+        DEBUG_MSG("%s: client didn't say hello, dropping the connection", __FUNCTION__);
+        return false;
+    }
+
+    // other hub wants to link with us; only federated hubs accept that
+    bool hub_link = channel.helloFlags() & HELLO_FLAG_HUB_LINK;
+    if (hub_link && !arg.accept_hub_links) {
+        DEBUG_MSG("%s: hub %s wants to link but federation is off, refused", __FUNCTION__, channel.name().c_str());
+        return false;
+    }
+
+    // any thread may send to the client from now on, they take turns at the socket
+    channel.serializeSends();
+
+    // the router adds the link, see HubFederation::addLink
+    if (hub_link) {
+        arg.message_queue.push(channel, ID_CLIENT_SAYS_HELLO, NULL, 0, "");
+        return true;
+    }
+
+    // have the router put it on the list, then send it the resumed session, the HELLOs and the last values from here.
+    // Client greeted during hot restart handover after the router drained is not handed over; it gets disconnected and reconnects
+    return awaitIntroduction(arg, ID_CLIENT_SAYS_HELLO, NULL, 0);
+}
+
+/**
+ * @name    awaitIntroduction
+ * @brief   Have the router list the client, then send it what it missed while away, ID_CLIENT_SAYS_HELLO from new to all connected clients
+ *          and vice versa, and the last values. Messages routed to the client meanwhile wait, see MessageChannel::holdSends,
+ *          so they go out after all that
+ * @param   id ID_CLIENT_SAYS_HELLO for the connection, ID_CLIENT_ATTACHES with its data for logical client on it
+ * @return  True if the client is listed, False if the router refused it or the hub is handing over
+ * @note    Run by the client handler thread, so the router doesn't wait for the client's socket
+ */
+bool MessageHub::awaitIntroduction(ClientFuncArg &arg, uint32_t id, const char *data, uint32_t size) {
+    MessageChannel &channel = arg.channel;
+    if (size > MESSAGE_BUFF_SIZE - sizeof(Introduction*)) {
+        ERROR_MSG("%s: %s sent message %u of size %u, too big", __FUNCTION__, channel.name().c_str(), id, size);
+        return false;
+    }
+
+    // the router learns where the introduction is from the message
+    Introduction *intro = new Introduction;
+    std::vector<char> request(sizeof(intro) + size);
+    memcpy(&request[0], &intro, sizeof(intro));
+    if (size > 0)
+        memcpy(&request[sizeof(intro)], data, size);
+
+    channel.holdSends();
+    arg.message_queue.push(channel, id, &request[0], request.size(), "");
+
+    // the router is gone once the handover is done, unless the connection is listed and so handed over
+    pthread_mutex_lock(&intro->mutex);
+    while (!intro->ready) {
+        timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += INTRODUCTION_WAIT_MS * 1000 * 1000;
+        deadline.tv_sec += deadline.tv_nsec / (1000 * 1000 * 1000);
+        deadline.tv_nsec %= 1000 * 1000 * 1000;
+        pthread_cond_timedwait(&intro->cond, &intro->mutex, &deadline);
+        if (!intro->ready && (id == ID_CLIENT_SAYS_HELLO) && arg.hot_restart.stopRequested()) {
+            intro->abandoned = true;
+            pthread_mutex_unlock(&intro->mutex);
+            channel.releaseSends();
+            return false;
+        }
+    }
+    pthread_mutex_unlock(&intro->mutex);
+
+    bool accepted = intro->accepted;
+    if (accepted) {
+        const MessageChannel &connected = intro->connected;
+
+        // 1. resumed session
+        for (std::deque<SessionStore::Message>::iterator it = intro->replay.begin(); it != intro->replay.end(); ++it) {
+            const char *data = it->data.empty() ? NULL : &it->data[0];
+            if (!connected.send(it->id, data, it->data.size(), it->sender.c_str()))
+                break;
+        }
+
+        // 2. HELLO exchange
+        broadcastClientConnected(*intro->existing, connected);
+        for (std::vector<std::string>::iterator it = intro->remote_clients.begin(); it != intro->remote_clients.end(); ++it)
+            connected.send(ID_CLIENT_SAYS_HELLO, it->c_str(), it->length() + 1, "");
+
+        // 3. snapshot of the bus state
+        for (std::vector<LastValueCache::Value>::iterator it = intro->last_values.begin(); it != intro->last_values.end(); ++it) {
+            const char *data = it->data.empty() ? NULL : &it->data[0];
+            if (!connected.send(it->id, data, it->data.size(), it->sender.c_str()))
+                break;
+        }
+    }
+
+    // the clients that were listed may be closed once the introduction lets go of them
+    channel.releaseSends();
+    delete intro;
+    return accepted;
+}
+
+/**
+ * @name    linkWithHubFunc
+ * @param   varg Holds LinkFuncArg*
+ * @brief   Connect to other hub as a link, then handle the link like a client connection; reconnect when it breaks
+ * @note    This is run in a dedicated thread
+ */
+void* MessageHub::linkWithHubFunc(void* varg) {
+    LinkFuncArg *arg = (LinkFuncArg*) varg;
+    const uint32_t hello_flags = HELLO_FLAG_HUB_LINK;
+
+    // hot restart: the next hub makes its own links
+    while (!arg->hot_restart.stopRequested()) {
+        MessageChannel link;
+        if (link.connectToMessageHub(arg->address.c_str()) &&
+            link.send(ID_CLIENT_SAYS_HELLO, (const char*)&hello_flags, sizeof(hello_flags), arg->hub_name.c_str())) {
+            link.setName(arg->address);
+            link.setHelloFlags(hello_flags);
+            link.serializeSends();
+
+            // the router adds the link, then handleClientFunc receives from it until it breaks and asks the router to remove it
+            arg->message_queue.push(link, ID_CLIENT_SAYS_HELLO, NULL, 0, "");
+            handleClientFunc(new ClientFuncArg(link, arg->message_queue, arg->busy_poll, arg->hot_restart));
+        }
+        else
+            link.shutDown();
+
+        usleep(LINK_RETRY_MS * 1000);
+    }
+
+    delete arg;
+    return NULL;
+}
+
 /**
  * @name    routeMessagesFunc
  * @param   varg Holds RouterFuncArg*
@@ -233,29 +629,313 @@ void* MessageHub::routeMessagesFunc(void* varg) {
     uint32_t message_id;
     uint32_t size;
     std::string recipient_name;
-    char *data = new char[MESSAGE_BUFF_SIZE];
+    std::string forwarded_sender_name;
+    char *buffer = new char[MESSAGE_BUFF_SIZE];
+    HubFederation &federation = arg->federation;
+
+    CpuPinning pinning;
 
-    // route messages forever
+    // route messages until the next hub takes over
     while (true) {
-        // get message
+        // get message; the queue spins as MessageHub::setBusyPoll says, the core is picked here
+        pinning.apply(__atomic_load_n(&arg->busy_poll.cpu, __ATOMIC_RELAXED));
+        char *data = buffer;
         arg->message_queue.pop(sender, message_id, data, size, recipient_name);
+        bool from_hub = sender.helloFlags() & HELLO_FLAG_HUB_LINK;
+
+        // hot restart: client handler or accepting stopped; once all did and everything they received is routed, the next hub takes over
+        if (message_id == ID_HOT_RESTART_HANDOVER) {
+            if (arg->hot_restart && arg->hot_restart->handlerStopped(sender, data, size, arg->channel_list))
+                break;
+            continue;
+        }
+
+        // client or hub link connected or disconnected; see greetClient, handleClientFunc and linkWithHubFunc
+        if (message_id == ID_CLIENT_SAYS_HELLO) {
+            if (from_hub)
+                federation.addLink(sender, arg->channel_list);
+            else
+                welcomeClient(*arg, sender, message_id, data, size);
+            continue;
+        }
+        if (message_id == ID_CLIENT_SAYS_GOODBYE) {
+            if (from_hub)
+                federation.removeLink(sender, arg->channel_list);
+            else {
+                detachAllClients(arg->channel_list, arg->sessions, federation, sender);
+                dismissClient(arg->channel_list, arg->sessions, federation, sender);
+                ThreadsafeChannelList::Iterator it = arg->channel_list.getIterator();
+                arg->consumer_groups.dropEmptyGroups(it);
+            }
+            continue;
+        }
+
+        // logical clients come and go on client connection; see MessageClient::attachClient
+        if ((message_id == ID_CLIENT_ATTACHES) || (message_id == ID_CLIENT_DETACHES)) {
+            if (from_hub)
+                continue;
+
+            if (message_id == ID_CLIENT_ATTACHES)
+                welcomeClient(*arg, sender, message_id, data, size);
+            else {
+                data[size] = '\0';
+                detachClient(arg->channel_list, arg->sessions, federation, sender, data);
+                ThreadsafeChannelList::Iterator it = arg->channel_list.getIterator();
+                arg->consumer_groups.dropEmptyGroups(it);
+            }
+            continue;
+        }
+
+        // message of logical client; from here on it is routed as if the logical client had its own connection.
+        // Internal messages are not taken from logical clients, peer channels are for connections only
+        if (message_id == ID_MUX_FORWARD) {
+            if (from_hub || !MessageChannel::openEnvelope(data, size, message_id, forwarded_sender_name) || (message_id >= ID_CLIENT_SAYS_HELLO))
+                continue;
+
+            if (!findAttachedClient(arg->channel_list, sender, forwarded_sender_name, sender)) {
+                DEBUG_MSG("%s: message %u from %s that is not attached", __FUNCTION__, message_id, forwarded_sender_name.c_str());
+                continue;
+            }
+        }
+
+        // peer channel requests are handled by the hub itself, not routed
+        if (message_id == ID_CLIENT_REQUESTS_PEER_CHANNEL) {
+            if (!from_hub) {
+                data[size] = '\0';
+                brokerPeerChannel(arg->channel_list, sender, data);
+            }
+            continue;
+        }
+
+        // federation traffic is accepted from hub links only; forwarded message is delivered here on behalf of its original sender
+        const std::string *origin_name = &sender.name();
+        if ((message_id >= ID_HUB_CLIENT_JOINED) && (message_id <= ID_HUB_FORWARD)) {
+            if (!from_hub)
+                continue;
+
+            if (message_id != ID_HUB_FORWARD) {
+                if (size > 0) {
+                    data[size - 1] = '\0';
+                    federation.updateMembership(sender, message_id, data, arg->channel_list);
+                }
+                continue;
+            }
+
+            if (!HubFederation::unpack(data, size, message_id, forwarded_sender_name))
+                continue;
+            origin_name = &forwarded_sender_name;
+        }
+
+        if (arg->journal.isOpen())
+            arg->journal.append(message_id, data, size, *origin_name, recipient_name);
+
+        if (arg->capture.isOpen())
+            arg->capture.append(message_id, data, size, *origin_name, recipient_name);
+
+        SessionStore &sessions = arg->sessions;
+        sessions.expire();
         ThreadsafeChannelList::Iterator it = arg->channel_list.getIterator();
 
+        // recipient knows who it is; tell it who the sender is instead
+        const char *sender_name = origin_name->c_str();
+
+        // other hubs deliver to their clients; what came from other hub is not passed any further
+        if (!from_hub && !federation.empty())
+            federation.forward(message_id, data, size, *origin_name, recipient_name);
+
         // broadcast
         if (recipient_name == MBUS_ALL_CONNECTED_CLIENTS) {
             while ((recipient = it.getNext()))
                 if (*recipient != sender)
-                    recipient->send(message_id, data, size, ""); // dont include recipient_name; no need
+                    if (!recipient->send(message_id, data, size, sender_name) && (recipient->helloFlags() & HELLO_FLAG_RESUME_SESSION))
+                        sessions.suspend(recipient->name()); // it is going away; keep the message until handleClientFunc notices
+
+            if (!sessions.empty())
+                sessions.bufferForAll(message_id, data, size, *origin_name);
+
+            if (arg->last_values.enabled() && (message_id < ID_CLIENT_SAYS_HELLO))
+                arg->last_values.update(message_id, data, size, *origin_name);
         }
-        // multicast
+        // multicast; of the consumer group members only the picked one gets the message
         else {
+            const MessageChannel *member = arg->consumer_groups.pick(it, recipient_name, sender, data, size, *origin_name);
+            it.reset();
             while ((recipient = it.getNext()))
                 if ((*recipient != sender) && (recipient->name() == recipient_name))
-                    recipient->send(message_id, data, size, ""); // dont include recipient_name; no need
+                    if (!(recipient->helloFlags() & HELLO_FLAG_CONSUMER_GROUP) || (recipient == member))
+                        if (!recipient->send(message_id, data, size, sender_name) && (recipient->helloFlags() & HELLO_FLAG_RESUME_SESSION))
+                            sessions.suspend(recipient_name); // it is going away; keep the message until handleClientFunc notices
+
+            if (!sessions.empty())
+                sessions.buffer(recipient_name, message_id, data, size, *origin_name);
         }
     }
 
-    delete[] data;
+    delete[] buffer;
     delete arg;
     return NULL;
 }
+
+/**
+ * @name    welcomeClient
+ * @brief   Do the router's part of the introduction the client handler waits for, see awaitIntroduction
+ * @param   data Introduction pointer, for ID_CLIENT_ATTACHES followed by what the client sent
+ * @note    Called by the router thread
+ */
+void MessageHub::welcomeClient(RouterFuncArg &arg, const MessageChannel &sender, uint32_t id, const char *data, uint32_t size) {
+    Introduction *intro;
+    if (size < sizeof(intro))
+        return;
+    memcpy(&intro, data, sizeof(intro));
+
+    pthread_mutex_lock(&intro->mutex);
+    if (intro->abandoned) {
+        pthread_mutex_unlock(&intro->mutex);
+        delete intro;
+        return;
+    }
+
+    if (id == ID_CLIENT_ATTACHES)
+        intro->accepted = attachClient(arg.channel_list, arg.sessions, arg.last_values, arg.federation, sender, data + sizeof(intro), size - sizeof(intro), *intro);
+    else {
+        intro->connected = sender;
+        introduceClient(arg.channel_list, arg.sessions, arg.last_values, arg.federation, *intro);
+        intro->accepted = true;
+    }
+
+    intro->ready = true;
+    pthread_cond_signal(&intro->cond);
+    pthread_mutex_unlock(&intro->mutex);
+}
+
+/**
+ * @name    introduceClient
+ * @brief   List the client and gather what it is to get first: messages buffered while it was away, the clients to say hello to
+ *          and the latest cached broadcasts; the client handler sends them, see awaitIntroduction
+ * @note    Called by the router thread. The handler holds the client's socket, so anything routed to the client meanwhile comes after
+ */
+void MessageHub::introduceClient(ThreadsafeChannelList &channel_list, SessionStore &sessions, const LastValueCache &last_values, HubFederation &federation, Introduction &intro) {
+    const MessageChannel &connected = intro.connected;
+    sessions.resume(connected.name(), intro.replay);
+
+    intro.existing = new ThreadsafeChannelList::Iterator(channel_list.getIterator());
+    channel_list.add(intro.connected);
+    federation.listRemoteClients(intro.remote_clients);
+    federation.announce(ID_HUB_CLIENT_JOINED, connected.name());
+
+    // what the client itself sent last time is not echoed, same as with routing
+    std::vector<const LastValueCache::Value*> values;
+    last_values.snapshot(values);
+    for (std::vector<const LastValueCache::Value*>::iterator it = values.begin(); it != values.end(); ++it)
+        if ((*it)->sender != connected.name())
+            intro.last_values.push_back(**it);
+}
+
+/**
+ * @name    dismissClient
+ * @brief   Say goodbye on behalf of disconnected client and for resumable session start buffering messages addressed to it
+ * @note    Called by the router thread
+ */
+void MessageHub::dismissClient(ThreadsafeChannelList &channel_list, SessionStore &sessions, HubFederation &federation, MessageChannel &disconnected) {
+    broadcastClientDisconnected(channel_list, disconnected);
+    channel_list.removeByValue(disconnected);
+    federation.announce(ID_HUB_CLIENT_LEFT, disconnected.name());
+
+    // channel_list shuts the socket down, so the other side knows we are not listening anymore
+    if (!(disconnected.helloFlags() & HELLO_FLAG_RESUME_SESSION))
+        return;
+
+    // client may have reconnected before its old connection was noticed dead; then there is nothing to suspend
+    bool reconnected = false;
+    {
+        ThreadsafeChannelList::Iterator it = channel_list.getIterator();
+        MessageChannel const *channel;
+        while ((channel = it.getNext()))
+            if (channel->name() == disconnected.name())
+                reconnected = true;
+    }
+    if (!reconnected)
+        sessions.suspend(disconnected.name());
+}
+
+/**
+ * @name    attachClient
+ * @brief   Add logical client to the connection and introduce it like a newly connected client;
+ *          from now on messages for it go over the connection in ID_MUX_FORWARD envelope
+ * @param   data Hello flags followed by the client name
+ * @return  True if attached, False if refused
+ * @note    Called by the router thread
+ */
+bool MessageHub::attachClient(ThreadsafeChannelList &channel_list, SessionStore &sessions, const LastValueCache &last_values, HubFederation &federation,
+                              const MessageChannel &connection, const char *data, uint32_t size, Introduction &intro) {
+    uint32_t flags;
+    if (size <= sizeof(flags))
+        return false;
+
+    memcpy(&flags, data, sizeof(flags));
+    std::string client_name(data + sizeof(flags), strnlen(data + sizeof(flags), std::min(size - (uint32_t)sizeof(flags), MAX_CLIENT_NAME_LENGTH)));
+    if (client_name.empty() || (client_name == connection.name()))
+        return false;
+
+    MessageChannel &attached = intro.connected;
+    if (findAttachedClient(channel_list, connection, client_name, attached)) {
+        DEBUG_MSG("%s: %s already attached to %s", __FUNCTION__, client_name.c_str(), connection.name().c_str());
+        return false;
+    }
+
+    // the copy takes turns at the socket with the connection
+    attached = connection;
+    attached.setName(client_name);
+    attached.setHelloFlags(flags & ~HELLO_FLAG_HUB_LINK);
+    attached.setMultiplexed(true);
+    DEBUG_MSG("%s: %s attached to %s", __FUNCTION__, client_name.c_str(), connection.name().c_str());
+    introduceClient(channel_list, sessions, last_values, federation, intro);
+    return true;
+}
+
+/**
+ * @name    detachClient
+ * @brief   Remove logical client from the connection and say goodbye on its behalf
+ * @note    Called by the router thread
+ */
+void MessageHub::detachClient(ThreadsafeChannelList &channel_list, SessionStore &sessions, HubFederation &federation, const MessageChannel &connection, const char *client_name) {
+    MessageChannel attached;
+    if (findAttachedClient(channel_list, connection, client_name, attached))
+        dismissClient(channel_list, sessions, federation, attached);
+}
+
+/**
+ * @name    detachAllClients
+ * @brief   Connection is gone; so are the logical clients on it
+ * @note    Called by the router thread
+ */
+void MessageHub::detachAllClients(ThreadsafeChannelList &channel_list, SessionStore &sessions, HubFederation &federation, const MessageChannel &connection) {
+    std::vector<MessageChannel> attached;
+    {
+        ThreadsafeChannelList::Iterator it = channel_list.getIterator();
+        MessageChannel const *channel;
+        while ((channel = it.getNext()))
+            if (channel->isMultiplexed() && (channel->fileDescriptor() == connection.fileDescriptor()))
+                attached.push_back(*channel);
+    }
+
+    for (std::vector<MessageChannel>::iterator it = attached.begin(); it != attached.end(); ++it)
+        dismissClient(channel_list, sessions, federation, *it);
+}
+
+/**
+ * @name    findAttachedClient
+ * @param   attached Filled with the logical client channel if found; may be the same object as connection
+ * @return  True if the logical client of given name is attached to the connection, False otherwise
+ */
+bool MessageHub::findAttachedClient(ThreadsafeChannelList &channel_list, const MessageChannel &connection, const std::string &client_name, MessageChannel &attached) {
+    ThreadsafeChannelList::Iterator it = channel_list.getIterator();
+    MessageChannel const *channel;
+    while ((channel = it.getNext()))
+        if (channel->isMultiplexed() && (channel->fileDescriptor() == connection.fileDescriptor()) && (channel->name() == client_name)) {
+            attached = *channel;
+            return true;
+        }
+
+    return false;
+}
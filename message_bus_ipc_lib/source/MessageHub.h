@@ -11,9 +11,48 @@
 #include "MessageServer.h"
 #include "ThreadsafeChannelList.h"
 #include "ThreadsafeMessageQueue.h"
+#include "SessionStore.h"
+#include "MessageJournal.h"
+#include "LastValueCache.h"
+#include "BusyPoll.h"
+#include "HubFederation.h"
+#include "ConsumerGroups.h"
+#include "HotRestart.h"
+#include "TrafficCapture.h"
 
 namespace messagebusipc {
 
+/**
+ * @struct  MessageHubConfig
+ * @brief   Optional MessageHub features; default constructed config runs the hub as it always did
+ */
+struct MessageHubConfig {
+    MessageHubConfig() :
+            listen_addresses(), seqpacket(false), journal_segment_size(64 * 1024 * 1024), journal_max_segments(0), last_value_cache(LAST_VALUE_CACHE_OFF),
+            last_value_cache_max_keys(10000), last_value_cache_max_bytes(64 * 1024 * 1024),
+            consumer_group_policy(CONSUMER_GROUP_ROUND_ROBIN), consumer_group_key_size(0), capture_payloads(false) {
+    }
+
+    std::vector<std::string> listen_addresses; // see HubAddress, eg. "unix:/tmp/ipc_hub" and "tcp:*:5555"; empty means the default address
+    bool seqpacket;                 // also listen on SOCK_SEQPACKET at every unix address + ".seq", see MessageClient::setSeqpacket
+    std::string journal_directory;  // routed messages are appended to journal segments here; empty means no journal
+    uint32_t journal_segment_size;  // bytes per segment file
+    unsigned journal_max_segments;  // oldest segments are deleted above this count; 0 means keep all
+    LastValueCacheMode last_value_cache; // latest broadcast payloads sent to new clients right after the HELLOs
+    uint32_t last_value_cache_max_keys;  // least recently updated values are forgotten above this count; 0 means no limit
+    uint32_t last_value_cache_max_bytes; // likewise above this many payload bytes; each new client gets a copy of the cache
+    BusyPollConfig router_busy_poll;     // router thread spins on the message queue; can be changed later, see MessageHub::setBusyPoll
+    BusyPollConfig io_busy_poll;         // client handler threads spin on their sockets; likewise
+    std::string hub_name;                // federation: name of this hub, sent to linked hubs; empty means no federation, links are refused
+    std::vector<std::string> federation_peers; // federation: addresses of other hubs to link with; link each pair of hubs once, from either side
+    ConsumerGroupPolicy consumer_group_policy; // how a member of consumer group is picked for a message, see MessageClient::enableConsumerGroup
+    uint32_t consumer_group_key_size;          // CONSUMER_GROUP_KEY_AFFINITY: leading payload bytes that make the key along with the sender name
+    std::string hot_restart_address;           // unix socket, see HotRestart; hub started with the same address takes over from the running one,
+                                               // which then exits. Empty means no hot restart
+    std::string capture_file;       // routed traffic is recorded here for load testing, see TrafficCapture; empty means no capture
+    bool capture_payloads;          // capture the payloads too, not only their sizes
+};
+
 /**
  * @class   MessageHub
  * @brief   This is the heart of our star-topology MessageBusIPC; all MessageClients connect to MessageHub in order to send-receive messages
@@ -21,40 +60,126 @@ namespace messagebusipc {
  */
 class MessageHub {
 public:
-    static bool runAndForget(bool own_thread = false);
+    MessageHub(const MessageHubConfig &config = MessageHubConfig());
+    ~MessageHub();
+    static bool runAndForget(bool own_thread = false, const MessageHubConfig &config = MessageHubConfig());
+    bool run();
+    bool start();
+    void setBusyPoll(const BusyPollConfig &router_busy_poll, const BusyPollConfig &io_busy_poll);
 
 private:
 
+    // messages for disconnected clients with HELLO_FLAG_RESUME_SESSION are kept this long and up to this amount
+    const static unsigned SESSION_WINDOW_MS = 10000;
+    const static unsigned SESSION_MAX_MESSAGES = 10000;
+    const static uint32_t SESSION_MAX_BYTES = 64 * 1024 * 1024;
+
+    MessageHubConfig config;
     MessageServer server;
     ThreadsafeMessageQueue message_queue;
     ThreadsafeChannelList channel_list;
+    HotRestart hot_restart;
+
+    // busy polling as the threads see it; starts as in config, see setBusyPoll
+    BusyPollConfig router_busy_poll;
+    BusyPollConfig io_busy_poll;
 
-    bool run();
     bool startMessageRouterThread();
     void startAcceptClients();
-    bool handleClientInSeparateThread(MessageChannel &channel);
-    static bool runInSeparateThread();
-    static void* runInCurrentThread(void* varg = NULL);
-    static void broadcastClientConnected(ThreadsafeChannelList &channel_list, MessageChannel &connected);
+    void adoptClients(const std::vector<MessageChannel> &channels);
+    bool handleClientInSeparateThread(MessageChannel &channel, bool await_hello = false);
+    static bool runInSeparateThread(const MessageHubConfig &config);
+    static void* runInCurrentThread(void* varg);
+    static void* runFunc(void* varg);
+    static void broadcastClientConnected(ThreadsafeChannelList::Iterator &existing, const MessageChannel &connected);
     static void broadcastClientDisconnected(ThreadsafeChannelList &channel_list, MessageChannel &disconnected);
+    static bool brokerPeerChannel(ThreadsafeChannelList &channel_list, MessageChannel &requester, const char *peer_name);
     static void* handleClientFunc(void* varg);
+    struct ClientFuncArg;
+    static bool greetClient(ClientFuncArg &arg);
+    static bool awaitIntroduction(ClientFuncArg &arg, uint32_t id, const char *data, uint32_t size);
     static void* routeMessagesFunc(void* varg);
+    struct RouterFuncArg;
+    static void welcomeClient(RouterFuncArg &arg, const MessageChannel &sender, uint32_t id, const char *data, uint32_t size);
+    struct Introduction;
+    static void introduceClient(ThreadsafeChannelList &channel_list, SessionStore &sessions, const LastValueCache &last_values, HubFederation &federation, Introduction &intro);
+    static void dismissClient(ThreadsafeChannelList &channel_list, SessionStore &sessions, HubFederation &federation, MessageChannel &disconnected);
+    static bool attachClient(ThreadsafeChannelList &channel_list, SessionStore &sessions, const LastValueCache &last_values, HubFederation &federation,
+                             const MessageChannel &connection, const char *data, uint32_t size, Introduction &intro);
+    static void detachClient(ThreadsafeChannelList &channel_list, SessionStore &sessions, HubFederation &federation, const MessageChannel &connection, const char *client_name);
+    static void detachAllClients(ThreadsafeChannelList &channel_list, SessionStore &sessions, HubFederation &federation, const MessageChannel &connection);
+    static bool findAttachedClient(ThreadsafeChannelList &channel_list, const MessageChannel &connection, const std::string &client_name, MessageChannel &attached);
+    bool startFederationLinks();
+    static void* linkWithHubFunc(void* varg);
 
     struct ClientFuncArg {
-        ClientFuncArg(MessageChannel c, ThreadsafeMessageQueue &q, ThreadsafeChannelList &l) :
-                channel(c), message_queue(q), channel_list(l) {
+        ClientFuncArg(MessageChannel c, ThreadsafeMessageQueue &q, BusyPollConfig &b, HotRestart &h) :
+                channel(c), message_queue(q), busy_poll(b), hot_restart(h), await_hello(false), accept_hub_links(false) {
         }
         MessageChannel channel;
         ThreadsafeMessageQueue &message_queue;
-        ThreadsafeChannelList &channel_list;
+        BusyPollConfig &busy_poll; // MessageHub::io_busy_poll
+        HotRestart &hot_restart;
+        bool await_hello;       // just accepted, see greetClient
+        bool accept_hub_links;  // federation on
     };
 
     struct RouterFuncArg {
-        RouterFuncArg(ThreadsafeMessageQueue &q, ThreadsafeChannelList &l) :
-                message_queue(q), channel_list(l) {
+        RouterFuncArg(ThreadsafeMessageQueue &q, ThreadsafeChannelList &l, LastValueCacheMode m, const MessageHubConfig &config, BusyPollConfig &b, HotRestart *h) :
+                message_queue(q), channel_list(l), sessions(SESSION_WINDOW_MS, SESSION_MAX_MESSAGES, SESSION_MAX_BYTES), last_values(m, config.last_value_cache_max_keys, config.last_value_cache_max_bytes),
+                consumer_groups(config.consumer_group_policy, config.consumer_group_key_size), busy_poll(b), hot_restart(h) {
+        }
+        ThreadsafeMessageQueue &message_queue;
+        ThreadsafeChannelList &channel_list;
+        SessionStore sessions;
+        MessageJournal journal;
+        TrafficCapture capture;
+        LastValueCache last_values;
+        HubFederation federation;
+        ConsumerGroups consumer_groups;
+        BusyPollConfig &busy_poll; // MessageHub::router_busy_poll
+        HotRestart *hot_restart; // NULL if off
+    };
+
+    // router's part of introducing a client, handed to the client handler that waits for it; see awaitIntroduction
+    struct Introduction {
+        Introduction() : ready(false), accepted(false), abandoned(false), existing(NULL) {
+            pthread_mutex_init(&mutex, NULL);
+            pthread_cond_init(&cond, NULL);
+        }
+        ~Introduction() {
+            delete existing;
+            pthread_cond_destroy(&cond);
+            pthread_mutex_destroy(&mutex);
+        }
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+        bool ready;             // the router is done
+        bool accepted;          // the client is listed; attach may be refused
+        bool abandoned;         // the handler gave up waiting, the router deletes the introduction
+        MessageChannel connected;                   // the client; for attach the logical client
+        std::deque<SessionStore::Message> replay;   // buffered while the client was away
+        ThreadsafeChannelList::Iterator *existing;  // the clients listed before it
+        std::vector<std::string> remote_clients;    // clients of the linked hubs
+        std::vector<LastValueCache::Value> last_values; // except what the client itself sent
+    };
+
+    // how long client handler waits for the router before checking for hot restart
+    const static unsigned INTRODUCTION_WAIT_MS = 100;
+
+    // broken link to other hub is retried after this time
+    const static unsigned LINK_RETRY_MS = 1000;
+
+    struct LinkFuncArg {
+        LinkFuncArg(const std::string &a, const std::string &n, ThreadsafeMessageQueue &q, ThreadsafeChannelList &l, BusyPollConfig &b, HotRestart &h) :
+                address(a), hub_name(n), message_queue(q), channel_list(l), busy_poll(b), hot_restart(h) {
         }
+        std::string address;
+        std::string hub_name;
         ThreadsafeMessageQueue &message_queue;
         ThreadsafeChannelList &channel_list;
+        BusyPollConfig &busy_poll; // MessageHub::io_busy_poll
+        HotRestart &hot_restart;
     };
 };
 
@@ -0,0 +1,256 @@
+/**
+ *   @file: MessageJournal.cpp
+ *
+ *   @date: Oct 18, 2026
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include "MessageJournal.h"
+#include "MessageJournalReader.h"
+
+using namespace messagebusipc;
+
+MessageJournal::MessageJournal() :
+        segment_size(0), max_segments(0), segment(NULL), mapped_size(0), write_pos(0), next_offset(0) {
+}
+
+MessageJournal::~MessageJournal() {
+    closeSegment();
+}
+
+/**
+ * @name    open
+ * @brief   Prepare the journal directory and start a new segment; offsets continue from what is already there
+ * @param   segment_size Size of single segment file in bytes
+ * @param   max_segments How many segments to keep, 0 means keep all
+ * @return  True on success, False otherwise
+ */
+bool MessageJournal::open(const std::string &directory, uint32_t segment_size, unsigned max_segments) {
+    closeSegment();
+    this->directory = directory;
+    this->segment_size = segment_size;
+    this->max_segments = max_segments;
+
+    if ((mkdir(directory.c_str(), 0755) == -1) && (errno != EEXIST)) {
+        ERROR_MSG("%s: mkdir %s failed, errno %d - %s", __FUNCTION__, directory.c_str(), errno, strerror(errno));
+        return false;
+    }
+
+    std::vector<uint64_t> base_offsets;
+    if (!listSegments(directory, base_offsets))
+        return false;
+
+    next_offset = findNextOffset(directory, base_offsets);
+    DEBUG_MSG("%s: journal %s, next offset %llu", __FUNCTION__, directory.c_str(), (unsigned long long)next_offset);
+    return startSegment(segment_size);
+}
+
+/**
+ * @name    append
+ * @brief   Write the message at the end of the journal
+ * @return  True on success, False if the journal is not open or the segment could not be created
+ * @note    record_size is published last with release semantics, so readers mapping the same file never see half a record
+ */
+bool MessageJournal::append(uint32_t id, const char *data, uint32_t size, const std::string &sender, const std::string &recipient) {
+    if (!segment)
+        return false;
+
+    uint32_t record_size = recordSize(size);
+    if (write_pos + record_size > mapped_size)
+        if (!startSegment(record_size))
+            return false;
+
+    JournalRecordHeader *header = reinterpret_cast<JournalRecordHeader*>(segment + write_pos);
+    header->id = id;
+    header->offset = next_offset;
+    header->timestamp_us = nowUs();
+    header->size = size;
+    header->reserved = 0;
+    strncpy(header->sender, sender.c_str(), MAX_CLIENT_NAME_LENGTH);
+    header->sender[MAX_CLIENT_NAME_LENGTH] = '\0';
+    strncpy(header->recipient, recipient.c_str(), MAX_CLIENT_NAME_LENGTH);
+    header->recipient[MAX_CLIENT_NAME_LENGTH] = '\0';
+    memcpy(header + 1, data, size);
+    __atomic_store_n(&header->record_size, record_size, __ATOMIC_RELEASE);
+
+    write_pos += record_size;
+    next_offset++;
+    return true;
+}
+
+/**
+ * @name    recordSize
+ * @return  Size of journal record holding payload of given size; there is always a '\0' after the payload
+ */
+uint32_t MessageJournal::recordSize(uint32_t payload_size) {
+    uint32_t size = sizeof(JournalRecordHeader) + payload_size + 1;
+    return (size + JOURNAL_RECORD_ALIGNMENT - 1) & ~(JOURNAL_RECORD_ALIGNMENT - 1);
+}
+
+/**
+ * @name    listSegments
+ * @brief   Find segment files in the directory
+ * @param   base_offsets Filled with base offsets of the segments, ascending
+ * @return  True on success, False if the directory could not be read
+ */
+bool MessageJournal::listSegments(const std::string &directory, std::vector<uint64_t> &base_offsets) {
+    base_offsets.clear();
+
+    DIR *dir = opendir(directory.c_str());
+    if (!dir) {
+        ERROR_MSG("%s: opendir %s failed, errno %d - %s", __FUNCTION__, directory.c_str(), errno, strerror(errno));
+        return false;
+    }
+
+    const size_t extension_length = strlen(JOURNAL_SEGMENT_EXTENSION);
+    while (dirent *entry = readdir(dir)) {
+        size_t length = strlen(entry->d_name);
+        if ((length <= extension_length) || strcmp(entry->d_name + length - extension_length, JOURNAL_SEGMENT_EXTENSION))
+            continue;
+
+        char *end;
+        unsigned long long base_offset = strtoull(entry->d_name, &end, 10);
+        if (end == entry->d_name + length - extension_length)
+            base_offsets.push_back(base_offset);
+    }
+    closedir(dir);
+
+    std::sort(base_offsets.begin(), base_offsets.end());
+    return true;
+}
+
+/**
+ * @name    segmentPath
+ * @return  Path to segment file starting with given offset
+ */
+std::string MessageJournal::segmentPath(const std::string &directory, uint64_t base_offset) {
+    char filename[32];
+    snprintf(filename, sizeof(filename), "%020llu%s", (unsigned long long)base_offset, JOURNAL_SEGMENT_EXTENSION);
+    return directory + "/" + filename;
+}
+
+/**
+ * @name    nowUs
+ * @return  Wall clock time in microseconds since epoch; journal timestamps must mean the same in every process
+ */
+uint64_t MessageJournal::nowUs() {
+    timeval now;
+    gettimeofday(&now, NULL);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_usec;
+}
+
+/**
+ * @name    startSegment
+ * @brief   Close current segment and create, preallocate and map the next one
+ * @param   min_size Record that needs to fit; segments grow above segment_size for oversized messages
+ * @note    The file may already exist when the journal is reopened and its last segment holds no complete record.
+ *          It is never truncated then: readers may have it mapped and would get SIGBUS past the new end.
+ *          It is only grown if needed and its old contents are zeroed through the mapping
+ */
+bool MessageJournal::startSegment(uint32_t min_size) {
+    closeSegment();
+
+    uint32_t size = std::max(segment_size, min_size);
+    std::string path = segmentPath(directory, next_offset);
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        ERROR_MSG("%s: open %s failed, errno %d - %s", __FUNCTION__, path.c_str(), errno, strerror(errno));
+        return false;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == -1) {
+        ERROR_MSG("%s: fstat %s failed, errno %d - %s", __FUNCTION__, path.c_str(), errno, strerror(errno));
+        ::close(fd);
+        return false;
+    }
+    uint32_t existing_size = (uint32_t)std::min<off_t>(file_stat.st_size, UINT32_MAX);
+    size = std::max(size, existing_size);
+
+    // allocate the blocks upfront, so appending doesn't stall on filesystem allocation in page faults.
+    // Both only ever grow the file
+    int error = posix_fallocate(fd, 0, size);
+    if (error && (existing_size < size) && (ftruncate(fd, size) == -1)) {
+        ERROR_MSG("%s: allocating %s failed, errno %d - %s", __FUNCTION__, path.c_str(), error, strerror(error));
+        ::close(fd);
+        return false;
+    }
+
+    void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd); // mapping keeps the file
+    if (mapping == MAP_FAILED) {
+        ERROR_MSG("%s: mmap %s failed, errno %d - %s", __FUNCTION__, path.c_str(), errno, strerror(errno));
+        return false;
+    }
+    madvise(mapping, size, MADV_SEQUENTIAL);
+
+    // leftovers of a record that was never completed must not pass for records written from now on
+    if (existing_size > 0)
+        memset(mapping, 0, existing_size);
+
+    segment = static_cast<char*>(mapping);
+    mapped_size = size;
+    write_pos = 0;
+    removeOldSegments();
+    return true;
+}
+
+/**
+ * @name    closeSegment
+ * @brief   Unmap current segment; what was written stays in the file
+ */
+void MessageJournal::closeSegment() {
+    if (!segment)
+        return;
+
+    munmap(segment, mapped_size);
+    segment = NULL;
+    mapped_size = 0;
+    write_pos = 0;
+}
+
+/**
+ * @name    removeOldSegments
+ * @brief   Delete the oldest segments above max_segments
+ */
+void MessageJournal::removeOldSegments() {
+    if (max_segments == 0)
+        return;
+
+    std::vector<uint64_t> base_offsets;
+    if (!listSegments(directory, base_offsets))
+        return;
+
+    for (size_t i = 0; i + max_segments < base_offsets.size(); i++)
+        unlink(segmentPath(directory, base_offsets[i]).c_str());
+}
+
+/**
+ * @name    findNextOffset
+ * @return  Offset that follows the last record already in the journal, 0 for empty journal
+ */
+uint64_t MessageJournal::findNextOffset(const std::string &directory, const std::vector<uint64_t> &base_offsets) {
+    if (base_offsets.empty())
+        return 0;
+
+    uint64_t next_offset = base_offsets.back();
+    MessageJournalReader reader(directory);
+    if (!reader.seekOffset(next_offset))
+        return next_offset;
+
+    MessageJournalReader::Entry entry;
+    while (reader.next(entry))
+        next_offset = entry.offset + 1;
+
+    return next_offset;
+}
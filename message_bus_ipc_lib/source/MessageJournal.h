@@ -0,0 +1,80 @@
+/**
+ *   @file: MessageJournal.h
+ *
+ *   @date: Oct 18, 2026
+ */
+
+#ifndef MESSAGE_BUS_IPC_LIB_SOURCE_MESSAGEJOURNAL_H_
+#define MESSAGE_BUS_IPC_LIB_SOURCE_MESSAGEJOURNAL_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "MessageBusIpcCommon.h"
+
+namespace messagebusipc {
+
+/**
+ * @struct  JournalRecordHeader
+ * @brief   Every journal record starts with this header followed by the message payload, padded to JOURNAL_RECORD_ALIGNMENT.
+ *          record_size is written last, so zero means "nothing more in this segment yet"
+ */
+struct JournalRecordHeader {
+    uint32_t record_size;       // whole record including header and padding
+    uint32_t id;
+    uint64_t offset;            // sequence number of the message in the journal, starts from 0
+    uint64_t timestamp_us;      // wall clock time the message was routed, microseconds since epoch
+    uint32_t size;              // payload size
+    uint32_t reserved;
+    char sender[MAX_CLIENT_NAME_LENGTH + 1];
+    char recipient[MAX_CLIENT_NAME_LENGTH + 1];
+};
+
+const uint32_t JOURNAL_RECORD_ALIGNMENT = 8;
+
+// segment files are named after the offset of their first record, eg. 00000000000000001000.mbj
+const char JOURNAL_SEGMENT_EXTENSION[] = ".mbj";
+
+/**
+ * @class   MessageJournal
+ * @brief   Append-only log of routed messages, written to memory-mapped segment files in given directory.
+ *          Segment is preallocated and mapped once, so appending is a memcpy; when it fills up the next segment is started.
+ *          Read it with MessageJournalReader, also while it is being written.
+ * @note    Not thread safe; owned by the MessageHub router thread
+ */
+class MessageJournal {
+public:
+    MessageJournal();
+    ~MessageJournal();
+
+    bool open(const std::string &directory, uint32_t segment_size, unsigned max_segments);
+    bool append(uint32_t id, const char *data, uint32_t size, const std::string &sender, const std::string &recipient);
+    bool isOpen() const { return segment != NULL; }
+    uint64_t nextOffset() const { return next_offset; }
+
+    static uint32_t recordSize(uint32_t payload_size);
+    static bool listSegments(const std::string &directory, std::vector<uint64_t> &base_offsets);
+    static std::string segmentPath(const std::string &directory, uint64_t base_offset);
+    static uint64_t nowUs();
+
+private:
+    std::string directory;
+    uint32_t segment_size;
+    unsigned max_segments;  // oldest segments are deleted above this count, 0 means keep all
+    char *segment;          // mapped segment being written
+    uint32_t mapped_size;
+    uint32_t write_pos;
+    uint64_t next_offset;
+
+    bool startSegment(uint32_t min_size);
+    void closeSegment();
+    void removeOldSegments();
+    static uint64_t findNextOffset(const std::string &directory, const std::vector<uint64_t> &base_offsets);
+
+    MessageJournal(const MessageJournal&);
+    MessageJournal& operator=(const MessageJournal&);
+};
+
+}
+
+#endif /* MESSAGE_BUS_IPC_LIB_SOURCE_MESSAGEJOURNAL_H_ */
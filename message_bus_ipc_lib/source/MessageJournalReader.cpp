@@ -0,0 +1,235 @@
+/**
+ *   @file: MessageJournalReader.cpp
+ *
+ *   @date: Oct 18, 2026
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include "MessageJournalReader.h"
+
+using namespace messagebusipc;
+
+MessageJournalReader::MessageJournalReader(const std::string &directory) :
+        directory(directory), segment_base(0), segment(NULL), mapped_size(0), read_pos(0), offset_known(true), next_offset(0), num_skipped(0) {
+}
+
+MessageJournalReader::~MessageJournalReader() {
+    closeSegment();
+}
+
+/**
+ * @name    seekOffset
+ * @brief   Position the reader at the first message with offset not less than given one
+ * @return  True on success, False if there is no journal
+ * @note    Offsets that were already removed from the journal position the reader at the oldest message kept; they count as skipped
+ */
+bool MessageJournalReader::seekOffset(uint64_t offset) {
+    std::vector<uint64_t> base_offsets;
+    if (!MessageJournal::listSegments(directory, base_offsets) || base_offsets.empty())
+        return false;
+
+    // last segment that starts at or before the offset
+    size_t i = base_offsets.size() - 1;
+    while ((i > 0) && (base_offsets[i] > offset))
+        i--;
+
+    if (!openSegment(base_offsets[i]))
+        return false;
+
+    offset_known = true;
+    next_offset = offset;
+    const JournalRecordHeader *header;
+    while ((header = peek()) && (header->offset < offset))
+        read_pos += header->record_size;
+
+    return true;
+}
+
+/**
+ * @name    seekTimestamp
+ * @brief   Position the reader at the first message routed at or after given time
+ * @param   timestamp_us Microseconds since epoch
+ * @return  True on success, False if there is no journal
+ */
+bool MessageJournalReader::seekTimestamp(uint64_t timestamp_us) {
+    std::vector<uint64_t> base_offsets;
+    if (!MessageJournal::listSegments(directory, base_offsets) || base_offsets.empty())
+        return false;
+
+    // last segment whose first message is not newer than the timestamp; segments are in time order
+    size_t i = base_offsets.size() - 1;
+    for (; i > 0; i--) {
+        if (!openSegment(base_offsets[i]))
+            continue;
+
+        const JournalRecordHeader *first = peek();
+        if (first && (first->timestamp_us <= timestamp_us))
+            break;
+    }
+
+    if (!openSegment(base_offsets[i]))
+        return false;
+
+    offset_known = false;
+    const JournalRecordHeader *header;
+    while ((header = peek()) && (header->timestamp_us < timestamp_us))
+        read_pos += header->record_size;
+
+    return true;
+}
+
+/**
+ * @name    next
+ * @brief   Get the message at reader position and move past it
+ * @return  True on success, False if there are no more messages for now
+ */
+bool MessageJournalReader::next(Entry &entry) {
+    const JournalRecordHeader *header = peek();
+    if (!header)
+        return false;
+
+    entry.offset = header->offset;
+    entry.timestamp_us = header->timestamp_us;
+    entry.id = header->id;
+    entry.size = header->size;
+    entry.data = reinterpret_cast<const char*>(header + 1);
+    entry.sender = header->sender;
+    entry.recipient = header->recipient;
+    entry.num_skipped = 0;
+
+    // retention removed the segments the reader was about to read
+    if (offset_known && (header->offset > next_offset)) {
+        entry.num_skipped = header->offset - next_offset;
+        num_skipped += entry.num_skipped;
+        ERROR_MSG("%s: %s: messages %llu..%llu removed from the journal before read", __FUNCTION__, directory.c_str(),
+                  (unsigned long long)next_offset, (unsigned long long)header->offset - 1);
+    }
+    offset_known = true;
+    next_offset = header->offset + 1;
+
+    read_pos += header->record_size;
+    return true;
+}
+
+/**
+ * @name    peek
+ * @return  Record at reader position, moving to the next segment at the end of current one; NULL if there is none yet
+ */
+const JournalRecordHeader *MessageJournalReader::peek() {
+    while (true) {
+        if (!segment && !openSegment(segment_base) && !openSegmentAfterRemoved())
+            return NULL;
+
+        if (read_pos + sizeof(JournalRecordHeader) <= mapped_size) {
+            const JournalRecordHeader *header = reinterpret_cast<const JournalRecordHeader*>(segment + read_pos);
+            if (__atomic_load_n(&header->record_size, __ATOMIC_ACQUIRE))
+                return header;
+        }
+
+        // end of what is written to this segment; the writer only starts the next segment when done with this one
+        if (!openNextSegment())
+            return NULL;
+    }
+}
+
+/**
+ * @name    openSegment
+ * @brief   Map the segment file for reading and position at its beginning
+ */
+bool MessageJournalReader::openSegment(uint64_t base_offset) {
+    closeSegment();
+    segment_base = base_offset;
+
+    std::string path = MessageJournal::segmentPath(directory, base_offset);
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        if (errno == ENOENT) {
+            DEBUG_MSG("%s: %s is gone", __FUNCTION__, path.c_str()); // removed by retention, see openSegmentAfterRemoved
+            return false;
+        }
+        ERROR_MSG("%s: open %s failed, errno %d - %s", __FUNCTION__, path.c_str(), errno, strerror(errno));
+        return false;
+    }
+
+    struct stat file_stat;
+    if ((fstat(fd, &file_stat) == -1) || (file_stat.st_size < (off_t)sizeof(JournalRecordHeader))) {
+        close(fd); // being created right now; try again later
+        return false;
+    }
+
+    void *mapping = mmap(NULL, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        ERROR_MSG("%s: mmap %s failed, errno %d - %s", __FUNCTION__, path.c_str(), errno, strerror(errno));
+        return false;
+    }
+    madvise(mapping, file_stat.st_size, MADV_SEQUENTIAL);
+
+    segment = static_cast<const char*>(mapping);
+    mapped_size = file_stat.st_size;
+    return true;
+}
+
+/**
+ * @name    openSegmentAfterRemoved
+ * @brief   Current segment was removed by retention before the reader mapped it; move to the oldest segment that follows
+ * @return  True if moved, False if the segment is still there or nothing follows it yet
+ */
+bool MessageJournalReader::openSegmentAfterRemoved() {
+    std::vector<uint64_t> base_offsets;
+    if (!MessageJournal::listSegments(directory, base_offsets))
+        return false;
+
+    for (size_t i = 0; i < base_offsets.size(); i++) {
+        if (base_offsets[i] == segment_base)
+            return false; // not removed, being created; try again later
+
+        if (base_offsets[i] > segment_base)
+            return openSegment(base_offsets[i]);
+    }
+
+    return false;
+}
+
+/**
+ * @name    openNextSegment
+ * @return  True if the reader moved to the following segment or found more records in current one, False otherwise
+ */
+bool MessageJournalReader::openNextSegment() {
+    std::vector<uint64_t> base_offsets;
+    if (!MessageJournal::listSegments(directory, base_offsets))
+        return false;
+
+    for (size_t i = 0; i < base_offsets.size(); i++) {
+        if (base_offsets[i] <= segment_base)
+            continue;
+
+        // the writer may have finished the last record of current segment in the meantime
+        if (segment && (read_pos + sizeof(JournalRecordHeader) <= mapped_size)) {
+            const JournalRecordHeader *header = reinterpret_cast<const JournalRecordHeader*>(segment + read_pos);
+            if (__atomic_load_n(&header->record_size, __ATOMIC_ACQUIRE))
+                return true;
+        }
+        return openSegment(base_offsets[i]);
+    }
+
+    return false;
+}
+
+/**
+ * @name    closeSegment
+ */
+void MessageJournalReader::closeSegment() {
+    if (!segment)
+        return;
+
+    munmap(const_cast<char*>(segment), mapped_size);
+    segment = NULL;
+    mapped_size = 0;
+    read_pos = 0;
+}
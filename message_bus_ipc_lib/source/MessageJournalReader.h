@@ -0,0 +1,95 @@
+/**
+ *   @file: MessageJournalReader.h
+ *
+ *   @date: Oct 18, 2026
+ */
+
+#ifndef MESSAGE_BUS_IPC_LIB_SOURCE_MESSAGEJOURNALREADER_H_
+#define MESSAGE_BUS_IPC_LIB_SOURCE_MESSAGEJOURNALREADER_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "MessageJournal.h"
+
+namespace messagebusipc {
+
+/**
+ * @class   MessageJournalReader
+ * @brief   Reads the journal written by MessageHub (see MessageHubConfig::journal_directory) straight from the mapped segment files.
+ *          Works while the hub keeps appending; when next() returns false there is nothing more for now, try again later.
+ *          Reader that lags behind journal retention (MessageHubConfig::journal_max_segments) continues from the oldest segment kept
+ *          and reports the messages it missed, see Entry::num_skipped and numSkipped.
+ */
+class MessageJournalReader {
+public:
+    // points into the mapped segment; valid until the next call that moves the reader
+    struct Entry {
+        uint64_t offset;
+        uint64_t timestamp_us;
+        uint32_t id;
+        uint32_t size;
+        const char *data;       // followed by '\0'
+        const char *sender;
+        const char *recipient;
+        uint64_t num_skipped;   // messages right before this one that retention removed before the reader got to them
+    };
+
+    MessageJournalReader(const std::string &directory);
+    ~MessageJournalReader();
+
+    bool seekOffset(uint64_t offset);
+    bool seekTimestamp(uint64_t timestamp_us);
+    bool next(Entry &entry);
+    uint64_t numSkipped() const { return num_skipped; }
+
+    /**
+     * @name    replay
+     * @brief   Pass journal messages to the callback, starting from where the reader was positioned with seekOffset or seekTimestamp
+     * @param   callback Same as for MessageClient::initializeAndListen; when it returns false replay stops
+     * @param   max_messages Upper bound of messages replayed in single call
+     * @return  Number of messages passed to the callback
+     */
+    template<class Callback>
+    uint64_t replay(Callback callback, uint64_t max_messages = (uint64_t)-1) {
+        Entry entry;
+        uint64_t num_replayed = 0;
+
+        while ((num_replayed < max_messages) && next(entry)) {
+            // callbacks may modify the payload, the mapping is read-only
+            buffer.assign(entry.data, entry.data + entry.size + 1);
+            uint32_t id = entry.id;
+            uint32_t size = entry.size;
+
+            num_replayed++;
+            if (callback(id, &buffer[0], size) == false)
+                break;
+        }
+
+        return num_replayed;
+    }
+
+private:
+    std::string directory;
+    uint64_t segment_base;
+    const char *segment;
+    size_t mapped_size;
+    size_t read_pos;
+    bool offset_known;      // next_offset is known; after seekTimestamp not until the first record
+    uint64_t next_offset;   // offset the next record should have
+    uint64_t num_skipped;   // total of Entry::num_skipped
+    std::vector<char> buffer;
+
+    const JournalRecordHeader *peek();
+    bool openSegment(uint64_t base_offset);
+    bool openSegmentAfterRemoved();
+    bool openNextSegment();
+    void closeSegment();
+
+    MessageJournalReader(const MessageJournalReader&);
+    MessageJournalReader& operator=(const MessageJournalReader&);
+};
+
+}
+
+#endif /* MESSAGE_BUS_IPC_LIB_SOURCE_MESSAGEJOURNALREADER_H_ */
@@ -0,0 +1,239 @@
+/**
+ *   @file: MessageRegistry.h
+ *
+ *   @date: Oct 18, 2026
+ */
+
+#ifndef MESSAGE_BUS_IPC_LIB_SOURCE_MESSAGEREGISTRY_H_
+#define MESSAGE_BUS_IPC_LIB_SOURCE_MESSAGEREGISTRY_H_
+
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+#include "MessageBusIpcCommon.h"
+#include "TypedMessage.h"
+
+namespace messagebusipc {
+
+/**
+ * @brief   Declare named message schema, eg. MBIPC_MESSAGE_SCHEMA(PositionMessage, ID_POSITION, Position)
+ *          gives PositionMessage that can be used with TypedMessageView, TypedMessageBuilder and MessageRegistry
+ */
+#define MBIPC_MESSAGE_SCHEMA(schema, id, fixed) \
+    struct schema : messagebusipc::MessageSchema<id, fixed> { \
+        static const char *name() { return #schema; } \
+    };
+
+// compile-time check that no message ID is registered twice
+template<uint32_t Id, uint32_t... Others>
+struct MessageIdNotIn;
+
+template<uint32_t Id>
+struct MessageIdNotIn<Id> {
+    static const bool value = true;
+};
+
+template<uint32_t Id, uint32_t First, uint32_t... Others>
+struct MessageIdNotIn<Id, First, Others...> {
+    static const bool value = (Id != First) && MessageIdNotIn<Id, Others...>::value;
+};
+
+template<uint32_t... Ids>
+struct MessageIdsDistinct;
+
+template<>
+struct MessageIdsDistinct<> {
+    static const bool value = true;
+};
+
+template<uint32_t Id, uint32_t... Others>
+struct MessageIdsDistinct<Id, Others...> {
+    static const bool value = MessageIdNotIn<Id, Others...>::value && MessageIdsDistinct<Others...>::value;
+};
+
+/**
+ * @class   MessageRegistry
+ * @brief   Dispatches incoming messages to typed handler methods through a table built from the schema list, eg.
+ *          struct Handler {
+ *              bool handle(TypedMessageView<PositionMessage> &position);
+ *              bool handle(TypedMessageView<VelocityMessage> &velocity);
+ *              bool unhandled(uint32_t id, char *data, uint32_t size); // optional; other IDs and malformed payloads
+ *          };
+ *          MessageRegistry<Handler, PositionMessage, VelocityMessage> registry(handler);
+ *          client.initializeAndListen(registry, "name");
+ * @note    When IDs are close to each other the table is indexed by ID directly, otherwise by perfect hash of the ID;
+ *          either way finding the handler is one table read. If no perfect hash fits in MAX_HASH_TABLE_BITS,
+ *          which takes thousands of scattered IDs, the registry says so in the log and falls back to binary search
+ */
+template<class Handler, class... Schemas>
+class MessageRegistry {
+    static_assert(sizeof...(Schemas) > 0, "register at least one message schema");
+    static_assert(MessageIdsDistinct<Schemas::ID...>::value, "message ID registered twice");
+
+public:
+    MessageRegistry(Handler &handler) :
+            handler(&handler) {
+        Slot slots[] = { makeSlot<Schemas>()... };
+        buildTable(slots, sizeof...(Schemas));
+    }
+
+    /**
+     * @name    operator()
+     * @brief   Message callback, as expected by MessageClient::initializeAndListen and dispatch
+     */
+    bool operator()(uint32_t &id, char *data, uint32_t &size) {
+        const Slot *slot = find(id);
+        if (!slot)
+            return callUnhandled(*handler, id, data, size, 0);
+
+        return slot->thunk(*handler, id, data, size);
+    }
+
+    /**
+     * @name    name
+     * @return  Name of registered or IPC internal message, "ID_?" for unknown one
+     */
+    const char *name(uint32_t id) const {
+        const Slot *slot = find(id);
+        if (slot)
+            return slot->name;
+
+        return GetMessageName((MessageBusMessage)id);
+    }
+
+    bool isDense() const { return table_kind == TABLE_DENSE; }
+
+private:
+    typedef bool (*Thunk)(Handler &handler, uint32_t id, char *data, uint32_t size);
+
+    struct Slot {
+        uint32_t id;
+        bool used;
+        Thunk thunk;
+        const char *name;
+    };
+
+    enum TableKind {
+        TABLE_DENSE,            // table[id - dense_base]
+        TABLE_HASHED,           // table[(id * hash_multiplier) >> hash_shift]
+        TABLE_SORTED            // table sorted by ID, binary search
+    };
+
+    // dense table is used when it would be at most this many times bigger than the number of messages
+    static const uint32_t MAX_DENSE_TABLE_SPREAD = 4;
+    static const unsigned HASH_MULTIPLIER_ATTEMPTS = 256;
+    static const unsigned MAX_HASH_TABLE_BITS = 16;  // hashed table has at most 2^16 slots
+
+    Handler *handler;
+    std::vector<Slot> table;
+    TableKind table_kind;
+    uint32_t dense_base;        // dense: ID of table[0]
+    uint32_t hash_multiplier;   // hashed: slot = (id * hash_multiplier) >> hash_shift
+    unsigned hash_shift;
+
+    template<class Schema>
+    static Slot makeSlot() {
+        Slot slot;
+        slot.id = Schema::ID;
+        slot.used = true;
+        slot.thunk = &MessageRegistry::thunk<Schema>;
+        slot.name = Schema::name();
+        return slot;
+    }
+
+    template<class Schema>
+    static bool thunk(Handler &handler, uint32_t id, char *data, uint32_t size) {
+        TypedMessageView<Schema> view(id, data, size);
+        if (!view.valid())
+            return callUnhandled(handler, id, data, size, 0);
+
+        return handler.handle(view);
+    }
+
+    // Handler::unhandled is optional; without it other messages are ignored and listening goes on
+    template<class H>
+    static auto callUnhandled(H &handler, uint32_t id, char *data, uint32_t size, int) -> decltype(handler.unhandled(id, data, size)) {
+        return handler.unhandled(id, data, size);
+    }
+
+    template<class H>
+    static bool callUnhandled(H &handler, uint32_t id, char *data, uint32_t size, long) {
+        return true;
+    }
+
+    const Slot *find(uint32_t id) const {
+        uint32_t index;
+        if (table_kind == TABLE_DENSE)
+            index = id - dense_base;
+        else if (table_kind == TABLE_HASHED)
+            index = (id * hash_multiplier) >> hash_shift;
+        else
+            index = std::lower_bound(table.begin(), table.end(), id, slotIdLess) - table.begin();
+
+        if ((index < table.size()) && table[index].used && (table[index].id == id))
+            return &table[index];
+
+        return NULL;
+    }
+
+    static bool slotIdLess(const Slot &slot, uint32_t id) { return slot.id < id; }
+
+    void buildTable(const Slot *slots, uint32_t count) {
+        uint32_t min_id = slots[0].id;
+        uint32_t max_id = slots[0].id;
+        for (uint32_t i = 1; i < count; i++) {
+            min_id = std::min(min_id, slots[i].id);
+            max_id = std::max(max_id, slots[i].id);
+        }
+
+        // 1. IDs close together; index directly
+        if (max_id - min_id < MAX_DENSE_TABLE_SPREAD * count) {
+            table_kind = TABLE_DENSE;
+            dense_base = min_id;
+            hash_multiplier = 0;
+            hash_shift = 0;
+            table.assign(max_id - min_id + 1, Slot());
+            for (uint32_t i = 0; i < count; i++)
+                table[slots[i].id - min_id] = slots[i];
+            return;
+        }
+
+        // 2. IDs scattered; find multiplicative hash without collisions, growing the table up to MAX_HASH_TABLE_BITS
+        table_kind = TABLE_HASHED;
+        dense_base = 0;
+        for (hash_shift = 31; (hash_shift > 32 - MAX_HASH_TABLE_BITS) && ((1u << (32 - hash_shift)) < 2 * count); hash_shift--)
+            ;
+        for (; hash_shift >= 32 - MAX_HASH_TABLE_BITS; hash_shift--)
+            for (unsigned attempt = 0; attempt < HASH_MULTIPLIER_ATTEMPTS; attempt++) {
+                hash_multiplier = (2654435769u * (2 * attempt + 1)) | 1;
+                if (tryHashTable(slots, count))
+                    return;
+            }
+
+        // 3. no perfect hash within the size limit; still correct, but not one table read anymore
+        ERROR_MSG("MessageRegistry: no perfect hash for %u message IDs in %u slots, falling back to binary search",
+                  count, 1u << MAX_HASH_TABLE_BITS);
+        table_kind = TABLE_SORTED;
+        hash_multiplier = 0;
+        hash_shift = 0;
+        table.assign(slots, slots + count);
+        std::sort(table.begin(), table.end(), slotLess);
+    }
+
+    static bool slotLess(const Slot &a, const Slot &b) { return a.id < b.id; }
+
+    bool tryHashTable(const Slot *slots, uint32_t count) {
+        table.assign(1u << (32 - hash_shift), Slot());
+        for (uint32_t i = 0; i < count; i++) {
+            Slot &slot = table[(slots[i].id * hash_multiplier) >> hash_shift];
+            if (slot.used)
+                return false;
+            slot = slots[i];
+        }
+        return true;
+    }
+};
+
+}
+
+#endif /* MESSAGE_BUS_IPC_LIB_SOURCE_MESSAGEREGISTRY_H_ */
@@ -7,11 +7,14 @@
 
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/time.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
 #include <stdint.h>
 #include <cstdio>
+#include <cstring>
 
 #include "MessageBusIpcCommon.h"
 #include "MessageChannel.h"
@@ -21,125 +24,259 @@ using namespace messagebusipc;
 
 
 MessageServer::MessageServer() :
-        server_socket_fd(UNINITIALIZED_SOCKET_FD) {
+        stop_fd(UNINITIALIZED_SOCKET_FD) {
 }
 
 MessageServer::~MessageServer() {
-    cleanupServerSocket();
+    cleanupServerSockets();
 }
 
 /**
  * @name    init
- * @brief   Run init before you start accepting clients
+ * @brief   Run init before you start accepting clients; listens on the default address, see HubAddress
  * @return  True on success, False otherwise
  */
 bool MessageServer::init() {
-    return prepareServerSocket();
+    return init(std::vector<std::string>());
+}
+
+/**
+ * @name    init
+ * @brief   Run init before you start accepting clients
+ * @param   addresses Where to listen, see HubAddress; empty means the default address
+ * @param   seqpacket Also listen on SOCK_SEQPACKET counterpart of every unix address, see HubAddress::seqpacketCounterpart
+ * @return  True on success, False otherwise
+ */
+bool MessageServer::init(const std::vector<std::string> &addresses, bool seqpacket) {
+    cleanupServerSockets();
+
+    std::vector<HubAddress> parsed(addresses.empty() ? 1 : addresses.size());
+    for (size_t i = 0; i < addresses.size(); i++)
+        if (!parsed[i].parse(addresses[i]))
+            return false;
+
+    for (std::vector<HubAddress>::const_iterator it = parsed.begin(); it != parsed.end(); ++it) {
+        HubAddress counterpart;
+        if (!prepareServerSocket(*it) || (seqpacket && it->seqpacketCounterpart(counterpart) && !prepareServerSocket(counterpart))) {
+            cleanupServerSockets();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @name    adopt
+ * @brief   Accept clients on listening socket made by somebody else, eg. handed over by the previous hub, see HotRestart
+ * @param   address Address the socket listens on; its socket file is removed along with the socket
+ * @param   socket_fd Listening socket; the server owns it from now on, also on failure
+ * @return  True on success, False otherwise
+ */
+bool MessageServer::adopt(const std::string &address, int socket_fd) {
+    HubAddress parsed;
+    if (!parsed.parse(address)) {
+        close(socket_fd);
+        return false;
+    }
+
+    addresses.push_back(parsed);
+    server_socket_fds.push_back(socket_fd);
+    return true;
+}
+
+/**
+ * @name    listeners
+ * @brief   Get the listening sockets along with their addresses
+ */
+void MessageServer::listeners(std::vector<std::string> &addresses, std::vector<int> &socket_fds) const {
+    addresses.clear();
+    for (std::vector<HubAddress>::const_iterator it = this->addresses.begin(); it != this->addresses.end(); ++it)
+        addresses.push_back(it->toString());
+    socket_fds = server_socket_fds;
+}
+
+/**
+ * @name    release
+ * @brief   Close the listening sockets but leave the socket files in place; other process listens on them now
+ */
+void MessageServer::release() {
+    for (std::vector<int>::iterator it = server_socket_fds.begin(); it != server_socket_fds.end(); ++it)
+        close(*it);
+    server_socket_fds.clear();
+    addresses.clear();
 }
 
 /**
  * @name    acceptClient
- * @return  MessageChannel that allows communication with accepted client
+ * @return  MessageChannel that allows communication with accepted client; it didn't say hello yet, see awaitHello.
+ *          Channel without socket (UNINITIALIZED_SOCKET_FD) if the stop descriptor became readable, see setStopDescriptor
  * @note    This is blocking function. Best run in dedicated thread
  */
 MessageChannel MessageServer::acceptOne() {
-    sockaddr_un remote;
-    unsigned remote_length = sizeof(remote);
-    int client_socket_fd;
 
-    // 1. repeat waiting for client until success
+    // 1. repeat waiting for client until it connects
+    int client_socket_fd;
     do {
-        client_socket_fd = accept(server_socket_fd, (sockaddr*) &remote, &remote_length);
-        if (client_socket_fd == UNINITIALIZED_SOCKET_FD)
-            DEBUG_MSG("%s: accept failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+        if (stopRequested()) {
+            DEBUG_MSG("%s: accepting stopped", __FUNCTION__);
+            return MessageChannel();
+        }
+
+        client_socket_fd = acceptFromAny();
     } while (client_socket_fd == UNINITIALIZED_SOCKET_FD);
 
     // 2. client connected, now turn socket into a channel
-    MessageChannel channel = prepareChannel(client_socket_fd);
-    DEBUG_MSG("%s: client connected: %s", __FUNCTION__, channel.name().c_str());
-
+    int socket_type = SOCK_STREAM;
+    socklen_t socket_type_length = sizeof(socket_type);
+    getsockopt(client_socket_fd, SOL_SOCKET, SO_TYPE, &socket_type, &socket_type_length);
+    MessageChannel channel(client_socket_fd);
+    channel.setSeqpacket(socket_type == SOCK_SEQPACKET);
     return channel;
 }
 
 /**
- * @name    prepareChannel
- * @param   socket_fd Socket file descriptor to turn into a channel
- * @return  MessageChannel based on given socket_fd
+ * @name    acceptFromAny
+ * @brief   Wait for connection on any of the listening sockets and accept it
+ * @return  Connected socket, UNINITIALIZED_SOCKET_FD on failure
  */
-MessageChannel MessageServer::prepareChannel(int socket_fd) {
-    uint32_t message_id; // will be ID_CLIENT_SAYS_HALLO
-    uint32_t size;
-    std::string name;
-    char empty_buffer[1];
+int MessageServer::acceptFromAny() {
+    int server_socket_fd = server_socket_fds.empty() ? UNINITIALIZED_SOCKET_FD : server_socket_fds[0];
 
-    // 1. create a channel
-    MessageChannel channel(socket_fd);
+    // more listeners or stop descriptor; find the one with pending connection
+    if ((server_socket_fds.size() > 1) || (stop_fd != UNINITIALIZED_SOCKET_FD)) {
+        std::vector<pollfd> fds(server_socket_fds.size());
+        for (size_t i = 0; i < fds.size(); i++) {
+            fds[i].fd = server_socket_fds[i];
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+        }
 
-    // 2. receive ID_CLIENT_SAYS_HELLO with channel name from MessageClient
-    channel.receive(message_id, empty_buffer, size, name);
+        // stop descriptor goes last, so pending connection is taken first
+        if (stop_fd != UNINITIALIZED_SOCKET_FD) {
+            pollfd stop = { stop_fd, POLLIN, 0 };
+            fds.push_back(stop);
+        }
 
-    // 3. setup channel name
-    channel.setName(name);
-    return channel;
+        if (poll(&fds[0], fds.size(), -1) == -1) {
+            if (errno != EINTR)
+                ERROR_MSG("%s: poll failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+            return UNINITIALIZED_SOCKET_FD;
+        }
+
+        server_socket_fd = UNINITIALIZED_SOCKET_FD;
+        for (size_t i = 0; i < server_socket_fds.size(); i++)
+            if (fds[i].revents) {
+                server_socket_fd = fds[i].fd;
+                break;
+            }
+
+        if (server_socket_fd == UNINITIALIZED_SOCKET_FD)
+            return UNINITIALIZED_SOCKET_FD; // stop descriptor
+    }
+
+    sockaddr_storage remote;
+    socklen_t remote_length = sizeof(remote);
+    int client_socket_fd = accept(server_socket_fd, (sockaddr*) &remote, &remote_length);
+    if (client_socket_fd == UNINITIALIZED_SOCKET_FD) {
+        ERROR_MSG("%s: accept failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+        return UNINITIALIZED_SOCKET_FD;
+    }
+
+    if ((remote.ss_family == AF_INET) || (remote.ss_family == AF_INET6))
+        HubAddress::tuneTcpSocket(client_socket_fd);
+
+    return client_socket_fd;
 }
+
 /**
- * @name    prepareServerSocket
- * @brief   Initialize listening server socket that will be used to accept clients
- * @return  True on success, False otherwise
+ * @name    stopRequested
+ * @return  True if the stop descriptor is readable, False otherwise
  */
-bool MessageServer::prepareServerSocket() {
+bool MessageServer::stopRequested() const {
+    if (stop_fd == UNINITIALIZED_SOCKET_FD)
+        return false;
 
-    // delete socket file if such already exists
-    unlink(MESSAGE_HUB_SOCKET_FILENAME);
+    pollfd pfd = { stop_fd, POLLIN, 0 };
+    return poll(&pfd, 1, 0) > 0;
+}
+
+/**
+ * @name    awaitHello
+ * @brief   Receive ID_CLIENT_SAYS_HELLO from just accepted client and set the channel up as it asks
+ * @param   channel Channel returned by acceptOne
+ * @return  True if the client introduced itself, False otherwise; the connection is to be dropped then
+ * @note    Client gets HELLO_TIMEOUT_SECONDS to say hello. Blocks that long, so better not on the accepting thread;
+ *          a few silent tcp connections would keep everybody else waiting
+ */
+bool MessageServer::awaitHello(MessageChannel &channel) {
+    uint32_t message_id; // will be ID_CLIENT_SAYS_HALLO
+    uint32_t size = 0;
+    std::string name;
+    char hello_payload[MAX_HELLO_PAYLOAD_SIZE];
+    uint32_t hello_flags = 0;
 
-    // get a socket filedescriptor
-    server_socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    // 1. receive ID_CLIENT_SAYS_HELLO with channel name and optional flags from MessageClient
+    int socket_fd = channel.fileDescriptor();
+    timeval timeout = { HELLO_TIMEOUT_SECONDS, 0 };
+    setsockopt(socket_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    bool said_hello = channel.receive(message_id, hello_payload, size, name, sizeof(hello_payload)) && (message_id == ID_CLIENT_SAYS_HELLO);
+    timeout.tv_sec = 0;
+    setsockopt(socket_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
 
-    // check socket for failure
-    if (server_socket_fd == UNINITIALIZED_SOCKET_FD) {
-        DEBUG_MSG("%s: socket(AF_UNIX, SOCK_STREAM, 0) failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+    if (!said_hello)
         return false;
-    }
 
-    DEBUG_MSG("%s: binding listening socket to %s...", __FUNCTION__, MESSAGE_HUB_SOCKET_FILENAME);
-    // prepare address struct
-    sockaddr_un local;
-    local.sun_family = AF_UNIX;
-    strncpy(local.sun_path, MESSAGE_HUB_SOCKET_FILENAME, sizeof(local.sun_path));
-
-    // bind socket to address in UNIX domain
-    size_t local_length = strlen(local.sun_path) + sizeof(local.sun_family);
-    if (bind(server_socket_fd, (sockaddr*) &local, local_length) == -1) {
-        DEBUG_MSG("%s: bind failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
-        close(server_socket_fd); // cleanup socket filedescriptor
-        server_socket_fd = UNINITIALIZED_SOCKET_FD; // status: uninitialized
-        return false;
+    if (size >= sizeof(hello_flags))
+        memcpy(&hello_flags, hello_payload, sizeof(hello_flags));
+
+    // 2. setup channel name and flags
+    channel.setName(name);
+    channel.setHelloFlags(hello_flags);
+
+    // 3. client understands v2 and said how many peer IDs it keeps; tell it in v1, along with how many we keep, and talk v2 from now on.
+    // The client switches its own direction when it gets this
+    uint32_t num_peer_ids = 0;
+    if (size >= sizeof(hello_flags) + sizeof(num_peer_ids))
+        memcpy(&num_peer_ids, hello_payload + sizeof(hello_flags), sizeof(num_peer_ids));
+    if ((hello_flags & HELLO_FLAG_WIRE_V2) && (num_peer_ids > 0)) {
+        uint32_t version_switch[2] = { WIRE_VERSION_2, MessageChannel::PEER_IDS };
+        if (!channel.send(ID_WIRE_VERSION_SWITCH, (const char*)version_switch, sizeof(version_switch), ""))
+            return false;
+        channel.setSendVersion(WIRE_VERSION_2, num_peer_ids);
     }
-    DEBUG_MSG("%s: done.", __FUNCTION__);
 
-    // mark socket as listening socket
-    if (listen(server_socket_fd, MAX_AWAITING_CONNECTIONS) == -1) {
-        DEBUG_MSG("%s: listen failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
-        close(server_socket_fd); // cleanup socket filedescriptor
-        server_socket_fd = UNINITIALIZED_SOCKET_FD; // status: uninitialized
+    DEBUG_MSG("%s: client connected: %s", __FUNCTION__, name.c_str());
+    return true;
+}
+
+/**
+ * @name    prepareServerSocket
+ * @brief   Initialize listening server socket that will be used to accept clients
+ * @return  True on success, False otherwise
+ */
+bool MessageServer::prepareServerSocket(const HubAddress &address) {
+    int server_socket_fd = address.listenSocket(MAX_AWAITING_CONNECTIONS);
+    if (server_socket_fd == UNINITIALIZED_SOCKET_FD)
         return false;
-    }
 
-    // success
+    addresses.push_back(address);
+    server_socket_fds.push_back(server_socket_fd);
     return true;
 }
 
 /**
- * @name    cleanupServerSocket
- * @brief   Get rid of the listening server socket and the backing socket file
+ * @name    cleanupServerSockets
+ * @brief   Get rid of the listening server sockets and the backing socket files
  */
-void MessageServer::cleanupServerSocket() {
-    // close the listening socket
-    if (server_socket_fd != UNINITIALIZED_SOCKET_FD) {
-        close(server_socket_fd);
-        server_socket_fd = UNINITIALIZED_SOCKET_FD;
-    }
+void MessageServer::cleanupServerSockets() {
+    // close the listening sockets
+    for (std::vector<int>::iterator it = server_socket_fds.begin(); it != server_socket_fds.end(); ++it)
+        close(*it);
+    server_socket_fds.clear();
 
-    // remove socket file
-    unlink(MESSAGE_HUB_SOCKET_FILENAME);
+    // remove socket files
+    for (std::vector<HubAddress>::iterator it = addresses.begin(); it != addresses.end(); ++it)
+        it->cleanup();
+    addresses.clear();
 }
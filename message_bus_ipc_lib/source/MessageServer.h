@@ -8,7 +8,10 @@
 #ifndef MESSAGE_BUS_IPC_LIB_SOURCE_MESSAGESERVER_H_
 #define MESSAGE_BUS_IPC_LIB_SOURCE_MESSAGESERVER_H_
 
+#include <vector>
+#include <string>
 #include "MessageChannel.h"
+#include "HubAddress.h"
 
 namespace messagebusipc {
 
@@ -22,15 +25,30 @@ public:
     virtual ~MessageServer();
 
     bool init();
+    bool init(const std::vector<std::string> &addresses, bool seqpacket = false);
+    bool adopt(const std::string &address, int socket_fd);
+    void listeners(std::vector<std::string> &addresses, std::vector<int> &socket_fds) const;
+    void release();
+    void setStopDescriptor(int fd) { stop_fd = fd; }
     MessageChannel acceptOne();
+    static bool awaitHello(MessageChannel &channel);
 
 private:
     const static int MAX_AWAITING_CONNECTIONS = 10;
-    int server_socket_fd;
+    const static uint32_t MAX_HELLO_PAYLOAD_SIZE = 64;
+    const static int HELLO_TIMEOUT_SECONDS = 5;
 
-    MessageChannel prepareChannel(int socket_fd);
-    bool prepareServerSocket();
-    void cleanupServerSocket();
+    // listening sockets, one per address; the hub can listen on unix socket and tcp at the same time
+    std::vector<HubAddress> addresses;
+    std::vector<int> server_socket_fds;
+
+    // acceptOne gives up when this becomes readable; UNINITIALIZED_SOCKET_FD means never
+    int stop_fd;
+
+    int acceptFromAny();
+    bool stopRequested() const;
+    bool prepareServerSocket(const HubAddress &address);
+    void cleanupServerSockets();
 };
 
 }
@@ -0,0 +1,117 @@
+/**
+ *   @file: SessionStore.cpp
+ *
+ *   @date: Oct 18, 2026
+ */
+
+#include <time.h>
+#include "MessageBusIpcCommon.h"
+#include "SessionStore.h"
+
+using namespace messagebusipc;
+
+SessionStore::SessionStore(unsigned window_ms, unsigned max_messages, uint32_t max_bytes) :
+        window_ms(window_ms), max_messages(max_messages), max_bytes(max_bytes) {
+}
+
+/**
+ * @name    suspend
+ * @brief   Start buffering messages for given client; no-op if already buffering
+ */
+void SessionStore::suspend(const std::string &client_name) {
+    if (sessions.find(client_name) != sessions.end())
+        return;
+
+    Session &session = sessions[client_name];
+    session.suspended_at_ms = nowMs();
+    session.num_bytes = 0;
+    DEBUG_MSG("%s: session suspended: %s", __FUNCTION__, client_name.c_str());
+}
+
+/**
+ * @name    resume
+ * @brief   Stop buffering messages for given client and hand them over
+ * @return  True if there was a session to resume, False otherwise
+ */
+bool SessionStore::resume(const std::string &client_name, std::deque<Message> &messages) {
+    expire();
+
+    std::map<std::string, Session>::iterator it = sessions.find(client_name);
+    if (it == sessions.end())
+        return false;
+
+    messages.swap(it->second.messages);
+    sessions.erase(it);
+    DEBUG_MSG("%s: session resumed: %s, %d messages", __FUNCTION__, client_name.c_str(), (int)messages.size());
+    return true;
+}
+
+/**
+ * @name    buffer
+ * @brief   Keep the message if given client session is suspended
+ */
+void SessionStore::buffer(const std::string &client_name, uint32_t id, const char *data, uint32_t size, const std::string &sender) {
+    std::map<std::string, Session>::iterator it = sessions.find(client_name);
+    if (it != sessions.end())
+        append(it->second, id, data, size, sender);
+}
+
+/**
+ * @name    bufferForAll
+ * @brief   Keep broadcast message for every suspended session except the sender's own
+ */
+void SessionStore::bufferForAll(uint32_t id, const char *data, uint32_t size, const std::string &sender) {
+    for (std::map<std::string, Session>::iterator it = sessions.begin(); it != sessions.end(); ++it)
+        if (it->first != sender)
+            append(it->second, id, data, size, sender);
+}
+
+/**
+ * @name    expire
+ * @brief   Forget sessions that have been suspended for longer than the window
+ */
+void SessionStore::expire() {
+    if (sessions.empty())
+        return;
+
+    uint64_t now = nowMs();
+    std::map<std::string, Session>::iterator it = sessions.begin();
+    while (it != sessions.end())
+        if (now - it->second.suspended_at_ms > window_ms) {
+            ERROR_MSG("%s: session expired: %s, %d messages lost", __FUNCTION__, it->first.c_str(), (int)it->second.messages.size());
+            sessions.erase(it++);
+        }
+        else
+            ++it;
+}
+
+/**
+ * @name    append
+ * @brief   Add message to the session, dropping the oldest ones to stay within the limits
+ */
+void SessionStore::append(Session &session, uint32_t id, const char *data, uint32_t size, const std::string &sender) {
+    if (size > max_bytes)
+        return;
+
+    while (!session.messages.empty() && ((session.messages.size() >= max_messages) || (session.num_bytes + size > max_bytes))) {
+        session.num_bytes -= session.messages.front().data.size();
+        session.messages.pop_front();
+    }
+
+    session.messages.push_back(Message());
+    Message &message = session.messages.back();
+    message.id = id;
+    message.sender = sender;
+    message.data.assign(data, data + size);
+    session.num_bytes += size;
+}
+
+/**
+ * @name    nowMs
+ * @return  Monotonic time in milliseconds
+ */
+uint64_t SessionStore::nowMs() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
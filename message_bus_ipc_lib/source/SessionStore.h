@@ -0,0 +1,60 @@
+/**
+ *   @file: SessionStore.h
+ *
+ *   @date: Oct 18, 2026
+ */
+
+#ifndef MESSAGE_BUS_IPC_LIB_SOURCE_SESSIONSTORE_H_
+#define MESSAGE_BUS_IPC_LIB_SOURCE_SESSIONSTORE_H_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <stdint.h>
+
+namespace messagebusipc {
+
+/**
+ * @class   SessionStore
+ * @brief   Messages for recently disconnected clients that asked for session resume (HELLO_FLAG_RESUME_SESSION).
+ *          Messages are kept for a bounded time and up to a bounded amount per session, then replayed when the client
+ *          of the same name connects again.
+ * @note    Not thread safe; owned by the MessageHub router thread
+ */
+class SessionStore {
+public:
+    struct Message {
+        uint32_t id;
+        std::string sender;
+        std::vector<char> data;
+    };
+
+    SessionStore(unsigned window_ms, unsigned max_messages, uint32_t max_bytes);
+
+    void suspend(const std::string &client_name);
+    bool resume(const std::string &client_name, std::deque<Message> &messages);
+    void buffer(const std::string &client_name, uint32_t id, const char *data, uint32_t size, const std::string &sender);
+    void bufferForAll(uint32_t id, const char *data, uint32_t size, const std::string &sender);
+    void expire();
+    bool empty() const { return sessions.empty(); }
+
+private:
+    struct Session {
+        uint64_t suspended_at_ms;
+        uint32_t num_bytes;
+        std::deque<Message> messages;
+    };
+
+    unsigned window_ms;
+    unsigned max_messages;
+    uint32_t max_bytes;
+    std::map<std::string, Session> sessions;
+
+    void append(Session &session, uint32_t id, const char *data, uint32_t size, const std::string &sender);
+    static uint64_t nowMs();
+};
+
+}
+
+#endif /* MESSAGE_BUS_IPC_LIB_SOURCE_SESSIONSTORE_H_ */
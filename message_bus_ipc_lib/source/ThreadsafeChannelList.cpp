@@ -6,6 +6,8 @@
  */
 
 #include <algorithm>
+#include <unistd.h>
+#include <sys/socket.h>
 #include "ThreadsafeChannelList.h"
 #include "MessageBusIpcCommon.h"
 #include "PThreadLockGuard.h"
@@ -15,19 +17,27 @@ using namespace messagebusipc;
 
 /**
  * Iterator Constructor.
- * @param   channels MessageChannel list to iterate over
- * @param   mutex ThreadsafeChannelList add/remove/iterate synchronization mutex
- * @brief   channellist_lock locks the mutex, so add/remove operations of ThreadsafeChannelList are blocked
+ * @param   snapshot Snapshot to iterate over, already referenced on behalf of the Iterator
  */
-ThreadsafeChannelList::Iterator::Iterator(std::vector<MessageChannel> &channels, pthread_mutex_t &mutex) :
-        channels(channels), current_position(0), channellist_lock(mutex) {
+ThreadsafeChannelList::Iterator::Iterator(Snapshot *snapshot) :
+        snapshot(snapshot), count(__atomic_load_n(&snapshot->count, __ATOMIC_ACQUIRE)), current_position(0) {
+}
+
+/**
+ * Iterator copy Constructor.
+ * @brief   The copy references the same snapshot
+ */
+ThreadsafeChannelList::Iterator::Iterator(const Iterator &other) :
+        snapshot(other.snapshot), count(other.count), current_position(other.current_position) {
+    __atomic_add_fetch(&snapshot->refs, 1, __ATOMIC_SEQ_CST);
 }
 
 /**
  * Iterator Destructor.
+ * @brief   Let go of the snapshot, so the writer can recycle it
  */
 ThreadsafeChannelList::Iterator::~Iterator() {
-    // channellist_lock gets destroyed and unlocks the mutex, so add/remove operations of ThreadsafeChannelList get unlocked
+    release(snapshot);
 }
 
 /**
@@ -36,10 +46,10 @@ ThreadsafeChannelList::Iterator::~Iterator() {
  * @return  MessageChannel pointer if iterating not done yet, NULL otherwise
  */
 MessageChannel const* ThreadsafeChannelList::Iterator::getNext() {
-    if (current_position == channels.size())
+    if (current_position == count)
         return NULL;
 
-    return &channels[current_position++];
+    return snapshot->channels[current_position++];
 }
 
 /**
@@ -51,18 +61,33 @@ void ThreadsafeChannelList::Iterator::reset() {
 }
 /**
  * ThreadsafeChannelList Constructor.
- * @brief   Initialize the add/remove/iterate mutex
+ * @brief   Initialize the writer mutex and publish empty snapshot
  */
 ThreadsafeChannelList::ThreadsafeChannelList() {
-    pthread_mutex_init(&channels_mutex, NULL);
+    pthread_mutex_init(&writer_mutex, NULL);
+    current = new Snapshot(this);
+    current->channels.resize(MIN_CAPACITY);
+    current->refs = 0;
+    all_snapshots.push_back(current);
 }
 
 /**
  * ThreadsafeChannelList Destructor.
- * @brief   Get rid of the add/remove/iterate mutex
+ * @brief   Get rid of the snapshots and the writer mutex; no Iterator may outlive the list
  */
 ThreadsafeChannelList::~ThreadsafeChannelList() {
-    pthread_mutex_destroy(&channels_mutex);
+    for (unsigned int i = 0; i < current->count; i++)
+        delete current->channels[i];
+
+    for (std::vector<Snapshot*>::iterator it = all_snapshots.begin(); it != all_snapshots.end(); ++it) {
+        for (std::vector<MessageChannel*>::iterator channel = (*it)->removed.begin(); channel != (*it)->removed.end(); ++channel) {
+            if (!(*channel)->isMultiplexed())
+                close((*channel)->fileDescriptor());
+            delete *channel;
+        }
+        delete *it;
+    }
+    pthread_mutex_destroy(&writer_mutex);
 }
 
 /**
@@ -71,10 +96,25 @@ ThreadsafeChannelList::~ThreadsafeChannelList() {
  * @note    Thread safe add/remove/iterate
  */
 void ThreadsafeChannelList::add(MessageChannel &channel) {
-    PThreadLockGuard lock(channels_mutex);
+    PThreadLockGuard lock(writer_mutex);
+
+    // readers look no further than the count they saw, so there is room to append in place
+    unsigned int count = current->count;
+    if (count < current->channels.size()) {
+        current->channels[count] = new MessageChannel(channel);
+        __atomic_store_n(&current->count, count + 1, __ATOMIC_RELEASE);
+        DEBUG_MSG("%s: num channels: %d", __FUNCTION__, (int )count + 1);
+        return;
+    }
 
-    channels.push_back(channel);
-    DEBUG_MSG("%s: num channels: %d", __FUNCTION__, (int )channels.size());
+    Snapshot *next = claimSnapshot();
+    if (next->channels.size() < 2 * count)
+        next->channels.resize(2 * count);
+    std::copy(current->channels.begin(), current->channels.begin() + count, next->channels.begin());
+    next->channels[count] = new MessageChannel(channel);
+    next->count = count + 1;
+    publish(next, std::vector<MessageChannel*>());
+    DEBUG_MSG("%s: num channels: %d", __FUNCTION__, (int )next->count);
 }
 
 /**
@@ -83,32 +123,144 @@ void ThreadsafeChannelList::add(MessageChannel &channel) {
  * @note    Thread safe add/remove/iterate
  */
 void ThreadsafeChannelList::remove(unsigned int index) {
-    PThreadLockGuard lock(channels_mutex);
+    PThreadLockGuard lock(writer_mutex);
 
-    if (index >= channels.size())
+    unsigned int count = current->count;
+    if (index >= count)
         return;
 
-    channels.erase(channels.begin() + index);
-    DEBUG_MSG("%s: num channels: %d", __FUNCTION__, (int )channels.size());
+    Snapshot *next = claimSnapshot();
+    if (next->channels.size() < current->channels.size())
+        next->channels.resize(current->channels.size());
+    std::copy(current->channels.begin(), current->channels.begin() + index, next->channels.begin());
+    std::copy(current->channels.begin() + index + 1, current->channels.begin() + count, next->channels.begin() + index);
+    next->count = count - 1;
+    publish(next, std::vector<MessageChannel*>(1, current->channels[index]));
+    DEBUG_MSG("%s: num channels: %d", __FUNCTION__, (int )next->count);
 }
 
 /**
  * @name    removeByValue
- * @param   channel MessageChannel to remove
+ * @param   channel MessageChannel to remove; connection takes its multiplexed channels along
  * @note    Thread safe add/remove/iterate
  */
 void ThreadsafeChannelList::removeByValue(MessageChannel &channel) {
-    PThreadLockGuard lock(channels_mutex);
+    PThreadLockGuard lock(writer_mutex);
 
-    channels.erase(std::remove(channels.begin(), channels.end(), channel), channels.end());
-    DEBUG_MSG("%s: num channels: %d", __FUNCTION__, (int )channels.size());
+    Snapshot *next = claimSnapshot();
+    if (next->channels.size() < current->channels.size())
+        next->channels.resize(current->channels.size());
+    std::vector<MessageChannel*> removed;
+    for (unsigned int i = 0; i < current->count; i++) {
+        MessageChannel *it = current->channels[i];
+        if ((*it == channel) || (!channel.isMultiplexed() && it->isMultiplexed() && (it->fileDescriptor() == channel.fileDescriptor())))
+            removed.push_back(it);
+        else
+            next->channels[next->count++] = it;
+    }
+    publish(next, removed);
+    DEBUG_MSG("%s: num channels: %d", __FUNCTION__, (int )next->count);
 }
 
 /**
  * @name    getIterator
- * @return  MessageChannel iterator
- * @note    Thread safe add/remove/iterate
+ * @return  MessageChannel iterator over the current snapshot
+ * @note    Thread safe add/remove/iterate; never blocks
  */
 ThreadsafeChannelList::Iterator ThreadsafeChannelList::getIterator() {
-    return Iterator(channels, channels_mutex);
+    return Iterator(acquire(current));
+}
+
+/**
+ * @name    acquire
+ * @brief   Reference the current snapshot. The snapshot may get replaced or even recycled between reading the pointer
+ *          and referencing it; then the reference is given back and the new current snapshot is tried
+ */
+ThreadsafeChannelList::Snapshot *ThreadsafeChannelList::acquire(Snapshot *const &current) {
+    while (true) {
+        Snapshot *snapshot = __atomic_load_n(&current, __ATOMIC_SEQ_CST);
+        int refs = __atomic_add_fetch(&snapshot->refs, 1, __ATOMIC_SEQ_CST);
+        if ((refs > 0) && (__atomic_load_n(&current, __ATOMIC_SEQ_CST) == snapshot))
+            return snapshot;
+
+        release(snapshot);
+    }
+}
+
+/**
+ * @name    release
+ * @brief   Unreference the snapshot; the last reader of a replaced snapshot recycles it, closing the sockets removed with it.
+ *          The writer marks the snapshot retired before it tries to recycle it, so either of the two gets it
+ */
+void ThreadsafeChannelList::release(Snapshot *snapshot) {
+    if ((__atomic_sub_fetch(&snapshot->refs, 1, __ATOMIC_SEQ_CST) == 0) && __atomic_load_n(&snapshot->retired, __ATOMIC_SEQ_CST)) {
+        ThreadsafeChannelList *list = snapshot->list;
+        PThreadLockGuard lock(list->writer_mutex);
+        list->recycleRetired();
+    }
+}
+
+/**
+ * @name    recycleRetired
+ * @brief   Close the sockets and reuse the snapshots that no Iterator holds, oldest first;
+ *          younger snapshot waits for the older ones, as they may still show the channels it closes
+ * @note    writer_mutex must be held
+ */
+void ThreadsafeChannelList::recycleRetired() {
+    while (!retired.empty()) {
+        Snapshot *oldest = retired.front();
+        int unreferenced = 0;
+        if (!__atomic_compare_exchange_n(&oldest->refs, &unreferenced, CLAIMED, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+            return;
+
+        for (std::vector<MessageChannel*>::iterator it = oldest->removed.begin(); it != oldest->removed.end(); ++it) {
+            if (!(*it)->isMultiplexed())
+                close((*it)->fileDescriptor());
+            delete *it;
+        }
+        oldest->removed.clear();
+        oldest->count = 0;
+        __atomic_store_n(&oldest->retired, false, __ATOMIC_SEQ_CST);
+        retired.pop_front();
+        free_snapshots.push_back(oldest);
+    }
+}
+
+/**
+ * @name    claimSnapshot
+ * @return  Empty snapshot owned by the writer
+ * @note    writer_mutex must be held
+ */
+ThreadsafeChannelList::Snapshot *ThreadsafeChannelList::claimSnapshot() {
+    recycleRetired();
+    if (!free_snapshots.empty()) {
+        Snapshot *snapshot = free_snapshots.back();
+        free_snapshots.pop_back();
+        return snapshot;
+    }
+
+    Snapshot *snapshot = new Snapshot(this);
+    all_snapshots.push_back(snapshot);
+    return snapshot;
+}
+
+/**
+ * @name    publish
+ * @brief   Make next the current snapshot; removed channels are shut down now, closed and deleted when the replaced snapshot is recycled.
+ *          Multiplexed channel doesn't own the connection, its socket is left alone
+ * @note    writer_mutex must be held
+ */
+void ThreadsafeChannelList::publish(Snapshot *next, const std::vector<MessageChannel*> &removed) {
+    Snapshot *previous = current;
+    __atomic_store_n(&current, next, __ATOMIC_SEQ_CST);
+    __atomic_sub_fetch(&next->refs, CLAIMED, __ATOMIC_SEQ_CST); // readers that stumbled on it while claimed give their references back
+
+    for (std::vector<MessageChannel*>::const_iterator it = removed.begin(); it != removed.end(); ++it) {
+        if (!(*it)->isMultiplexed())
+            shutdown((*it)->fileDescriptor(), SHUT_RDWR);
+        previous->removed.push_back(*it);
+    }
+    __atomic_store_n(&previous->retired, true, __ATOMIC_SEQ_CST);
+    retired.push_back(previous);
+    recycleRetired();
 }
@@ -9,6 +9,7 @@
 #define MESSAGE_BUS_IPC_LIB_SOURCE_THREADSAFECHANNELLIST_H_
 
 #include <vector>
+#include <deque>
 #include "MessageChannel.h"
 #include "PThreadLockGuard.h"
 
@@ -16,23 +17,35 @@ namespace messagebusipc {
 
 /**
  * @class   ThreadsafeChannelList
- * @brief   List with thread-safe add/remove/iterate operations;
- *          add/remove blocks Iterator from being constructed
- *          Constructed Iterator object blocks add/remove operations.
+ * @brief   List with thread-safe add/remove/iterate operations, read-copy-update style:
+ *          Iterator walks a reference counted snapshot of the list and never takes a lock. Snapshot holds pointers to
+ *          the channels and has room to spare; add appends in place and publishes the new count, readers see
+ *          the count from when they got the Iterator. Remove, or add with no room left, copies the pointers
+ *          into a new snapshot and publishes it atomically, so writers never wait for iterating readers.
+ *          Snapshots are recycled, never freed, once no Iterator holds them (and none older than them);
+ *          the sockets of removed channels are closed only then, so a reader never writes to a reused descriptor.
+ *          The last Iterator of a replaced snapshot recycles it, so the sockets don't wait for the next add/remove
+ * @note    Removed channel is shut down right away and owned by the list until its socket is closed
  */
 class ThreadsafeChannelList {
+    struct Snapshot;
+
 public:
     class Iterator {
     public:
-        Iterator(std::vector<MessageChannel> &channels, pthread_mutex_t &mtx);
+        Iterator(const Iterator &other);
         ~Iterator();
         MessageChannel const* getNext();
         void reset();
 
     private:
-        std::vector<MessageChannel> &channels;
+        friend class ThreadsafeChannelList;
+        explicit Iterator(Snapshot *snapshot);
+        Iterator& operator=(const Iterator&);
+
+        Snapshot *snapshot;     // referenced for the lifetime of Iterator
+        unsigned int count;     // channels in the snapshot when the Iterator was made; add may append more
         unsigned int current_position;
-        PThreadLockGuard channellist_lock; // this guy blocks add/remove operations of ThreadsafeChannelList for the lifetime of Iterator
     };
 
 public:
@@ -45,8 +58,36 @@ public:
     Iterator getIterator();
 
 private:
-    pthread_mutex_t channels_mutex;
-    std::vector<MessageChannel> channels;
+    struct Snapshot {
+        Snapshot(ThreadsafeChannelList *list) : refs(CLAIMED), count(0), retired(false), list(list) {}
+        int refs;                               // atomic; number of Iterators, CLAIMED while the writer owns the snapshot
+        unsigned int count;                     // atomic; channels[0, count) are valid, the rest is room for add
+        bool retired;                           // atomic; replaced, its last Iterator recycles it
+        std::vector<MessageChannel*> channels;  // shared with other snapshots; owned by the list
+        std::vector<MessageChannel*> removed;   // channels removed when this snapshot was replaced; deleted when it is recycled
+        ThreadsafeChannelList *list;
+    };
+
+    // added to refs so they stay negative while the snapshot is being recycled or filled
+    static const int CLAIMED = -(1 << 30);
+
+    // room for this many channels in the first snapshot; doubles when full
+    static const unsigned int MIN_CAPACITY = 16;
+
+    pthread_mutex_t writer_mutex;               // one writer at a time; readers never take it
+    Snapshot *current;                          // atomic
+    std::deque<Snapshot*> retired;              // replaced snapshots, oldest first; guarded by writer_mutex
+    std::vector<Snapshot*> free_snapshots;      // claimed and empty, ready to be filled; guarded by writer_mutex
+    std::vector<Snapshot*> all_snapshots;       // for the destructor; guarded by writer_mutex
+
+    static Snapshot *acquire(Snapshot *const &current);
+    static void release(Snapshot *snapshot);
+    void recycleRetired();
+    Snapshot *claimSnapshot();
+    void publish(Snapshot *next, const std::vector<MessageChannel*> &removed);
+
+    ThreadsafeChannelList(const ThreadsafeChannelList&);
+    ThreadsafeChannelList& operator=(const ThreadsafeChannelList&);
 };
 
 }
@@ -5,39 +5,69 @@
  *      Author: mateusz
  */
 
+#include <time.h>
+#include <errno.h>
+#include <algorithm>
 #include "PThreadLockGuard.h"
 #include "ThreadsafeClientList.h"
 
 namespace messagebusipc {
 
-ThreadsafeClientList::ThreadsafeClientList() {
+ThreadsafeClientList::ThreadsafeClientList() : next_round(0) {
     pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&notification_done, NULL);
+
+    // timed waits should not jump together with wall clock
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&client_added, &attr);
+    pthread_condattr_destroy(&attr);
 }
 
 ThreadsafeClientList::~ThreadsafeClientList() {
+    pthread_cond_destroy(&client_added);
+    pthread_cond_destroy(&notification_done);
     pthread_mutex_destroy(&mutex);
 }
 
 /**
  * @name    add
+ * @brief   Register client and wake up everyone waiting for it
  * @note    Thread safe
  */
 void ThreadsafeClientList::add(const std::string &client_name) {
-    PThreadLockGuard lock(mutex);
+    bool joined;
+    {
+        PThreadLockGuard lock(mutex);
 
-    clients += client_name + ";";
+        joined = (++clients[client_name] == 1);
+        pthread_cond_broadcast(&client_added);
+    }
+
+    if (joined)
+        notify(std::vector<std::string>(1, client_name), true);
 }
+
 /**
  * @name    remove
+ * @brief   Unregister single client of given name
  * @note    Thread safe
  */
 void ThreadsafeClientList::remove(const std::string &client_name) {
-    PThreadLockGuard lock(mutex);
+    bool left = false;
+    {
+        PThreadLockGuard lock(mutex);
 
-    std::string::size_type i = clients.find(client_name);
+        std::unordered_map<std::string, unsigned>::iterator it = clients.find(client_name);
+        if ((it != clients.end()) && (--it->second == 0)) {
+            clients.erase(it);
+            left = true;
+        }
+    }
 
-    if (i != std::string::npos)
-       clients.erase(i, client_name.length() + 1 ); // +1 for ';'
+    if (left)
+        notify(std::vector<std::string>(1, client_name), false);
 }
 
 /**
@@ -45,9 +75,16 @@ void ThreadsafeClientList::remove(const std::string &client_name) {
  * @note    Thread safe
  */
 void ThreadsafeClientList::clear() {
-    PThreadLockGuard lock(mutex);
+    std::vector<std::string> names;
+    {
+        PThreadLockGuard lock(mutex);
+
+        for (std::unordered_map<std::string, unsigned>::iterator it = clients.begin(); it != clients.end(); ++it)
+            names.push_back(it->first);
+        clients.clear();
+    }
 
-    clients.clear();
+    notify(names, false);
 }
 
 /**
@@ -57,7 +94,66 @@ void ThreadsafeClientList::clear() {
 bool ThreadsafeClientList::exists(const std::string &client_name) {
     PThreadLockGuard lock(mutex);
 
-    return (clients.find(client_name) != std::string::npos);
+    return (clients.find(client_name) != clients.end());
+}
+
+/**
+ * @name    waitFor
+ * @brief   Block current thread until given client is on the list
+ * @param   timeout_ms How long to wait at most, WAIT_FOREVER to wait without limit
+ * @return  True if the client is on the list, False on timeout
+ * @note    Thread safe
+ */
+bool ThreadsafeClientList::waitFor(const std::string &client_name, int timeout_ms) {
+    timespec deadline;
+    if (timeout_ms != WAIT_FOREVER) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    PThreadLockGuard lock(mutex);
+
+    while (clients.find(client_name) == clients.end()) {
+        if (timeout_ms == WAIT_FOREVER)
+            pthread_cond_wait(&client_added, &mutex);
+        else if (pthread_cond_timedwait(&client_added, &mutex, &deadline) == ETIMEDOUT)
+            return (clients.find(client_name) != clients.end());
+    }
+
+    return true;
+}
+
+/**
+ * @name    subscribe
+ * @brief   Start notifying the observer about clients joining and leaving
+ * @note    Thread safe
+ */
+void ThreadsafeClientList::subscribe(ClientPresenceObserver *observer) {
+    PThreadLockGuard lock(mutex);
+
+    observers.push_back(observer);
+}
+
+/**
+ * @name    unsubscribe
+ * @brief   Stop notifying the observer; when this returns the observer is not called anymore and may be deleted
+ * @note    Thread safe. Waits for notify rounds in progress in other threads; called from inside an observer
+ *          it does not wait for its own round, which skips the unsubscribed observer from now on
+ */
+void ThreadsafeClientList::unsubscribe(ClientPresenceObserver *observer) {
+    PThreadLockGuard lock(mutex);
+
+    observers.erase(std::remove(observers.begin(), observers.end(), observer), observers.end());
+
+    // rounds started from now on don't see the observer; the ones started earlier may be calling it right now
+    uint64_t removed_round = next_round;
+    while (notifyingBefore(removed_round))
+        pthread_cond_wait(&notification_done, &mutex);
 }
 
 /**
@@ -68,6 +164,72 @@ bool ThreadsafeClientList::exists(const std::string &client_name) {
 std::string ThreadsafeClientList::toString() {
     PThreadLockGuard lock(mutex);
 
-    return clients;
+    std::string result;
+    for (std::unordered_map<std::string, unsigned>::iterator it = clients.begin(); it != clients.end(); ++it)
+        result += it->first + ";";
+    return result;
+}
+
+/**
+ * @name    notify
+ * @brief   Tell observers about clients that joined or left
+ * @note    Called without the mutex held, so observers are free to query the list and to unsubscribe
+ */
+void ThreadsafeClientList::notify(const std::vector<std::string> &names, bool joined) {
+    if (names.empty())
+        return;
+
+    std::vector<ClientPresenceObserver*> current_observers;
+    uint64_t round;
+    {
+        PThreadLockGuard lock(mutex);
+        current_observers = observers;
+        round = next_round++;
+        Notification notification = { round, pthread_self() };
+        notifications.push_back(notification);
+    }
+
+    for (std::vector<ClientPresenceObserver*>::iterator observer = current_observers.begin(); observer != current_observers.end(); ++observer)
+        for (std::vector<std::string>::const_iterator name = names.begin(); name != names.end(); ++name) {
+            // an earlier observer may have unsubscribed this one
+            if (!isSubscribed(*observer))
+                break;
+
+            if (joined)
+                (*observer)->onClientJoined(*name);
+            else
+                (*observer)->onClientLeft(*name);
+        }
+
+    PThreadLockGuard lock(mutex);
+    for (std::vector<Notification>::iterator it = notifications.begin(); it != notifications.end(); ++it)
+        if (it->round == round) {
+            notifications.erase(it);
+            break;
+        }
+    pthread_cond_broadcast(&notification_done);
+}
+
+/**
+ * @name    isSubscribed
+ * @note    Thread safe
+ */
+bool ThreadsafeClientList::isSubscribed(ClientPresenceObserver *observer) {
+    PThreadLockGuard lock(mutex);
+
+    return std::find(observers.begin(), observers.end(), observer) != observers.end();
+}
+
+/**
+ * @name    notifyingBefore
+ * @return  True if other thread is in notify round started before given one
+ * @note    Call with the mutex held
+ */
+bool ThreadsafeClientList::notifyingBefore(uint64_t round) {
+    for (std::vector<Notification>::const_iterator it = notifications.begin(); it != notifications.end(); ++it)
+        if ((it->round < round) && !pthread_equal(it->thread, pthread_self()))
+            return true;
+
+    return false;
 }
 } /* namespace messagebusipc */
@@ -9,16 +9,33 @@
 #define MESSAGE_BUS_IPC_LIB_SOURCE_THREADSAFECLIENTLIST_H_
 
 #include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
 #include <pthread.h>
 
 namespace messagebusipc {
 
+/**
+ * @class   ClientPresenceObserver
+ * @brief   Gets notified when client of given name becomes available or unavailable
+ * @note    Called from MessageClient listener thread
+ */
+class ClientPresenceObserver {
+public:
+    virtual ~ClientPresenceObserver() {}
+    virtual void onClientJoined(const std::string &client_name) = 0;
+    virtual void onClientLeft(const std::string &client_name) = 0;
+};
+
 /**
  * @class   ThreadsafeClientList
- * @brief   Thread safe list of connected client names
+ * @brief   Thread safe list of connected client names; many clients of the same name count as one presence
  */
 class ThreadsafeClientList {
 public:
+    static const int WAIT_FOREVER = -1;
+
     ThreadsafeClientList();
     virtual ~ThreadsafeClientList();
 
@@ -26,11 +43,29 @@ public:
     void remove(const std::string &client_name);
     void clear();
     bool exists(const std::string &client_name);
+    bool waitFor(const std::string &client_name, int timeout_ms = WAIT_FOREVER);
+    void subscribe(ClientPresenceObserver *observer);
+    void unsubscribe(ClientPresenceObserver *observer);
     std::string toString();
 
 private:
     pthread_mutex_t mutex;
-    std::string clients;
+    pthread_cond_t client_added;
+    std::unordered_map<std::string, unsigned> clients; // name -> number of connected clients of that name
+    std::vector<ClientPresenceObserver*> observers;
+
+    // notify rounds in progress, see unsubscribe
+    struct Notification {
+        uint64_t round;
+        pthread_t thread;
+    };
+    pthread_cond_t notification_done;
+    std::vector<Notification> notifications;
+    uint64_t next_round;
+
+    bool isSubscribed(ClientPresenceObserver *observer);
+    bool notifyingBefore(uint64_t round);
+    void notify(const std::vector<std::string> &names, bool joined);
 };
 
 } /* namespace messagebusipc */
@@ -6,6 +6,8 @@
  */
 
 #include <string.h>
+#include <errno.h>
+#include <time.h>
 #include "MessageBusIpcCommon.h"
 #include "ThreadsafeMessageQueue.h"
 
@@ -14,10 +16,17 @@ using namespace messagebusipc;
 ThreadsafeMessageQueue::ThreadsafeMessageQueue() {
     pthread_mutex_init(&push_pop_mutex, NULL);
     pthread_cond_init(&queue_not_empty, NULL);
-    pthread_cond_init(&queue_not_full, NULL);
+
+    // tryPush waits against monotonic clock
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&queue_not_full, &attr);
+    pthread_condattr_destroy(&attr);
 
     reader_pos = 0;
     writer_pos = 0;
+    spin_useconds = 0;
 }
 
 ThreadsafeMessageQueue::~ThreadsafeMessageQueue() {
@@ -38,26 +47,73 @@ void ThreadsafeMessageQueue::push(const MessageChannel &sender, uint32_t message
     while (((writer_pos+1) % MAX_QUEUE_SIZE) == reader_pos)
         pthread_cond_wait(&queue_not_full, &push_pop_mutex);
 
+    store(sender, message_id, data, size, recipient);
+
+    pthread_mutex_unlock(&push_pop_mutex);
+}
+
+/**
+ * @name    tryPush
+ * @brief   Like push, but give up if the queue stays full for timeout_ms
+ * @return  True if pushed, False on timeout
+ * @note    Thread safe
+ */
+bool ThreadsafeMessageQueue::tryPush(const MessageChannel &sender, uint32_t message_id, const char *data, uint32_t size, const std::string &recipient,
+        unsigned timeout_ms) {
+    timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&push_pop_mutex);
+
+    // wait until there is free space in the queue, or the time is up
+    bool has_room = true;
+    while (((writer_pos+1) % MAX_QUEUE_SIZE) == reader_pos)
+        if (pthread_cond_timedwait(&queue_not_full, &push_pop_mutex, &deadline) == ETIMEDOUT) {
+            has_room = (((writer_pos+1) % MAX_QUEUE_SIZE) != reader_pos);
+            break;
+        }
+
+    if (has_room)
+        store(sender, message_id, data, size, recipient);
+
+    pthread_mutex_unlock(&push_pop_mutex);
+    return has_room;
+}
+
+/**
+ * @name    store
+ * @brief   Copy the message in at writer_pos and wake the consumer
+ * @note    Call with push_pop_mutex locked and room in the queue
+ */
+void ThreadsafeMessageQueue::store(const MessageChannel &sender, uint32_t message_id, const char *data, uint32_t size, const std::string &recipient) {
     Message &m = messages[writer_pos];
     m.sender = sender;
     m.id = message_id;
     m.size = size;
     m.recipient = recipient;
     memcpy(m.buff, data, size);
-    writer_pos = (writer_pos + 1) % MAX_QUEUE_SIZE; // advance the writer
+    __atomic_store_n(&writer_pos, (writer_pos + 1) % MAX_QUEUE_SIZE, __ATOMIC_RELEASE); // advance the writer; pop may be spinning on it
 
     // signal that the queue now has data in it
     pthread_cond_signal(&queue_not_empty);
-
-    pthread_mutex_unlock(&push_pop_mutex);
 }
 
 /**
  * @name    pop
  * @brief   This function copies from the queue internal storage to data
- * @note    Thread safe
+ * @note    Thread safe. With busy polling on it spins before sleeping, and is meant for single consumer
  */
 void ThreadsafeMessageQueue::pop(MessageChannel &sender, uint32_t &message_id, char *data, uint32_t &size, std::string &recipient) {
+    spinner.configure(__atomic_load_n(&spin_useconds, __ATOMIC_RELAXED));
+    if (spinner.enabled())
+        spinner.spin([this] { return __atomic_load_n(&reader_pos, __ATOMIC_RELAXED) != __atomic_load_n(&writer_pos, __ATOMIC_ACQUIRE); });
+
     pthread_mutex_lock(&push_pop_mutex);
 
     // wait until there is data in the queue
@@ -70,10 +126,18 @@ void ThreadsafeMessageQueue::pop(MessageChannel &sender, uint32_t &message_id, c
     size = m.size;
     recipient = m.recipient;
     memcpy(data, m.buff, m.size);
-    reader_pos = (reader_pos + 1) % MAX_QUEUE_SIZE; // advance the reader
+    __atomic_store_n(&reader_pos, (reader_pos + 1) % MAX_QUEUE_SIZE, __ATOMIC_RELAXED); // advance the reader
 
     // signal that the queue now has free room
     pthread_cond_signal(&queue_not_full);
 
     pthread_mutex_unlock(&push_pop_mutex);
 }
+
+/**
+ * @name    setBusyPoll
+ * @brief   Make pop spin this long for the next message before going to sleep; 0 turns spinning off
+ */
+void ThreadsafeMessageQueue::setBusyPoll(unsigned spin_useconds) {
+    __atomic_store_n(&this->spin_useconds, spin_useconds, __ATOMIC_RELAXED);
+}
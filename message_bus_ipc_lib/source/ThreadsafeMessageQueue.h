@@ -13,6 +13,7 @@
 #include <stdint.h>
 #include "MessageChannel.h"
 #include "MessageBusIpcCommon.h"
+#include "BusyPoll.h"
 namespace messagebusipc {
 
 
@@ -26,9 +27,13 @@ public:
     virtual ~ThreadsafeMessageQueue();
 
     void push(const MessageChannel &sender, uint32_t id, const char *data, uint32_t size, const std::string &recipient);
+    bool tryPush(const MessageChannel &sender, uint32_t id, const char *data, uint32_t size, const std::string &recipient, unsigned timeout_ms);
     void pop(MessageChannel &sender, uint32_t &id, char *data, uint32_t &size, std::string &recipient);
+    void setBusyPoll(unsigned spin_useconds);
 
 private:
+    void store(const MessageChannel &sender, uint32_t id, const char *data, uint32_t size, const std::string &recipient);
+
     pthread_mutex_t push_pop_mutex;
     pthread_cond_t queue_not_empty;
     pthread_cond_t queue_not_full;
@@ -46,6 +51,10 @@ private:
     Message messages[MAX_QUEUE_SIZE];
     int reader_pos, writer_pos;
 
+    // busy polling consumer; spin_useconds can be changed any time, spinner belongs to the popping thread
+    unsigned spin_useconds;
+    AdaptiveSpinner spinner;
+
 
 };
 
@@ -0,0 +1,207 @@
+/**
+ *   @file: TrafficCapture.cpp
+ *
+ *   @date: Oct 18, 2026
+ */
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <cstring>
+#include "TrafficCapture.h"
+#include "MessageJournal.h"
+
+using namespace messagebusipc;
+
+TrafficCapture::TrafficCapture() :
+        fd(-1), with_payloads(false), window(NULL), window_offset(0), window_size(0), write_pos(0), last_time_us(0) {
+}
+
+TrafficCapture::~TrafficCapture() {
+    close();
+}
+
+/**
+ * @name    open
+ * @brief   Start new capture file; existing file is overwritten
+ * @param   with_payloads Capture the payloads too, not only their sizes
+ * @return  True on success, False otherwise
+ */
+bool TrafficCapture::open(const std::string &path, bool with_payloads) {
+    close();
+
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        ERROR_MSG("%s: open %s failed, errno %d - %s", __FUNCTION__, path.c_str(), errno, strerror(errno));
+        return false;
+    }
+
+    CaptureFileHeader header;
+    memcpy(header.magic, CAPTURE_MAGIC, sizeof(header.magic));
+    header.version = CAPTURE_VERSION;
+    header.flags = with_payloads ? CAPTURE_FLAG_PAYLOADS : 0;
+    header.start_time_us = MessageJournal::nowUs();
+
+    write_pos = 0;
+    if (!mapWindow(sizeof(header))) {
+        close();
+        return false;
+    }
+    memcpy(window, &header, sizeof(header));
+    write_pos = sizeof(header);
+
+    this->with_payloads = with_payloads;
+    last_time_us = monotonicUs();
+    names.clear();
+    DEBUG_MSG("%s: capturing to %s, payloads %s", __FUNCTION__, path.c_str(), with_payloads ? "on" : "off");
+    return true;
+}
+
+/**
+ * @name    append
+ * @brief   Write the message at the end of the capture
+ * @return  True on success, False if the capture is not open or the file could not grow; the capture is closed then
+ */
+bool TrafficCapture::append(uint32_t id, const char *data, uint32_t size, const std::string &sender, const std::string &recipient) {
+    if (!isOpen())
+        return false;
+
+    uint32_t sender_index, recipient_index;
+    if (!nameIndex(sender, sender_index) || !nameIndex(recipient, recipient_index))
+        return false;
+
+    uint64_t now_us = monotonicUs();
+    record.assign(1, CAPTURE_RECORD_MESSAGE);
+    putVarint(record, now_us - last_time_us);
+    putVarint(record, sender_index);
+    putVarint(record, recipient_index);
+    putVarint(record, id);
+    putVarint(record, size);
+    last_time_us = now_us;
+
+    return write(record, data, with_payloads ? size : 0);
+}
+
+/**
+ * @name    close
+ * @brief   Cut the file down to what was captured and close it
+ */
+void TrafficCapture::close() {
+    if (fd == -1)
+        return;
+
+    unmapWindow();
+    if (ftruncate(fd, write_pos) == -1)
+        ERROR_MSG("%s: ftruncate failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+    ::close(fd);
+    fd = -1;
+}
+
+/**
+ * @name    monotonicUs
+ * @return  Monotonic clock in microseconds; gaps between messages don't jump with the wall clock
+ */
+uint64_t TrafficCapture::monotonicUs() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/**
+ * @name    nameIndex
+ * @brief   Get the index of the name; name seen for the first time is written to the capture first
+ * @return  True on success, False if writing the name failed
+ */
+bool TrafficCapture::nameIndex(const std::string &name, uint32_t &index) {
+    std::map<std::string, uint32_t>::const_iterator it = names.find(name);
+    if (it != names.end()) {
+        index = it->second;
+        return true;
+    }
+
+    std::vector<char> fields(1, CAPTURE_RECORD_NAME);
+    putVarint(fields, name.length());
+    if (!write(fields, name.data(), name.length()))
+        return false;
+
+    index = names.size();
+    names[name] = index;
+    return true;
+}
+
+/**
+ * @name    write
+ * @brief   Append record made of the fields followed by the data
+ * @note    Record type goes in last, so the hub killed halfway leaves zero there, which ends the capture
+ */
+bool TrafficCapture::write(const std::vector<char> &fields, const char *data, uint32_t size) {
+    uint64_t record_size = fields.size() + size;
+    if ((write_pos + record_size > window_offset + window_size) && !mapWindow(record_size)) {
+        ERROR_MSG("%s: capture stopped", __FUNCTION__);
+        close();
+        return false;
+    }
+
+    char *destination = window + (write_pos - window_offset);
+    memcpy(destination + 1, &fields[1], fields.size() - 1);
+    if (size > 0)
+        memcpy(destination + fields.size(), data, size);
+    __atomic_store_n(destination, fields[0], __ATOMIC_RELEASE);
+
+    write_pos += record_size;
+    return true;
+}
+
+/**
+ * @name    mapWindow
+ * @brief   Grow the file and map the part of it from write_pos on, at least min_size bytes
+ * @return  True on success, False otherwise
+ */
+bool TrafficCapture::mapWindow(uint64_t min_size) {
+    unmapWindow();
+
+    uint64_t page_size = sysconf(_SC_PAGESIZE);
+    uint64_t offset = write_pos - write_pos % page_size;
+    uint64_t size = (write_pos - offset + min_size + page_size - 1) / page_size * page_size;
+    if (size < WINDOW_SIZE)
+        size = WINDOW_SIZE;
+
+    // allocate the blocks upfront, so appending doesn't stall on filesystem allocation in page faults
+    int error = posix_fallocate(fd, offset, size);
+    if (error && (ftruncate(fd, offset + size) == -1)) {
+        ERROR_MSG("%s: growing capture file failed, errno %d - %s", __FUNCTION__, error, strerror(error));
+        return false;
+    }
+
+    void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+    if (mapping == MAP_FAILED) {
+        ERROR_MSG("%s: mmap failed, errno %d - %s", __FUNCTION__, errno, strerror(errno));
+        return false;
+    }
+    madvise(mapping, size, MADV_SEQUENTIAL);
+
+    window = static_cast<char*>(mapping);
+    window_offset = offset;
+    window_size = size;
+    return true;
+}
+
+void TrafficCapture::unmapWindow() {
+    if (!window)
+        return;
+
+    munmap(window, window_size);
+    window = NULL;
+    window_offset = 0;
+    window_size = 0;
+}
+
+void TrafficCapture::putVarint(std::vector<char> &buffer, uint64_t value) {
+    while (value >= 0x80) {
+        buffer.push_back((char)(value | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back((char)value);
+}
@@ -0,0 +1,86 @@
+/**
+ *   @file: TrafficCapture.h
+ *
+ *   @date: Oct 18, 2026
+ */
+
+#ifndef MESSAGE_BUS_IPC_LIB_SOURCE_TRAFFICCAPTURE_H_
+#define MESSAGE_BUS_IPC_LIB_SOURCE_TRAFFICCAPTURE_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdint.h>
+#include "MessageBusIpcCommon.h"
+
+namespace messagebusipc {
+
+/**
+ * @struct  CaptureFileHeader
+ * @brief   Capture file starts with this header, followed by records. Every record starts with its CAPTURE_RECORD_* type byte,
+ *          zero byte instead means the capture ends there; numbers in records are unsigned LEB128 varints:
+ *          CAPTURE_RECORD_NAME     length, name bytes; the name gets the next index, starting from 0
+ *          CAPTURE_RECORD_MESSAGE  microseconds since the previous message, sender index, recipient index, ID, payload size,
+ *                                  payload bytes if CAPTURE_FLAG_PAYLOADS
+ */
+struct CaptureFileHeader {
+    char magic[8];              // CAPTURE_MAGIC
+    uint32_t version;           // CAPTURE_VERSION
+    uint32_t flags;             // CAPTURE_FLAG_*
+    uint64_t start_time_us;     // wall clock time the capture started, microseconds since epoch
+};
+
+const char CAPTURE_MAGIC[8] = { 'M', 'B', 'I', 'P', 'C', 'C', 'A', 'P' };
+const uint32_t CAPTURE_VERSION = 1;
+const uint32_t CAPTURE_FLAG_PAYLOADS = 1 << 0;   // payloads are captured, not only their sizes
+
+const uint8_t CAPTURE_RECORD_NAME = 1;
+const uint8_t CAPTURE_RECORD_MESSAGE = 2;
+
+/**
+ * @class   TrafficCapture
+ * @brief   Compact record of routed traffic for load testing, see MessageHubConfig::capture_file;
+ *          a message takes about ten bytes plus the payload if payloads are captured.
+ *          Read it with TrafficCaptureReader, replay it with replay_performancetest
+ * @note    Not thread safe; owned by the MessageHub router thread. The file is memory-mapped like MessageJournal segments,
+ *          a window at a time, so appending is a memcpy and what was appended is there even if the hub gets killed
+ */
+class TrafficCapture {
+public:
+    TrafficCapture();
+    ~TrafficCapture();
+
+    bool open(const std::string &path, bool with_payloads);
+    bool append(uint32_t id, const char *data, uint32_t size, const std::string &sender, const std::string &recipient);
+    bool isOpen() const { return fd != -1; }
+    void close();
+
+    static uint64_t monotonicUs();
+
+private:
+    // the file grows and gets mapped by this much
+    static const uint64_t WINDOW_SIZE = 16 * 1024 * 1024;
+
+    int fd;
+    bool with_payloads;
+    char *window;               // mapped part of the file being written
+    uint64_t window_offset;     // file offset of the window, page aligned
+    uint64_t window_size;
+    uint64_t write_pos;         // file offset
+    uint64_t last_time_us;      // monotonic time of the previous message
+    std::map<std::string, uint32_t> names;
+    std::vector<char> record;   // reused by append
+
+    bool nameIndex(const std::string &name, uint32_t &index);
+    bool write(const std::vector<char> &fields, const char *data, uint32_t size);
+    bool mapWindow(uint64_t min_size);
+    void unmapWindow();
+    static void putVarint(std::vector<char> &buffer, uint64_t value);
+
+    TrafficCapture(const TrafficCapture&);
+    TrafficCapture& operator=(const TrafficCapture&);
+};
+
+}
+
+#endif /* MESSAGE_BUS_IPC_LIB_SOURCE_TRAFFICCAPTURE_H_ */
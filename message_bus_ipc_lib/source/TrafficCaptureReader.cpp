@@ -0,0 +1,122 @@
+/**
+ *   @file: TrafficCaptureReader.cpp
+ *
+ *   @date: Oct 18, 2026
+ */
+
+#include <errno.h>
+#include <cstring>
+#include "TrafficCaptureReader.h"
+
+using namespace messagebusipc;
+
+TrafficCaptureReader::TrafficCaptureReader() :
+        file(NULL), time_us(0) {
+    memset(&header, 0, sizeof(header));
+}
+
+TrafficCaptureReader::~TrafficCaptureReader() {
+    close();
+}
+
+/**
+ * @name    open
+ * @brief   Open the capture and position the reader at the first message
+ * @return  True on success, False if there is no capture file or it is not one
+ */
+bool TrafficCaptureReader::open(const std::string &path) {
+    close();
+    names.clear();
+    time_us = 0;
+
+    file = fopen(path.c_str(), "rbe");
+    if (!file) {
+        ERROR_MSG("%s: fopen %s failed, errno %d - %s", __FUNCTION__, path.c_str(), errno, strerror(errno));
+        return false;
+    }
+
+    if ((fread(&header, sizeof(header), 1, file) != 1) || memcmp(header.magic, CAPTURE_MAGIC, sizeof(header.magic)) ||
+        (header.version != CAPTURE_VERSION)) {
+        ERROR_MSG("%s: %s is not a capture file of version %u", __FUNCTION__, path.c_str(), CAPTURE_VERSION);
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @name    next
+ * @brief   Read the next message
+ * @return  True on success, False at the end of the capture; capture cut short by a killed hub ends at the last whole message
+ */
+bool TrafficCaptureReader::next(Entry &entry) {
+    if (!file)
+        return false;
+
+    int type;
+    while ((type = fgetc(file)) == CAPTURE_RECORD_NAME) {
+        uint64_t length;
+        if (!getVarint(length) || (length > MAX_CLIENT_NAME_LENGTH + 1))
+            return false;
+
+        std::string name(length, '\0');
+        if ((length > 0) && (fread(&name[0], length, 1, file) != 1))
+            return false;
+        names.push_back(name);
+    }
+
+    if (type != CAPTURE_RECORD_MESSAGE)
+        return false;
+
+    uint64_t delta_us, sender, recipient, id, size;
+    if (!getVarint(delta_us) || !getVarint(sender) || !getVarint(recipient) || !getVarint(id) || !getVarint(size))
+        return false;
+
+    if (!getName(sender, entry.sender) || !getName(recipient, entry.recipient) || (size > MESSAGE_BUFF_SIZE))
+        return false;
+
+    entry.data = NULL;
+    if (hasPayloads()) {
+        payload.resize(size + 1);
+        if ((size > 0) && (fread(&payload[0], size, 1, file) != 1))
+            return false;
+        payload[size] = '\0';
+        entry.data = &payload[0];
+    }
+
+    time_us += delta_us;
+    entry.time_us = time_us;
+    entry.id = id;
+    entry.size = size;
+    return true;
+}
+
+bool TrafficCaptureReader::getVarint(uint64_t &value) {
+    value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        int byte = fgetc(file);
+        if (byte == EOF)
+            return false;
+
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+
+    return false;
+}
+
+bool TrafficCaptureReader::getName(uint64_t index, const std::string *&name) const {
+    if (index >= names.size())
+        return false;
+
+    name = &names[index];
+    return true;
+}
+
+void TrafficCaptureReader::close() {
+    if (file)
+        fclose(file);
+    file = NULL;
+}
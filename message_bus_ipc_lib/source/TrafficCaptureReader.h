@@ -0,0 +1,59 @@
+/**
+ *   @file: TrafficCaptureReader.h
+ *
+ *   @date: Oct 18, 2026
+ */
+
+#ifndef MESSAGE_BUS_IPC_LIB_SOURCE_TRAFFICCAPTUREREADER_H_
+#define MESSAGE_BUS_IPC_LIB_SOURCE_TRAFFICCAPTUREREADER_H_
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <stdint.h>
+#include "TrafficCapture.h"
+
+namespace messagebusipc {
+
+/**
+ * @class   TrafficCaptureReader
+ * @brief   Reads the capture written by MessageHub, see MessageHubConfig::capture_file
+ */
+class TrafficCaptureReader {
+public:
+    // valid until the next call that moves the reader
+    struct Entry {
+        uint64_t time_us;               // since the capture started
+        uint32_t id;
+        uint32_t size;
+        const char *data;               // NULL if the capture has payload sizes only
+        const std::string *sender;
+        const std::string *recipient;
+    };
+
+    TrafficCaptureReader();
+    ~TrafficCaptureReader();
+
+    bool open(const std::string &path);
+    bool next(Entry &entry);
+    bool hasPayloads() const { return header.flags & CAPTURE_FLAG_PAYLOADS; }
+    uint64_t startTimeUs() const { return header.start_time_us; }
+
+private:
+    FILE *file;
+    CaptureFileHeader header;
+    std::vector<std::string> names;
+    std::vector<char> payload;
+    uint64_t time_us;
+
+    bool getVarint(uint64_t &value);
+    bool getName(uint64_t index, const std::string *&name) const;
+    void close();
+
+    TrafficCaptureReader(const TrafficCaptureReader&);
+    TrafficCaptureReader& operator=(const TrafficCaptureReader&);
+};
+
+}
+
+#endif /* MESSAGE_BUS_IPC_LIB_SOURCE_TRAFFICCAPTUREREADER_H_ */
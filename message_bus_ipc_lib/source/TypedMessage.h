@@ -0,0 +1,219 @@
+/**
+ *   @file: TypedMessage.h
+ *
+ *   @date: Oct 18, 2026
+ */
+
+#ifndef MESSAGE_BUS_IPC_LIB_SOURCE_TYPEDMESSAGE_H_
+#define MESSAGE_BUS_IPC_LIB_SOURCE_TYPEDMESSAGE_H_
+
+#include <stdint.h>
+#include <cstring>
+#include <vector>
+#include <type_traits>
+#include "MessageBusIpcCommon.h"
+
+namespace messagebusipc {
+
+/**
+ * Typed message payload layout, everything in host byte order:
+ *
+ *   [Fixed struct][padding to 8]
+ *   [uint32 length][uint32 reserved][field bytes]['\0' + padding to 8]   <- variable field, zero or more times
+ *
+ * Fixed part and every variable field start 8-byte aligned within the payload, and payload buffers handed to the callbacks
+ * are allocated with new[], so the receiver can read all of them in place.
+ */
+const uint32_t TYPED_MESSAGE_ALIGNMENT = 8;
+
+struct TypedMessageFieldHeader {
+    uint32_t length;
+    uint32_t reserved;
+};
+
+inline uint32_t typedMessageAlign(uint32_t size) {
+    return (size + TYPED_MESSAGE_ALIGNMENT - 1) & ~(TYPED_MESSAGE_ALIGNMENT - 1);
+}
+
+/**
+ * @struct  MessageSchema
+ * @brief   Binds message ID to the fixed layout of its payload, eg.
+ *          struct Position { double x, y; };
+ *          typedef MessageSchema<ID_POSITION, Position> PositionMessage;
+ */
+template<uint32_t Id, class Fixed>
+struct MessageSchema {
+    static_assert(std::is_trivially_copyable<Fixed>::value, "fixed part is sent as raw bytes");
+    static_assert(std::is_standard_layout<Fixed>::value, "fixed part is sent as raw bytes");
+    static_assert(alignof(Fixed) <= TYPED_MESSAGE_ALIGNMENT, "fixed part is read in place");
+
+    static const uint32_t ID = Id;
+    typedef Fixed FixedPart;
+    static const char *name() { return "ID_USER"; } // MBIPC_MESSAGE_SCHEMA gives the real name
+};
+
+/**
+ * @class   TypedMessageView
+ * @brief   Reads typed message straight from the received payload, eg. in the listen callback:
+ *          TypedMessageView<PositionMessage> position(id, data, size);
+ *          if (position.valid()) use(position->x);
+ * @note    Doesn't copy anything; valid as long as the payload buffer is
+ */
+template<class Schema>
+class TypedMessageView {
+public:
+    typedef typename Schema::FixedPart Fixed;
+
+    TypedMessageView(uint32_t id, const char *data, uint32_t size) :
+            id(id), data(data), size(size), read_pos(typedMessageAlign(sizeof(Fixed))) {
+    }
+
+    /**
+     * @name    valid
+     * @return  True if the payload is this message type and the fixed part can be read in place, False otherwise
+     */
+    bool valid() const {
+        return (id == Schema::ID) && (size >= sizeof(Fixed)) && (reinterpret_cast<uintptr_t>(data) % alignof(Fixed) == 0);
+    }
+
+    const Fixed &fixed() const { return *reinterpret_cast<const Fixed*>(data); }
+    const Fixed *operator->() const { return reinterpret_cast<const Fixed*>(data); }
+
+    /**
+     * @name    nextField
+     * @brief   Get the next variable field
+     * @return  True on success, False if there are no more fields or the payload is malformed
+     * @note    field is followed by '\0', so string fields can be used as they are
+     */
+    bool nextField(const char *&field, uint32_t &length) {
+        if (read_pos + sizeof(TypedMessageFieldHeader) > size)
+            return false;
+
+        const TypedMessageFieldHeader *header = reinterpret_cast<const TypedMessageFieldHeader*>(data + read_pos);
+        uint32_t field_pos = read_pos + sizeof(TypedMessageFieldHeader);
+        if ((header->length >= size - field_pos) || data[field_pos + header->length])
+            return false; // the '\0' after the field must be inside the payload too
+
+        field = data + field_pos;
+        length = header->length;
+        read_pos = field_pos + typedMessageAlign(header->length + 1);
+        return true;
+    }
+
+    /**
+     * @name    nextArray
+     * @brief   Get the next variable field as array of trivially copyable items
+     */
+    template<class T>
+    bool nextArray(const T *&items, uint32_t &count) {
+        static_assert(std::is_trivially_copyable<T>::value && (alignof(T) <= TYPED_MESSAGE_ALIGNMENT), "array items are read in place");
+
+        const char *field;
+        uint32_t length;
+        if (!nextField(field, length) || (length % sizeof(T)))
+            return false;
+
+        items = reinterpret_cast<const T*>(field);
+        count = length / sizeof(T);
+        return true;
+    }
+
+    /**
+     * @name    rewind
+     * @brief   Start reading variable fields from the first one again
+     */
+    void rewind() { read_pos = typedMessageAlign(sizeof(Fixed)); }
+
+private:
+    uint32_t id;
+    const char *data;
+    uint32_t size;
+    uint32_t read_pos;
+};
+
+/**
+ * @class   TypedMessageBuilder
+ * @brief   Builds typed message payload in place, ready to be sent as is with MessageClient::send(builder), eg.
+ *          TypedMessageBuilder<PositionMessage> position;
+ *          position->x = 1.0;
+ *          position.appendString("marker");
+ *          client.send(position);
+ * @note    Keep the builder around and reset() it to reuse the buffer
+ */
+template<class Schema>
+class TypedMessageBuilder {
+public:
+    typedef typename Schema::FixedPart Fixed;
+
+    TypedMessageBuilder() {
+        reset();
+    }
+
+    /**
+     * @name    reset
+     * @brief   Start over with zeroed fixed part and no variable fields
+     */
+    void reset() {
+        payload_size = typedMessageAlign(sizeof(Fixed));
+        words.assign(payload_size / sizeof(uint64_t), 0);
+    }
+
+    Fixed &fixed() { return *reinterpret_cast<Fixed*>(&words[0]); }
+    Fixed *operator->() { return reinterpret_cast<Fixed*>(&words[0]); }
+
+    /**
+     * @name    reserve
+     * @brief   Add variable field of given length and let the caller write it in place
+     * @return  Pointer to the field, valid until the next append or reserve; NULL if the message would be too big
+     */
+    char *reserve(uint32_t length) {
+        uint32_t field_pos = payload_size + sizeof(TypedMessageFieldHeader);
+        if (length >= MESSAGE_BUFF_SIZE - field_pos)
+            return NULL;
+
+        uint32_t new_size = field_pos + typedMessageAlign(length + 1);
+        if (new_size > MESSAGE_BUFF_SIZE)
+            return NULL;
+
+        words.resize(new_size / sizeof(uint64_t), 0); // zeroes the padding and the '\0' after the field
+
+        TypedMessageFieldHeader *header = reinterpret_cast<TypedMessageFieldHeader*>(buffer() + payload_size);
+        header->length = length;
+        header->reserved = 0;
+        payload_size = new_size;
+        return buffer() + field_pos;
+    }
+
+    bool append(const void *field, uint32_t length) {
+        char *destination = reserve(length);
+        if (!destination)
+            return false;
+
+        memcpy(destination, field, length);
+        return true;
+    }
+
+    template<class T>
+    bool appendArray(const T *items, uint32_t count) {
+        static_assert(std::is_trivially_copyable<T>::value, "array items are sent as raw bytes");
+        return append(items, count * sizeof(T));
+    }
+
+    bool appendString(const char *str) {
+        return append(str, strlen(str));
+    }
+
+    static uint32_t id() { return Schema::ID; }
+    const char *data() const { return reinterpret_cast<const char*>(&words[0]); }
+    uint32_t size() const { return payload_size; }
+
+private:
+    std::vector<uint64_t> words; // keeps the payload 8-byte aligned
+    uint32_t payload_size;
+
+    char *buffer() { return reinterpret_cast<char*>(&words[0]); }
+};
+
+}
+
+#endif /* MESSAGE_BUS_IPC_LIB_SOURCE_TYPEDMESSAGE_H_ */
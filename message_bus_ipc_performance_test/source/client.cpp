@@ -65,15 +65,20 @@ void sendBunchOfMessages(MessageClient& client, int num_messages, int msg_size_i
 
 void runAsReceiver() {
     printf("Run as message receiver. "
-           "You can run as sender by providing num messages and msg size in KB eg. ./client_performance 100 1\n");
+           "You can run as sender by providing num messages and msg size in KB eg. ./client_performance 100 1\n"
+           "Add p2p to send directly to the receiver, bypassing the hub eg. ./client_performance 100 1 p2p\n"
+           "Add async to send through asynchronous send queue eg. ./client_performance 100 1 async\n");
 
     MessageClient client;
     client.initializeAndListen(callback, "receiver"); // blocking
 //    printf("Receiver received %d messages\n", num_messages);
 }
 
-void runAsSender(char** argv) {
+void runAsSender(char** argv, const char *mode) {
     MessageClient client;
+    if (strcmp(mode, "async") == 0)
+        client.enableAsyncSend(4096);
+
     auto thread_func = [&client]() {client.initializeAndListen(callback, "sender");};
     std::thread t(thread_func);
     t.detach();
@@ -84,8 +89,17 @@ void runAsSender(char** argv) {
     int message_size_in_kb = atoi(argv[2]);
     Timer timer;
 
+    // optionally talk to the receiver directly
+    if (strcmp(mode, "p2p") == 0) {
+        client.waitForClient("receiver");
+        client.requestPeerChannel("receiver");
+        while (!client.hasPeerChannel("receiver"))
+            usleep(1000);
+    }
+
     timer.reset();
     sendBunchOfMessages(client, num_messages, message_size_in_kb);
+    client.drainSendQueue();
     double elapsed = timer.elapsed();
 
 
@@ -96,10 +110,12 @@ void runAsSender(char** argv) {
 
 int main(int argc, char** argv) {
 
-    if (argc != 3)
-        runAsReceiver();
+    if (argc == 3)
+        runAsSender(argv, "");
+    else if (argc == 4)
+        runAsSender(argv, argv[3]);
     else
-        runAsSender(argv);
+        runAsReceiver();
 
     return 0;
 }
@@ -5,12 +5,23 @@
  * @author: Mateusz Midor
  */
 
+#include <cstring>
 #include "MessageHub.h"
 
 using namespace messagebusipc;
 
 
-int main() {
-    MessageHub::runAndForget(false);
+int main(int argc, char* argv[]) {
+    // optional arguments: directory to journal routed messages in, to measure the journal overhead ("" for none),
+    // file to capture routed traffic to for replay_performancetest, and "payloads" to capture the payloads too
+    MessageHubConfig config;
+    if (argc > 1)
+        config.journal_directory = argv[1];
+    if (argc > 2)
+        config.capture_file = argv[2];
+    if (argc > 3)
+        config.capture_payloads = (strcmp(argv[3], "payloads") == 0);
+
+    MessageHub::runAndForget(false, config);
     return 0;
 }
@@ -0,0 +1,256 @@
+/**
+ *   @file: interop.cpp
+ *
+ *   @date: Oct 19, 2026
+ *
+ *   Wire protocol interop check: clients limited to wire protocol v1 and clients that switch to v2 exchange
+ *   unicast and broadcast messages through one hub, over stream and seqpacket sockets. The hub and every client
+ *   run in processes of their own, so none of them knows a peer name it was not told over the wire.
+ *   Every receiver checks the sender name, order and payload of what it gets; the second round brings in names
+ *   the hub has never seen, while the first round clients are gone.
+ *   Exits with 1 on the first failed check, so it can gate a build.
+ *   Usage: ./interop_performancetest [messages per pair]
+ *   Run with MBIPC_LOG_LEVEL=error.
+ */
+
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include "MessageHub.h"
+#include "MessageClient.h"
+
+using namespace std;
+using namespace messagebusipc;
+
+#define CHECK(condition, ...) \
+    do { \
+        if (!(condition)) { \
+            printf("FAILED %s:%d: %s: ", __FILE__, __LINE__, #condition); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            fflush(stdout); \
+            _exit(1); \
+        } \
+    } while (0)
+
+const uint32_t UNICAST_MESSAGE = ID_USER_MESSAGE_BASE + 1;
+const uint32_t BROADCAST_MESSAGE = ID_USER_MESSAGE_BASE + 2;
+const uint32_t BIG_PAYLOAD_SIZE = 200 * 1024; // above MessageChannel::SEQPACKET_MAX_PACKET_SIZE, goes in many packets
+const unsigned BROADCAST_EVERY = 10;
+const unsigned DELIVERY_TIMEOUT_MS = 30000;
+
+unsigned messages_per_pair = 2000;
+
+struct ClientSpec {
+    const char *name;   // up to MAX_CLIENT_NAME_LENGTH
+    uint8_t wire_version;
+    bool seqpacket;
+};
+
+struct Payload {
+    char sender[MAX_CLIENT_NAME_LENGTH + 1];
+    uint32_t round;
+    uint32_t seq;
+    uint32_t size;  // whole payload, the rest is filled with pattern(seq, i)
+};
+
+char pattern(uint32_t seq, uint32_t i) {
+    return (char)(seq * 31 + i);
+}
+
+uint32_t payloadSize(uint32_t seq) {
+    if (seq % 97 == 0)
+        return BIG_PAYLOAD_SIZE;
+    return sizeof(Payload) + (seq * 7) % 300;
+}
+
+/**
+ * Checks and counts what the client receives from each sender
+ */
+class Receiver : public MessageHandler {
+public:
+    Receiver(const string &name, unsigned round) :
+            name(name), round(round), num_received(0) {
+    }
+
+    // called from the listener thread
+    bool onMessage(uint32_t &id, char *data, uint32_t &size, const string &sender) {
+        if (((id != UNICAST_MESSAGE) && (id != BROADCAST_MESSAGE)) || (sender == name))
+            return true;
+
+        CHECK(size >= sizeof(Payload), "%s: %u byte message from %s", name.c_str(), size, sender.c_str());
+        Payload payload;
+        memcpy(&payload, data, sizeof(payload));
+        CHECK(sender == payload.sender, "%s: message of %s arrived as sent by '%s'", name.c_str(), payload.sender, sender.c_str());
+        CHECK(payload.round == round, "%s: round %u message from %s in round %u", name.c_str(), payload.round, sender.c_str(), round);
+        CHECK(size == payload.size, "%s: %u bytes from %s, sent %u", name.c_str(), size, sender.c_str(), payload.size);
+        for (uint32_t i = sizeof(Payload); i < size; i++)
+            CHECK(data[i] == pattern(payload.seq, i), "%s: byte %u of message %u from %s corrupted", name.c_str(), i, payload.seq, sender.c_str());
+
+        // one sender's messages are sent from one thread, unicasts and broadcasts in one sequence
+        map<string, int64_t>::iterator last = last_seq_from.insert(make_pair(sender, -1)).first;
+        CHECK((int64_t)payload.seq > last->second, "%s: message %u from %s after %lld", name.c_str(), payload.seq, sender.c_str(), (long long)last->second);
+        last->second = payload.seq;
+        num_received++;
+        return true;
+    }
+
+    string name;
+    unsigned round;
+    atomic<uint64_t> num_received;
+    map<string, int64_t> last_seq_from;
+};
+
+/**
+ * Child process of one client: send messages_per_pair messages to every other client, each BROADCAST_EVERY-th one
+ * to all of them instead, and receive as many from each of them. Writes a byte to done_fd when all arrived
+ */
+void runClient(const string &address, unsigned round, const vector<ClientSpec> &clients, size_t self, int done_fd) {
+    const ClientSpec &spec = clients[self];
+    Receiver receiver(spec.name, round);
+    MessageClient client;
+    client.setHubAddress(address.c_str());
+    client.setWireVersion(spec.wire_version);
+    client.setSeqpacket(spec.seqpacket);
+    thread([&]() { client.initializeAndListen(static_cast<MessageHandler*>(&receiver), spec.name); }).detach();
+
+    for (size_t i = 0; i < clients.size(); i++)
+        CHECK((i == self) || client.waitForClient(clients[i].name, DELIVERY_TIMEOUT_MS), "%s does not see %s", spec.name, clients[i].name);
+
+    vector<char> buffer;
+    uint32_t seq = 0;
+    auto send = [&](uint32_t id, const char *recipient) {
+        uint32_t size = payloadSize(seq);
+        buffer.resize(size);
+        Payload payload;
+        memset(&payload, 0, sizeof(payload));
+        strncpy(payload.sender, spec.name, MAX_CLIENT_NAME_LENGTH);
+        payload.round = round;
+        payload.seq = seq;
+        payload.size = size;
+        memcpy(&buffer[0], &payload, sizeof(payload));
+        for (uint32_t i = sizeof(Payload); i < size; i++)
+            buffer[i] = pattern(seq, i);
+
+        CHECK(client.send(id, &buffer[0], size, recipient), "%s: send %u to %s failed", spec.name, seq, recipient);
+        seq++;
+    };
+
+    for (unsigned n = 0; n < messages_per_pair; n++) {
+        if (n % BROADCAST_EVERY == 0) {
+            send(BROADCAST_MESSAGE, MBUS_ALL_CONNECTED_CLIENTS);
+            continue;
+        }
+        for (size_t i = 0; i < clients.size(); i++)
+            if (i != self)
+                send(UNICAST_MESSAGE, clients[i].name);
+    }
+
+    uint64_t expected = (clients.size() - 1) * messages_per_pair;
+    auto start = chrono::steady_clock::now();
+    while ((receiver.num_received < expected) && (chrono::steady_clock::now() - start < chrono::milliseconds(DELIVERY_TIMEOUT_MS)))
+        this_thread::sleep_for(chrono::milliseconds(10));
+    CHECK(receiver.num_received == expected, "round %u: %s got %llu messages, expected %llu", round, spec.name,
+          (unsigned long long)receiver.num_received, (unsigned long long)expected);
+
+    // stay connected until everyone is done, the parent ends us then
+    char done = 1;
+    CHECK(write(done_fd, &done, 1) == 1, "%s: write failed", spec.name);
+    while (true)
+        pause();
+}
+
+/**
+ * Start a process for every client and wait for all of them to get their messages
+ */
+void runRound(const string &address, unsigned round, const vector<ClientSpec> &clients) {
+    int done_pipe[2];
+    CHECK(pipe(done_pipe) == 0, "pipe failed");
+
+    auto start = chrono::steady_clock::now();
+    vector<pid_t> children;
+    for (size_t i = 0; i < clients.size(); i++) {
+        pid_t pid = fork();
+        CHECK(pid != -1, "fork failed");
+        if (pid == 0) {
+            prctl(PR_SET_PDEATHSIG, SIGKILL);
+            close(done_pipe[0]);
+            runClient(address, round, clients, i, done_pipe[1]);
+        }
+        children.push_back(pid);
+    }
+    close(done_pipe[1]);
+
+    // a client that fails exits without writing; the clients that are done never exit by themselves
+    size_t num_done = 0;
+    while (num_done < clients.size()) {
+        CHECK(chrono::steady_clock::now() - start < chrono::milliseconds(2 * DELIVERY_TIMEOUT_MS), "round %u: %u of %u clients done",
+              round, (unsigned)num_done, (unsigned)clients.size());
+        CHECK(waitpid(-1, NULL, WNOHANG) <= 0, "round %u: client failed, %u of %u done", round, (unsigned)num_done, (unsigned)clients.size());
+
+        pollfd done_poll = { done_pipe[0], POLLIN, 0 };
+        char done;
+        if ((poll(&done_poll, 1, 100) == 1) && (read(done_pipe[0], &done, 1) == 1))
+            num_done++;
+    }
+    close(done_pipe[0]);
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    for (size_t i = 0; i < children.size(); i++) {
+        kill(children[i], SIGKILL);
+        waitpid(children[i], NULL, 0);
+    }
+
+    printf("round %u: %2u clients, %8llu messages checked in %.2fs  OK\n", round, (unsigned)clients.size(),
+           (unsigned long long)(clients.size() - 1) * messages_per_pair * clients.size(), elapsed);
+}
+
+//====================================================================================================
+// Program entry point
+//====================================================================================================
+int main(int argc, char** argv) {
+    if (argc > 1)
+        messages_per_pair = atoi(argv[1]);
+    setvbuf(stdout, NULL, _IONBF, 0);
+
+    // own abstract address, so a hub already running on the machine doesn't get in the way
+    string address = "unix:@mbipc_interop_" + to_string(getpid());
+    pid_t hub = fork();
+    CHECK(hub != -1, "fork failed");
+    if (hub == 0) {
+        prctl(PR_SET_PDEATHSIG, SIGKILL); // don't outlive a failed check
+        MessageHubConfig config;
+        config.listen_addresses.push_back(address);
+        config.seqpacket = true;
+        MessageHub::runAndForget(false, config);
+        _exit(1);
+    }
+
+    vector<ClientSpec> clients;
+    clients.push_back({ "v1_stream", WIRE_VERSION_1, false });
+    clients.push_back({ "v2_stream", WIRE_VERSION_2, false });
+    clients.push_back({ "v1_seqpacket", WIRE_VERSION_1, true });
+    clients.push_back({ "v2_seqpacket_longer", WIRE_VERSION_2, true });
+    runRound(address, 1, clients);
+
+    // names the hub has never seen, next to the ones it knows from the first round
+    clients.push_back({ "late_v2", WIRE_VERSION_2, false });
+    clients.push_back({ "late_v1", WIRE_VERSION_1, true });
+    runRound(address, 2, clients);
+
+    kill(hub, SIGKILL);
+    waitpid(hub, NULL, 0);
+    printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,265 @@
+/**
+ *   @file: microbenchmark.cpp
+ *
+ *   @date: Oct 18, 2026
+ *
+ *   Component level benchmarks; each hot component is measured on its own, without the hub and process scheduling noise.
+ *   Usage: ./microbenchmark_performancetest [name filter] [max producers]
+ *   Run with MBIPC_LOG_LEVEL=error; at debug level the library logs every channel list change.
+ */
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include "MessageBusIpcCommon.h"
+#include "MessageChannel.h"
+#include "ThreadsafeMessageQueue.h"
+#include "ThreadsafeChannelList.h"
+#include "ThreadsafeClientList.h"
+
+using namespace std;
+using namespace messagebusipc;
+
+class Timer {
+public:
+    Timer() :
+            beg_(clock_::now()) {
+    }
+    void reset() {
+        beg_ = clock_::now();
+    }
+    double elapsed() const {
+        return std::chrono::duration_cast<second_>(clock_::now() - beg_).count();
+    }
+
+private:
+    typedef std::chrono::high_resolution_clock clock_;
+    typedef std::chrono::duration<double, std::ratio<1> > second_;
+    std::chrono::time_point<clock_> beg_;
+};
+
+const char *name_filter = "";
+
+bool selected(const string &name) {
+    return name.find(name_filter) != string::npos;
+}
+
+void report(const string &name, unsigned num_operations, double elapsed) {
+    printf("%-52s %10u ops %10.1f ns/op %12.0f ops/s\n", name.c_str(), num_operations, elapsed * 1e9 / num_operations, num_operations / elapsed);
+}
+
+/**
+ * @name    benchmarkMessageQueue
+ * @brief   Producers push small messages, single consumer pops them; the router's view of the hub
+ */
+void benchmarkMessageQueue(unsigned num_producers) {
+    char name[64];
+    snprintf(name, sizeof(name), "ThreadsafeMessageQueue push/pop %u producer(s)", num_producers);
+    if (!selected(name))
+        return;
+
+    const unsigned NUM_MESSAGES = 200000;
+    const unsigned per_producer = NUM_MESSAGES / num_producers;
+    ThreadsafeMessageQueue queue;
+    MessageChannel sender;
+    char payload[64] = {};
+
+    Timer timer;
+    vector<thread> producers;
+    for (unsigned i = 0; i < num_producers; i++)
+        producers.push_back(thread([&queue, &sender, &payload, per_producer] {
+            string recipient("receiver");
+            for (unsigned n = 0; n < per_producer; n++)
+                queue.push(sender, ID_USER_MESSAGE_BASE, payload, sizeof(payload), recipient);
+        }));
+
+    MessageChannel popped_sender;
+    uint32_t id, size;
+    string recipient;
+    char *data = new char[MESSAGE_BUFF_SIZE];
+    for (unsigned n = 0; n < per_producer * num_producers; n++)
+        queue.pop(popped_sender, id, data, size, recipient);
+    double elapsed = timer.elapsed();
+
+    for (unsigned i = 0; i < producers.size(); i++)
+        producers[i].join();
+    delete[] data;
+    report(name, per_producer * num_producers, elapsed);
+}
+
+/**
+ * @name    benchmarkChannelListIteration
+ * @brief   Iterate the list like the router does on broadcast while other thread keeps adding and removing a client
+ */
+void benchmarkChannelListIteration(bool with_churn) {
+    string name = with_churn ? "ThreadsafeChannelList iterate 64, add/remove churn" : "ThreadsafeChannelList iterate 64";
+    if (!selected(name))
+        return;
+
+    const unsigned NUM_CHANNELS = 64;
+    const unsigned NUM_PASSES = 100000;
+    ThreadsafeChannelList list;
+    for (unsigned i = 0; i < NUM_CHANNELS; i++) {
+        MessageChannel channel(1000 + i);
+        list.add(channel);
+    }
+
+    atomic<bool> stop(false);
+    thread churn([&list, &stop, with_churn] {
+        MessageChannel channel(999);
+        while (with_churn && !stop) {
+            list.add(channel);
+            list.removeByValue(channel);
+        }
+    });
+
+    Timer timer;
+    unsigned long num_visited = 0;
+    for (unsigned n = 0; n < NUM_PASSES; n++) {
+        ThreadsafeChannelList::Iterator it = list.getIterator();
+        while (it.getNext())
+            num_visited++;
+    }
+    double elapsed = timer.elapsed();
+
+    stop = true;
+    churn.join();
+    report(name, NUM_PASSES, elapsed);
+    (void)num_visited;
+}
+
+/**
+ * @name    benchmarkClientList
+ * @brief   Many client names; HELLO/GOODBYE bookkeeping and waitForClient lookups
+ */
+void benchmarkClientList() {
+    const unsigned NUM_CLIENTS = 100000;
+    vector<string> names;
+    for (unsigned i = 0; i < NUM_CLIENTS; i++)
+        names.push_back("client_" + to_string(i));
+
+    ThreadsafeClientList list;
+    Timer timer;
+    if (selected("ThreadsafeClientList add")) {
+        timer.reset();
+        for (unsigned i = 0; i < NUM_CLIENTS; i++)
+            list.add(names[i]);
+        report("ThreadsafeClientList add", NUM_CLIENTS, timer.elapsed());
+    }
+    else
+        for (unsigned i = 0; i < NUM_CLIENTS; i++)
+            list.add(names[i]);
+
+    if (selected("ThreadsafeClientList exists")) {
+        timer.reset();
+        unsigned num_found = 0;
+        for (unsigned i = 0; i < NUM_CLIENTS; i++)
+            num_found += list.exists(names[(i * 7919) % NUM_CLIENTS]);
+        report("ThreadsafeClientList exists", NUM_CLIENTS, timer.elapsed());
+        (void)num_found;
+    }
+
+    if (selected("ThreadsafeClientList remove")) {
+        timer.reset();
+        for (unsigned i = 0; i < NUM_CLIENTS; i++)
+            list.remove(names[i]);
+        report("ThreadsafeClientList remove", NUM_CLIENTS, timer.elapsed());
+    }
+}
+
+/**
+ * @name    benchmarkGetMessageName
+ * @brief   Every message the hub receives gets its name looked up for the debug log
+ */
+void benchmarkGetMessageName() {
+    if (!selected("GetMessageName"))
+        return;
+
+    const unsigned NUM_LOOKUPS = 10000000;
+    const uint32_t ids[] = { ID_USER_MESSAGE_BASE, ID_CLIENT_SAYS_HELLO, ID_CLIENT_SAYS_GOODBYE, ID_INTERNAL_MESSAGE_END - 1 };
+    size_t total_length = 0;
+
+    Timer timer;
+    for (unsigned n = 0; n < NUM_LOOKUPS; n++)
+        total_length += strlen(GetMessageName((MessageBusMessage)ids[n % 4]));
+    report("GetMessageName", NUM_LOOKUPS, timer.elapsed());
+    (void)total_length;
+}
+
+/**
+ * @name    benchmarkFraming
+ * @brief   Send and receive messages through MessageChannel over a socketpair; header encoding, decoding and the syscalls
+ */
+void benchmarkFraming(int socket_type, uint8_t wire_version, uint32_t payload_size) {
+    char name[64];
+    snprintf(name, sizeof(name), "MessageChannel %s v%u framing %uB", (socket_type == SOCK_SEQPACKET) ? "seqpacket" : "stream", wire_version, payload_size);
+    if (!selected(name))
+        return;
+
+    int fds[2];
+    if (socketpair(AF_UNIX, socket_type, 0, fds) == -1) {
+        printf("%-52s socketpair failed: %s\n", name, strerror(errno));
+        return;
+    }
+
+    MessageChannel sender(fds[0]);
+    MessageChannel receiver(fds[1]);
+    sender.setSeqpacket(socket_type == SOCK_SEQPACKET);
+    receiver.setSeqpacket(socket_type == SOCK_SEQPACKET);
+    sender.setSendVersion(wire_version);
+    receiver.setReceiveVersion(wire_version);
+
+    const unsigned NUM_MESSAGES = (payload_size > 4096) ? 20000 : 200000;
+    vector<char> payload(payload_size + 1);
+
+    Timer timer;
+    thread sending([&sender, &payload, payload_size, NUM_MESSAGES] {
+        for (unsigned n = 0; n < NUM_MESSAGES; n++)
+            sender.send(ID_USER_MESSAGE_BASE, &payload[0], payload_size, "receiver");
+    });
+
+    uint32_t id, size;
+    string recipient;
+    char *data = new char[MESSAGE_BUFF_SIZE];
+    for (unsigned n = 0; n < NUM_MESSAGES; n++)
+        if (!receiver.receive(id, data, size, recipient))
+            break;
+    double elapsed = timer.elapsed();
+
+    sending.join();
+    delete[] data;
+    close(fds[0]);
+    close(fds[1]);
+    report(name, NUM_MESSAGES, elapsed);
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1)
+        name_filter = argv[1];
+    unsigned max_producers = (argc > 2) ? atoi(argv[2]) : 4;
+
+    for (unsigned num_producers = 1; num_producers <= max_producers; num_producers *= 2)
+        benchmarkMessageQueue(num_producers);
+
+    benchmarkChannelListIteration(false);
+    benchmarkChannelListIteration(true);
+    benchmarkClientList();
+    benchmarkGetMessageName();
+
+    const uint32_t payload_sizes[] = { 0, 64, 4096, 65536 };
+    const int socket_types[] = { SOCK_STREAM, SOCK_SEQPACKET };
+    for (unsigned t = 0; t < 2; t++)
+        for (uint8_t version = WIRE_VERSION_1; version <= WIRE_VERSION_2; version++)
+            for (unsigned s = 0; s < 4; s++)
+                benchmarkFraming(socket_types[t], version, payload_sizes[s]);
+
+    return 0;
+}
@@ -0,0 +1,169 @@
+/**
+ *   @file: multihub.cpp
+ *
+ *   @date: Oct 19, 2026
+ *
+ *   Federation check on one host: three hubs linked in a full mesh, a client on each. Every client must learn
+ *   of the clients of the other hubs, get every broadcast exactly once and in order, and get messages addressed
+ *   to it from any hub. Exits with 1 on the first failed check, so it can gate a build.
+ *   Usage: ./multihub_performancetest [messages per client]
+ *   Run with MBIPC_LOG_LEVEL=error.
+ */
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include "MessageHub.h"
+#include "MessageClient.h"
+
+using namespace std;
+using namespace messagebusipc;
+
+const uint32_t BROADCAST_MESSAGE = ID_USER_MESSAGE_BASE + 1;
+const uint32_t DIRECT_MESSAGE = ID_USER_MESSAGE_BASE + 2;
+const unsigned NUM_HUBS = 3;
+unsigned num_messages = 1000;
+
+#define CHECK(condition, ...) \
+    do { \
+        if (!(condition)) { \
+            printf("FAILED %s:%d: %s: ", __FILE__, __LINE__, #condition); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            fflush(stdout); \
+            _exit(1); \
+        } \
+    } while (0)
+
+/**
+ * Counts what came from every sender; the payload is the sequence number of the message
+ */
+class Receiver : public MessageHandler {
+public:
+    bool onMessage(uint32_t &id, char *data, uint32_t &size, const string &sender) {
+        if ((id != BROADCAST_MESSAGE) && (id != DIRECT_MESSAGE))
+            return true;
+
+        uint32_t sequence;
+        CHECK(size == sizeof(sequence), "message %u from %s of size %u", id, sender.c_str(), size);
+        memcpy(&sequence, data, sizeof(sequence));
+
+        lock_guard<mutex> lock(guard);
+        uint32_t &expected = (id == BROADCAST_MESSAGE) ? next_broadcast[sender] : next_direct[sender];
+        CHECK(sequence == expected, "message %u from %s: got %u, expected %u", id, sender.c_str(), sequence, expected);
+        expected++;
+        return true;
+    }
+
+    uint32_t received(uint32_t id, const string &sender) {
+        lock_guard<mutex> lock(guard);
+        return (id == BROADCAST_MESSAGE) ? next_broadcast[sender] : next_direct[sender];
+    }
+
+private:
+    mutex guard;
+    map<string, uint32_t> next_broadcast;
+    map<string, uint32_t> next_direct;
+};
+
+//====================================================================================================
+// Program entry point
+//====================================================================================================
+int main(int argc, char** argv) {
+    if (argc > 1)
+        num_messages = atoi(argv[1]);
+
+    char directory[64];
+    snprintf(directory, sizeof(directory), "/tmp/mbipc_multihub_%d", (int)getpid());
+    mkdir(directory, 0700);
+
+    vector<string> addresses;
+    for (unsigned i = 0; i < NUM_HUBS; i++)
+        addresses.push_back(string("unix:") + directory + "/hub" + to_string(i));
+
+    // each pair linked once, from the hub with the higher index
+    for (unsigned i = 0; i < NUM_HUBS; i++) {
+        MessageHubConfig config;
+        config.listen_addresses.push_back(addresses[i]);
+        config.hub_name = "hub" + to_string(i);
+        for (unsigned j = 0; j < i; j++)
+            config.federation_peers.push_back(addresses[j]);
+        CHECK(MessageHub::runAndForget(true, config), "hub %u didn't start", i);
+    }
+
+    vector<MessageClient*> clients;
+    vector<Receiver*> receivers;
+    vector<thread> listeners;
+    for (unsigned i = 0; i < NUM_HUBS; i++) {
+        clients.push_back(new MessageClient);
+        receivers.push_back(new Receiver);
+        clients[i]->setHubAddress(addresses[i].c_str());
+        string name = "client" + to_string(i);
+        MessageClient *client = clients[i];
+        MessageHandler *receiver = receivers[i];
+        listeners.push_back(thread([client, receiver, name]() { client->initializeAndListen(receiver, name.c_str()); }));
+    }
+
+    // the links come up in the background; every client hears hello from the clients of the other hubs
+    for (unsigned i = 0; i < NUM_HUBS; i++)
+        for (unsigned j = 0; j < NUM_HUBS; j++)
+            if (i != j)
+                CHECK(clients[i]->waitForClient(("client" + to_string(j)).c_str(), 10000), "client%u doesn't see client%u", i, j);
+
+    // everybody broadcasts and talks to the client of the next hub at the same time
+    vector<thread> senders;
+    for (unsigned i = 0; i < NUM_HUBS; i++)
+        senders.push_back(thread([i, &clients]() {
+            string next = "client" + to_string((i + 1) % NUM_HUBS);
+            for (uint32_t sequence = 0; sequence < num_messages; sequence++) {
+                CHECK(clients[i]->send(BROADCAST_MESSAGE, &sequence, sizeof(sequence)), "client%u broadcast %u", i, sequence);
+                CHECK(clients[i]->send(DIRECT_MESSAGE, &sequence, sizeof(sequence), next.c_str()), "client%u to %s %u", i, next.c_str(), sequence);
+            }
+        }));
+    for (size_t i = 0; i < senders.size(); i++)
+        senders[i].join();
+
+    auto start = chrono::steady_clock::now();
+    for (unsigned i = 0; i < NUM_HUBS; i++)
+        for (unsigned j = 0; j < NUM_HUBS; j++) {
+            if (i == j)
+                continue;
+
+            string sender = "client" + to_string(j);
+            uint32_t expected_direct = ((j + 1) % NUM_HUBS == i) ? num_messages : 0;
+            while (((receivers[i]->received(BROADCAST_MESSAGE, sender) < num_messages) || (receivers[i]->received(DIRECT_MESSAGE, sender) < expected_direct)) &&
+                   (chrono::steady_clock::now() - start < chrono::seconds(30)))
+                this_thread::sleep_for(chrono::milliseconds(10));
+
+            CHECK(receivers[i]->received(BROADCAST_MESSAGE, sender) == num_messages, "client%u got %u of %u broadcasts from %s", i,
+                  receivers[i]->received(BROADCAST_MESSAGE, sender), num_messages, sender.c_str());
+            CHECK(receivers[i]->received(DIRECT_MESSAGE, sender) == expected_direct, "client%u got %u of %u messages from %s", i,
+                  receivers[i]->received(DIRECT_MESSAGE, sender), expected_direct, sender.c_str());
+        }
+
+    // nothing more than expected comes late, eg. a broadcast that crossed two links
+    this_thread::sleep_for(chrono::milliseconds(200));
+    for (unsigned i = 0; i < NUM_HUBS; i++)
+        for (unsigned j = 0; j < NUM_HUBS; j++)
+            if (i != j)
+                CHECK(receivers[i]->received(BROADCAST_MESSAGE, "client" + to_string(j)) == num_messages, "client%u got extra broadcasts from client%u", i, j);
+    CHECK(receivers[0]->received(BROADCAST_MESSAGE, "client0") == 0, "client0 got its own broadcast back");
+
+    printf("%u hubs, %u clients: %u broadcasts and %u direct messages each  OK\n", NUM_HUBS, NUM_HUBS, num_messages, num_messages);
+    fflush(stdout);
+
+    for (unsigned i = 0; i < NUM_HUBS; i++)
+        unlink((string(directory) + "/hub" + to_string(i)).c_str());
+    rmdir(directory);
+
+    // hubs and listeners run until the process exits
+    _exit(0);
+}
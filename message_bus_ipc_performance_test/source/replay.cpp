@@ -0,0 +1,234 @@
+/**
+ *   @file: replay.cpp
+ *
+ *   @date: Oct 18, 2026
+ *
+ *   Replays traffic captured by the hub (see MessageHubConfig::capture_file, hub_performancetest) against a running hub,
+ *   every captured client simulated by a client of the same name; without captured payloads the payloads are zeros of the captured size.
+ *   Usage: ./replay_performancetest <capture file> [speed] [sender threads]
+ *          speed: 1 keeps the captured timing, N plays N times faster, max sends as fast as possible; default 1
+ *          sender threads: the simulated clients are split among this many threads sending for them; default 1
+ *   Run with MBIPC_LOG_LEVEL=error; the hub address comes from MBIPC_HUB_ADDRESS as for any client.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include "MessageClient.h"
+#include "TrafficCaptureReader.h"
+
+using namespace std;
+using namespace messagebusipc;
+
+class Timer {
+public:
+    Timer() :
+            beg_(clock_::now()) {
+    }
+    void reset() {
+        beg_ = clock_::now();
+    }
+    double elapsed() const {
+        return std::chrono::duration_cast<second_>(clock_::now() - beg_).count();
+    }
+
+private:
+    typedef std::chrono::high_resolution_clock clock_;
+    typedef std::chrono::duration<double, std::ratio<1> > second_;
+    std::chrono::time_point<clock_> beg_;
+};
+
+// what the capture holds, found in the first pass over it
+struct Capture {
+    map<string, unsigned> clients;  // every sender and recipient but MBUS_ALL_CONNECTED_CLIENTS, by index
+    uint64_t num_messages;
+    uint64_t num_bytes;
+    uint64_t num_deliveries;        // expected: broadcast reaches every other client, other message its recipient
+    uint64_t duration_us;
+    uint32_t max_size;
+};
+
+// one sending thread
+struct SenderStats {
+    uint64_t num_sent;
+    uint64_t num_failed;
+    uint64_t total_lag_us;          // behind the schedule, timed replay only
+    uint64_t max_lag_us;
+};
+
+// replay is over when no delivery came for this long
+const double SETTLE_SECONDS = 1.0;
+
+atomic<uint64_t> num_delivered(0);
+
+bool replayable(uint32_t id) {
+    return id < ID_CLIENT_SAYS_HELLO; // the hub makes its own internal messages
+}
+
+bool scanCapture(const char *path, Capture &capture) {
+    TrafficCaptureReader reader;
+    if (!reader.open(path))
+        return false;
+
+    capture.num_messages = capture.num_bytes = capture.num_deliveries = capture.duration_us = 0;
+    capture.max_size = 0;
+    uint64_t num_broadcasts = 0;
+    TrafficCaptureReader::Entry entry;
+    while (reader.next(entry)) {
+        if (!replayable(entry.id))
+            continue;
+
+        capture.clients.insert(make_pair(*entry.sender, capture.clients.size()));
+        if (*entry.recipient == MBUS_ALL_CONNECTED_CLIENTS)
+            num_broadcasts++;
+        else {
+            capture.clients.insert(make_pair(*entry.recipient, capture.clients.size()));
+            capture.num_deliveries += (*entry.recipient != *entry.sender);
+        }
+
+        capture.num_messages++;
+        capture.num_bytes += entry.size;
+        capture.duration_us = entry.time_us;
+        capture.max_size = max(capture.max_size, entry.size);
+    }
+
+    capture.num_deliveries += num_broadcasts * (capture.clients.size() - 1);
+    return true;
+}
+
+/**
+ * Send the messages of the clients with index % num_threads == thread_index, on the captured schedule scaled by speed (0 is max speed)
+ */
+void sendCaptured(const char *path, const Capture &capture, const vector<MessageClient*> &clients, unsigned thread_index, unsigned num_threads,
+                  double speed, const vector<char> &zeros, chrono::steady_clock::time_point start, SenderStats &stats) {
+    memset(&stats, 0, sizeof(stats));
+
+    TrafficCaptureReader reader;
+    if (!reader.open(path))
+        return;
+
+    TrafficCaptureReader::Entry entry;
+    while (reader.next(entry)) {
+        if (!replayable(entry.id))
+            continue;
+
+        unsigned index = capture.clients.find(*entry.sender)->second;
+        if (index % num_threads != thread_index)
+            continue;
+
+        if (speed > 0) {
+            chrono::steady_clock::time_point due = start + chrono::microseconds((uint64_t)(entry.time_us / speed));
+            this_thread::sleep_until(due);
+            uint64_t lag_us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - due).count();
+            stats.total_lag_us += lag_us;
+            stats.max_lag_us = max(stats.max_lag_us, lag_us);
+        }
+
+        const char *data = entry.data ? entry.data : &zeros[0];
+        if (clients[index]->send(entry.id, data, entry.size, entry.recipient->c_str()))
+            stats.num_sent++;
+        else
+            stats.num_failed++;
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        printf("Usage: %s <capture file> [speed: 1, N times faster or max] [sender threads]\n", argv[0]);
+        return 1;
+    }
+
+    const char *path = argv[1];
+    double speed = 1;
+    if (argc > 2)
+        speed = strcmp(argv[2], "max") ? atof(argv[2]) : 0;
+    unsigned num_threads = (argc > 3) ? max(atoi(argv[3]), 1) : 1;
+
+    // 1. find out who talks to whom
+    Capture capture;
+    if (!scanCapture(path, capture))
+        return 1;
+
+    if (capture.clients.empty()) {
+        printf("Nothing to replay in %s\n", path);
+        return 0;
+    }
+
+    printf("Capture: %llu messages, %llu bytes, %u clients, %.3f seconds\n", (unsigned long long)capture.num_messages,
+           (unsigned long long)capture.num_bytes, (unsigned)capture.clients.size(), capture.duration_us / 1e6);
+
+    // 2. connect the simulated clients; the first one waits until the hub introduced all the others
+    vector<MessageClient*> clients(capture.clients.size());
+    for (map<string, unsigned>::const_iterator it = capture.clients.begin(); it != capture.clients.end(); ++it) {
+        MessageClient *client = new MessageClient;
+        clients[it->second] = client;
+        string name = it->first;
+        thread([client, name] {
+            client->initializeAndListen([](uint32_t &id, char *data, uint32_t &size) {
+                if (replayable(id))
+                    num_delivered++;
+                return true;
+            }, name.c_str());
+        }).detach();
+    }
+
+    for (map<string, unsigned>::const_iterator it = capture.clients.begin(); it != capture.clients.end(); ++it)
+        if ((it->second != 0) && !clients[0]->waitForClient(it->first.c_str(), 5000)) {
+            printf("Client %s didn't connect; is the hub running?\n", it->first.c_str());
+            return 1;
+        }
+
+    // 3. replay
+    vector<char> zeros(capture.max_size + 1, 0);
+    vector<SenderStats> stats(num_threads);
+    vector<thread> senders;
+    Timer timer;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (unsigned i = 0; i < num_threads; i++)
+        senders.push_back(thread(sendCaptured, path, std::cref(capture), std::cref(clients), i, num_threads, speed, std::cref(zeros), start, std::ref(stats[i])));
+    for (unsigned i = 0; i < num_threads; i++)
+        senders[i].join();
+    double send_elapsed = timer.elapsed();
+
+    // 4. wait for the deliveries to settle; elapsed counts until the last one arrived
+    uint64_t delivered = num_delivered;
+    double elapsed = timer.elapsed();
+    double idle_since = elapsed;
+    while ((delivered < capture.num_deliveries) && (timer.elapsed() - idle_since < SETTLE_SECONDS)) {
+        usleep(10000);
+        if (num_delivered != delivered) {
+            delivered = num_delivered;
+            elapsed = idle_since = timer.elapsed();
+        }
+    }
+
+    SenderStats total = { 0, 0, 0, 0 };
+    for (unsigned i = 0; i < num_threads; i++) {
+        total.num_sent += stats[i].num_sent;
+        total.num_failed += stats[i].num_failed;
+        total.total_lag_us += stats[i].total_lag_us;
+        total.max_lag_us = max(total.max_lag_us, stats[i].max_lag_us);
+    }
+
+    printf("*********************************************************\n");
+    if (speed > 0)
+        printf("Replayed at %gx with %u sender threads\n", speed, num_threads);
+    else
+        printf("Replayed at max speed with %u sender threads\n", num_threads);
+    printf("Sent %llu messages (%llu failed) in %f seconds, %.0f msgs/s, %.1f MB/s\n", (unsigned long long)total.num_sent,
+           (unsigned long long)total.num_failed, send_elapsed, total.num_sent / send_elapsed, capture.num_bytes / send_elapsed / (1024 * 1024));
+    printf("Delivered %llu of %llu expected in %f seconds\n", (unsigned long long)delivered, (unsigned long long)capture.num_deliveries, elapsed);
+    if ((speed > 0) && (total.num_sent > 0))
+        printf("Behind schedule: %.1f us average, %llu us max\n", (double)total.total_lag_us / total.num_sent, (unsigned long long)total.max_lag_us);
+    printf("*********************************************************\n");
+
+    fflush(stdout);
+    _exit(0); // simulated clients keep listening
+}
@@ -0,0 +1,288 @@
+/**
+ *   @file: stress.cpp
+ *
+ *   @date: Oct 19, 2026
+ *
+ *   Stress checks of the lock-free components: ThreadsafeChannelList add/remove against iterating readers,
+ *   and LockfreeQueue with many producers and consumers. Every check asserts what it sees and the program
+ *   exits with 1 on the first failed check, so it can gate a build.
+ *   Usage: ./stress_performancetest [seconds per check] [threads]
+ *   Run with MBIPC_LOG_LEVEL=error; at debug level the library logs every channel list change.
+ */
+
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include "MessageChannel.h"
+#include "ThreadsafeChannelList.h"
+#include "LockfreeQueue.h"
+
+using namespace std;
+using namespace messagebusipc;
+
+double seconds_per_check = 2.0;
+unsigned num_threads = 4;
+
+#define CHECK(condition, ...) \
+    do { \
+        if (!(condition)) { \
+            printf("FAILED %s:%d: %s: ", __FILE__, __LINE__, #condition); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            fflush(stdout); \
+            _exit(1); \
+        } \
+    } while (0)
+
+bool timeIsUp(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count() > seconds_per_check;
+}
+
+unsigned countOpenDescriptors() {
+    unsigned count = 0;
+    DIR *dir = opendir("/proc/self/fd");
+    if (!dir)
+        return 0;
+    while (readdir(dir))
+        count++;
+    closedir(dir);
+    return count;
+}
+
+/**
+ * Readers iterate the list while writers add and remove channels. Every channel is named after a generation number
+ * given to its socket; the socket of a removed channel must stay open, and so not reused by a newer generation,
+ * for as long as a reader can still see the channel. Channels that are never removed must be seen on every pass
+ */
+void stressChannelList() {
+    const unsigned NUM_STABLE = 8;
+    const unsigned MAX_CHURN_PER_WRITER = 16;
+    const unsigned NUM_WRITERS = 2;
+    const int MAX_FD = 1 << 16;
+
+    unsigned open_at_start = countOpenDescriptors();
+    vector<atomic<uint32_t> > generation_of_fd(MAX_FD);
+    atomic<uint32_t> next_generation(1);
+    ThreadsafeChannelList *list = new ThreadsafeChannelList;
+
+    // channel end goes to the list, the peer end stays with the test
+    auto makeChannel = [&](MessageChannel &channel, int &peer_fd) {
+        int fds[2];
+        CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0, "socketpair: %s", strerror(errno));
+        CHECK(fds[0] < MAX_FD, "descriptor %d too big", fds[0]);
+        uint32_t generation = next_generation++;
+        generation_of_fd[fds[0]] = generation;
+        channel = MessageChannel(fds[0]);
+        channel.setName(to_string(generation));
+        peer_fd = fds[1];
+    };
+
+    vector<int> stable_peers(NUM_STABLE);
+    vector<int> stable_fds(NUM_STABLE);
+    for (unsigned i = 0; i < NUM_STABLE; i++) {
+        MessageChannel channel;
+        makeChannel(channel, stable_peers[i]);
+        stable_fds[i] = channel.fileDescriptor();
+        list->add(channel);
+    }
+
+    atomic<bool> stop(false);
+    atomic<uint64_t> num_passes(0), num_changes(0);
+    vector<thread> threads;
+
+    for (unsigned w = 0; w < NUM_WRITERS; w++)
+        threads.emplace_back([&, w]() {
+            vector<MessageChannel> churn;
+            vector<int> churn_peers;
+            unsigned seed = w;
+            while (!stop) {
+                if (churn.empty() || ((churn.size() < MAX_CHURN_PER_WRITER) && (rand_r(&seed) % 2))) {
+                    MessageChannel channel;
+                    int peer_fd;
+                    makeChannel(channel, peer_fd);
+                    list->add(channel);
+                    churn.push_back(channel);
+                    churn_peers.push_back(peer_fd);
+                }
+                else {
+                    unsigned index = rand_r(&seed) % churn.size();
+                    list->removeByValue(churn[index]);
+                    close(churn_peers[index]);
+                    churn.erase(churn.begin() + index);
+                    churn_peers.erase(churn_peers.begin() + index);
+                }
+                num_changes++;
+            }
+
+            for (size_t i = 0; i < churn.size(); i++) {
+                list->removeByValue(churn[i]);
+                close(churn_peers[i]);
+            }
+        });
+
+    for (unsigned r = 0; r < num_threads; r++)
+        threads.emplace_back([&]() {
+            vector<bool> seen(MAX_FD);
+            vector<int> visited;
+            while (!stop) {
+                ThreadsafeChannelList::Iterator it = list->getIterator();
+                visited.clear();
+                while (const MessageChannel *channel = it.getNext()) {
+                    int fd = channel->fileDescriptor();
+                    CHECK((fd >= 0) && (fd < MAX_FD), "bad descriptor %d", fd);
+                    CHECK(!seen[fd], "descriptor %d twice in one snapshot", fd);
+                    seen[fd] = true;
+                    visited.push_back(fd);
+
+                    uint32_t generation = strtoul(channel->name().c_str(), NULL, 10);
+                    CHECK(generation_of_fd[fd] == generation, "descriptor %d of generation %u reused by generation %u while still listed",
+                          fd, generation, (unsigned)generation_of_fd[fd]);
+                    CHECK(fcntl(fd, F_GETFD) != -1, "descriptor %d closed while still listed", fd);
+                }
+
+                for (unsigned i = 0; i < NUM_STABLE; i++)
+                    CHECK(seen[stable_fds[i]], "channel %d missing from snapshot", stable_fds[i]);
+                CHECK(visited.size() <= NUM_STABLE + NUM_WRITERS * MAX_CHURN_PER_WRITER, "%u channels in snapshot", (unsigned)visited.size());
+
+                for (size_t i = 0; i < visited.size(); i++)
+                    seen[visited[i]] = false;
+                num_passes++;
+            }
+        });
+
+    auto start = chrono::steady_clock::now();
+    while (!timeIsUp(start))
+        this_thread::sleep_for(chrono::milliseconds(10));
+    stop = true;
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+
+    {
+        ThreadsafeChannelList::Iterator it = list->getIterator();
+        unsigned num_left = 0;
+        while (it.getNext())
+            num_left++;
+        CHECK(num_left == NUM_STABLE, "%u channels left, expected %u", num_left, NUM_STABLE);
+    }
+
+    // with no reader left, one more change recycles every retired snapshot and closes the removed sockets
+    MessageChannel last;
+    int last_peer;
+    makeChannel(last, last_peer);
+    list->add(last);
+    list->removeByValue(last);
+    close(last_peer);
+    unsigned open_now = countOpenDescriptors();
+    CHECK(open_now <= open_at_start + 2 * NUM_STABLE + 1, "%u descriptors open, %u at start; removed sockets leak", open_now, open_at_start);
+
+    delete list;
+    for (unsigned i = 0; i < NUM_STABLE; i++) {
+        close(stable_fds[i]);
+        close(stable_peers[i]);
+    }
+
+    printf("%-52s %10llu passes %10llu changes  OK\n", "ThreadsafeChannelList add/remove vs iterate",
+           (unsigned long long)num_passes, (unsigned long long)num_changes);
+}
+
+/**
+ * Producers push numbered items, consumers pop them. Every item must come out exactly once,
+ * and items of one producer must come out to any single consumer in the order they were pushed
+ */
+void stressLockfreeQueue(size_t capacity, unsigned num_producers, unsigned num_consumers) {
+    const uint64_t ITEMS_PER_PRODUCER = 200000;
+
+    LockfreeQueue<uint64_t> queue(capacity);
+    vector<vector<atomic<uint8_t> > > times_popped;
+    for (unsigned p = 0; p < num_producers; p++)
+        times_popped.push_back(vector<atomic<uint8_t> >(ITEMS_PER_PRODUCER));
+
+    atomic<unsigned> producers_running(num_producers);
+    atomic<uint64_t> num_popped(0), num_full(0), num_empty(0);
+    vector<thread> threads;
+    auto start = chrono::steady_clock::now();
+
+    for (unsigned p = 0; p < num_producers; p++)
+        threads.emplace_back([&, p]() {
+            for (uint64_t seq = 0; seq < ITEMS_PER_PRODUCER; seq++) {
+                uint64_t item = ((uint64_t)p << 32) | seq;
+                while (!queue.push(item)) {
+                    num_full++;
+                    this_thread::yield();
+                }
+            }
+            producers_running--;
+        });
+
+    for (unsigned c = 0; c < num_consumers; c++)
+        threads.emplace_back([&]() {
+            vector<int64_t> last_seq(num_producers, -1);
+            uint64_t item;
+            while (true) {
+                if (!queue.pop(item)) {
+                    // producers done and still empty: nothing more will come
+                    bool producers_done = (producers_running == 0);
+                    if (!queue.pop(item)) {
+                        if (producers_done)
+                            break;
+                        num_empty++;
+                        this_thread::yield();
+                        continue;
+                    }
+                }
+
+                unsigned p = item >> 32;
+                uint64_t seq = item & 0xFFFFFFFF;
+                CHECK(p < num_producers && seq < ITEMS_PER_PRODUCER, "garbage item %llx", (unsigned long long)item);
+                CHECK((int64_t)seq > last_seq[p], "producer %u item %llu after %lld", p, (unsigned long long)seq, (long long)last_seq[p]);
+                last_seq[p] = seq;
+                CHECK(++times_popped[p][seq] == 1, "producer %u item %llu popped twice", p, (unsigned long long)seq);
+                num_popped++;
+            }
+        });
+
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    CHECK(num_popped == num_producers * ITEMS_PER_PRODUCER, "popped %llu of %llu", (unsigned long long)num_popped,
+          (unsigned long long)(num_producers * ITEMS_PER_PRODUCER));
+    uint64_t item;
+    CHECK(!queue.pop(item), "queue not empty at the end");
+
+    char name[64];
+    snprintf(name, sizeof(name), "LockfreeQueue capacity %u, %u producers %u consumers", (unsigned)queue.capacity(), num_producers, num_consumers);
+    printf("%-52s %10llu items %10.1f ns/item  full %llu empty %llu  OK\n", name, (unsigned long long)num_popped, elapsed * 1e9 / num_popped,
+           (unsigned long long)num_full, (unsigned long long)num_empty);
+}
+
+//====================================================================================================
+// Program entry point
+//====================================================================================================
+int main(int argc, char** argv) {
+    if (argc > 1)
+        seconds_per_check = atof(argv[1]);
+    if (argc > 2)
+        num_threads = atoi(argv[2]);
+
+    stressChannelList();
+
+    // smallest queue wraps around all the time and is full and empty the most
+    stressLockfreeQueue(2, num_threads, num_threads);
+    stressLockfreeQueue(64, num_threads, 1);
+    stressLockfreeQueue(64, 1, num_threads);
+    stressLockfreeQueue(1024, num_threads, num_threads);
+
+    printf("all checks passed\n");
+    return 0;
+}
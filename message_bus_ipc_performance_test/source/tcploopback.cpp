@@ -0,0 +1,193 @@
+/**
+ *   @file: tcploopback.cpp
+ *
+ *   @date: Oct 19, 2026
+ *
+ *   TCP transport check over loopback: a hub listening on tcp:127.0.0.1 with a silent connection that never says hello,
+ *   and clients in wire protocol v1 and v2 that must connect regardless and exchange messages, some of them bigger
+ *   than the socket buffers. Every receiver checks the order and the payload of what it gets.
+ *   Exits with 1 on the first failed check, so it can gate a build.
+ *   Usage: ./tcploopback_performancetest [messages per client]
+ *   Run with MBIPC_LOG_LEVEL=error.
+ */
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include "MessageHub.h"
+#include "MessageClient.h"
+
+using namespace std;
+using namespace messagebusipc;
+
+const uint32_t TEST_MESSAGE = ID_USER_MESSAGE_BASE + 1;
+const uint32_t BIG_PAYLOAD_SIZE = 1024 * 1024;
+const unsigned NUM_CLIENTS = 3;
+unsigned num_messages = 2000;
+
+#define CHECK(condition, ...) \
+    do { \
+        if (!(condition)) { \
+            printf("FAILED %s:%d: %s: ", __FILE__, __LINE__, #condition); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            fflush(stdout); \
+            _exit(1); \
+        } \
+    } while (0)
+
+char pattern(uint32_t sequence, uint32_t i) {
+    return (char)(sequence * 13 + i);
+}
+
+uint32_t payloadSize(uint32_t sequence) {
+    if (sequence % 101 == 0)
+        return BIG_PAYLOAD_SIZE;
+    return sizeof(sequence) + sequence % 500;
+}
+
+/**
+ * Checks what comes from every sender; the payload starts with the sequence number of the message
+ */
+class Receiver : public MessageHandler {
+public:
+    bool onMessage(uint32_t &id, char *data, uint32_t &size, const string &sender) {
+        if (id != TEST_MESSAGE)
+            return true;
+
+        uint32_t sequence;
+        CHECK(size >= sizeof(sequence), "message from %s of size %u", sender.c_str(), size);
+        memcpy(&sequence, data, sizeof(sequence));
+        CHECK(size == payloadSize(sequence), "message %u from %s of size %u", sequence, sender.c_str(), size);
+        for (uint32_t i = sizeof(sequence); i < size; i++)
+            CHECK(data[i] == pattern(sequence, i), "message %u from %s garbled at byte %u", sequence, sender.c_str(), i);
+
+        lock_guard<mutex> lock(guard);
+        uint32_t &expected = next[sender];
+        CHECK(sequence == expected, "message from %s: got %u, expected %u", sender.c_str(), sequence, expected);
+        expected++;
+        return true;
+    }
+
+    uint32_t received(const string &sender) {
+        lock_guard<mutex> lock(guard);
+        return next[sender];
+    }
+
+private:
+    mutex guard;
+    map<string, uint32_t> next;
+};
+
+/**
+ * @brief   Port nobody listens on right now
+ */
+unsigned short freePort() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    CHECK(bind(fd, (sockaddr*)&address, sizeof(address)) == 0, "bind: %s", strerror(errno));
+    CHECK(getsockname(fd, (sockaddr*)&address, &length) == 0, "getsockname: %s", strerror(errno));
+    close(fd);
+    return ntohs(address.sin_port);
+}
+
+//====================================================================================================
+// Program entry point
+//====================================================================================================
+int main(int argc, char** argv) {
+    if (argc > 1)
+        num_messages = atoi(argv[1]);
+
+    unsigned short port = freePort();
+    string address = "tcp:127.0.0.1:" + to_string(port);
+
+    MessageHubConfig config;
+    config.listen_addresses.push_back(address);
+    CHECK(MessageHub::runAndForget(true, config), "hub didn't start on %s", address.c_str());
+
+    // connected and silent; must not hold up the clients below. The hub starts listening in the background
+    sockaddr_in hub;
+    memset(&hub, 0, sizeof(hub));
+    hub.sin_family = AF_INET;
+    hub.sin_port = htons(port);
+    hub.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int silent_fd = UNINITIALIZED_SOCKET_FD;
+    for (unsigned attempt = 0; (silent_fd == UNINITIALIZED_SOCKET_FD) && (attempt < 100); attempt++) {
+        silent_fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (connect(silent_fd, (sockaddr*)&hub, sizeof(hub)) != 0) {
+            close(silent_fd);
+            silent_fd = UNINITIALIZED_SOCKET_FD;
+            this_thread::sleep_for(chrono::milliseconds(50));
+        }
+    }
+    CHECK(silent_fd != UNINITIALIZED_SOCKET_FD, "connect to %s: %s", address.c_str(), strerror(errno));
+
+    auto start = chrono::steady_clock::now();
+    vector<MessageClient*> clients;
+    vector<Receiver*> receivers;
+    vector<thread> listeners;
+    for (unsigned i = 0; i < NUM_CLIENTS; i++) {
+        clients.push_back(new MessageClient);
+        receivers.push_back(new Receiver);
+        clients[i]->setHubAddress(address.c_str());
+        clients[i]->setWireVersion((i % 2) ? WIRE_VERSION_1 : WIRE_VERSION_2);
+        string name = "tcpclient" + to_string(i);
+        MessageClient *client = clients[i];
+        MessageHandler *receiver = receivers[i];
+        listeners.push_back(thread([client, receiver, name]() { client->initializeAndListen(receiver, name.c_str()); }));
+    }
+
+    for (unsigned i = 0; i < NUM_CLIENTS; i++)
+        for (unsigned j = 0; j < NUM_CLIENTS; j++)
+            if (i != j)
+                CHECK(clients[i]->waitForClient(("tcpclient" + to_string(j)).c_str(), 10000), "tcpclient%u doesn't see tcpclient%u", i, j);
+    double connect_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    CHECK(connect_seconds < 2.0, "clients took %.1f s to connect next to a silent connection", connect_seconds);
+
+    // everybody sends to the next client at the same time
+    vector<thread> senders;
+    for (unsigned i = 0; i < NUM_CLIENTS; i++)
+        senders.push_back(thread([i, &clients]() {
+            string next = "tcpclient" + to_string((i + 1) % NUM_CLIENTS);
+            vector<char> payload(BIG_PAYLOAD_SIZE);
+            for (uint32_t sequence = 0; sequence < num_messages; sequence++) {
+                uint32_t size = payloadSize(sequence);
+                memcpy(&payload[0], &sequence, sizeof(sequence));
+                for (uint32_t k = sizeof(sequence); k < size; k++)
+                    payload[k] = pattern(sequence, k);
+                CHECK(clients[i]->send(TEST_MESSAGE, &payload[0], size, next.c_str()), "tcpclient%u to %s %u", i, next.c_str(), sequence);
+            }
+        }));
+    for (size_t i = 0; i < senders.size(); i++)
+        senders[i].join();
+
+    start = chrono::steady_clock::now();
+    for (unsigned i = 0; i < NUM_CLIENTS; i++) {
+        string sender = "tcpclient" + to_string((i + NUM_CLIENTS - 1) % NUM_CLIENTS);
+        while ((receivers[i]->received(sender) < num_messages) && (chrono::steady_clock::now() - start < chrono::seconds(30)))
+            this_thread::sleep_for(chrono::milliseconds(10));
+        CHECK(receivers[i]->received(sender) == num_messages, "tcpclient%u got %u of %u messages from %s", i, receivers[i]->received(sender),
+              num_messages, sender.c_str());
+    }
+
+    printf("%u clients over %s next to a silent connection: %u messages each  OK\n", NUM_CLIENTS, address.c_str(), num_messages);
+    fflush(stdout);
+    close(silent_fd);
+
+    // hub and listeners run until the process exits
+    _exit(0);
+}